@@ -0,0 +1,270 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Micro-benchmarks of the numerical kernels used by the RooUnfold
+//      package. Each kernel is timed on a square response with a number of
+//      bins that is swept from 10 up to 10^4 (kernels whose memory or time
+//      grows too fast are capped at fewer bins). For each size the time per
+//      call, the throughput (measured x truth cells per second, or Fill calls
+//      per second), and the local scaling exponent d(ln t)/d(ln n) are printed.
+//
+//      Usage: RooUnfoldBenchmark [KERNELS [MAXBINS [MINTIME [NOCAPS]]]]
+//        KERNELS  comma-separated list from Fill,Fill3D,H2M,H2V,Bayes1,ABAT,
+//                 TSVDUnfold,InvertMatrix,GetErrMat (default: all)
+//        MAXBINS  largest number of bins to try (default 10000)
+//        MINTIME  minimum time in seconds spent on each point (default 0.5)
+//        NOCAPS   if non-zero, ignore the per-kernel bin caps
+//
+//==============================================================================
+
+#if !defined(__CINT__) || defined(__MAKECINT__)
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+using std::cout;
+using std::endl;
+using std::setw;
+
+#include "TRandom.h"
+#include "TStopwatch.h"
+#include "TString.h"
+#include "TH1.h"
+#include "TH1D.h"
+#include "TH2D.h"
+#include "TH3D.h"
+#include "TVectorD.h"
+#include "TMatrixD.h"
+#include "RVersion.h"
+
+#include "RooUnfold.h"
+#include "RooUnfoldResponse.h"
+#include "RooUnfoldBayes.h"
+#if defined(HAVE_TSVDUNFOLD) || ROOT_VERSION_CODE < ROOT_VERSION(5,29,2)
+#include "TSVDUnfold_local.h"  /* Use local copy of TSVDUnfold.h */
+#else
+#include "TSVDUnfold.h"
+#endif
+
+#endif
+
+//==============================================================================
+// Kernel definitions
+//==============================================================================
+
+enum BenchKernel { kFill, kFill3D, kH2M, kH2V, kBayes1, kABAT, kTSVDUnfold, kInvertMatrix, kGetErrMat, kNKernels };
+
+const char* const kernelName[kNKernels]=    { "Fill", "Fill3D", "H2M", "H2V", "Bayes1", "ABAT", "TSVDUnfold", "InvertMatrix", "GetErrMat" };
+// Largest number of bins for each kernel unless NOCAPS is set. The O(n^2) memory kernels are
+// limited by the size of a dense TH2D/TMatrixD, the O(n^3) ones by run time.
+const Int_t       kernelMaxBins[kNKernels]= { 3000,   3000,     3000,  10000, 1000,     1000,   1000,         1000,           100 };
+
+const Int_t    nFillPerCall= 1000;   // Fill calls per timed call of the Fill kernel
+const Int_t    nToysErrMat=  20;     // toys per GetErrMat call
+const Double_t smearBins=    1.5;    // Gaussian resolution, in bins
+
+// Exposes the protected kernels of RooUnfold and RooUnfoldBayes.
+class RooUnfoldBenchmarkKernels : public RooUnfoldBayes {
+public:
+  RooUnfoldBenchmarkKernels (const RooUnfoldResponse* res, const TH1* meas)
+    : RooUnfoldBayes (res, meas, 1) { SetVerbose(0); }
+  static TMatrixD& ABAT (const TMatrixD& a, const TMatrixD& b, TMatrixD& c) { return RooUnfold::ABAT (a, b, c); }
+  static Int_t InvertMatrix (const TMatrixD& mat, TMatrixD& inv) { return RooUnfold::InvertMatrix (mat, inv, "benchmark matrix", 0); }
+  void Setup()     { setup(); }
+  void Iteration() { unfold(); }
+  void ErrMat()    { GetErrMat(); }
+};
+
+// Inputs shared by all kernels for one number of bins.
+struct BenchSetup {
+  Int_t              nb;
+  RooUnfoldResponse* res;
+  RooUnfoldResponse* res3;     // 3D response with about nb bins, for the Fill3D kernel
+  TH1D*              hMeas;
+  TVectorD           xt, xm;   // pre-generated events for the Fill kernel
+  TVectorD           t3[3], m3[3];  // pre-generated (x,y,z) events for the Fill3D kernel
+  TMatrixD           a, b, c;  // ABAT and InvertMatrix operands
+  RooUnfoldBenchmarkKernels* kern;
+
+  BenchSetup (Int_t n) : nb(n), res(0), res3(0), hMeas(0), kern(0) {
+    res=   new RooUnfoldResponse (nb, 0.0, Double_t(nb));
+    hMeas= new TH1D ("benchmeas", "Benchmark Measured", nb, 0.0, Double_t(nb));
+    Int_t ntrain= nb<100 ? 100*100 : 100*nb;
+    for (Int_t i= 0; i<ntrain; i++) {
+      Double_t t= gRandom->Uniform (0.0, nb);
+      Double_t m= t + gRandom->Gaus (0.0, smearBins);
+      if (m>=0.0 && m<nb && gRandom->Rndm()<0.9) res->Fill (m, t);
+      else                                       res->Miss (t);
+    }
+    for (Int_t i= 0; i<ntrain/10; i++) {
+      Double_t m= gRandom->Uniform (0.0, nb) + gRandom->Gaus (0.0, smearBins);
+      if (m>=0.0 && m<nb) hMeas->Fill (m);
+    }
+    xt.ResizeTo (nFillPerCall);
+    xm.ResizeTo (nFillPerCall);
+    for (Int_t i= 0; i<nFillPerCall; i++) {
+      xt[i]= gRandom->Uniform (0.0, nb);
+      xm[i]= xt[i] + gRandom->Gaus (0.0, smearBins);
+    }
+    kern= new RooUnfoldBenchmarkKernels (res, hMeas);
+  }
+  ~BenchSetup() { delete kern; delete hMeas; delete res3; delete res; }
+
+  void PrepareFill3D() {
+    // nx^3 ~ nb bins, with events spread over the full range in each dimension
+    Int_t nx= Int_t (pow (Double_t(nb), 1.0/3.0) + 0.5);
+    if (nx<2) nx= 2;
+    TH3D hm ("bench3m", "Benchmark 3D Measured", nx, 0.0, Double_t(nx), nx, 0.0, Double_t(nx), nx, 0.0, Double_t(nx));
+    TH3D ht ("bench3t", "Benchmark 3D Truth",    nx, 0.0, Double_t(nx), nx, 0.0, Double_t(nx), nx, 0.0, Double_t(nx));
+    delete res3;
+    res3= new RooUnfoldResponse (&hm, &ht);
+    for (Int_t d= 0; d<3; d++) {
+      t3[d].ResizeTo (nFillPerCall);
+      m3[d].ResizeTo (nFillPerCall);
+      for (Int_t i= 0; i<nFillPerCall; i++) {
+        t3[d][i]= gRandom->Uniform (0.0, nx);
+        m3[d][i]= t3[d][i] + gRandom->Gaus (0.0, smearBins);
+      }
+    }
+  }
+
+  void PrepareMatrices (Bool_t symmetric) {
+    a.ResizeTo (nb, nb);
+    b.ResizeTo (nb, nb);
+    c.ResizeTo (nb, nb);
+    for (Int_t i= 0; i<nb; i++)
+      for (Int_t j= 0; j<nb; j++)
+        a(i,j)= gRandom->Uniform (-1.0, 1.0);
+    if (symmetric) {
+      // positive-definite matrix to invert
+      RooUnfoldBenchmarkKernels::ABAT (a, TMatrixD (TMatrixD::kUnit, a), b);
+      for (Int_t i= 0; i<nb; i++) b(i,i) += nb;
+    } else {
+      for (Int_t i= 0; i<nb; i++)
+        for (Int_t j= 0; j<nb; j++)
+          b(i,j)= gRandom->Uniform (-1.0, 1.0);
+    }
+  }
+};
+
+// Runs one call of the kernel.
+void RunKernel (Int_t k, BenchSetup& s)
+{
+  switch (k) {
+    case kFill:
+      for (Int_t i= 0; i<nFillPerCall; i++) s.res->Fill (s.xm[i], s.xt[i]);
+      break;
+    case kFill3D:
+      for (Int_t i= 0; i<nFillPerCall; i++) s.res3->Fill (s.m3[0][i], s.m3[1][i], s.m3[2][i], s.t3[0][i], s.t3[1][i], s.t3[2][i]);
+      break;
+    case kH2M:
+      delete RooUnfoldResponse::H2M (s.res->Hresponse(), s.nb, s.nb, s.res->Htruth());
+      break;
+    case kH2V:
+      delete RooUnfoldResponse::H2V (s.hMeas, s.nb);
+      break;
+    case kBayes1:
+      s.kern->Iteration();
+      break;
+    case kABAT:
+      RooUnfoldBenchmarkKernels::ABAT (s.a, s.b, s.c);
+      break;
+    case kTSVDUnfold: {
+      TSVDUnfold svd (s.hMeas, dynamic_cast<const TH1D*>(s.res->Hmeasured()),
+                      dynamic_cast<const TH1D*>(s.res->Htruth()), dynamic_cast<const TH2D*>(s.res->Hresponse()));
+      delete svd.Unfold (s.nb/2 > 2 ? s.nb/2 : 2);
+      break;
+    }
+    case kInvertMatrix:
+      RooUnfoldBenchmarkKernels::InvertMatrix (s.b, s.c);
+      break;
+    case kGetErrMat:
+      s.kern->ErrMat();
+      break;
+  }
+}
+
+// Work done by one call of the kernel, in the units used for the throughput.
+Double_t KernelWork (Int_t k, Int_t nb)
+{
+  if (k==kFill || k==kFill3D) return nFillPerCall;
+  if (k==kH2V)  return nb;
+  if (k==kGetErrMat) return Double_t(nToysErrMat)*nb*nb;
+  return Double_t(nb)*nb;
+}
+
+//==============================================================================
+// Benchmark driver
+//==============================================================================
+
+void RooUnfoldBenchmark (const char* kernels= "", Int_t maxbins= 10000, Double_t mintime= 0.5, Bool_t nocaps= false)
+{
+  const Int_t nbins[]= { 10, 30, 100, 300, 1000, 3000, 10000 };
+  const Int_t nsizes= sizeof(nbins)/sizeof(nbins[0]);
+
+  Bool_t oldstat= TH1::AddDirectoryStatus();
+  TH1::AddDirectory (kFALSE);
+  TString klist= kernels;
+  klist= "," + klist + ",";
+
+  cout << setw(12) << "kernel" << setw(7)  << "bins" << setw(9) << "calls"
+       << setw(13) << "time/call"  << setw(13) << "throughput" << setw(7) << "units"
+       << setw(9)  << "scaling" << endl;
+
+  Double_t lastTime[kNKernels];
+  Int_t    lastBins[kNKernels];
+  for (Int_t k= 0; k<kNKernels; k++) lastTime[k]= lastBins[k]= 0;
+
+  for (Int_t is= 0; is<nsizes; is++) {
+    Int_t nb= nbins[is];
+    if (nb>maxbins) break;
+    BenchSetup* s= 0;
+    for (Int_t k= 0; k<kNKernels; k++) {
+      if (klist.Length()>2 && !klist.Contains (TString(",")+kernelName[k]+",")) continue;
+      if (!nocaps && nb>kernelMaxBins[k]) continue;
+      if (!s) s= new BenchSetup (nb);
+      if      (k==kFill3D)       s->PrepareFill3D();
+      else if (k==kBayes1)       s->kern->Setup();
+      else if (k==kABAT)         s->PrepareMatrices (false);
+      else if (k==kInvertMatrix) s->PrepareMatrices (true);
+      else if (k==kGetErrMat)    s->kern->SetNToys (nToysErrMat);
+
+      // Double the number of calls until at least mintime has been spent.
+      TStopwatch timer;
+      Double_t t= 0.0;
+      Int_t ncalls= 0;
+      for (Int_t n= 1; t<mintime; n *= 2) {
+        timer.Start (kTRUE);
+        for (Int_t i= 0; i<n; i++) RunKernel (k, *s);
+        timer.Stop();
+        t += timer.RealTime();
+        ncalls += n;
+      }
+      Double_t tcall= t/ncalls;
+      Double_t rate=  tcall>0.0 ? KernelWork (k, nb)/tcall : 0.0;
+
+      cout << setw(12) << kernelName[k] << setw(7) << nb << setw(9) << ncalls
+           << setw(11) << std::setprecision(4) << tcall*1e3 << "ms"
+           << setw(13) << std::setprecision(4) << rate*1e-6 << setw(7) << (k==kFill || k==kFill3D ? "Mfill/s" : "Mcell/s");
+      if (lastBins[k]>0 && lastTime[k]>0.0 && tcall>0.0)
+        cout << setw(9) << std::setprecision(3) << log(tcall/lastTime[k]) / log(Double_t(nb)/lastBins[k]);
+      cout << endl;
+      lastTime[k]= tcall;
+      lastBins[k]= nb;
+    }
+    delete s;
+  }
+  TH1::AddDirectory (oldstat);
+}
+
+#ifndef __CINT__
+int main (int argc, char** argv) {  // Main program when run stand-alone
+  RooUnfoldBenchmark (argc>1 ? argv[1] : "",
+                      argc>2 ? atoi(argv[2]) : 10000,
+                      argc>3 ? atof(argv[3]) : 0.5,
+                      argc>4 ? atoi(argv[4])!=0 : false);
+  return 0;
+}
+#endif
@@ -0,0 +1,390 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Unfolding service. Keeps named response matrices resident in memory,
+//      with their matrix and vector forms already computed, and serves
+//      unfolding requests over a Unix domain socket. Each connection is handled
+//      in its own thread, and the unfoldings themselves run on the shared
+//      RooUnfoldThreadPool, so independent requests are served concurrently.
+//      Unfolding objects are kept between requests for each response and set of
+//      settings, so a new request only sets the measurement.
+//
+//      Usage: RooUnfoldDaemon SOCKET [NAME=FILE:OBJECT ...]
+//        SOCKET   path of the Unix domain socket to listen on
+//        NAME=FILE:OBJECT
+//                 load RooUnfoldResponse OBJECT from FILE under NAME.
+//                 More can be loaded later with RooUnfoldDaemonLoad().
+//
+//      Clients (eg. a ROOT macro after .L RooUnfoldDaemon.cxx+) use
+//      RooUnfoldDaemonUnfold() or RooUnfoldDaemonLoad().
+//
+//      Protocol: each request and reply is one TMessage of type kMESS_ANY.
+//        "unfold": string response name, Int_t algorithm (RooUnfold::Algorithm),
+//                  Double_t regparm (-1e30 for default), Int_t error treatment,
+//                  Int_t number of toys (0 for default), TVectorD measured,
+//                  TMatrixD measured covariance (or null for sqrt(N) errors)
+//        "load":   string response name, string file name, string object name
+//        reply:    Int_t status (0 if OK), string message, and for "unfold",
+//                  TVectorD unfolded, TMatrixD errors as returned by
+//                  RooUnfold::Ereco(), and Double_t server time in seconds.
+//
+//==============================================================================
+
+#if !defined(__CINT__) || defined(__MAKECINT__)
+#include <iostream>
+#include <map>
+#include <cstring>
+#include <cmath>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+#include "TServerSocket.h"
+#include "TSocket.h"
+#include "TMessage.h"
+#include "TThread.h"
+#include "TMutex.h"
+#include "TFile.h"
+#include "TSystem.h"
+#include "TStopwatch.h"
+#include "TString.h"
+#include "TH1.h"
+#include "TVectorD.h"
+#include "TMatrixD.h"
+
+#include "RooUnfold.h"
+#include "RooUnfoldResponse.h"
+#include "RooUnfoldAsync.h"
+#endif
+
+//==============================================================================
+// Server
+//==============================================================================
+
+class RooUnfoldDaemon {
+public:
+  RooUnfoldDaemon() : _lock(new TMutex()) {}
+
+  Int_t Load (const char* name, const char* file, const char* object, TString& msg)
+  {
+    // Read a response and compute everything it caches, so that requests only read it.
+    _lock->Lock();
+    RooUnfoldResponse* res= 0;
+    {
+      TFile f (file, "READ");
+      if (!f.IsZombie()) res= dynamic_cast<RooUnfoldResponse*>(f.Get (object));
+      f.Close();
+    }
+    if (!res) {
+      _lock->UnLock();
+      msg.Form ("could not read RooUnfoldResponse %s from %s", object, file);
+      return 1;
+    }
+    res->Mresponse(); res->Eresponse();
+    res->Vmeasured(); res->Emeasured(); res->Vfakes();
+    res->Vtruth();    res->Etruth();
+    std::map<TString,RooUnfoldResponse*>::iterator it= _responses.find (name);
+    if (it != _responses.end()) {
+      cerr << "Warning: replacing response " << name << "; the old one is kept for requests still using it" << endl;
+      DropIdle (it->second);
+      it->second= res;
+    } else
+      _responses[name]= res;
+    _lock->UnLock();
+    msg.Form ("loaded %s (%d x %d bins)", name, res->GetNbinsMeasured(), res->GetNbinsTruth());
+    cout << msg << endl;
+    return 0;
+  }
+
+  const RooUnfoldResponse* Find (const char* name) const
+  {
+    _lock->Lock();
+    std::map<TString,RooUnfoldResponse*>::const_iterator it= _responses.find (name);
+    const RooUnfoldResponse* res= it != _responses.end() ? it->second : 0;
+    _lock->UnLock();
+    return res;
+  }
+
+  Int_t Unfold (TMessage& req, TMessage& reply)
+  {
+    char name[1024];
+    Int_t alg, withError, ntoys;
+    Double_t regparm;
+    req.ReadString (name, sizeof(name));
+    req.ReadInt (alg);
+    req.ReadDouble (regparm);
+    req.ReadInt (withError);
+    req.ReadInt (ntoys);
+    TVectorD* meas= (TVectorD*) req.ReadObject (TVectorD::Class());
+    TMatrixD* cov=  (TMatrixD*) req.ReadObject (TMatrixD::Class());
+
+    TStopwatch timer;
+    TString msg;
+    Int_t status= 0;
+    const RooUnfoldResponse* res= Find (name);
+    RooUnfold* unfold= 0;
+    TString key;
+    if (!res) {
+      msg.Form ("unknown response %s", name);
+      status= 1;
+    } else if (!meas || meas->GetNrows() != res->GetNbinsMeasured()
+                                            + (res->UseOverflowStatus() ? 2 : 0)) {
+      msg.Form ("measured vector has wrong number of bins for %s", name);
+      status= 1;
+    } else {
+      // A prepared unfolding for this response and these settings is reused, so only the measurement
+      // changes and the algorithm keeps whatever it derived from the response alone.
+      key.Form ("%p %d %.17g %d %d", (const void*)res, alg, regparm, ntoys, cov ? 1 : 0);
+      unfold= Take (key, res, alg, regparm, ntoys);
+      if (!unfold) {
+        msg.Form ("could not create unfolding algorithm %d", alg);
+        status= 1;
+      } else {
+        if (cov) unfold->SetMeasured (*meas, *cov);
+        else {
+          TVectorD err (meas->GetNrows());
+          for (Int_t i= 0; i<err.GetNrows(); i++) err[i]= sqrt (fabs ((*meas)[i]));
+          unfold->SetMeasured (*meas, err);
+        }
+        RooUnfoldFuture* job= unfold->UnfoldAsync (RooUnfold::ErrorTreatment(withError));
+        if (!job->Wait()) {
+          msg= "unfolding failed";
+          status= 2;
+        }
+        delete job;
+      }
+    }
+
+    reply.WriteInt (status);
+    reply.WriteString (msg);
+    if (status==0) {
+      const TVectorD& reco= unfold->Vreco();
+      const TMatrixD& ereco= unfold->ErecoRef (RooUnfold::ErrorTreatment(withError));
+      reply.WriteObject (&reco);
+      reply.WriteObject (&ereco);
+    }
+    reply.WriteDouble (timer.RealTime());
+    if (unfold) Give (key, res, unfold);
+    delete meas;
+    delete cov;
+    return status;
+  }
+
+  RooUnfold* Take (const TString& key, const RooUnfoldResponse* res, Int_t alg, Double_t regparm, Int_t ntoys)
+  {
+    // An idle unfolding prepared with these settings, or a new one. The caller has it to itself until Give().
+    _lock->Lock();
+    RooUnfold* unfold= 0;
+    std::multimap<TString,RooUnfold*>::iterator it= _idle.find (key);
+    if (it != _idle.end()) {
+      unfold= it->second;
+      _idle.erase (it);
+    } else {
+      unfold= RooUnfold::New (RooUnfold::Algorithm(alg), res, 0, regparm);
+      if (unfold) {
+        unfold->SetVerbose (0);
+        if (ntoys>0) unfold->SetNToys (ntoys);
+      }
+    }
+    _lock->UnLock();
+    return unfold;
+  }
+
+  void Give (const TString& key, const RooUnfoldResponse* res, RooUnfold* unfold)
+  {
+    // Keep the unfolding for the next request with the same settings, unless its response has been replaced.
+    _lock->Lock();
+    Bool_t current= false;
+    for (std::map<TString,RooUnfoldResponse*>::const_iterator it= _responses.begin(); it != _responses.end(); ++it)
+      if (it->second == res) current= true;
+    if (current) _idle.insert (std::make_pair (key, unfold));
+    else         delete unfold;
+    _lock->UnLock();
+  }
+
+  void DropIdle (const RooUnfoldResponse* res)
+  {
+    // Delete idle unfoldings using res. Call with the lock held.
+    std::multimap<TString,RooUnfold*>::iterator it= _idle.begin();
+    while (it != _idle.end()) {
+      if (it->second->response() == res) {
+        delete it->second;
+        _idle.erase (it++);
+      } else
+        ++it;
+    }
+  }
+
+  static void* Serve (void* arg)
+  {
+    // Handle requests on one connection until the client closes it.
+    std::pair<RooUnfoldDaemon*,TSocket*>* p= static_cast<std::pair<RooUnfoldDaemon*,TSocket*>*>(arg);
+    RooUnfoldDaemon* daemon= p->first;
+    TSocket* sock= p->second;
+    delete p;
+    for (;;) {
+      TMessage* req= 0;
+      if (sock->Recv (req) <= 0 || !req) break;
+      char cmd[64];
+      req->ReadString (cmd, sizeof(cmd));
+      TMessage reply (kMESS_ANY);
+      if        (strcmp (cmd, "unfold") == 0) {
+        daemon->Unfold (*req, reply);
+      } else if (strcmp (cmd, "load") == 0) {
+        char name[1024], file[4096], object[1024];
+        req->ReadString (name,   sizeof(name));
+        req->ReadString (file,   sizeof(file));
+        req->ReadString (object, sizeof(object));
+        TString msg;
+        reply.WriteInt (daemon->Load (name, file, object, msg));
+        reply.WriteString (msg);
+      } else {
+        reply.WriteInt (1);
+        reply.WriteString (Form ("unknown command %s", cmd));
+      }
+      delete req;
+      if (sock->Send (reply) <= 0) break;
+    }
+    sock->Close();
+    delete sock;
+    return 0;
+  }
+
+  void Run (const char* sockpath)
+  {
+    gSystem->Unlink (sockpath);   // remove a stale socket from a previous run
+    TServerSocket server (sockpath);
+    if (!server.IsValid()) {
+      cerr << "Error: could not listen on " << sockpath << endl;
+      return;
+    }
+    RooUnfoldThreadPool::Instance();   // start the workers and switch on ROOT's locking
+    cout << "RooUnfoldDaemon listening on " << sockpath << endl;
+    Int_t nfail= 0;
+    for (;;) {
+      TSocket* sock= server.Accept();
+      if (!sock || sock == (TSocket*)-1) {
+        // Back off rather than spin if the socket keeps failing, and give up if it does not recover.
+        if (++nfail >= kMaxAcceptFailures) {
+          cerr << "Error: " << nfail << " successive failures accepting connections on " << sockpath << endl;
+          return;
+        }
+        gSystem->Sleep (nfail<10 ? 10<<nfail : 5000);   // ms
+        continue;
+      }
+      nfail= 0;
+      TThread* t= new TThread (&RooUnfoldDaemon::Serve, new std::pair<RooUnfoldDaemon*,TSocket*>(this, sock));
+      t->Run();   // thread object is not deleted: it lives as long as the connection
+    }
+  }
+
+private:
+  enum { kMaxAcceptFailures= 20 };
+  std::map<TString,RooUnfoldResponse*> _responses;  // responses are never deleted while serving
+  std::multimap<TString,RooUnfold*> _idle;          // prepared unfoldings not in use, by response and settings
+  TMutex* _lock;
+};
+
+//==============================================================================
+// Client
+//==============================================================================
+
+Int_t RooUnfoldDaemonUnfold (const char* sockpath, const char* response, Int_t alg, Double_t regparm,
+                             Int_t withError, const TVectorD& meas, const TMatrixD* cov,
+                             TVectorD& reco, TMatrixD& ereco, Int_t ntoys= 0)
+{
+  // Send one unfolding request. Returns 0 if OK, with the results in reco and ereco.
+  // For many requests, keep one TSocket open and send several messages on it.
+  TSocket sock (sockpath);
+  if (!sock.IsValid()) {
+    cerr << "Error: could not connect to RooUnfoldDaemon at " << sockpath << endl;
+    return -1;
+  }
+  TMessage req (kMESS_ANY);
+  req.WriteString ("unfold");
+  req.WriteString (response);
+  req.WriteInt (alg);
+  req.WriteDouble (regparm);
+  req.WriteInt (withError);
+  req.WriteInt (ntoys);
+  req.WriteObject (&meas);
+  req.WriteObject (cov);
+  TMessage* reply= 0;
+  if (sock.Send (req) <= 0 || sock.Recv (reply) <= 0 || !reply) {
+    cerr << "Error: no reply from RooUnfoldDaemon at " << sockpath << endl;
+    return -1;
+  }
+  Int_t status;
+  char msg[1024];
+  reply->ReadInt (status);
+  reply->ReadString (msg, sizeof(msg));
+  if (status==0) {
+    TVectorD* r= (TVectorD*) reply->ReadObject (TVectorD::Class());
+    TMatrixD* e= (TMatrixD*) reply->ReadObject (TMatrixD::Class());
+    reco.ResizeTo (*r);  reco= *r;
+    ereco.ResizeTo (*e); ereco= *e;
+    delete r;
+    delete e;
+  } else
+    cerr << "RooUnfoldDaemon: " << msg << endl;
+  delete reply;
+  sock.Close();
+  return status;
+}
+
+Int_t RooUnfoldDaemonLoad (const char* sockpath, const char* name, const char* file, const char* object)
+{
+  // Ask the daemon to load (or replace) a response. Returns 0 if OK.
+  TSocket sock (sockpath);
+  if (!sock.IsValid()) {
+    cerr << "Error: could not connect to RooUnfoldDaemon at " << sockpath << endl;
+    return -1;
+  }
+  TMessage req (kMESS_ANY);
+  req.WriteString ("load");
+  req.WriteString (name);
+  req.WriteString (file);
+  req.WriteString (object);
+  TMessage* reply= 0;
+  if (sock.Send (req) <= 0 || sock.Recv (reply) <= 0 || !reply) {
+    cerr << "Error: no reply from RooUnfoldDaemon at " << sockpath << endl;
+    return -1;
+  }
+  Int_t status;
+  char msg[1024];
+  reply->ReadInt (status);
+  reply->ReadString (msg, sizeof(msg));
+  cout << "RooUnfoldDaemon: " << msg << endl;
+  delete reply;
+  sock.Close();
+  return status;
+}
+
+#ifndef __CINT__
+int main (int argc, char** argv) {  // Main program when run stand-alone
+  if (argc<2) {
+    cerr << "Usage: " << argv[0] << " SOCKET [NAME=FILE:OBJECT ...]" << endl;
+    return 1;
+  }
+  TH1::AddDirectory (kFALSE);
+  RooUnfoldDaemon daemon;
+  for (Int_t i= 2; i<argc; i++) {
+    TString arg= argv[i];
+    Ssiz_t eq= arg.First('='), colon= arg.Last(':');
+    if (eq<=0 || colon<eq) {
+      cerr << "Bad response specification " << arg << ": should be NAME=FILE:OBJECT" << endl;
+      return 1;
+    }
+    TString msg;
+    TString name= arg(0,eq), file= arg(eq+1,colon-eq-1), object= arg(colon+1,arg.Length());
+    if (daemon.Load (name, file, object, msg)) {
+      cerr << "Error: " << msg << endl;
+      return 1;
+    }
+  }
+  daemon.Run (argv[1]);
+  return 0;
+}
+#endif
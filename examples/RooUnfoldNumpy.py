@@ -0,0 +1,81 @@
+#!/usr/bin/env python
+# ==============================================================================
+#  File and Version Information:
+#       $Id$
+#
+#  Description:
+#       Example exchanging NumPy arrays with RooUnfold, with no intermediate
+#       histograms in Python and no copies of the results.
+#
+# ==============================================================================
+
+from __future__ import print_function
+
+import numpy
+from ROOT import gSystem
+
+gSystem.Load( "libRooUnfold" )
+
+from ROOT import RooUnfoldResponse, RooUnfold, RooUnfoldBayes
+
+# ==============================================================================
+#  Gaussian smearing, systematic translation, and variable inefficiency,
+#  as in RooUnfoldExample.py, but on arrays of events
+# ==============================================================================
+
+def smear( xt, rng ):
+    xeff= 0.3 + (1.0-0.3)/20.0*(xt+10.0)
+    seen= rng.uniform( size=len(xt) ) <= xeff
+    x= xt + rng.normal( -2.5, 0.2, size=len(xt) )
+    return x, seen
+
+def asarray( buf, n ):
+    # View a buffer returned by RooUnfold (Double_t*) as a NumPy array of n doubles, without copying.
+    buf.SetSize( n )
+    return numpy.frombuffer( buf, dtype=numpy.float64, count=n )
+
+# ==============================================================================
+#  Example Unfolding
+# ==============================================================================
+
+def main():
+
+    rng= numpy.random.RandomState( 1 )
+    nm, nt= 40, 20
+
+    print( "==================================== TRAIN ====================================" )
+    response= RooUnfoldResponse( nm, -10.0, 10.0, nt, -10.0, 10.0 )
+    xt= rng.normal( 0.0, 5.0, size=100000 )
+    x, seen= smear( xt, rng )
+    # arrays must be contiguous float64
+    response.FillN( int(seen.sum()), numpy.ascontiguousarray( x[seen] ), numpy.ascontiguousarray( xt[seen] ) )
+    response.MissN( int((~seen).sum()), numpy.ascontiguousarray( xt[~seen] ) )
+
+    print( "==================================== TEST =====================================" )
+    xt= 0.3 + 2.5*rng.standard_cauchy( size=10000 )
+    x, seen= smear( xt, rng )
+    meas, edges= numpy.histogram( x[seen], bins=nm, range=(-10.0,10.0) )
+    meas= meas.astype( numpy.float64 )
+    true, edges= numpy.histogram( xt, bins=nt, range=(-10.0,10.0) )
+
+    # Measurement covariance: here just Poisson errors, but any nm x nm matrix can be used.
+    # share=True uses the array in place, so it must be kept alive and unchanged while unfolding.
+    cov= numpy.ascontiguousarray( numpy.diag( numpy.maximum( meas, 1.0 ) ) )
+
+    print( "==================================== UNFOLD ===================================" )
+    unfold= RooUnfoldBayes( "bayes", "Bayes" )
+    unfold.SetIterations( 4 )
+    unfold.SetResponse( response )
+    unfold.SetMeasuredCov( nm, cov, True )
+    unfold.SetMeasured( nm, meas )
+
+    reco= asarray( unfold.VrecoArray(), nt )
+    ereco= asarray( unfold.ErecoArray( RooUnfold.kCovariance ), nt*nt ).reshape( nt, nt )
+
+    for i in range( nt ):
+        print( "%3d %10.1f %10.1f +/- %6.1f" % ( i, true[i], reco[i], numpy.sqrt( ereco[i,i] ) ) )
+
+    return reco, ereco
+
+if __name__ == '__main__':
+   main()
@@ -26,6 +26,7 @@ public:
   Int_t    ftrainy, ftesty, nty, nmy;
   Double_t ylo, yhi, mtrainy, wtrainy, btrainy, mtesty, wtesty, btesty, mscaley;
   Double_t effylo, effyhi, fakeylo, fakeyhi, rotxy, ybias, ysmear;
+  Int_t    binorder;
 
   // Data
   TH1D *hTrainX, *hTrainTrueX, *hTrainFakeX, *hTrueX, *hMeasX, *hRecoX, *hFakeX, *hPullsX;
@@ -15,6 +15,7 @@
 <p>The unfolding method can either use the constructors for individual unfolding algorithms or the New() method, specifiying the algorithm to be used.
 <p>The resultant distribution can be displayed as a plot (Hreco) or as a bin by bin breakdown of the true, measured and reconstructed values (PrintTable)
 <p>A covariance matrix can be returned using the Ereco() method. A vector of its diagonals can be returned with the ErecoV() method.
+<p>ErecoRef(), ErecoVRef() and WrecoRef() return the same results without copying them, as references to internal matrices that are overwritten by the next call.
 <p>A summary of the unfolding algorithms which inherit from this class is below:
 <ul>
 <li>RooUnfoldBayes: Uses the Bayes method of unfolding based on the method written by D'Agostini (<a href="http://www.slac.stanford.edu/spires/find/hep/www?j=NUIMA,A362,487">NIM A 362 (1995) 487</a>).
@@ -57,6 +58,11 @@
 <ul>
 <li>For small statistics, this method does not produce useful results.
 <li>The inversion method is included largely to illustrate the necessity of a more effective method of unfolding</ul>
+<li> RooUnfoldCGLS: Tikhonov regularisation (like TUnfold), solved iteratively with conjugate gradients.
+<ul>
+<li>The response matrix is stored in sparse form, so suits very large, sparse response matrices.
+<li>Regularisation parameter is tau, with size, derivative (default), or curvature conditions.
+<li>kCovariance errors need one solution per measured bin: use kCovToy or kNoError for very large problems.</ul>
 </ul>
 END_HTML */
 
@@ -68,6 +74,7 @@ END_HTML */
 #include <iomanip>
 #include <sstream>
 #include <cmath>
+#include <cstring>
 #include <vector>
 
 #include "TClass.h"
@@ -78,12 +85,20 @@ END_HTML */
 #include "TH3.h"
 #include "TVectorD.h"
 #include "TDecompSVD.h"
-#include "TDecompChol.h"
 #include "TRandom.h"
 #include "TMath.h"
+#include "TMD5.h"
 
 #include "RooUnfoldResponse.h"
 #include "RooUnfoldErrors.h"
+#include "RooUnfoldCache.h"
+#include "RooUnfoldCovariance.h"
+#include "RooUnfoldCheckpoint.h"
+#include "RooUnfoldProgress.h"
+#include "RooUnfoldAsync.h"
+#include "RooUnfoldPhilox.h"
+#include "RooUnfoldForkPool.h"
+#include "core/RooUnfoldCore.h"
 // Need subclasses just for RooUnfold::New()
 #include "RooUnfoldBayes.h"
 #include "RooUnfoldSvd.h"
@@ -96,6 +111,7 @@ END_HTML */
 #include "RooUnfoldDagostini.h"
 #endif
 #include "RooUnfoldBasisSplines.h"
+#include "RooUnfoldCGLS.h"
 
 using std::vector;
 using std::cout;
@@ -130,6 +146,7 @@ RooUnfold* RooUnfold::New (Algorithm alg, const RooUnfoldResponse* res,
     4: Unfold with TUnfold
     5: Unfold using inversion of response matrix
     6: Unfold with basis spline
+    8: Unfold with Tikhonov regularisation, solved iteratively (CGLS)
     */
   RooUnfold* unfold;
   switch (alg) {
@@ -167,6 +184,9 @@ RooUnfold* RooUnfold::New (Algorithm alg, const RooUnfoldResponse* res,
     case kBasisSplines:
       unfold= new RooUnfoldBasisSplines( res, meas );
       break;
+    case kCGLS:
+      unfold= new RooUnfoldCGLS     (res, meas);
+      break;
     default:
       cerr << "Unknown RooUnfold method " << Int_t(alg) << endl;
       return 0;
@@ -193,7 +213,8 @@ void RooUnfold::Destroy()
   delete _vMes;
   delete _eMes;
   delete _covMes;
-  delete _covL;
+  delete _covStr;
+  delete _covView;
   delete _resmine;
 }
 
@@ -215,9 +236,18 @@ void RooUnfold::Assign (const RooUnfold& rhs)
 
 void RooUnfold::CopyData (const RooUnfold& rhs)
 {
-  Setup (rhs.response(), rhs.Hmeasured());
+  if (rhs._meas || !rhs._vMes) {
+    Setup (rhs.response(), rhs.Hmeasured());
+  } else {
+    Setup (rhs.response(), 0);
+    SetMeasured (*rhs._vMes, *rhs._eMes);
+  }
   SetVerbose (rhs.verbose());
   SetNToys   (rhs.NToys());
+  SetToySeed (rhs.GetToySeed());
+  SetCache   (rhs.GetCache());
+  SetCheckpoint (rhs.GetCheckpoint());
+  SetProgress   (rhs.GetProgress());
 }
 
 void RooUnfold::Reset()
@@ -230,18 +260,27 @@ void RooUnfold::Init()
 {
   _res= _resmine= 0;
   _vMes= _eMes= 0;
-  _covMes= _covL= 0;
+  _covMes= 0;
+  _covStr= _covView= 0;
   _meas= _measmine= 0;
   _nm= _nt= 0;
   _verbose= 1;
   _overflow= 0;
   _dosys= _unfolded= _haveCov= _haveCovMes= _fail= _have_err_mat= _haveErrors= _haveWgt= false;
   _NToys=50;
+  _toySeed= -1;
+  _cache= RooUnfoldCache::GetDefault();
+  _checkpoint= 0;
+  _progress= 0;
+  _NToysRun= 0;
+  _fromCache= false;
+  _haveCacheKey= false;
   GetSettings();
 }
 
 RooUnfold& RooUnfold::Setup (const RooUnfoldResponse* res, const TH1* meas)
 {
+  RooUnfoldTimer timer (_timing, RooUnfoldTiming::kSetup);
   Reset();
   SetResponse (res);
   SetMeasured (meas);
@@ -254,11 +293,50 @@ void RooUnfold::SetMeasured (const TH1* meas)
   _meas= meas;
   delete _vMes; _vMes= 0;
   delete _eMes; _eMes= 0;
+  ForgetMeasuredErrors();
+  ForgetResults();
 }
 
 void RooUnfold::SetMeasured (const TVectorD& meas, const TVectorD& err)
 {
   // Set measured distribution and errors. Should be called after setting response matrix.
+  // The vectors are used directly: a measured histogram is only made if Hmeasured() is called.
+  if (meas.GetNrows() != _nm || err.GetNrows() != _nm) {
+    cerr << "Warning: " << ClassName() << "::SetMeasured given " << meas.GetNrows() << " bins, but response has " << _nm << endl;
+    return;
+  }
+  if (&meas != _vMes) {
+    if (!_vMes) _vMes= new TVectorD (meas);
+    else        *_vMes= meas;
+  }
+  if (&err != _eMes) {
+    if (!_eMes) _eMes= new TVectorD (err);
+    else        *_eMes= err;
+    ForgetMeasuredErrors();
+  }
+  _meas= 0;
+  ForgetResults();
+}
+
+void RooUnfold::ForgetMeasuredErrors()
+{
+  // Drop covariances cached from the old measurement errors.
+  if (_haveCovMes) return;
+  delete _covMes;  _covMes= 0;
+  delete _covView; _covView= 0;
+}
+
+void RooUnfold::ForgetResults()
+{
+  // A new measurement: the results are recalculated when next requested. Anything the algorithm
+  // derived from the response alone (eg. RooUnfoldInvert's SVD) is kept.
+  _unfolded= _haveCov= _have_err_mat= _haveErrors= _haveWgt= _fail= _fromCache= false;
+}
+
+void RooUnfold::MakeMeasured() const
+{
+  // Make the measured histogram from the vectors given to SetMeasured().
+  RooUnfoldTimer timer (_timing, RooUnfoldTiming::kConversion);
   if (!_measmine) {
     Bool_t oldstat= TH1::AddDirectoryStatus();
     TH1::AddDirectory (kFALSE);
@@ -268,11 +346,11 @@ void RooUnfold::SetMeasured (const TVectorD& meas, const TVectorD& err)
     _measmine->SetTitle (GetTitle());
   }
   for (Int_t i= 0; i<_nm; i++) {
-    Int_t j= RooUnfoldResponse::GetBin (_measmine, i, _overflow);
-    _measmine->SetBinContent(j, meas[i]);
-    _measmine->SetBinError  (j, err [i]);
+    Int_t j= RooUnfoldResponse::GetBin (_measmine, i, _overflow, _res->GetPermMeasured());
+    _measmine->SetBinContent(j, (*_vMes)[i]);
+    _measmine->SetBinError  (j, (*_eMes)[i]);
   }
-  SetMeasured (_measmine);
+  _meas= _measmine;
 }
 
 void RooUnfold::SetMeasured (const TVectorD& meas, const TMatrixD& cov)
@@ -285,24 +363,102 @@ void RooUnfold::SetMeasured (const TVectorD& meas, const TMatrixD& cov)
 void RooUnfold::SetMeasuredCov (const TMatrixD& cov)
 {
   // Set covariance matrix on measured distribution.
-  delete _covL; _covL= 0;
+  AdoptMeasuredCov (new TMatrixD (cov));
+}
+
+void RooUnfold::SetMeasuredCov (const RooUnfoldCovariance& cov)
+{
+  // Set covariance matrix on measured distribution, keeping its diagonal or low-rank-plus-diagonal structure,
+  // so that it is not expanded to an n x n matrix unless GetMeasuredCov() is called.
+  if (cov.GetN() != _nm) {
+    cerr << "Warning: " << ClassName() << "::SetMeasuredCov given " << cov.GetN() << " bins, but response has " << _nm << endl;
+    return;
+  }
+  delete _covMes;  _covMes= 0;
+  delete _covView; _covView= 0;
+  if (!_covStr) _covStr= new RooUnfoldCovariance (cov);
+  else         *_covStr= cov;
   delete _eMes;
-  delete _covMes;
   _eMes= new TVectorD(_nm);
   for (Int_t i= 0; i<_nm; i++) {
     Double_t e= cov(i,i);
     if (e>0.0) (*_eMes)[i]= sqrt(e);
   }
-  _covMes= new TMatrixD (cov);
   _haveCovMes= true;
+  ForgetResults();
+}
+
+void RooUnfold::SetMeasured (Int_t n, const Double_t* meas, const Double_t* err)
+{
+  // Set measured distribution and errors from arrays of n=GetNbinsMeasured() values, eg. NumPy arrays
+  // from PyROOT. If err=0, the errors are sqrt(meas), or from the diagonal of a covariance matrix
+  // already set with SetMeasuredCov(). Should be called after setting response matrix.
+  if (n != _nm) {
+    cerr << "Warning: " << ClassName() << "::SetMeasured given " << n << " bins, but response has " << _nm << endl;
+    return;
+  }
+  TVectorD vmeas, verr;
+  vmeas.Use (n, const_cast<Double_t*>(meas));   // wrap caller's buffer: read only
+  if (err) {
+    verr.Use (n, const_cast<Double_t*>(err));
+  } else if (_haveCovMes) {
+    const RooUnfoldCovariance& cov= GetMeasuredCovariance();
+    verr.ResizeTo (n);
+    for (Int_t i= 0; i<n; i++) verr[i]= sqrt (fabs (cov(i,i)));
+  } else {
+    verr.ResizeTo (n);
+    for (Int_t i= 0; i<n; i++) verr[i]= sqrt (fabs (meas[i]));
+  }
+  SetMeasured (vmeas, verr);
+}
+
+void RooUnfold::SetMeasuredCov (Int_t n, const Double_t* cov, Bool_t share)
+{
+  // Set covariance matrix on measured distribution from an n x n row-major array, eg. a NumPy array.
+  // With share=true, the array is used in place rather than copied, so it must not be changed
+  // or freed while this object (but not its clones or toys) is in use.
+  if (n != _nm) {
+    cerr << "Warning: " << ClassName() << "::SetMeasuredCov given " << n << " bins, but response has " << _nm << endl;
+    return;
+  }
+  TMatrixD* m;
+  if (share) {
+    m= new TMatrixD();
+    m->Use (n, n, const_cast<Double_t*>(cov));   // not owned, and only read
+  } else
+    m= new TMatrixD (n, n, cov);
+  AdoptMeasuredCov (m);
+}
+
+void RooUnfold::AdoptMeasuredCov (TMatrixD* cov)
+{
+  // Set covariance matrix on measured distribution, taking ownership of the TMatrixD.
+  delete _covStr;  _covStr= 0;
+  delete _covView; _covView= 0;
+  delete _eMes;
+  delete _covMes;
+  _eMes= new TVectorD(_nm);
+  for (Int_t i= 0; i<_nm; i++) {
+    Double_t e= (*cov)(i,i);
+    if (e>0.0) (*_eMes)[i]= sqrt(e);
+  }
+  _covMes= cov;
+  _haveCovMes= true;
+  ForgetResults();
 }
 
 const TMatrixD& RooUnfold::GetMeasuredCov() const
 {
   // Get covariance matrix on measured distribution.
+  // Use GetMeasuredCovariance() to avoid making an n x n matrix for uncorrelated or low-rank errors.
   if (_covMes) return *_covMes;
-  const TVectorD& err= Emeasured();
+  RooUnfoldTimer timer (_timing, RooUnfoldTiming::kConversion, Long64_t(_nm)*_nm*sizeof(Double_t));
   _covMes= new TMatrixD (_nm,_nm);
+  if (_covStr) {
+    _covStr->GetMatrix (*_covMes);
+    return *_covMes;
+  }
+  const TVectorD& err= Emeasured();
   for (Int_t i= 0 ; i<_nm; i++) {
     Double_t e= err[i];
     (*_covMes)(i,i)= e*e;
@@ -310,6 +466,19 @@ const TMatrixD& RooUnfold::GetMeasuredCov() const
   return *_covMes;
 }
 
+const RooUnfoldCovariance& RooUnfold::GetMeasuredCovariance() const
+{
+  // Get covariance matrix on measured distribution as set: diagonal from the measured errors,
+  // dense from SetMeasuredCov(TMatrixD) (shared, not copied), or as given to SetMeasuredCov(RooUnfoldCovariance).
+  if (_covStr) return *_covStr;
+  if (!_covView) {
+    _covView= new RooUnfoldCovariance();
+    if (_haveCovMes) _covView->Use (*_covMes);
+    else             _covView->SetErrors (Emeasured());
+  }
+  return *_covView;
+}
+
 
 void RooUnfold::SetResponse (const RooUnfoldResponse* res)
 {
@@ -361,7 +530,7 @@ void RooUnfold::GetErrors()
 void RooUnfold::GetCov()
 {
     //Dummy routine to get covariance matrix. It should be overridden by derived classes.
-  const TMatrixD& covmeas= GetMeasuredCov();
+  const RooUnfoldCovariance& covmeas= GetMeasuredCovariance();
   Int_t nb= _nm < _nt ? _nm : _nt;
   _cov.ResizeTo (_nt, _nt);
   for (int i=0; i<nb; i++)
@@ -380,40 +549,94 @@ void RooUnfold::GetWgt()
   _haveWgt= true;
 }
 
+Bool_t RooUnfold::GetJacobian()
+{
+  // Fills the derivatives of the unfolded result used by GetCovJacobian: _dxdy(i,j) = dx_i/dy_j and,
+  // if systematic errors are included, dx_i/dA_jk = _dxdAP(i,k)*_dxdAs(j) - _dxdy(i,j)*_dxdAu(k),
+  // for response matrix A. The latter form holds for the solution of any (regularised) least-squares
+  // problem, so the _nt x (_nm*_nt) Jacobian never has to be built.
+  // Should be overridden by derived classes that support analytic error propagation.
+  return false;
+}
+
+Bool_t RooUnfold::GetCovJacobian()
+{
+  // Get covariance matrix by linear propagation of the errors on the measured distribution
+  // and (if systematic errors are included) the response matrix, instead of using toys.
+  if (!GetJacobian()) return false;
+  _cov.ResizeTo (_nt, _nt);
+  if (_dosys!=2) {
+    ABAT (_dxdy, GetMeasuredCovariance(), _cov);
+  } else
+    _cov.Zero();
+  if (_dosys) AddResponseCov (_dxdAP, _dxdAs, _dxdy, _dxdAu, _res->Eresponse(), _cov);
+  _haveCov= true;
+  return true;
+}
+
 void RooUnfold::GetErrMat()
 {
   // Get covariance matrix from the variation of the results in toy MC tests
   if (_NToys<=1) return;
   _err_mat.ResizeTo(_nt,_nt);
-  TVectorD xisum (_nt);
-  TMatrixD xijsum(_nt,_nt);
-  for (Int_t k=0; k<_NToys; k++){
-    RooUnfold* unfold= RunToy();
-    const TVectorD& x= unfold->Vreco();
-    for (Int_t i=0; i<_nt;i++){
-      Double_t xi= x[i];
-      xisum[i] += xi;
-      for (Int_t j=0; j<_nt; j++) xijsum(i,j) += xi * x[j];
-    }
-    delete unfold;
-  }
+  // Toys in worker processes, or resumed from a checkpoint, need a seed for independent, reproducible random numbers
+  ToyArgs args= { this, _toySeed };
+  if (args.seed<0 && (_checkpoint || RooUnfoldForkPool::GetNWorkers() > 1)) args.seed= UInt_t(gRandom->Rndm()*4294967296.0);
+  TString key;
+  if (_checkpoint) key= CheckpointKey() + Form (" ntoys=%d", _NToys);
+  // Only the sums of x_i and x_i*x_j are kept (and checkpointed), not each toy's result.
+  // Stops early if cancelled or out of time (see RooUnfoldProgress)
+  std::vector<Double_t> sums;
+  Int_t next= RooUnfoldForkPool::RunLoop ("toys", _NToys, _nt, &RooUnfold::ToyJob, &args, sums,
+                                          _progress, _checkpoint, key, &args.seed, &RooUnfold::ToySums, _nt*(_nt+1));
+  // Stopped by _progress: use the toys done so far
+  if (next<=1) return;
+  _NToysRun= next;
+  const Double_t* xisum=  &sums[0];
+  const Double_t* xijsum= xisum+_nt;
   for (Int_t i=0; i<_nt; i++){
     for (Int_t j=0; j<_nt; j++){
-      _err_mat(i,j)= (xijsum(i,j) - (xisum[i]*xisum[j])/_NToys) / (_NToys-1);
+      _err_mat(i,j)= (xijsum[i*_nt+j] - (xisum[i]*xisum[j])/next) / (next-1);
     }
   }
   _have_err_mat=true;
 }
 
+void RooUnfold::ToyJob (Int_t k, Double_t* out, void* arg)
+{
+  // Unfolded result of toy k, for RooUnfoldForkPool. A seed<0 uses gRandom, which is only possible without worker processes.
+  const ToyArgs* args= static_cast<const ToyArgs*>(arg);
+  RooUnfoldPhilox* rnd= args->seed>=0 ? new RooUnfoldPhilox (UInt_t(args->seed), k) : 0;
+  RooUnfold* unfold= args->unfold->RunToy (rnd);
+  const TVectorD& x= unfold->Vreco();
+  for (Int_t i=0; i<x.GetNrows(); i++) out[i]= x[i];
+  delete unfold;
+  delete rnd;
+}
+
+void RooUnfold::ToySums (const Double_t* x, Double_t* sums, void* arg)
+{
+  // Add a toy's result x to the sums of x_i (sums[0.._nt-1]) and x_i*x_j (sums[_nt+i*_nt+j]), for RooUnfoldForkPool.
+  Int_t nt= static_cast<const ToyArgs*>(arg)->unfold->_nt;
+  Double_t* xijsum= sums+nt;
+  for (Int_t i=0; i<nt; i++){
+    Double_t xi= x[i];
+    sums[i] += xi;
+    for (Int_t j=0; j<nt; j++) xijsum[i*nt+j] += xi * x[j];
+  }
+}
+
 Bool_t RooUnfold::UnfoldWithErrors (ErrorTreatment withError, bool getWeights)
 {
-  if (!_unfolded) {
+  if (ReadCache (withError, getWeights)) return true;
+  if (!_unfolded || _fromCache) {
     if (_fail) return false;
     const TH1* rmeas= _res->Hmeasured();
-    if (_meas->GetDimension() != rmeas->GetDimension() ||
+    if (_meas && (
+        _meas->GetDimension() != rmeas->GetDimension() ||
         _meas->GetNbinsX()    != rmeas->GetNbinsX()    ||
         _meas->GetNbinsY()    != rmeas->GetNbinsY()    ||
-        _meas->GetNbinsZ()    != rmeas->GetNbinsZ()) {
+        _meas->GetNbinsZ()    != rmeas->GetNbinsZ())) {
       cerr << "Warning: measured "              << _meas->GetNbinsX();
       if (_meas->GetDimension()>=2) cerr << "x" << _meas->GetNbinsY();
       if (_meas->GetDimension()>=3) cerr << "x" << _meas->GetNbinsZ();
@@ -422,28 +645,35 @@ Bool_t RooUnfold::UnfoldWithErrors (ErrorTreatment withError, bool getWeights)
       if (rmeas->GetDimension()>=3) cerr << "x" << rmeas->GetNbinsZ();
       cerr << "-bin measured histogram from RooUnfoldResponse" << endl;
     }
-    Unfold();
+    // If only the result came from the cache, we still need the algorithm's internal state for the errors.
+    Bool_t rerun= _unfolded;
+    {
+      RooUnfoldTimer timer (_timing, RooUnfoldTiming::kUnfold);
+      Unfold();
+    }
     if (!_unfolded) {
       _fail= true;
       return false;
     }
+    _fromCache= false;
+    if (!rerun && withError!=kNoError) WriteCache (kNoError);
   }
   Bool_t ok;
   if (getWeights && (withError==kErrors || withError==kCovariance)) {
-      if   (!_haveWgt)      GetWgt();
+      if   (!_haveWgt)      { RooUnfoldTimer t (_timing, RooUnfoldTiming::kCovariance); GetWgt(); }
       ok= _haveWgt;
   } else {
     switch (withError) {
     case kErrors:
-      if   (!_haveErrors)   GetErrors();
+      if   (!_haveErrors)   { RooUnfoldTimer t (_timing, RooUnfoldTiming::kCovariance); GetErrors(); }
       ok= _haveErrors;
       break;
     case kCovariance:
-      if   (!_haveCov)      GetCov();
+      if   (!_haveCov)      { RooUnfoldTimer t (_timing, RooUnfoldTiming::kCovariance); GetCov(); }
       ok= _haveCov;
       break;
     case kCovToy:
-      if   (!_have_err_mat) GetErrMat();
+      if   (!_have_err_mat) { RooUnfoldTimer t (_timing, RooUnfoldTiming::kToys);       GetErrMat(); }
       ok= _have_err_mat;
       break;
     default:
@@ -451,9 +681,172 @@ Bool_t RooUnfold::UnfoldWithErrors (ErrorTreatment withError, bool getWeights)
     }
   }
   if (!ok) _fail= true;
+  else     WriteCache (withError, getWeights);
   return ok;
 }
 
+RooUnfoldFuture* RooUnfold::UnfoldAsync (ErrorTreatment withError)
+{
+  // Queue the unfolding and the error calculation requested by withError on the shared thread pool
+  // (see RooUnfoldAsync) and return at once. Wait() on the returned handle before using the
+  // results, and delete it afterwards. This object must not be used or changed until then.
+  // The measured and response vectors and matrices are converted here, because the response
+  // (and its cached conversions) may be shared with other unfoldings running at the same time.
+  Vmeasured();
+  GetMeasuredCovariance();
+  _res->Vmeasured();
+  _res->Vfakes();
+  _res->Vtruth();
+  _res->Mresponse();
+  if (_dosys) _res->Eresponse();
+  RooUnfoldFuture* job= new RooUnfoldFuture (this, withError);
+  RooUnfoldThreadPool::Instance().Submit (job);
+  return job;
+}
+
+Bool_t RooUnfold::ThreadSafe (ErrorTreatment withError) const
+{
+  // Can this unfolding run at the same time as other unfoldings? Toys use gRandom and create
+  // histograms, and the on-disk cache uses ROOT I/O. Algorithms whose Unfold() or GetCov() create
+  // histograms or use other global ROOT state should override this to return false.
+  return withError!=kCovToy && !_cache;
+}
+
+TString RooUnfold::CacheSettings() const
+{
+  // Settings of the unfolding algorithm that affect the result, included in the cache key.
+  // Should be overridden by derived classes with settings other than the regularisation parameter.
+  // An empty string disables caching.
+  return Form ("regparm=%.17g", GetRegParm());
+}
+
+TString RooUnfold::CacheKey() const
+{
+  // MD5 hash of the response matrix, measured distribution and covariance, algorithm, and settings.
+  TString settings= CacheSettings();
+  if (settings.Length()==0) return settings;
+  TMD5 md5;
+  RooUnfoldCache::Hash (md5, ClassName());
+  RooUnfoldCache::Hash (md5, settings);
+  RooUnfoldCache::Hash (md5, Form ("nm=%d nt=%d overflow=%d dosys=%d", _nm, _nt, _overflow, _dosys));
+  RooUnfoldCache::Hash (md5, _res->Hresponse());
+  RooUnfoldCache::Hash (md5, _res->Htruth());
+  RooUnfoldCache::Hash (md5, _res->Hmeasured());
+  RooUnfoldCache::Hash (md5, _res->Hfakes());
+  RooUnfoldCache::Hash (md5, Vmeasured());
+  if      (_covStr)     RooUnfoldCache::Hash (md5, *_covStr);
+  else if (_haveCovMes) RooUnfoldCache::Hash (md5, *_covMes);
+  else                  RooUnfoldCache::Hash (md5, Emeasured());
+  md5.Final();
+  return md5.AsString();
+}
+
+const TString& RooUnfold::CurrentCacheKey()
+{
+  // CacheKey() hashes the whole response, so is calculated only once for each unfolding:
+  // at the first cache lookup after the inputs or settings may have changed (when there is no result),
+  // and used for the result and all the errors stored for it.
+  if (!_haveCacheKey) {
+    _cacheKey= CacheKey();
+    _haveCacheKey= true;
+  }
+  return _cacheKey;
+}
+
+TString RooUnfold::DecompositionKey (const char* settings, Bool_t withCov) const
+{
+  // Cache key for factorisations that depend only on the response (RooUnfoldResponse::Checksum()) and settings,
+  // and, if withCov, the measurement covariance, but not on the measured values. These can then be reused by
+  // unfoldings of other measurements with the same response.
+  TMD5 md5;
+  RooUnfoldCache::Hash (md5, ClassName());
+  RooUnfoldCache::Hash (md5, settings);
+  RooUnfoldCache::Hash (md5, _res->Checksum());
+  if (withCov) RooUnfoldCache::Hash (md5, GetMeasuredCovariance());
+  md5.Final();
+  return md5.AsString();
+}
+
+TString RooUnfold::CheckpointKey() const
+{
+  // Identifies the inputs of a toy or scan loop, so that it is only resumed from a checkpoint
+  // (see RooUnfoldCheckpoint) of the same calculation: MD5 hash of the response (RooUnfoldResponse::Checksum()),
+  // measured distribution and covariance, algorithm, and settings (CacheSettings(), or just the
+  // regularisation parameter if the algorithm does not support caching).
+  TString settings= CacheSettings();
+  if (settings.Length()==0) settings= Form ("regparm=%.17g", GetRegParm());
+  TMD5 md5;
+  RooUnfoldCache::Hash (md5, ClassName());
+  RooUnfoldCache::Hash (md5, settings);
+  RooUnfoldCache::Hash (md5, Form ("nm=%d nt=%d overflow=%d dosys=%d", _nm, _nt, _overflow, _dosys));
+  RooUnfoldCache::Hash (md5, _res->Checksum());
+  RooUnfoldCache::Hash (md5, Vmeasured());
+  if      (_covStr)     RooUnfoldCache::Hash (md5, *_covStr);
+  else if (_haveCovMes) RooUnfoldCache::Hash (md5, *_covMes);
+  else                  RooUnfoldCache::Hash (md5, Emeasured());
+  md5.Final();
+  return md5.AsString();
+}
+
+Bool_t RooUnfold::ReadCache (ErrorTreatment withError, bool getWeights)
+{
+  // Fill the unfolded distribution and the errors requested by withError from the cache, if they
+  // are there. Returns true if they are now all available.
+  if (!_unfolded) _haveCacheKey= false;   // a new unfolding, maybe with new inputs
+  if (!_cache || _fail) return false;
+  Bool_t weights= getWeights && (withError==kErrors || withError==kCovariance);
+  Bool_t* have= 0;
+  if      (weights)                have= &_haveWgt;
+  else if (withError==kErrors)     have= &_haveErrors;
+  else if (withError==kCovariance) have= &_haveCov;
+  else if (withError==kCovToy)     have= &_have_err_mat;
+  if (_unfolded && (!have || *have)) return true;
+
+  const TString& key= CurrentCacheKey();
+  if (key.Length()==0) return false;
+  if (!_unfolded) {
+    _fromCache= false;
+    if (!_cache->Read (key, "reco", _rec)) return false;
+    _unfolded= _fromCache= true;
+    if (_verbose>=1) cout << "Read unfolded distribution from cache " << _cache->Directory() << endl;
+    if (!have || *have) return true;
+  }
+  if      (weights)                *have= _cache->Read (key, "wgt",    _wgt);
+  else if (withError==kErrors)     *have= _cache->Read (key, "errors", _variances);
+  else if (withError==kCovariance) *have= _cache->Read (key, "cov",    _cov);
+  else {
+    *have= _cache->Read (key, Form ("covtoy%d", _NToys), _err_mat);
+    if (*have) _NToysRun= _NToys;
+  }
+  return *have;
+}
+
+void RooUnfold::WriteCache (ErrorTreatment withError, bool getWeights)
+{
+  // Store the unfolded distribution (withError=kNoError) or the errors requested by withError in the cache.
+  if (!_cache || !_unfolded) return;
+  const TString& key= CurrentCacheKey();
+  if (key.Length()==0) return;
+  if (getWeights && (withError==kErrors || withError==kCovariance)) {
+    if (_haveWgt)      _cache->Write (key, "wgt",    _wgt);
+    return;
+  }
+  switch (withError) {
+    case kNoError:
+      if (!_fromCache) _cache->Write (key, "reco",   _rec);
+      break;
+    case kErrors:
+      if (_haveErrors)   _cache->Write (key, "errors", _variances);
+      break;
+    case kCovariance:
+      if (_haveCov)      _cache->Write (key, "cov",    _cov);
+      break;
+    case kCovToy:
+      if (_have_err_mat && _NToysRun==_NToys) _cache->Write (key, Form ("covtoy%d", _NToys), _err_mat);
+      break;
+  }
+}
+
 Double_t RooUnfold::Chi2(const TH1* hTrue,ErrorTreatment DoChi2)
 {
     /*Calculates Chi squared. Method depends on value of DoChi2
@@ -468,7 +861,7 @@ Double_t RooUnfold::Chi2(const TH1* hTrue,ErrorTreatment DoChi2)
 
     TVectorD res(_nt);
     for (Int_t i = 0 ; i < _nt; i++) {
-      Int_t it= RooUnfoldResponse::GetBin (hTrue, i, _overflow);
+      Int_t it= RooUnfoldResponse::GetBin (hTrue, i, _overflow, _res->GetPermTruth());
       if (hTrue->GetBinContent(it)!=0.0 || hTrue->GetBinError(it)>0.0) {
         res[i] = _rec[i] - hTrue->GetBinContent(it);
       }
@@ -483,7 +876,8 @@ Double_t RooUnfold::Chi2(const TH1* hTrue,ErrorTreatment DoChi2)
         ABAT (resmat, wgt, chi2mat);
         chi2= chi2mat(0,0);
     } else {
-        TVectorD ereco= ErecoV(DoChi2);
+        TVectorD ereco;
+        ErecoV(ereco, DoChi2);
         if (_fail) return -1.0;
         for (Int_t i = 0 ; i < _nt; i++) {
           Double_t e= ereco[i];
@@ -497,15 +891,10 @@ Double_t RooUnfold::Chi2(const TH1* hTrue,ErrorTreatment DoChi2)
 
 
 Double_t RooUnfold::Chi2measured() {
-  TVectorD vReco= Vreco();
-  TMatrixD A= _res->Mresponse();
-  TVectorD yreco= A*vReco;
-  TVectorD ymeasured= Vmeasured();
-  TVectorD delta= ymeasured - yreco;
-  TMatrixD Vinv= GetMeasuredCov();
-  InvertMatrix( Vinv, Vinv );
-  Double_t chisq= Vinv.Similarity( delta );
-  return chisq;
+  TVectorD delta;
+  VrecoMeasured( delta );
+  delta -= Vmeasured();
+  return GetMeasuredCovariance().Chi2( delta );
 }
 
 
@@ -673,13 +1062,23 @@ TH1* RooUnfold::Hreco (ErrorTreatment withError)
     3: Errors from the square root of the covariance matrix from the variation of the results in toy MC tests
     */
   TH1* reco= (TH1*) _res->Htruth()->Clone(GetName());
-  reco->Reset();
   reco->SetTitle (GetTitle());
+  return Hreco (reco, withError);
+}
+
+
+TH1* RooUnfold::Hreco (TH1* reco, ErrorTreatment withError)
+{
+  // Fills an existing histogram (eg. returned by a previous call to Hreco) with the
+  // reconstructed distribution, avoiding a new histogram in toy or scan loops.
+  // reco must have the same binning as the response's truth histogram.
+  reco->Reset();
   if (!UnfoldWithErrors (withError)) withError= kNoError;
   if (!_unfolded) return reco;
+  RooUnfoldTimer timer (_timing, RooUnfoldTiming::kConversion);
 
   for (Int_t i= 0; i < _nt; i++) {
-    Int_t j= RooUnfoldResponse::GetBin (reco, i, _overflow);
+    Int_t j= RooUnfoldResponse::GetBin (reco, i, _overflow, _res->GetPermTruth());
     reco->SetBinContent (j,             _rec(i));
     if        (withError==kErrors){
       reco->SetBinError (j, sqrt (fabs (_variances(i))));
@@ -695,19 +1094,37 @@ TH1* RooUnfold::Hreco (ErrorTreatment withError)
 
 
 TH1* RooUnfold::HrecoMeasured() {
-  TH1* hist= (TH1*) _meas->Clone( GetName() );
-  hist->Reset();
+  TH1* hist= (TH1*) Hmeasured()->Clone( GetName() );
   hist->SetTitle( GetTitle() );
-  TVectorD reco= Vreco();
-  TMatrixD A= _res->Mresponse();
-  TVectorD yreco= A*reco;
+  return HrecoMeasured( hist );
+}
+
+
+TH1* RooUnfold::HrecoMeasured (TH1* hist) {
+  // Fills an existing histogram, with the binning of the measured histogram,
+  // with the reconstructed distribution folded with the response.
+  hist->Reset();
+  TVectorD yreco;
+  VrecoMeasured( yreco );
+  RooUnfoldTimer timer( _timing, RooUnfoldTiming::kConversion );
   for( Int_t i= 0; i < _nm; i++ ) {
-    Int_t j= RooUnfoldResponse::GetBin( hist, i, _overflow );
+    Int_t j= RooUnfoldResponse::GetBin( hist, i, _overflow, _res->GetPermMeasured() );
     hist->SetBinContent( j, yreco(i) );
   }
   return hist;
 }
 
+
+TVectorD& RooUnfold::VrecoMeasured (TVectorD& yreco) {
+  // Reconstructed distribution folded with the response matrix. yreco is only
+  // reallocated if it does not already have _nm elements.
+  const TVectorD& reco= Vreco();
+  const TMatrixD& A= _res->Mresponse();
+  if (yreco.GetNrows() != _nm) yreco.ResizeTo(_nm);
+  yreco.Zero();
+  return Add (yreco, 1.0, A, reco);
+}
+
 void RooUnfold::GetSettings()
 {
     //Gets maximum and minimum parameters and step size
@@ -741,34 +1158,35 @@ Double_t RooUnfold::GetDefaultParm() const
     return _defaultparm;
 }
 
-RooUnfold* RooUnfold::RunToy() const
+RooUnfold* RooUnfold::RunToy (TRandom* rnd) const
 {
   // Returns new RooUnfold object with smeared measurements and
   // (if IncludeSystematics) response matrix for use as a toy.
   // Use multiple toys to find spread of unfolding results.
+  // Random numbers are taken from rnd, if specified, or gRandom.
+  RooUnfoldTraceSpan span ("RunToy");
+  if (!rnd) rnd= gRandom;
   TString name= GetName();
   name += "_toy";
   RooUnfold* unfold = Clone(name);
+  unfold->SetCache (0);  // each toy has different inputs, so don't fill the cache with them
 
   // Make new smeared response matrix
-  if (_dosys) unfold->SetResponse (_res->RunToy(), kTRUE);
+  if (_dosys) unfold->SetResponse (_res->RunToy(rnd), kTRUE);
   if (_dosys==2) return unfold;
 
   if (_haveCovMes) {
 
-    // _covL is a lower triangular matrix for which the covariance matrix, V = _covL * _covL^T.
-    if (!_covL) {
-      TDecompChol c(*_covMes);
-      c.Decompose();
-      TMatrixD U(c.GetU());
-      _covL= new TMatrixD (TMatrixD::kTransposed, U);
-      if (_verbose>=2) RooUnfoldResponse::PrintMatrix(*_covL,"decomposed measurement covariance matrix");
-    }
-    TVectorD newmeas(_nm);
-    for (Int_t i= 0; i<_nm; i++) newmeas[i]= gRandom->Gaus(0.0,1.0);
-    newmeas *= *_covL;
+    // Sampled using the Cholesky decomposition of a dense covariance matrix, which is kept for later toys,
+    // or directly from the variances and factors of a diagonal or low-rank-plus-diagonal covariance.
+    TVectorD newmeas;
+    GetMeasuredCovariance().Sample (newmeas, rnd);
     newmeas += Vmeasured();
-    unfold->SetMeasured(newmeas,*_covMes);
+    if (_covStr) {
+      unfold->SetMeasuredCov (*_covStr);
+      unfold->SetMeasured (newmeas, Emeasured());
+    } else
+      unfold->SetMeasured(newmeas,*_covMes);
 
   } else {
 
@@ -776,7 +1194,7 @@ RooUnfold* RooUnfold::RunToy() const
     const TVectorD& err= Emeasured();
     for (Int_t i= 0; i<_nm; i++) {
       Double_t e= err[i];
-      if (e>0.0) newmeas[i] += gRandom->Gaus(0,e);
+      if (e>0.0) newmeas[i] += rnd->Gaus(0,e);
     }
     unfold->SetMeasured(newmeas,err);
 
@@ -790,12 +1208,13 @@ void RooUnfold::Print(Option_t* /*opt*/) const
        << "\", regularisation parameter=" << GetRegParm() << ", ";
   if (_haveCovMes) cout << "with measurement covariance, ";
   if (_dosys)      cout << "calculate systematic errors, ";
-  if (_meas->GetDimension()==1) cout << _nm;
+  const TH1* rmeas= _res->Hmeasured();
+  if (rmeas->GetDimension()==1) cout << _nm;
   else {
-    cout <<        _meas->GetNbinsX()
-         << "x" << _meas->GetNbinsY();
-    if (_meas->GetDimension()>=3)
-    cout << "x" << _meas->GetNbinsZ();
+    cout <<        rmeas->GetNbinsX()
+         << "x" << rmeas->GetNbinsY();
+    if (rmeas->GetDimension()>=3)
+    cout << "x" << rmeas->GetNbinsZ();
     cout << " (" << _nm << ")";
   }
   cout << " bins measured, ";
@@ -811,37 +1230,32 @@ void RooUnfold::Print(Option_t* /*opt*/) const
   cout << " bins truth";
   if (_overflow) cout << " including overflows";
   cout << endl;
+  if (!_timing.IsEmpty()) {
+    cout << GetName() << " timing:" << endl;
+    _timing.Print();
+  }
 }
 
 TMatrixD RooUnfold::CutZeros(const TMatrixD& ereco)
 {
     //Removes row & column if all their elements are 0.
-    vector<int> diags;
-        int missed=0;
-        for (int i=0; i<ereco.GetNrows(); i++){
-            double coltot=0;
-            for (int j=0;j<ereco.GetNrows();j++){
-                coltot+=ereco(i,j);
-            }
-            if (coltot==0){
-                diags.push_back(i);
-                missed++;
-            }
+    //The result is built in place, so is returned without a copy.
+    vector<int> keep;
+    keep.reserve (ereco.GetNrows());
+    for (int i=0; i<ereco.GetNrows(); i++){
+        double coltot=0;
+        for (int j=0;j<ereco.GetNcols();j++){
+            coltot+=ereco(i,j);
         }
-        int x=ereco.GetNrows()-missed;
-        int y=ereco.GetNcols()-missed;
-        TMatrixD ereco_cut(x,y);
-        unsigned int v=0;
-        for (int i=0;i<ereco.GetNrows();i++){
-            if(v<diags.size() && diags[v]==i){
-                v++;
-            }
-            else{
-                for (int j=0; j<ereco_cut.GetNcols();j++){
-                    ereco_cut(i-v,j)=ereco(i,j+v);
-                    }
-                }
+        if (coltot!=0) keep.push_back(i);
+    }
+    int n=keep.size();
+    TMatrixD ereco_cut(n,n);
+    for (int i=0; i<n; i++){
+        for (int j=0; j<n; j++){
+            ereco_cut(i,j)=ereco(keep[i],keep[j]);
         }
+    }
     return ereco_cut;
 }
 
@@ -852,6 +1266,7 @@ TMatrixD RooUnfold::Ereco(ErrorTreatment withError)
     1: Errors from the diagonals of the covariance matrix given by the unfolding
     2: Errors from the covariance matrix given by the unfolding
     3: Errors from the covariance matrix from the variation of the results in toy MC tests
+    Use ErecoRef() to avoid copying the matrix.
     */
     TMatrixD Ereco_m(_nt,_nt);
     if (!UnfoldWithErrors (withError)) return Ereco_m;
@@ -879,6 +1294,56 @@ TMatrixD RooUnfold::Ereco(ErrorTreatment withError)
     return Ereco_m;
 }
 
+const TMatrixD& RooUnfold::ErecoRef(ErrorTreatment withError)
+{
+    // As Ereco(), but the kCovariance and kCovToy matrices are returned without copying. The reference is to
+    // an internal matrix, which may be overwritten by the next call or unfolding: copy it to keep the result.
+    // This is not virtual, so does not see a subclass's Ereco().
+    Bool_t ok= UnfoldWithErrors (withError);
+    if (ok && withError==kCovariance) return _cov;
+    if (ok && withError==kCovToy)     return _err_mat;
+    _ereco.ResizeTo(_nt,_nt);
+    _ereco.Zero();
+    if (!ok) return _ereco;
+
+    switch(withError){
+      case kNoError:
+        for (int i=0; i<_nt; i++){
+          _ereco(i,i)=_rec(i);
+        }
+        break;
+      case kErrors:
+        for (int i=0; i<_nt;i++){
+          _ereco(i,i)=_variances(i);
+        }
+        break;
+      default:
+        cerr<<"Error, unrecognised error method= "<<withError<<endl;
+    }
+    return _ereco;
+}
+
+const Double_t* RooUnfold::VrecoArray()
+{
+  // Unfolded distribution as an array of GetNbinsTruth() values, pointing to the internal vector.
+  // PyROOT returns a buffer, so numpy.frombuffer(buf, count=n) gives an array without copying.
+  // Valid until the object is changed or deleted.
+  return Vreco().GetMatrixArray();
+}
+
+const Double_t* RooUnfold::ErecoArray (ErrorTreatment withError)
+{
+  // Covariance matrix of type kCovariance or kCovToy as a row-major array of nt x nt values, pointing
+  // to the internal matrix, so that large matrices can be passed to NumPy without copying.
+  // Returns 0 on failure. Valid until the object is changed or deleted.
+  if (withError != kCovariance && withError != kCovToy) {
+    cerr << "Warning: " << ClassName() << "::ErecoArray only provides kCovariance or kCovToy matrices: use ErecoV" << endl;
+    return 0;
+  }
+  if (!UnfoldWithErrors (withError)) return 0;
+  return withError==kCovToy ? _err_mat.GetMatrixArray() : _cov.GetMatrixArray();
+}
+
 TVectorD RooUnfold::ErecoV(ErrorTreatment withError)
 {
     /*Returns vector of unfolding errors computed according to the withError flag:
@@ -888,6 +1353,22 @@ TVectorD RooUnfold::ErecoV(ErrorTreatment withError)
     3: Errors from the covariance matrix from the variation of the results in toy MC tests
     */
     TVectorD Ereco_v(_nt);
+    return ErecoV (Ereco_v, withError);
+}
+
+const TVectorD& RooUnfold::ErecoVRef(ErrorTreatment withError)
+{
+    // As ErecoV(), but the reference is to an internal vector, which is overwritten by the next call:
+    // copy it to keep the result.
+    return ErecoV (_erecoV, withError);
+}
+
+TVectorD& RooUnfold::ErecoV(TVectorD& Ereco_v, ErrorTreatment withError)
+{
+    // As ErecoV(withError), but fills an existing vector, which is only
+    // reallocated if it does not already have _nt elements.
+    if (Ereco_v.GetNrows() != _nt) Ereco_v.ResizeTo(_nt);
+    Ereco_v.Zero();
     if (!UnfoldWithErrors (withError)) return Ereco_v;
 
     switch(withError){
@@ -919,6 +1400,7 @@ TVectorD RooUnfold::ErecoV(ErrorTreatment withError)
 
 TMatrixD RooUnfold::Wreco(ErrorTreatment withError)
 {
+    // Weight (inverse covariance) matrix. Use WrecoRef() to avoid copying the matrix.
     TMatrixD Wreco_m(_nt,_nt);
     if (!UnfoldWithErrors (withError, true)) return Wreco_m;
 
@@ -945,10 +1427,42 @@ TMatrixD RooUnfold::Wreco(ErrorTreatment withError)
     return Wreco_m;
 }
 
-TH1D* RooUnfold::HistNoOverflow (const TH1* h, Bool_t overflow)
+const TMatrixD& RooUnfold::WrecoRef(ErrorTreatment withError)
+{
+    // As Wreco(), but the kCovariance matrix is returned without copying, the kCovToy matrix is inverted on
+    // each call. The reference is to an internal matrix, which may be overwritten by the next call or
+    // unfolding: copy it to keep the result. This is not virtual, so does not see a subclass's Wreco().
+    Bool_t ok= UnfoldWithErrors (withError, true);
+    if (ok && withError==kCovariance) return _wgt;
+    _wreco.ResizeTo(_nt,_nt);
+    _wreco.Zero();
+    if (!ok) return _wreco;
+
+    switch(withError){
+      case kNoError:
+        for (int i=0; i<_nt; i++){
+          if (_rec(i)!=0.0) _wreco(i,i)=1.0/_rec(i);
+        }
+        break;
+      case kErrors:
+        for (int i=0; i<_nt;i++){
+          _wreco(i,i)=_wgt(i,i);
+        }
+        break;
+      case kCovToy:
+        InvertMatrix (_err_mat, _wreco, "covariance matrix from toys", _verbose);
+        break;
+      default:
+        cerr<<"Error, unrecognised error method= "<<withError<<endl;
+    }
+    return _wreco;
+}
+
+TH1D* RooUnfold::HistNoOverflow (const TH1* h, Bool_t overflow, const Int_t* perm)
 {
+  // 1D copy of h, with bins in vector index order (with the order given by perm, if specified)
   if (!overflow) {   // also for 2D+
-    TH1D* hx= RooUnfoldResponse::H2H1D (h, h->GetNbinsX()*h->GetNbinsY()*h->GetNbinsZ());
+    TH1D* hx= RooUnfoldResponse::H2H1D (h, h->GetNbinsX()*h->GetNbinsY()*h->GetNbinsZ(), perm);
     if (!hx) return hx;
     // clear under/overflow bins for cloned TH1D
     hx->SetBinContent (0,                 0.0);
@@ -1070,8 +1584,9 @@ TH1* RooUnfold::Resize (TH1* h, Int_t nx, Int_t ny, Int_t nz)
 TMatrixD& RooUnfold::ABAT (const TMatrixD& a, const TMatrixD& b, TMatrixD& c)
 {
   // Fills C such that C = A * B * A^T. Note that C cannot be the same object as A.
-  TMatrixD d (b, TMatrixD::kMultTranspose, a);
-  c.Mult (a, d);
+  Int_t na= a.GetNrows();
+  c.ResizeTo (na, na);
+  RooUnfoldCore::ABAT (na, a.GetNcols(), a.GetMatrixArray(), b.GetMatrixArray(), c.GetMatrixArray());
   return c;
 }
 
@@ -1079,12 +1594,58 @@ TMatrixD& RooUnfold::ABAT (const TMatrixD& a, const TVectorD& b, TMatrixD& c)
 {
   // Fills C such that C = A * B * A^T, where B is a diagonal matrix specified by the vector.
   // Note that C cannot be the same object as A.
-  TMatrixD d (TMatrixD::kTransposed, a);
-  d.NormByColumn (b, "M");
-  c.Mult (a, d);
+  Int_t na= a.GetNrows();
+  c.ResizeTo (na, na);
+  RooUnfoldCore::ABATDiag (na, a.GetNcols(), a.GetMatrixArray(), b.GetMatrixArray(), c.GetMatrixArray());
   return c;
 }
 
+TMatrixD& RooUnfold::ABAT (const TMatrixD& a, const RooUnfoldCovariance& b, TMatrixD& c)
+{
+  // Fills C such that C = A * B * A^T, using the structure of B: O(n^2) for a diagonal B = diag(d),
+  // and A diag(d) A^T + (A F) (A F)^T for a low-rank-plus-diagonal B = diag(d) + F F^T.
+  // Note that C cannot be the same object as A.
+  if (b.GetType()==RooUnfoldCovariance::kDense) return ABAT (a, b.GetFactors(), c);
+  ABAT (a, b.GetDiagonal(), c);
+  if (b.GetType()==RooUnfoldCovariance::kLowRank) {
+    TMatrixD af (a, TMatrixD::kMult, b.GetFactors());
+    TMatrixD afaft (af, TMatrixD::kMultTranspose, af);
+    c += afaft;
+  }
+  return c;
+}
+
+TMatrixD& RooUnfold::AddResponseCov (const TMatrixD& dxdAP, const TVectorD& dxdAs, const TMatrixD& dxdy,
+                                      const TVectorD& dxdAu, const TMatrixD& eres, TMatrixD& cov)
+{
+  // Adds to cov the contribution of independent errors, eres(j,k), on the response matrix elements for a
+  // result with dx_i/dA_jk = P(i,k)*s(j) - M(i,j)*u(k), where P=dxdAP, s=dxdAs, M=dxdy, and u=dxdAu.
+  // Summing over (j,k) gives P*diag(a)*P^T + M*diag(b)*M^T - (P*Q*M^T + its transpose), with
+  // a(k) = sum_j V(j,k)*s(j)^2, b(j) = sum_k V(j,k)*u(k)^2, and Q(k,j) = V(j,k)*s(j)*u(k).
+  Int_t nm= eres.GetNrows(), nt= eres.GetNcols(), n= cov.GetNrows();
+  TVectorD a(nt), b(nm);
+  TMatrixD Q(nt,nm);
+  for (Int_t j= 0; j < nm; j++) {
+    for (Int_t k= 0; k < nt; k++) {
+      Double_t v= eres(j,k);
+      if (v==0.0) continue;
+      v *= v;
+      a[k]  += v * dxdAs[j] * dxdAs[j];
+      b[j]  += v * dxdAu[k] * dxdAu[k];
+      Q(k,j)=  v * dxdAs[j] * dxdAu[k];
+    }
+  }
+  TMatrixD c(n,n);
+  cov += ABAT (dxdAP, a, c);
+  cov += ABAT (dxdy,  b, c);
+  TMatrixD PQ (dxdAP, TMatrixD::kMult, Q);
+  c.MultT (PQ, dxdy);
+  for (Int_t i= 0; i < n; i++)
+    for (Int_t l= 0; l < n; l++)
+      cov(i,l) -= c(i,l) + c(l,i);
+  return cov;
+}
+
 Int_t RooUnfold::InvertMatrix(const TMatrixD& mat, TMatrixD& inv, const char* name, Int_t verbose)
 {
   // Invert a matrix using Single Value Decomposition: inv = mat^-1.
@@ -1147,6 +1708,7 @@ void RooUnfold::Streamer (TBuffer &R__b)
     RooUnfold::Class()->ReadBuffer  (R__b, this);
     TH1::AddDirectory (oldstat);
   } else {
+    Hmeasured();   // make the histogram, if only the vectors were set
     RooUnfold::Class()->WriteBuffer (R__b, this);
   }
 }
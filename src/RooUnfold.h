@@ -19,6 +19,12 @@
 
 class TH1;
 class TH1D;
+class TRandom;
+class RooUnfoldCache;
+class RooUnfoldCheckpoint;
+class RooUnfoldProgress;
+class RooUnfoldFuture;
+class RooUnfoldCovariance;
 
 class RooUnfold : public TNamed {
 
@@ -32,7 +38,8 @@ public:
     kTUnfold,            //   RooUnfoldTUnfold
     kInvert,             //   RooUnfoldInvert
     kDagostini,          //   RooUnfoldDagostini
-    kBasisSplines        //   RooUnfoldBasisSplines
+    kBasisSplines,       //   RooUnfoldBasisSplines
+    kCGLS                //   RooUnfoldCGLS
   };
 
   enum ErrorTreatment {  // Error treatment:
@@ -67,6 +74,9 @@ public:
   virtual void SetMeasured (const TVectorD& meas, const TMatrixD& cov);
   virtual void SetMeasured (const TVectorD& meas, const TVectorD& err);
   virtual void SetMeasuredCov (const TMatrixD& cov);
+  virtual void SetMeasuredCov (const RooUnfoldCovariance& cov);  // diagonal, dense, or low-rank plus diagonal
+  virtual void SetMeasured (Int_t n, const Double_t* meas, const Double_t* err= 0); // err=0 uses sqrt(meas)
+  virtual void SetMeasuredCov (Int_t n, const Double_t* cov, Bool_t share= kFALSE); // n x n, row-major
   virtual void SetResponse (const RooUnfoldResponse* res);
   virtual void SetResponse (RooUnfoldResponse* res, Bool_t takeOwnership);
 
@@ -77,17 +87,26 @@ public:
   virtual const RooUnfoldResponse* response() const;
   virtual const TH1* Hmeasured() const;
   virtual       TH1* Hreco (ErrorTreatment withError=kErrors);
+  virtual       TH1* Hreco (TH1* reco, ErrorTreatment withError=kErrors); // fill existing histogram
   const    TVectorD& Vmeasured() const;   // Measured distribution as a TVectorD
   const    TVectorD& Emeasured() const;   // Measured distribution errors as a TVectorD
   const    TMatrixD& GetMeasuredCov() const;   // Measured distribution covariance matrix
+  const RooUnfoldCovariance& GetMeasuredCovariance() const;  // Measured distribution covariance, keeping its structure
 
   virtual TH1* HrecoMeasured();
-
+  virtual TH1* HrecoMeasured (TH1* hist); // fill existing histogram
+  virtual TVectorD& VrecoMeasured (TVectorD& yreco); // Refolded distribution, filled into yreco
 
   virtual TVectorD&  Vreco();
   virtual TMatrixD   Ereco  (ErrorTreatment witherror=kCovariance);
   virtual TVectorD   ErecoV (ErrorTreatment witherror=kErrors);
+  virtual TVectorD&  ErecoV (TVectorD& ereco, ErrorTreatment witherror=kErrors); // fill existing vector
   virtual TMatrixD   Wreco  (ErrorTreatment witherror=kCovariance);
+  const TMatrixD&    ErecoRef  (ErrorTreatment witherror=kCovariance);  // Ereco() without copying: internal, so copy to keep
+  const TVectorD&    ErecoVRef (ErrorTreatment witherror=kErrors);      // ErecoV() without copying: internal, so copy to keep
+  const TMatrixD&    WrecoRef  (ErrorTreatment witherror=kCovariance);  // Wreco() without copying: internal, so copy to keep
+  const Double_t*    VrecoArray();  // Vreco() contents, without copying
+  const Double_t*    ErecoArray (ErrorTreatment witherror=kCovariance);  // covariance matrix, row-major, without copying
 
   virtual Int_t      verbose() const;
   virtual void       SetVerbose (Int_t level);
@@ -95,6 +114,8 @@ public:
   virtual Int_t      SystematicsIncluded() const;
   virtual Int_t      NToys() const;         // Number of toys
   virtual void       SetNToys (Int_t toys); // Set number of toys
+  Long64_t           GetToySeed() const;
+  void               SetToySeed (Long64_t seed= 0); // Reproducible toys: RooUnfoldPhilox stream per toy. -1 uses gRandom.
   virtual Int_t      Overflow() const;
   virtual void       PrintTable (std::ostream& o, const TH1* hTrue= 0, ErrorTreatment witherror=kNoError);
   virtual void       SetRegParm (Double_t parm);
@@ -107,8 +128,19 @@ public:
   Double_t GetMaxParm() const;
   Double_t GetStepSizeParm() const;
   Double_t GetDefaultParm() const;
-  RooUnfold* RunToy() const;
+  RooUnfold* RunToy (TRandom* rnd= 0) const;  // rnd=0 uses gRandom
   void Print(Option_t* opt="") const;
+  RooUnfoldTiming& Timing() const;  // Per-phase timing (see RooUnfoldTiming::Enable)
+  virtual void       SetCache (RooUnfoldCache* cache); // Use on-disk result cache (not owned, 0 to disable)
+  RooUnfoldCache*    GetCache() const;
+  void               SetCheckpoint (RooUnfoldCheckpoint* checkpoint); // Checkpoint and resume toys (not owned, 0 to disable)
+  RooUnfoldCheckpoint* GetCheckpoint() const;
+  TString            CheckpointKey() const; // Identifies the inputs of toy and scan checkpoints
+  void               SetProgress (RooUnfoldProgress* progress); // Report progress of, and stop, toys (not owned, 0 to disable)
+  RooUnfoldProgress* GetProgress() const;
+  Int_t              NToysRun() const;      // Number of toys used for kCovToy errors (fewer than NToys() if stopped)
+  RooUnfoldFuture*   UnfoldAsync (ErrorTreatment withError=kErrors); // Unfold on the shared thread pool
+  virtual Bool_t     ThreadSafe (ErrorTreatment withError=kErrors) const; // Can run in parallel with other unfoldings?
 
   static void PrintTable (std::ostream& o, const TH1* hTrainTrue, const TH1* hTrain,
                           const TH1* hTrue, const TH1* hMeas, const TH1* hReco,
@@ -126,13 +158,24 @@ protected:
   virtual void GetCov(); // Get covariance matrix using errors on measured distribution
   virtual void GetErrMat(); // Get covariance matrix using errors from residuals on reconstructed distribution
   virtual void GetWgt(); // Get weight matrix using errors on measured distribution
+  virtual Bool_t GetJacobian(); // Get derivatives of the result for analytic error propagation
+  Bool_t GetCovJacobian(); // Get covariance matrix by linear propagation using GetJacobian
   virtual void GetSettings();
   virtual Bool_t UnfoldWithErrors (ErrorTreatment withError, bool getWeights=false);
+  virtual TString CacheSettings() const; // Algorithm settings that affect the result, for the cache key
+  TString CacheKey() const;
+  const TString& CurrentCacheKey();  // CacheKey() of the current unfolding, only calculated once
+  TString DecompositionKey (const char* settings, Bool_t withCov= kFALSE) const; // Cache key for factorisations of the response
+  Bool_t  ReadCache  (ErrorTreatment withError, bool getWeights=false);
+  void    WriteCache (ErrorTreatment withError, bool getWeights=false);
 
   static TMatrixD CutZeros     (const TMatrixD& ereco);
-  static TH1D*    HistNoOverflow (const TH1* h, Bool_t overflow);
+  static TH1D*    HistNoOverflow (const TH1* h, Bool_t overflow, const Int_t* perm= 0);
   static TMatrixD& ABAT (const TMatrixD& a, const TMatrixD& b, TMatrixD& c);
   static TMatrixD& ABAT (const TMatrixD& a, const TVectorD& b, TMatrixD& c);
+  static TMatrixD& ABAT (const TMatrixD& a, const RooUnfoldCovariance& b, TMatrixD& c);
+  static TMatrixD& AddResponseCov (const TMatrixD& dxdAP, const TVectorD& dxdAs, const TMatrixD& dxdy,
+                                   const TVectorD& dxdAu, const TMatrixD& eres, TMatrixD& cov);
   static TH1*     Resize (TH1* h, Int_t nx, Int_t ny=-1, Int_t nz=-1);
   static Int_t    InvertMatrix (const TMatrixD& mat, TMatrixD& inv, const char* name="matrix", Int_t verbose=1);
 
@@ -140,6 +183,14 @@ private:
   void Init();
   void Destroy();
   void CopyData (const RooUnfold& rhs);
+  void AdoptMeasuredCov (TMatrixD* cov);
+  void ForgetMeasuredErrors();
+  void ForgetResults();
+  void MakeMeasured() const;
+  struct ToyArgs { const RooUnfold* unfold; Long64_t seed; };
+  static void ToyJob  (Int_t k, Double_t* out, void* arg);               // RooUnfoldForkPool job for GetErrMat
+  static void ToySums (const Double_t* x, Double_t* sums, void* arg);    // and its reduction
+  friend class RooUnfoldFuture;
 
 protected:
   // instance variables
@@ -152,31 +203,48 @@ protected:
   Int_t    _nt;            // Total number of truth    bins (including under/overflows if _overflow set)
   Int_t    _overflow;      // Use histogram under/overflows if 1 (set from RooUnfoldResponse)
   Int_t    _NToys;         // Number of toys to be used
+  Long64_t _toySeed;       // Seed for RooUnfoldPhilox toys, or -1 to use gRandom
   Bool_t   _unfolded;      // unfolding done
   Bool_t   _haveCov;       // have _cov
   Bool_t   _haveWgt;       // have _wgt
   Bool_t   _have_err_mat;  // have _err_mat
   Bool_t   _fail;          // unfolding failed
   Bool_t   _haveErrors;    // have _variances
-  Bool_t   _haveCovMes;    // _covMes was set, not just cached
+  Bool_t   _haveCovMes;    // _covMes or _covStr was set, not just cached
   Int_t    _dosys;         // include systematic errors from response matrix? use _dosys=2 to exclude measurement errors
   const RooUnfoldResponse* _res;   // Response matrix (not owned)
   RooUnfoldResponse* _resmine;     // Owned response matrix
-  const TH1*               _meas;  // Measured distribution (not owned)
-  TH1*     _measmine;      // Owned measured histogram
+  mutable const TH1*       _meas;  // Measured distribution (not owned), or 0 if only set as vectors
+  mutable TH1*     _measmine;      // Owned measured histogram
   TVectorD _rec;           // Reconstructed distribution
   TMatrixD _cov;           // Reconstructed distribution covariance
   TMatrixD _wgt;           // Reconstructed distribution weights (inverse of _cov)
   TVectorD _variances;     // Error matrix diagonals
   TMatrixD _err_mat;       // Error matrix from toys
+  TMatrixD _dxdy;          //! Derivative of result wrt measured distribution, d(reco_i)/d(meas_j)
+  TMatrixD _dxdAP;         //! Derivative wrt response(j,k) is _dxdAP(i,k)*_dxdAs(j) - _dxdy(i,j)*_dxdAu(k)
+  TVectorD _dxdAs;         //! see _dxdAP
+  TVectorD _dxdAu;         //! see _dxdAP
+  TMatrixD _ereco;         //! ErecoRef() result for kNoError and kErrors
+  TVectorD _erecoV;        //! ErecoVRef() result
+  TMatrixD _wreco;         //! WrecoRef() result for kNoError, kErrors, and kCovToy
   mutable TVectorD* _vMes; //! Cached measured vector
   mutable TVectorD* _eMes; //! Cached measured error
   mutable TMatrixD* _covMes;       // Measurement covariance matrix
-  mutable TMatrixD* _covL; //! Cached lower triangular matrix for which _covMes = _covL * _covL^T.
+  RooUnfoldCovariance* _covStr;    // Measurement covariance, if set as a RooUnfoldCovariance (_covMes is then a cached copy)
+  mutable RooUnfoldCovariance* _covView; //! Cached GetMeasuredCovariance() for _covMes or Emeasured()
+  mutable RooUnfoldTiming _timing; //! Per-phase timing
+  RooUnfoldCache* _cache;  //! On-disk result cache (not owned)
+  RooUnfoldCheckpoint* _checkpoint; //! Checkpoint for toys (not owned)
+  RooUnfoldProgress* _progress;     //! Progress and cancellation of toys (not owned)
+  Int_t    _NToysRun;      //! Number of toys used for _err_mat
+  Bool_t   _fromCache;     //! _rec was read from the cache, so Unfold() has not been run
+  TString  _cacheKey;      //! CurrentCacheKey()
+  Bool_t   _haveCacheKey;  //! _cacheKey is set
 
 public:
 
-  ClassDef (RooUnfold, 1) // Unfolding base class: implementations in RooUnfoldBayes, RooUnfoldSvd, RooUnfoldBinByBin, RooUnfoldTUnfold, and RooUnfoldInvert
+  ClassDef (RooUnfold, 3) // Unfolding base class: implementations in RooUnfoldBayes, RooUnfoldSvd, RooUnfoldBinByBin, RooUnfoldTUnfold, and RooUnfoldInvert
 };
 
 //==============================================================================
@@ -252,7 +320,8 @@ const RooUnfoldResponse* RooUnfold::response()  const
 inline
 const TH1*               RooUnfold::Hmeasured() const
 {
-  // Measured Distribution as a histogram
+  // Measured Distribution as a histogram. If it was set as vectors, the histogram is made when first requested.
+  if (!_meas && _vMes) MakeMeasured();
   return _meas;
 }
 
@@ -261,7 +330,13 @@ TVectorD&                RooUnfold::Vreco()
 {
   // Unfolded (reconstructed) distribution as a vector
   if (!_unfolded) {
-    if (!_fail) Unfold();
+    if (!_fail && !ReadCache (kNoError)) {
+      {
+        RooUnfoldTimer t (_timing, RooUnfoldTiming::kUnfold);
+        Unfold();
+      }
+      if (_unfolded) WriteCache (kNoError);
+    }
     if (!_unfolded) {
       _fail= true;
       if (_nt > 0 && _rec.GetNrows() == 0) _rec.ResizeTo(_nt);   // need something
@@ -274,17 +349,76 @@ inline
 const TVectorD&          RooUnfold::Vmeasured() const
 {
   // Measured distribution as a vector.
-  if (!_vMes)
-    _vMes= RooUnfoldResponse::H2V  (_meas, _res->GetNbinsMeasured(), _overflow);
+  if (!_vMes) {
+    RooUnfoldTimer t (_timing, RooUnfoldTiming::kConversion, Long64_t(_nm)*sizeof(Double_t));
+    _vMes= RooUnfoldResponse::H2V  (_meas, _res->GetNbinsMeasured(), _overflow, _res->GetPermMeasured());
+  }
   return *_vMes;
 }
 
+inline
+RooUnfoldTiming&         RooUnfold::Timing() const
+{
+  // Per-phase timing and memory use of this object. Only filled after RooUnfoldTiming::Enable().
+  return _timing;
+}
+
+inline
+void RooUnfold::SetCache (RooUnfoldCache* cache)
+{
+  // Read and store results in an on-disk cache (see RooUnfoldCache). The cache is not owned.
+  _cache= cache;
+}
+
+inline
+RooUnfoldCache*          RooUnfold::GetCache() const
+{
+  return _cache;
+}
+
+inline
+void RooUnfold::SetCheckpoint (RooUnfoldCheckpoint* checkpoint)
+{
+  // Periodically save the kCovToy toys, and resume them after a restart (see RooUnfoldCheckpoint).
+  // Also used by RooUnfoldErrors and RooUnfoldParms. The checkpoint is not owned.
+  _checkpoint= checkpoint;
+}
+
+inline
+RooUnfoldCheckpoint*     RooUnfold::GetCheckpoint() const
+{
+  return _checkpoint;
+}
+
+inline
+void RooUnfold::SetProgress (RooUnfoldProgress* progress)
+{
+  // Report the progress of kCovToy toys, and stop them if cancelled or out of time (see RooUnfoldProgress).
+  // Also used by RooUnfoldErrors and RooUnfoldParms. The progress object is not owned.
+  _progress= progress;
+}
+
+inline
+RooUnfoldProgress*       RooUnfold::GetProgress() const
+{
+  return _progress;
+}
+
+inline
+Int_t                    RooUnfold::NToysRun() const
+{
+  // Number of toys used for the kCovToy covariance matrix. Fewer than NToys() if stopped by a RooUnfoldProgress.
+  return _NToysRun;
+}
+
 inline
 const TVectorD&          RooUnfold::Emeasured() const
 {
   // Measured errors as a vector.
-  if (!_eMes)
-    _eMes= RooUnfoldResponse::H2VE (_meas, _res->GetNbinsMeasured(), _overflow);
+  if (!_eMes) {
+    RooUnfoldTimer t (_timing, RooUnfoldTiming::kConversion, Long64_t(_nm)*sizeof(Double_t));
+    _eMes= RooUnfoldResponse::H2VE (_meas, _res->GetNbinsMeasured(), _overflow, _res->GetPermMeasured());
+  }
   return *_eMes;
 }
 
@@ -302,6 +436,23 @@ void  RooUnfold::SetNToys (Int_t toys)
   _NToys= toys;
 }
 
+inline
+Long64_t RooUnfold::GetToySeed() const
+{
+  // Seed for reproducible toys, or -1 if toys use gRandom.
+  return _toySeed;
+}
+
+inline
+void  RooUnfold::SetToySeed (Long64_t seed)
+{
+  // Use RooUnfoldPhilox, keyed by seed, for toys, with toy k always using stream k, so that the
+  // toys (and so kCovToy errors) do not depend on what else used random numbers, nor on the order
+  // in which the toys are run. Use seed=-1 to return to using gRandom.
+  if (seed!=_toySeed) _have_err_mat= kFALSE;
+  _toySeed= seed;
+}
+
 inline
 void  RooUnfold::SetRegParm (Double_t)
 {
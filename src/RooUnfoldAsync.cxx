@@ -0,0 +1,200 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Asynchronous unfolding: a handle to an unfolding running on a shared
+//      thread pool.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>RooUnfold::UnfoldAsync() queues the unfolding, and the error calculation requested, on a pool of
+worker threads shared by all unfolding objects, and returns a RooUnfoldFuture handle at once.
+Many unfoldings can be submitted and then collected, eg.
+<pre>
+  std::vector&lt;RooUnfoldFuture*&gt; jobs;
+  for (Int_t i= 0; i&lt;n; i++) jobs.push_back (unfold[i]-&gt;UnfoldAsync (RooUnfold::kCovariance));
+  for (Int_t i= 0; i&lt;n; i++) {
+    jobs[i]-&gt;Wait();
+    delete jobs[i];
+    TH1* hReco= unfold[i]-&gt;Hreco (RooUnfold::kCovariance);   // no further calculation needed
+    ...
+  }
+</pre>
+An unfolding object must not be used, changed, or deleted until its job has finished.</p>
+<p>The number of threads defaults to the number of CPUs, and can be changed with
+RooUnfoldThreadPool::SetNThreads() before the first job is submitted (0 runs each job synchronously).
+Jobs that use non-thread-safe parts of ROOT (toys using gRandom, algorithms that create histograms,
+such as RooUnfoldSvd and RooUnfoldTUnfold, or the on-disk cache) are run one at a time,
+overlapping only with thread-safe jobs; see RooUnfold::ThreadSafe().</p>
+<p>A job submitted from a worker thread, eg. by RooUnfoldBlocks running on the pool, is run at once in that
+thread. Waiting for it on the pool could deadlock, since the worker may hold the lock a non-thread-safe job
+needs, or be the only worker. After fork() (see RooUnfoldForkPool), the child has none of the worker threads,
+so AfterFork() makes it run every job synchronously.</p>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldAsync.h"
+
+#include "TThread.h"
+#include "TMutex.h"
+#include "TCondition.h"
+#include "TSystem.h"
+
+#include "RooUnfold.h"
+
+RooUnfoldThreadPool* RooUnfoldThreadPool::_instance= 0;
+Int_t                RooUnfoldThreadPool::_nthreads= -1;
+
+//==============================================================================
+// RooUnfoldFuture
+//==============================================================================
+
+RooUnfoldFuture::RooUnfoldFuture (RooUnfold* unfold, Int_t withError)
+  : _unfold(unfold), _withError(withError), _done(false), _ok(false)
+{
+}
+
+RooUnfoldFuture::~RooUnfoldFuture()
+{
+  Wait();
+}
+
+void RooUnfoldFuture::Run()
+{
+  _ok= _unfold->UnfoldWithErrors (RooUnfold::ErrorTreatment(_withError));
+}
+
+Bool_t RooUnfoldFuture::Wait()
+{
+  return RooUnfoldThreadPool::Instance().Wait (this);
+}
+
+Bool_t RooUnfoldFuture::IsReady() const
+{
+  return RooUnfoldThreadPool::Instance().IsDone (this);
+}
+
+//==============================================================================
+// RooUnfoldThreadPool
+//==============================================================================
+
+RooUnfoldThreadPool& RooUnfoldThreadPool::Instance()
+{
+  // Shared pool, started on first use. It lives until the end of the job.
+  if (!_instance) {
+    Int_t n= _nthreads;
+    if (n<0) {
+      SysInfo_t info;
+      n= (gSystem->GetSysInfo (&info) == 0 && info.fCpus > 0) ? info.fCpus : 1;
+    }
+    _instance= new RooUnfoldThreadPool (n);
+  }
+  return *_instance;
+}
+
+void RooUnfoldThreadPool::SetNThreads (Int_t nthreads)
+{
+  // Set number of worker threads. Has no effect once the pool has been started.
+  _nthreads= nthreads;
+}
+
+void RooUnfoldThreadPool::AfterFork()
+{
+  // Only the forking thread survives fork(), so in the child the pool is replaced by one that runs jobs
+  // synchronously. The old pool is left alone, since its locks may be held by threads that no longer exist.
+  _nthreads= 0;
+  if (_instance) _instance= new RooUnfoldThreadPool (0);
+}
+
+Bool_t RooUnfoldThreadPool::OnWorker() const
+{
+  Long_t self= TThread::SelfId();
+  for (size_t i= 0; i<_threads.size(); i++)
+    if (_threads[i]->GetId() == self) return true;
+  return false;
+}
+
+RooUnfoldThreadPool::RooUnfoldThreadPool (Int_t nthreads)
+{
+  TThread::Initialize();  // switch on ROOT's internal locking
+  _mutex=    new TMutex();
+  _serial=   new TMutex(kTRUE);
+  _haveWork= new TCondition (_mutex);
+  _finished= new TCondition (_mutex);
+  for (Int_t i= 0; i<nthreads; i++) {
+    TThread* t= new TThread (&RooUnfoldThreadPool::Worker, this);
+    _threads.push_back (t);
+    t->Run();
+  }
+}
+
+RooUnfoldThreadPool::~RooUnfoldThreadPool()
+{
+  // Never called: the worker threads are left waiting for work until the process exits.
+}
+
+void RooUnfoldThreadPool::Submit (RooUnfoldFuture* job)
+{
+  if (_threads.empty() || OnWorker()) {
+    Execute (job);
+    _mutex->Lock();
+    job->_done= true;
+    _mutex->UnLock();
+    return;
+  }
+  _mutex->Lock();
+  _queue.push_back (job);
+  _haveWork->Signal();
+  _mutex->UnLock();
+}
+
+Bool_t RooUnfoldThreadPool::Wait (RooUnfoldFuture* job)
+{
+  _mutex->Lock();
+  while (!job->_done) _finished->Wait();
+  _mutex->UnLock();
+  return job->_ok;
+}
+
+Bool_t RooUnfoldThreadPool::IsDone (const RooUnfoldFuture* job) const
+{
+  _mutex->Lock();
+  Bool_t done= job->_done;
+  _mutex->UnLock();
+  return done;
+}
+
+void RooUnfoldThreadPool::Execute (RooUnfoldFuture* job)
+{
+  if (job->_unfold->ThreadSafe (RooUnfold::ErrorTreatment(job->_withError))) {
+    job->Run();
+  } else {
+    _serial->Lock();
+    job->Run();
+    _serial->UnLock();
+  }
+}
+
+void* RooUnfoldThreadPool::Worker (void* arg)
+{
+  RooUnfoldThreadPool* pool= static_cast<RooUnfoldThreadPool*>(arg);
+  for (;;) {
+    pool->_mutex->Lock();
+    while (pool->_queue.empty()) pool->_haveWork->Wait();
+    RooUnfoldFuture* job= pool->_queue.front();
+    pool->_queue.pop_front();
+    pool->_mutex->UnLock();
+
+    pool->Execute (job);
+
+    pool->_mutex->Lock();
+    job->_done= true;
+    pool->_finished->Broadcast();
+    pool->_mutex->UnLock();
+  }
+  return 0;
+}
@@ -0,0 +1,101 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Asynchronous unfolding: a handle to an unfolding running on a shared
+//      thread pool.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDASYNC_HH
+#define ROOUNFOLDASYNC_HH
+
+#include <deque>
+#include <vector>
+
+#include "Rtypes.h"
+
+class TThread;
+class TMutex;
+class TCondition;
+class RooUnfold;
+class RooUnfoldThreadPool;
+
+class RooUnfoldFuture {
+  // Handle returned by RooUnfold::UnfoldAsync(). Deleting it waits for the unfolding to finish.
+public:
+  ~RooUnfoldFuture();
+
+  Bool_t     Wait();           // Block until finished. Returns false if the unfolding failed.
+  Bool_t     IsReady() const;  // Finished?
+  RooUnfold* Unfolding() const;
+  Int_t      GetErrorTreatment() const;
+
+private:
+  friend class RooUnfoldThreadPool;
+  friend class RooUnfold;
+  RooUnfoldFuture (RooUnfold* unfold, Int_t withError);
+  RooUnfoldFuture (const RooUnfoldFuture&);             // not copyable
+  RooUnfoldFuture& operator= (const RooUnfoldFuture&);
+  void Run();
+
+  RooUnfold* _unfold;
+  Int_t      _withError;
+  Bool_t     _done;
+  Bool_t     _ok;
+};
+
+
+class RooUnfoldThreadPool {
+  // Worker threads shared by all asynchronous unfoldings.
+public:
+  static RooUnfoldThreadPool& Instance();
+  static void  SetNThreads (Int_t nthreads);  // Before first use. 0 runs jobs synchronously in Submit().
+  static void  AfterFork();                   // Call in a fork()ed child, where the worker threads do not exist
+  Int_t  NThreads() const;
+  Bool_t OnWorker() const;                    // Called from one of the pool's worker threads?
+  void   Submit (RooUnfoldFuture* job);
+  Bool_t Wait   (RooUnfoldFuture* job);
+  Bool_t IsDone (const RooUnfoldFuture* job) const;
+
+private:
+  RooUnfoldThreadPool (Int_t nthreads);
+  ~RooUnfoldThreadPool();
+  RooUnfoldThreadPool (const RooUnfoldThreadPool&);
+  RooUnfoldThreadPool& operator= (const RooUnfoldThreadPool&);
+  static void* Worker (void* arg);
+  void Execute (RooUnfoldFuture* job);
+
+  std::deque<RooUnfoldFuture*> _queue;
+  std::vector<TThread*>        _threads;
+  TMutex*     _mutex;     // protects _queue and the jobs' _done flags
+  TMutex*     _serial;    // held while running jobs that are not thread-safe (recursive, for nested jobs)
+  TCondition* _haveWork;
+  TCondition* _finished;
+
+  static RooUnfoldThreadPool* _instance;
+  static Int_t                _nthreads;
+};
+
+// Inline method definitions
+
+inline
+RooUnfold* RooUnfoldFuture::Unfolding() const
+{
+  return _unfold;
+}
+
+inline
+Int_t RooUnfoldFuture::GetErrorTreatment() const
+{
+  return _withError;
+}
+
+inline
+Int_t RooUnfoldThreadPool::NThreads() const
+{
+  return _threads.size();
+}
+
+#endif
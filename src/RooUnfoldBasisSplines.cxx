@@ -22,6 +22,8 @@
 #include "TDecompSVD.h"
 
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldCache.h"
+#include "RooUnfoldCovariance.h"
 
 using std::cout;
 using std::cerr;
@@ -151,10 +153,15 @@ TH1* RooUnfoldBasisSplines::Hreco( ErrorTreatment withError ) {
     */
   TH1* reco= (TH1*) _res->Htruth()->Clone( GetName() ); 
   reco= reco->Rebin( _nrebin );
-  reco->Reset();
   reco->SetTitle( GetTitle() );
+  return Hreco( reco, withError );
+}
+// Fill an existing histogram, with the rebinned truth binning, in place:
+TH1* RooUnfoldBasisSplines::Hreco( TH1* reco, ErrorTreatment withError ) {
+  reco->Reset();
   if( !UnfoldWithErrors( withError ) ) withError= kNoError;
   if( !_unfolded ) return reco;
+  RooUnfoldTimer timer( _timing, RooUnfoldTiming::kConversion );
   for( Int_t i= 0; i < _nt; i++ ) {
     Int_t j= RooUnfoldResponse::GetBin( reco, i, _overflow );
     reco->SetBinContent( j, _rec(i) );
@@ -170,24 +177,37 @@ TH1* RooUnfoldBasisSplines::Hreco( ErrorTreatment withError ) {
 }
 
 TH1* RooUnfoldBasisSplines::HrecoMeasured() {
-  TH1* hist= (TH1*) _meas->Clone( GetName() );
-  hist->Reset();
+  TH1* hist= (TH1*) Hmeasured()->Clone( GetName() );
   hist->SetTitle( GetTitle() );
-  TVectorD yreco= _resm*_reconstructed;
+  return HrecoMeasured( hist );
+}
+// Fill an existing histogram, with the measured binning, in place:
+TH1* RooUnfoldBasisSplines::HrecoMeasured( TH1* hist ) {
+  hist->Reset();
+  TVectorD yreco;
+  VrecoMeasured( yreco );
+  RooUnfoldTimer timer( _timing, RooUnfoldTiming::kConversion );
   for( Int_t i= 0; i < _nm; i++ ) {
     Int_t j= RooUnfoldResponse::GetBin( hist, i, _overflow );
     hist->SetBinContent( j, yreco(i) );
   }
   return hist;
 }
+// Refolded distribution using the rebinned response:
+TVectorD& RooUnfoldBasisSplines::VrecoMeasured( TVectorD& yreco ) {
+  if( yreco.GetNrows() != _nm ) yreco.ResizeTo( _nm );
+  yreco.Zero();
+  return Add( yreco, 1.0, _resm, _reconstructed );
+}
 
 
 
 
 // Override for measured chi^2:
 Double_t RooUnfoldBasisSplines::Chi2measured() {
-  TVectorD yreco= _resm*_reconstructed;
-  TVectorD delta= _measured - yreco;
+  TVectorD delta;
+  VrecoMeasured( delta );
+  delta-= _measured;
   Double_t chisq= _vinv.Similarity( delta );
   return chisq;
 }
@@ -220,9 +240,17 @@ void RooUnfoldBasisSplines::Unfold() {
   _resm.ResizeTo( nbinm, nbint );
   _resm= _res->Mresponse();
 
-  // Get inverted measured error matrix:
-  TMatrixD covm= GetMeasuredCov();
-  RooUnfold::InvertMatrix( covm, covm );
+  // Get inverted measured error matrix (from the cache if this response and covariance were used before,
+  // unless the errors are uncorrelated, when the inverse is quicker to make than to read):
+  const RooUnfoldCovariance& cov= GetMeasuredCovariance();
+  Bool_t cachecov= _cache && cov.GetType() != RooUnfoldCovariance::kDiagonal;
+  TString covkey;
+  if( cachecov ) covkey= DecompositionKey( "", kTRUE );
+  TMatrixD covm;
+  if( !cachecov || !_cache->Read( covkey, "vinv", covm ) ) {
+    cov.Invert( covm );
+    if( cachecov ) _cache->Write( covkey, "vinv", covm );
+  }
   _vinv.ResizeTo( nbinm, nbinm );
   for( Int_t ibin= 0; ibin < nbinm; ibin++ ) {
     for( Int_t jbin= 0; jbin < nbinm; jbin++ ) {
@@ -272,8 +300,15 @@ void RooUnfoldBasisSplines::Unfold() {
   TMatrixDSym H( _vinv );
   H.SimilarityT( AB );
   TMatrixDSym ABC= H + _tau*C;
-  // Use explicit SVD inversion:
-  TDecompSVD ABCsvd( ABC, _tol );
+  // Use explicit SVD inversion, cached with the settings it depends on:
+  TString svdkey;
+  if( _cache ) svdkey= DecompositionKey( Form( "np=%d nrebin=%d tau=%.17g tol=%.17g",
+                                              np, _nrebin, _tau, _tol ), kTRUE );
+  TDecompSVD ABCsvd;
+  if( !_cache || !_cache->Read( svdkey, "abcsvd", ABCsvd ) ) {
+    ABCsvd= TDecompSVD( ABC, _tol );
+    if( _cache && ABCsvd.Decompose() ) _cache->Write( svdkey, "abcsvd", ABCsvd );
+  }
   TMatrixD ABCsvdinv= ABCsvd.Invert();
   TVectorD s= ABCsvd.GetSig();
   Int_t nrejsvd= 0;
@@ -305,6 +340,26 @@ void RooUnfoldBasisSplines::Unfold() {
   _nt= nbint/_nrebin;
   _cov.ResizeTo( _nt, _nt );
   _cov= covt.Similarity( rbm );
+
+  // Derivatives of the result, rbm*B*p, wrt measured and response:
+  // dt/dA_jk= (B ABCinv B^T)(.,k) s(j) - (B ABCinvh)(.,j) t(k), 
+  // with s= Vinv (measured - AB p):
+  TMatrixD rbmB= rbm*B;
+  _dxdy.ResizeTo( _nt, nbinm );
+  _dxdy= rbmB*ABCinvh;
+  TMatrixD BT( B );
+  BT.T();
+  _dxdAP.ResizeTo( _nt, nbint );
+  _dxdAP= rbmB*ABCinv*BT;
+  _dxdAs.ResizeTo( nbinm );
+  _dxdAs= _measured;
+  Add( _dxdAs, -1.0, AB, p );
+  _dxdAs*= _vinv;
+  _dxdAu.ResizeTo( nbint );
+  _dxdAu= t;
+  // Covariance from response matrix errors added if requested:
+  if( _dosys == 2 ) _cov.Zero();
+  if( _dosys ) AddResponseCov( _dxdAP, _dxdAs, _dxdy, _dxdAu, _res->Eresponse(), _cov );
   _variances.ResizeTo( _nt );
   for( Int_t it= 0; it < _nt; it++ ) {
     _variances(it)= _cov(it,it);
@@ -609,6 +664,10 @@ TVectorD RooUnfoldBasisSplines::makeControlpoints( const TVectorD& bins,
 void RooUnfoldBasisSplines::GetCov() {
   return;
 }
+// Derivatives for error propagation (calculation is done in unfold):
+Bool_t RooUnfoldBasisSplines::GetJacobian() {
+  return _unfolded;
+}
 
 // Get settings (makes superclass happy):
 void RooUnfoldBasisSplines::GetSettings() {
@@ -618,6 +677,11 @@ void RooUnfoldBasisSplines::GetSettings() {
   _defaultparm=0;
 }
 
+// Not cached, because the result is held in the rebinned internal state:
+TString RooUnfoldBasisSplines::CacheSettings() const {
+  return "";
+}
+
 // Matrix of basis splines integrated over bins:
 TMatrixD RooUnfoldBasisSplines::makeBasisSplineMatrix( const TVectorD& bins, 
 						       const TVectorD& cppos ) {
@@ -89,7 +89,10 @@ public:
   virtual void PrintTable( std::ostream& o, const TH1* hTrue, 
 			   ErrorTreatment withError );
   virtual TH1* Hreco( ErrorTreatment withError );
+  virtual TH1* Hreco( TH1* reco, ErrorTreatment withError );
   virtual TH1* HrecoMeasured();
+  virtual TH1* HrecoMeasured( TH1* hist );
+  virtual TVectorD& VrecoMeasured( TVectorD& yreco );
   // Set/get Regularisation Parameter tau:
   virtual void SetRegParm( Double_t tau );
   virtual Double_t GetRegParm() const; 
@@ -100,7 +103,9 @@ protected:
 
   virtual void Unfold();
   virtual void GetCov();
+  virtual Bool_t GetJacobian();
   virtual void GetSettings();
+  virtual TString CacheSettings() const;
 
 private:
 
@@ -18,6 +18,9 @@
 <p>Is able to account for bin migration and smearing
 <p>Can unfold if test and measured distributions have different binning.
 <p>Returns covariance matrices with conditions approximately that of the machine precision. This occasionally leads to very large chi squared values
+<p>For fine binnings, SetMultiLevel() starts the iterations from the result of unfolding with merged bins
+(2, 4, ... adjacent bins merged in each dimension), so fewer iterations are needed with the full binning.
+SetPrior() sets a different starting distribution instead of the MC truth.
 END_HTML */
 
 /////////////////////////////////////////////////////////////
@@ -37,6 +40,8 @@ END_HTML */
 #include "TH2.h"
 
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldCovariance.h"
+#include "core/RooUnfoldCore.h"
 
 using std::min;
 using std::cerr;
@@ -61,7 +66,7 @@ RooUnfoldBayes::RooUnfoldBayes( const RooUnfoldResponse* res,
 				Int_t niter, Bool_t smoothit, Bool_t usechi2,
                                 const char* name, const char* title )
   : RooUnfold (res, meas, name, title), 
-    _niter(niter), _smoothit(smoothit), _usechi2(usechi2)
+    _niter(niter), _smoothit(smoothit), _usechi2(usechi2), _nlevels(0), _niterCoarse(4)
 {
   // Constructor with response matrix object and measured unfolding input histogram.
   // The regularisation parameter is niter (number of iterations).
@@ -99,6 +104,10 @@ void RooUnfoldBayes::CopyData (const RooUnfoldBayes& rhs)
 {
   _niter=    rhs._niter;
   _smoothit= rhs._smoothit;
+  _nlevels=  rhs._nlevels;
+  _niterCoarse= rhs._niterCoarse;
+  _prior.ResizeTo (rhs._prior);
+  _prior=    rhs._prior;
 }
 
 void RooUnfoldBayes::Unfold()
@@ -133,6 +142,12 @@ void RooUnfoldBayes::GetSettings()
     _defaultparm=4;
 }
 
+TString RooUnfoldBayes::CacheSettings() const
+{
+  if (_prior.GetNrows()) return "";   // don't cache results with a user prior
+  return Form ("niter=%d smooth=%d levels=%d citer=%d", _niter, _smoothit, _nlevels, _nlevels ? _niterCoarse : 0);
+}
+
 TMatrixD& RooUnfoldBayes::H2M (const TH2* h, TMatrixD& m, Bool_t overflow)
 {
   // TH2 -> TMatrixD
@@ -182,13 +197,110 @@ void RooUnfoldBayes::setup()
   if (_dosys)    _dnCidPjk.ResizeTo(_nc,_ne*_nc);
 
   // Initial distribution
-  _N0C= _nCi.Sum();
+  TVectorD n0= _nCi;
+  if (_prior.GetNrows()) {
+    if (_prior.GetNrows()!=_nt)
+      cerr << "Warning: RooUnfoldBayes prior has " << _prior.GetNrows() << " bins, but response has " << _nt << ": using MC truth" << endl;
+    else
+      for (Int_t i= 0; i<_nt; i++) n0[i]= _prior[i];
+  }
+  if (_nlevels>0) multiLevel (n0);
+  _N0C= n0.Sum();
   if (_N0C!=0.0) {
-    _P0C= _nCi;
+    _P0C= n0;
     _P0C *= 1.0/_N0C;
   }
 }
 
+//-------------------------------------------------------------------------
+Int_t RooUnfoldBayes::coarseBins (const TH1* h, Int_t n, Bool_t overflow, Int_t level, std::vector<Int_t>& map,
+                                  const Int_t* perm)
+{
+  // Fill map with the bin index, for each vector index 0..n-1, after merging groups of 2^level
+  // adjacent bins in each dimension of h. Returns the number of merged bins.
+  Int_t dims[3]= { n, 1, 1 };
+  Bool_t multi= h && h->GetDimension()>1 && !overflow;
+  if (multi) {
+    dims[0]= h->GetNbinsX();
+    dims[1]= h->GetNbinsY();
+    if (h->GetDimension()>2) dims[2]= h->GetNbinsZ();
+  }
+  Int_t cdims[3];
+  for (Int_t d= 0; d<3; d++) cdims[d]= ((dims[d]-1)>>level) + 1;
+  map.resize (n);
+  for (Int_t i= 0; i<n; i++) {
+    Int_t x= i, y= 0, z= 0;
+    if (multi) {
+      h->GetBinXYZ (RooUnfoldResponse::GetBin (h, i, overflow, perm), x, y, z);
+      x--;
+      y= dims[1]>1 ? y-1 : 0;
+      z= dims[2]>1 ? z-1 : 0;
+    }
+    map[i]= (x>>level) + cdims[0]*((y>>level) + cdims[1]*(z>>level));
+  }
+  return cdims[0]*cdims[1]*cdims[2];
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::multiLevel (TVectorD& n0) const
+{
+  // Replace the starting distribution, n0, with a multilevel prior. The response, measurement, and n0 are
+  // merged into successively coarser bins (2x2x2 per level), and unfolded from the coarsest level down.
+  // Each level's result is shared out within its merged bins in proportion to n0, to give the prior
+  // for the next finer level. The coarse levels are cheap, so the full binning needs fewer iterations.
+  // Note that the errors treat the resulting prior as fixed, as they do the MC truth.
+  Int_t nlev= _nlevels;
+  std::vector< std::vector<Int_t> > tmap (nlev+1), mmap (nlev+1);   // vector index -> level index
+  std::vector<Int_t> ntl (nlev+1), nml (nlev+1);
+  ntl[0]= _nc;
+  nml[0]= _ne;
+  tmap[0].resize (_nc);
+  mmap[0].resize (_ne);
+  for (Int_t i= 0; i<_nc; i++) tmap[0][i]= i;
+  for (Int_t j= 0; j<_ne; j++) mmap[0][j]= j;
+  for (Int_t l= 1; l<=nlev; l++) {
+    ntl[l]= coarseBins (_res->Htruth(),    _nt, _overflow, l, tmap[l], _res->GetPermTruth());
+    nml[l]= coarseBins (_res->Hmeasured(), _nm, _overflow, l, mmap[l], _res->GetPermMeasured());
+    if (_nc>_nt) tmap[l].push_back (ntl[l]++);   // fakes bin stays separate
+    if (ntl[l]>=ntl[l-1] || ntl[l]<2) { nlev= l-1; break; }
+  }
+  if (nlev<1) return;
+
+  TVectorD prior;   // result at level l+1
+  for (Int_t l= nlev; l>=0; l--) {
+    Int_t nc= ntl[l], ne= nml[l];
+    // merged starting distribution, and prior from the coarser level shared out in proportion to it
+    TVectorD start(nc);
+    for (Int_t i= 0; i<_nc; i++) start[tmap[l][i]] += n0[i];
+    if (l<nlev) {
+      std::vector<Int_t> up (nc);
+      for (Int_t i= 0; i<_nc; i++) up[tmap[l][i]]= tmap[l+1][i];
+      TVectorD sum(prior.GetNrows()), count(prior.GetNrows());
+      for (Int_t i= 0; i<nc; i++) {
+        sum  [up[i]] += start[i];
+        count[up[i]] += 1.0;
+      }
+      for (Int_t i= 0; i<nc; i++)
+        start[i]= (sum[up[i]]>0.0) ? prior[up[i]]*start[i]/sum[up[i]] : prior[up[i]]/count[up[i]];
+    }
+    if (l==0) {
+      n0= start;
+      break;
+    }
+    TMatrixD N(ne,nc);
+    TVectorD nC(nc), nE(ne);
+    for (Int_t i= 0; i<_nc; i++) nC[tmap[l][i]] += _nCi[i];
+    for (Int_t j= 0; j<_ne; j++) {
+      nE[mmap[l][j]] += _nEstj[j];
+      for (Int_t i= 0; i<_nc; i++) N(mmap[l][j],tmap[l][i]) += _Nji(j,i);
+    }
+    if (verbose()>=1) cout << "Multilevel prior: unfold " << ne << "x" << nc << " merged bins with " << _niterCoarse << " iterations" << endl;
+    prior.ResizeTo(nc);
+    RooUnfoldCore::Bayes (ne, nc, N.GetMatrixArray(), nC.GetMatrixArray(), nE.GetMatrixArray(), _niterCoarse,
+                          prior.GetMatrixArray(), start.GetMatrixArray());
+  }
+}
+
 //-------------------------------------------------------------------------
 void RooUnfoldBayes::unfold()
 {
@@ -197,18 +309,9 @@ void RooUnfoldBayes::unfold()
   // _smoothit = smooth the matrix in between iterations (default false).
 
   TMatrixD PEjCi(_ne,_nc), PEjCiEff(_ne,_nc);
-  for (Int_t i = 0 ; i < _nc ; i++) {
-    if (_nCi[i] <= 0.0) { _efficiencyCi[i] = 0.0; continue; }
-    Double_t eff = 0.0;
-    for (Int_t j = 0 ; j < _ne ; j++) {
-      Double_t response = _Nji(j,i) / _nCi[i];
-      PEjCi(j,i) = PEjCiEff(j,i) = response;  // efficiency of detecting the cause Ci in Effect Ej
-      eff += response;
-    }
-    _efficiencyCi[i] = eff;
-    Double_t effinv = eff > 0.0 ? 1.0/eff : 0.0;   // reset PEjCiEff if eff=0
-    for (Int_t j = 0 ; j < _ne ; j++) PEjCiEff(j,i) *= effinv;
-  }
+  // efficiency of detecting the cause Ci in Effect Ej
+  RooUnfoldCore::BayesEfficiencies (_ne, _nc, _Nji.GetMatrixArray(), _nCi.GetMatrixArray(),
+                                    PEjCi.GetMatrixArray(), PEjCiEff.GetMatrixArray(), _efficiencyCi.GetMatrixArray());
 
   TVectorD PbarCi(_nc);
 
@@ -222,25 +325,10 @@ void RooUnfoldBayes::unfold()
       _N0C = _nbartrue;
     }
 
-    for (Int_t j = 0 ; j < _ne ; j++) {
-      Double_t Uj = 0.0;
-      for (Int_t i = 0 ; i < _nc ; i++)
-        Uj += PEjCi(j,i) * _P0C[i];
-      _UjInv[j] = Uj > 0.0 ? 1.0/Uj : 0.0;
-    }
-
-    // Unfolding matrix M
-    _nbartrue = 0.0;
-    for (Int_t i = 0 ; i < _nc ; i++) {
-      Double_t nbarC = 0.0;
-      for (Int_t j = 0 ; j < _ne ; j++) {
-        Double_t Mij = _UjInv[j] * PEjCiEff(j,i) * _P0C[i];
-        _Mij(i,j) = Mij;
-        nbarC += Mij * _nEstj[j];
-      }
-      _nbarCi[i] = nbarC;
-      _nbartrue += nbarC;  // best estimate of true number of events
-    }
+    // Unfolding matrix M and best estimate of true number of events
+    _nbartrue= RooUnfoldCore::BayesStep (_ne, _nc, PEjCi.GetMatrixArray(), PEjCiEff.GetMatrixArray(),
+                                         _P0C.GetMatrixArray(), _nEstj.GetMatrixArray(),
+                                         _UjInv.GetMatrixArray(), _Mij.GetMatrixArray(), _nbarCi.GetMatrixArray());
 
     // new estimate of true distribution
     PbarCi= _nbarCi;
@@ -362,7 +450,7 @@ void RooUnfoldBayes::getCovariance()
     const TMatrixD& Dprop= _dnCidnEj;
 #endif
     if (_haveCovMes) {
-      ABAT (Dprop, GetMeasuredCov(), _cov);
+      ABAT (Dprop, GetMeasuredCovariance(), _cov);
     } else {
       TVectorD v= Emeasured();
       v.Sqr();
@@ -12,6 +12,8 @@
 #ifndef ROOUNFOLDBAYES_HH
 #define ROOUNFOLDBAYES_HH
 
+#include <vector>
+
 #include "RooUnfold.h"
 
 #include "TVectorD.h"
@@ -42,8 +44,12 @@ public:
 
   void SetIterations (Int_t niter= 4);
   void SetSmoothing  (Bool_t smoothit= false);
+  void SetMultiLevel (Int_t nlevels= 2, Int_t niterCoarse= 4);  // coarse-to-fine prior: 0 to disable
+  void SetPrior      (const TVectorD& prior);  // starting truth distribution: empty vector for the MC truth
   Int_t GetIterations() const;
   Int_t GetSmoothing()  const;
+  Int_t GetMultiLevel() const;
+  const TVectorD& GetPrior() const;
   const TMatrixD& UnfoldingMatrix() const;
 
   virtual void  SetRegParm (Double_t parm);
@@ -58,8 +64,10 @@ protected:
   virtual void Unfold();
   virtual void GetCov();
   virtual void GetSettings();
+  virtual TString CacheSettings() const;
 
   void setup();
+  void multiLevel (TVectorD& n0) const;
   void unfold();
   void getCovariance();
 
@@ -71,12 +79,16 @@ protected:
 private:
   void Init();
   void CopyData (const RooUnfoldBayes& rhs);
+  static Int_t coarseBins (const TH1* h, Int_t n, Bool_t overflow, Int_t level, std::vector<Int_t>& map, const Int_t* perm= 0);
 
 protected:
   // instance variables
   Int_t _niter;
   Int_t _smoothit;
   Bool_t _usechi2;
+  Int_t _nlevels;         // number of coarser levels for the multilevel prior
+  Int_t _niterCoarse;     // iterations at each coarse level
+  TVectorD _prior;        // user-supplied starting truth distribution
 
   Int_t _nc;              // number of causes  (same as _nt)
   Int_t _ne;              // number of effects (same as _nm)
@@ -98,14 +110,14 @@ protected:
   TMatrixD _dnCidPjk;     // response error propagation matrix (stack j,k into each column)
 
 public:
-  ClassDef (RooUnfoldBayes, 1) // Bayesian Unfolding
+  ClassDef (RooUnfoldBayes, 2) // Bayesian Unfolding
 };
 
 // Inline method definitions
 
 inline
 RooUnfoldBayes::RooUnfoldBayes()
-  : RooUnfold()
+  : RooUnfold(), _nlevels(0), _niterCoarse(4)
 {
   // Default constructor. Use Setup() to prepare for unfolding.
   Init();
@@ -113,7 +125,7 @@ RooUnfoldBayes::RooUnfoldBayes()
 
 inline
 RooUnfoldBayes::RooUnfoldBayes (const char* name, const char* title)
-  : RooUnfold(name,title)
+  : RooUnfold(name,title), _nlevels(0), _niterCoarse(4)
 {
   // Basic named constructor. Use Setup() to prepare for unfolding.
   Init();
@@ -121,7 +133,7 @@ RooUnfoldBayes::RooUnfoldBayes (const char* name, const char* title)
 
 inline
 RooUnfoldBayes::RooUnfoldBayes (const TString& name, const TString& title)
-  : RooUnfold(name,title)
+  : RooUnfold(name,title), _nlevels(0), _niterCoarse(4)
 {
   // Basic named constructor. Use Setup() to prepare for unfolding.
   Init();
@@ -150,6 +162,37 @@ void RooUnfoldBayes::SetSmoothing (Bool_t smoothit)
   _smoothit= smoothit;
 }
 
+inline
+void RooUnfoldBayes::SetMultiLevel (Int_t nlevels, Int_t niterCoarse)
+{
+  // Start from the result of unfolding with bins merged 2^nlevels, 2^(nlevels-1), ... 2 at a time
+  // in each dimension, running niterCoarse iterations at each coarse level.
+  _nlevels= nlevels;
+  _niterCoarse= niterCoarse;
+}
+
+inline
+void RooUnfoldBayes::SetPrior (const TVectorD& prior)
+{
+  // Set the starting (prior) truth distribution, instead of the MC truth. Only its shape is used.
+  _prior.ResizeTo (prior);
+  _prior= prior;
+}
+
+inline
+Int_t RooUnfoldBayes::GetMultiLevel() const
+{
+  // Return number of coarse levels used for the multilevel prior
+  return _nlevels;
+}
+
+inline
+const TVectorD& RooUnfoldBayes::GetPrior() const
+{
+  // Return user-supplied prior (empty if the MC truth is used)
+  return _prior;
+}
+
 inline
 Int_t RooUnfoldBayes::GetIterations() const
 {
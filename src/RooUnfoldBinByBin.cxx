@@ -26,6 +26,8 @@ END_HTML */
 #include "TH2.h"
 
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldCovariance.h"
+#include "core/RooUnfoldCore.h"
 
 ClassImp (RooUnfoldBinByBin);
 
@@ -82,25 +84,31 @@ RooUnfoldBinByBin::Unfold()
     _rec.ResizeTo(_nt);
     _factors.ResizeTo(_nt);
     Int_t nb= _nm < _nt ? _nm : _nt;
-    for (int i=0; i<nb; i++) {
-      Double_t train= vtrain[i]-fakes[i];
-      if (train==0.0) continue;
-      Double_t c= vtruth[i]/train;
-      _factors[i]= c;
-      _rec[i]= c * (vmeas[i]-fac*fakes[i]);
-    }
+    RooUnfoldCore::BinByBin (nb, vtruth.GetMatrixArray(), vtrain.GetMatrixArray(), fakes.GetMatrixArray(),
+                             vmeas.GetMatrixArray(), fac, _factors.GetMatrixArray(), _rec.GetMatrixArray());
     _unfolded= true;
 }
 
 void
 RooUnfoldBinByBin::GetCov()
 {
-    const TMatrixD& covmeas= GetMeasuredCov();
+    // V_reco(i,j) = f_i f_j V_meas(i,j), from the measurement covariance in its own form, so an uncorrelated
+    // measurement only needs the diagonal.
+    const RooUnfoldCovariance& covmeas= GetMeasuredCovariance();
     _cov.ResizeTo(_nt,_nt);
     Int_t nb= _nm < _nt ? _nm : _nt;
-    for (int i=0; i<nb; i++)
-      for (int j=0; j<nb; j++)
-        _cov(i,j)= _factors[i]*_factors[j]*covmeas(i,j);
+    if (covmeas.GetType()==RooUnfoldCovariance::kDense && nb==_nt && nb==covmeas.GetN())
+      RooUnfoldCore::BinByBinCov (nb, _factors.GetMatrixArray(), covmeas.GetFactors().GetMatrixArray(), _cov.GetMatrixArray());
+    else if (covmeas.GetType()==RooUnfoldCovariance::kDiagonal) {
+      _cov.Zero();
+      const TVectorD& d= covmeas.GetDiagonal();
+      for (int i=0; i<nb; i++)
+        _cov(i,i)= _factors[i]*_factors[i]*d[i];
+    } else {
+      for (int i=0; i<nb; i++)
+        for (int j=0; j<nb; j++)
+          _cov(i,j)= _factors[i]*_factors[j]*covmeas(i,j);
+    }
     _haveCov= true;
 }
 
@@ -0,0 +1,272 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Unfolding of block-diagonal responses: splits the problem into the
+//      independent blocks found by RooUnfoldResponse::FindBlocks(), unfolds
+//      each in parallel with any RooUnfold algorithm, and combines the results.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>Many multi-dimensional responses have no migrations between some groups of bins (eg. between
+slices in one variable), so the response matrix is block-diagonal after reordering the bins.
+RooUnfoldBlocks finds these blocks (the connected components of the migration graph, using
+RooUnfoldResponse::FindBlocks()) and unfolds each as a separate problem, with the algorithm and settings of
+the unfolding object it is given. The blocks are unfolded at the same time on the RooUnfoldAsync thread pool.
+The results and (block-diagonal) covariance matrices are combined into the full binning. For k equal blocks,
+this reduces the time for an O(n<sup>3</sup>) algorithm by k<sup>2</sup>, even before running in parallel.</p>
+<pre>
+  RooUnfoldBayes   bayes  (&amp;response, hMeas, 4);
+  RooUnfoldBlocks  unfold (&amp;bayes);
+  TH1* hReco= unfold.Hreco();
+</pre>
+<p>Notes:</p>
+<ul>
+<li>The same regularisation parameter is used for each block.
+<li>Truth bins that are never reconstructed, and measured bins that are pure fakes, are not part of any block.
+The former are unfolded as 0.
+<li>Any measurement covariance between blocks is ignored. Set a measurement covariance with SetMeasuredCov()
+on the RooUnfoldBlocks object, not on the unfolding object it was constructed from.
+<li>The blocks themselves use the thread pool. If RooUnfoldBlocks itself runs on the pool (UnfoldAsync()),
+or in a RooUnfoldForkPool worker, the blocks are unfolded one after the other in that thread.
+</ul>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldBlocks.h"
+
+#include <iostream>
+
+#include "TH1.h"
+#include "TVectorD.h"
+#include "TMatrixD.h"
+
+#include "RooUnfoldResponse.h"
+#include "RooUnfoldCovariance.h"
+#include "RooUnfoldAsync.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+ClassImp (RooUnfoldBlocks);
+
+RooUnfoldBlocks::RooUnfoldBlocks (const RooUnfoldBlocks& rhs)
+  : RooUnfold (rhs), _proto(0)
+{
+  // Copy constructor.
+  Init();
+  CopyData (rhs);
+}
+
+RooUnfoldBlocks::RooUnfoldBlocks (const RooUnfold* unfold, const char* name, const char* title)
+  : RooUnfold (unfold->response(), unfold->Hmeasured(), name, title), _proto(0)
+{
+  // Constructor using the response, measured distribution, algorithm and settings of unfold.
+  Init();
+  SetUnfolding (unfold);
+  SetVerbose (unfold->verbose());
+  IncludeSystematics (unfold->SystematicsIncluded());
+  SetNToys (unfold->NToys());
+  SetToySeed (unfold->GetToySeed());
+}
+
+RooUnfoldBlocks*
+RooUnfoldBlocks::Clone (const char* newname) const
+{
+  RooUnfoldBlocks* unfold= new RooUnfoldBlocks(*this);
+  if (newname && strlen(newname)) unfold->SetName(newname);
+  return unfold;
+}
+
+void
+RooUnfoldBlocks::Init()
+{
+  GetSettings();
+}
+
+void
+RooUnfoldBlocks::DestroyBlocks()
+{
+  for (size_t b= 0; b<_blocks.size(); b++) delete _blocks[b];
+  _blocks.clear();
+  _mbins.clear();
+  _tbins.clear();
+}
+
+void
+RooUnfoldBlocks::Destroy()
+{
+  DestroyBlocks();
+  delete _proto; _proto= 0;
+}
+
+void
+RooUnfoldBlocks::Reset()
+{
+  // Keeps the algorithm set with SetUnfolding().
+  DestroyBlocks();
+  Init();
+  RooUnfold::Reset();
+}
+
+void
+RooUnfoldBlocks::Assign (const RooUnfoldBlocks& rhs)
+{
+  RooUnfold::Assign (rhs);
+  CopyData (rhs);
+}
+
+void
+RooUnfoldBlocks::CopyData (const RooUnfoldBlocks& rhs)
+{
+  SetUnfolding (rhs._proto);
+}
+
+void
+RooUnfoldBlocks::SetUnfolding (const RooUnfold* unfold)
+{
+  // Set the unfolding algorithm and settings to use for each block. unfold is copied, so can be deleted afterwards.
+  DestroyBlocks();
+  delete _proto;
+  _proto= unfold ? unfold->Clone() : 0;
+  GetSettings();
+}
+
+void
+RooUnfoldBlocks::SetRegParm (Double_t parm)
+{
+  // Set regularisation parameter used for every block
+  if (_proto) _proto->SetRegParm (parm);
+}
+
+Double_t
+RooUnfoldBlocks::GetRegParm() const
+{
+  // Return regularisation parameter used for every block
+  return _proto ? _proto->GetRegParm() : -1.0;
+}
+
+Bool_t
+RooUnfoldBlocks::ThreadSafe (ErrorTreatment) const
+{
+  // Creates histograms for the block responses. On a pool worker, the blocks are run in the same thread
+  // (see RooUnfoldThreadPool::Submit), so holding the pool's serial lock does not stop them.
+  return false;
+}
+
+void
+RooUnfoldBlocks::Unfold()
+{
+  DestroyBlocks();
+  if (!_proto) {
+    cerr << "Warning: RooUnfoldBlocks has no unfolding algorithm: use SetUnfolding()" << endl;
+    return;
+  }
+
+  std::vector<Int_t> mblock, tblock;
+  Int_t nb= _res->FindBlocks (mblock, tblock);
+  _mbins.resize (nb);
+  _tbins.resize (nb);
+  for (Int_t i= 0; i<_nm; i++) if (mblock[i]>=0) _mbins[mblock[i]].push_back (i);
+  for (Int_t j= 0; j<_nt; j++) if (tblock[j]>=0) _tbins[tblock[j]].push_back (j);
+  if (_verbose>=1) {
+    cout << "RooUnfoldBlocks: " << _nm << "x" << _nt << " response has " << nb << " independent blocks:";
+    for (Int_t b= 0; b<nb; b++) cout << " " << _mbins[b].size() << "x" << _tbins[b].size();
+    cout << endl;
+  }
+
+  // Each block gets its slice of the measurement covariance, keeping its diagonal or low-rank structure,
+  // or just the errors if no covariance was given.
+  const TVectorD& meas= Vmeasured();
+  const TVectorD& err=  Emeasured();
+  for (Int_t b= 0; b<nb; b++) {
+    const std::vector<Int_t>& mb= _mbins[b];
+    Int_t nmb= mb.size();
+    TVectorD vb(nmb), eb(nmb);
+    for (Int_t i= 0; i<nmb; i++) {
+      vb[i]= meas[mb[i]];
+      eb[i]= err [mb[i]];
+    }
+    TString name= Form ("%s_block%d", GetName(), b);
+    RooUnfold* unfold= _proto->Clone (name);
+    unfold->SetResponse (_res->BlockResponse (mb, _tbins[b], name+"_response"), kTRUE);
+    if (_haveCovMes) {
+      RooUnfoldCovariance cb;
+      unfold->SetMeasuredCov (cb.SetSlice (GetMeasuredCovariance(), mb));
+      unfold->SetMeasured (vb, unfold->Emeasured());
+    } else
+      unfold->SetMeasured (vb, eb);
+    unfold->SetVerbose (_verbose-1);
+    unfold->IncludeSystematics (_dosys);
+    unfold->SetNToys (_NToys);
+    _blocks.push_back (unfold);
+  }
+  if (!RunBlocks (kNoError)) return;
+
+  _rec.ResizeTo (_nt);
+  _rec.Zero();
+  for (Int_t b= 0; b<nb; b++) {
+    const TVectorD& rb= _blocks[b]->Vreco();
+    for (size_t k= 0; k<_tbins[b].size(); k++) _rec[_tbins[b][k]]= rb[k];
+  }
+  _unfolded= true;
+  _haveCov=  false;
+}
+
+void
+RooUnfoldBlocks::GetCov()
+{
+  if (!RunBlocks (kCovariance)) return;
+  _cov.ResizeTo (_nt, _nt);
+  _cov.Zero();
+  for (size_t b= 0; b<_blocks.size(); b++) {
+    const TMatrixD& cb= _blocks[b]->ErecoRef (kCovariance);
+    const std::vector<Int_t>& tb= _tbins[b];
+    for (size_t k= 0; k<tb.size(); k++)
+      for (size_t l= 0; l<tb.size(); l++) _cov(tb[k],tb[l])= cb(k,l);
+  }
+  _haveCov= true;
+}
+
+Bool_t
+RooUnfoldBlocks::RunBlocks (ErrorTreatment withError)
+{
+  // Unfold all blocks, with errors, on the thread pool, and wait for them to finish. On a pool worker, or in a
+  // RooUnfoldForkPool worker, they are unfolded one after the other in this thread (see RooUnfoldThreadPool::Submit).
+  std::vector<RooUnfoldFuture*> jobs (_blocks.size());
+  for (size_t b= 0; b<_blocks.size(); b++) jobs[b]= _blocks[b]->UnfoldAsync (withError);
+  Bool_t ok= true;
+  for (size_t b= 0; b<_blocks.size(); b++) {
+    if (!jobs[b]->Wait()) {
+      cerr << "Warning: RooUnfoldBlocks unfolding of block " << b << " failed" << endl;
+      ok= false;
+    }
+    delete jobs[b];
+  }
+  return ok;
+}
+
+void
+RooUnfoldBlocks::GetSettings()
+{
+  if (_proto) {
+    _minparm=      _proto->GetMinParm();
+    _maxparm=      _proto->GetMaxParm();
+    _stepsizeparm= _proto->GetStepSizeParm();
+    _defaultparm=  _proto->GetDefaultParm();
+  } else {
+    _minparm= _maxparm= _stepsizeparm= _defaultparm= 0;
+  }
+}
+
+TString
+RooUnfoldBlocks::CacheSettings() const
+{
+  // The combined result is not cached (the blocks may be).
+  return "";
+}
@@ -0,0 +1,138 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Unfolding of block-diagonal responses: splits the problem into the
+//      independent blocks found by RooUnfoldResponse::FindBlocks(), unfolds
+//      each in parallel with any RooUnfold algorithm, and combines the results.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDBLOCKS_H_
+#define ROOUNFOLDBLOCKS_H_
+
+#include <vector>
+
+#include "RooUnfold.h"
+
+class RooUnfoldResponse;
+class TH1;
+
+class RooUnfoldBlocks : public RooUnfold {
+
+public:
+  RooUnfoldBlocks(); // default constructor
+  RooUnfoldBlocks (const char*    name, const char*    title); // named constructor
+  RooUnfoldBlocks (const TString& name, const TString& title); // named constructor
+  RooUnfoldBlocks (const RooUnfoldBlocks& rhs); // copy constructor
+  virtual ~RooUnfoldBlocks(); // destructor
+  RooUnfoldBlocks& operator= (const RooUnfoldBlocks& rhs); // assignment operator
+  virtual RooUnfoldBlocks* Clone (const char* newname= 0) const;
+  RooUnfoldBlocks (const RooUnfold* unfold, const char* name= 0, const char* title= 0);
+
+  virtual void Reset();
+  void SetUnfolding (const RooUnfold* unfold);  // algorithm and settings to use for each block (copied)
+  const RooUnfold* GetUnfolding() const;
+  Int_t      NBlocks() const;        // number of blocks found by the last unfolding
+  RooUnfold* Block (Int_t b) const;  // unfolding of block b
+  const std::vector<Int_t>& BlockTruthBins (Int_t b) const;  // truth vector indices in block b
+
+  virtual void     SetRegParm (Double_t parm);
+  virtual Double_t GetRegParm() const;
+  virtual Bool_t   ThreadSafe (ErrorTreatment withError=kErrors) const;
+
+protected:
+  virtual void Unfold();
+  virtual void GetCov();
+  virtual void GetSettings();
+  virtual TString CacheSettings() const;
+  void Assign   (const RooUnfoldBlocks& rhs); // implementation of assignment operator
+  void CopyData (const RooUnfoldBlocks& rhs);
+
+private:
+  void Init();
+  void Destroy();
+  void DestroyBlocks();
+  Bool_t RunBlocks (ErrorTreatment withError);
+
+protected:
+  // instance variables
+  RooUnfold* _proto;                               // unfolding algorithm and settings used for each block
+  std::vector<RooUnfold*> _blocks;                 //! unfolding of each block
+  std::vector< std::vector<Int_t> > _mbins;        //! measured vector indices of each block
+  std::vector< std::vector<Int_t> > _tbins;        //! truth vector indices of each block
+
+public:
+  ClassDef (RooUnfoldBlocks, 1)  // Unfolding of independent blocks of the response
+};
+
+// Inline method definitions
+
+inline
+RooUnfoldBlocks::RooUnfoldBlocks()
+  : RooUnfold(), _proto(0)
+{
+  // Default constructor. Use SetUnfolding() and Setup() to prepare for unfolding.
+  Init();
+}
+
+inline
+RooUnfoldBlocks::RooUnfoldBlocks (const char* name, const char* title)
+  : RooUnfold(name,title), _proto(0)
+{
+  // Basic named constructor. Use SetUnfolding() and Setup() to prepare for unfolding.
+  Init();
+}
+
+inline
+RooUnfoldBlocks::RooUnfoldBlocks (const TString& name, const TString& title)
+  : RooUnfold(name,title), _proto(0)
+{
+  // Basic named constructor. Use SetUnfolding() and Setup() to prepare for unfolding.
+  Init();
+}
+
+inline
+RooUnfoldBlocks& RooUnfoldBlocks::operator= (const RooUnfoldBlocks& rhs)
+{
+  // Assignment operator for copying RooUnfoldBlocks settings.
+  Assign(rhs);
+  return *this;
+}
+
+inline
+RooUnfoldBlocks::~RooUnfoldBlocks()
+{
+  Destroy();
+}
+
+inline
+const RooUnfold* RooUnfoldBlocks::GetUnfolding() const
+{
+  // Unfolding algorithm and settings used for each block
+  return _proto;
+}
+
+inline
+Int_t RooUnfoldBlocks::NBlocks() const
+{
+  // Number of independent blocks found by the last unfolding
+  return _blocks.size();
+}
+
+inline
+RooUnfold* RooUnfoldBlocks::Block (Int_t b) const
+{
+  // Unfolding object for block b, 0..NBlocks()-1
+  return _blocks[b];
+}
+
+inline
+const std::vector<Int_t>& RooUnfoldBlocks::BlockTruthBins (Int_t b) const
+{
+  // Truth vector indices of block b, ie. where its results go in Vreco()
+  return _tbins[b];
+}
+
+#endif /*ROOUNFOLDBLOCKS_H_*/
@@ -0,0 +1,379 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Unfolding class using Tikhonov regularisation, solved iteratively with
+//      CGLS (conjugate gradients for least squares) on a sparse response matrix.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>Tikhonov-regularised unfolding for large, sparse response matrices. The unfolded distribution, x, minimises</p>
+<pre>
+  (y-Rx)<sup>T</sup> W (y-Rx) + tau |Lx|<sup>2</sup>
+</pre>
+<p>where y is the measured distribution (with fakes subtracted), R the response matrix, W the inverse of the
+measurement variances, and L a regularisation condition (size, first derivative, or curvature of the
+truth vector, as in TUnfold). Unlike RooUnfoldTUnfold and RooUnfoldSvd, the solution is found with
+CGLS, a conjugate gradient method that only needs products of the response matrix and its transpose with
+a vector. The response matrix is held in sparse (compressed row) form, so the memory and time needed
+scale with the number of non-zero elements, rather than with the number of measured times truth bins.</p>
+<p>The regularisation parameter is tau (SetRegParm). tau=0 gives the unregularised least-squares solution
+(the minimum norm solution if it is not unique), as for RooUnfoldInvert.
+Iteration stops when the residual of the normal equations falls below SetTolerance() (default 1e-6)
+times its initial value, or after SetMaxIterations() (default 1000) iterations.</p>
+<p>The kCovariance errors are found by solving for each column of the unfolding matrix, which needs one
+solution per measured bin (and one per truth bin to include systematic errors from the response), and
+the covariance matrix itself is dense. For very large problems use kCovToy or kNoError instead.</p>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldCGLS.h"
+
+#include <iostream>
+#include <cmath>
+
+#include "TH1.h"
+#include "TVectorD.h"
+#include "TMatrixD.h"
+
+#include "RooUnfoldResponse.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+ClassImp (RooUnfoldCGLS);
+
+RooUnfoldCGLS::RooUnfoldCGLS (const RooUnfoldCGLS& rhs)
+  : RooUnfold (rhs)
+{
+  // Copy constructor.
+  Init();
+  CopyData (rhs);
+}
+
+RooUnfoldCGLS::RooUnfoldCGLS (const RooUnfoldResponse* res, const TH1* meas, Double_t tau, RegMode reg,
+                              const char* name, const char* title)
+  : RooUnfold (res, meas, name, title), _tau(tau), _reg(reg), _maxiter(1000), _tol(1e-6)
+{
+  // Constructor with response matrix object and measured unfolding input histogram.
+  // The regularisation parameter is tau.
+  Init();
+}
+
+RooUnfoldCGLS*
+RooUnfoldCGLS::Clone (const char* newname) const
+{
+  RooUnfoldCGLS* unfold= new RooUnfoldCGLS(*this);
+  if (newname && strlen(newname)) unfold->SetName(newname);
+  return unfold;
+}
+
+void
+RooUnfoldCGLS::Init()
+{
+  _A= 0;
+  _niter= 0;
+  GetSettings();
+}
+
+void
+RooUnfoldCGLS::Destroy()
+{
+  delete _A;
+}
+
+void
+RooUnfoldCGLS::Reset()
+{
+  Destroy();
+  Init();
+  RooUnfold::Reset();
+}
+
+void
+RooUnfoldCGLS::Assign (const RooUnfoldCGLS& rhs)
+{
+  RooUnfold::Assign (rhs);
+  CopyData (rhs);
+}
+
+void
+RooUnfoldCGLS::CopyData (const RooUnfoldCGLS& rhs)
+{
+  _tau=     rhs._tau;
+  _reg=     rhs._reg;
+  _maxiter= rhs._maxiter;
+  _tol=     rhs._tol;
+}
+
+const TMatrixDSparse*
+RooUnfoldCGLS::Impl()
+{
+  // Return the weighted response matrix, W^1/2 R, used for the last unfolding.
+  return _A;
+}
+
+void
+RooUnfoldCGLS::Unfold()
+{
+  if (!SetupResponse()) return;
+
+  TVectorD b= Vmeasured();
+  _res->SubtractFakes (b, b.Sum(), _verbose);
+  for (Int_t i= 0; i<_nm; i++) b[i] *= _w12[i];
+
+  _niter= SolveLS (b, _rec);
+  if (_niter<0) {
+    cerr << "Warning: RooUnfoldCGLS did not converge after " << _maxiter << " iterations" << endl;
+    _niter= _maxiter;
+  } else if (_verbose>=1)
+    cout << "RooUnfoldCGLS converged after " << _niter << " iterations" << endl;
+
+  _unfolded= true;
+  _haveCov=  false;
+}
+
+Bool_t
+RooUnfoldCGLS::SetupResponse()
+{
+  // Fill the sparse weighted response matrix directly from the response histogram, skipping
+  // empty bins, without creating the dense RooUnfoldResponse::Mresponse().
+  delete _A; _A= 0;
+  const TVectorD& err= Emeasured();
+  _w12.ResizeTo (_nm);
+  for (Int_t i= 0; i<_nm; i++) _w12[i]= (err[i]>0.0) ? 1.0/err[i] : 1.0;
+  _A= _res->MresponseSparse (&_w12);
+  if (!_A) {
+    cerr << "Warning: RooUnfoldCGLS response matrix is empty" << endl;
+    return false;
+  }
+  if (_verbose>=1) cout << "RooUnfoldCGLS response matrix has " << _A->NonZeros() << " non-zero elements out of "
+                        << _nm << "x" << _nt << endl;
+  return true;
+}
+
+Int_t
+RooUnfoldCGLS::NReg() const
+{
+  // Number of regularisation conditions
+  if (_tau<=0.0) return 0;
+  switch (_reg) {
+    case kRegModeSize:       return _nt;
+    case kRegModeDerivative: return _nt>1 ? _nt-1 : 0;
+    case kRegModeCurvature:  return _nt>2 ? _nt-2 : 0;
+    default:                 return 0;
+  }
+}
+
+void
+RooUnfoldCGLS::Mult (const TVectorD& x, TVectorD& y) const
+{
+  RooUnfoldResponse::SparseMult (*_A, x, y);
+}
+
+void
+RooUnfoldCGLS::MultT (const TVectorD& y, TVectorD& x) const
+{
+  RooUnfoldResponse::SparseMultT (*_A, y, x);
+}
+
+void
+RooUnfoldCGLS::RegMult (const TVectorD& x, TVectorD& y) const
+{
+  // Differences are between neighbouring truth bins in the natural order, even if the response uses
+  // another bin order (RooUnfoldResponse::SetBinOrder).
+  Int_t nr= NReg();
+  if (_res->GetPermTruth()) {
+    for (Int_t i= 0; i<nr; i++) {
+      Int_t a= _res->VectorIndexTruth(i), b= _res->VectorIndexTruth(i+1), c= _res->VectorIndexTruth(i+2);
+      switch (_reg) {
+        case kRegModeSize:       y[i]= x[a];                    break;
+        case kRegModeDerivative: y[i]= x[b] - x[a];             break;
+        case kRegModeCurvature:  y[i]= x[a] - 2.0*x[b] + x[c];  break;
+      }
+    }
+    return;
+  }
+  switch (_reg) {
+    case kRegModeSize:
+      for (Int_t i= 0; i<nr; i++) y[i]= x[i];
+      break;
+    case kRegModeDerivative:
+      for (Int_t i= 0; i<nr; i++) y[i]= x[i+1] - x[i];
+      break;
+    case kRegModeCurvature:
+      for (Int_t i= 0; i<nr; i++) y[i]= x[i] - 2.0*x[i+1] + x[i+2];
+      break;
+  }
+}
+
+void
+RooUnfoldCGLS::RegMultT (const TVectorD& y, TVectorD& x) const
+{
+  Int_t nr= NReg();
+  if (_res->GetPermTruth()) {
+    for (Int_t i= 0; i<nr; i++) {
+      Int_t a= _res->VectorIndexTruth(i), b= _res->VectorIndexTruth(i+1), c= _res->VectorIndexTruth(i+2);
+      switch (_reg) {
+        case kRegModeSize:       x[a] += y[i];                                   break;
+        case kRegModeDerivative: x[a] -= y[i]; x[b] += y[i];                     break;
+        case kRegModeCurvature:  x[a] += y[i]; x[b] -= 2.0*y[i]; x[c] += y[i];   break;
+      }
+    }
+    return;
+  }
+  switch (_reg) {
+    case kRegModeSize:
+      for (Int_t i= 0; i<nr; i++) x[i] += y[i];
+      break;
+    case kRegModeDerivative:
+      for (Int_t i= 0; i<nr; i++) { x[i] -= y[i]; x[i+1] += y[i]; }
+      break;
+    case kRegModeCurvature:
+      for (Int_t i= 0; i<nr; i++) { x[i] += y[i]; x[i+1] -= 2.0*y[i]; x[i+2] += y[i]; }
+      break;
+  }
+}
+
+Int_t
+RooUnfoldCGLS::SolveLS (const TVectorD& b, TVectorD& x) const
+{
+  // CGLS for min |Ax-b|^2 + tau |Lx|^2, ie. least squares on the stacked system [A; sqrt(tau) L] x = [b; 0],
+  // starting from x=0. Returns the number of iterations, or -1 if not converged.
+  Int_t nr= NReg();
+  Double_t sqtau= nr>0 ? sqrt(_tau) : 0.0;
+  x.ResizeTo (_nt);
+  x.Zero();
+  TVectorD r(b), q(_nm), s(_nt), p(_nt);
+  TVectorD rl(nr), ql(nr);   // regularisation part of the residual, -sqrt(tau) L x
+  MultT (r, s);
+  p= s;
+  Double_t gamma= s.Norm2Sqr(), stop= _tol*_tol*gamma;
+  if (gamma==0.0) return 0;
+  for (Int_t it= 1; it<=_maxiter; it++) {
+    Mult (p, q);
+    Double_t delta= q.Norm2Sqr();
+    if (nr>0) {
+      RegMult (p, ql);
+      ql *= sqtau;
+      delta += ql.Norm2Sqr();
+    }
+    if (delta<=0.0) return it;
+    Double_t alpha= gamma/delta;
+    Add (x,  alpha, p);
+    Add (r, -alpha, q);
+    MultT (r, s);
+    if (nr>0) {
+      Add (rl, -alpha, ql);
+      TVectorD t= rl;
+      t *= sqtau;
+      RegMultT (t, s);
+    }
+    Double_t gnew= s.Norm2Sqr();
+    if (gnew<=stop) return it;
+    Double_t beta= gnew/gamma;
+    gamma= gnew;
+    p *= beta;
+    p += s;
+  }
+  return -1;
+}
+
+Int_t
+RooUnfoldCGLS::SolveNormal (const TVectorD& g, TVectorD& x) const
+{
+  // Conjugate gradients for (A^T A + tau L^T L) x = g, starting from x=0.
+  // Returns the number of iterations, or -1 if not converged.
+  Int_t nr= NReg();
+  x.ResizeTo (_nt);
+  x.Zero();
+  TVectorD r(g), p(g), q(_nm), hp(_nt), ql(nr);
+  Double_t rr= r.Norm2Sqr(), stop= _tol*_tol*rr;
+  if (rr==0.0) return 0;
+  for (Int_t it= 1; it<=_maxiter; it++) {
+    Mult  (p, q);
+    MultT (q, hp);
+    if (nr>0) {
+      RegMult (p, ql);
+      ql *= _tau;
+      RegMultT (ql, hp);
+    }
+    Double_t php= Dot (p, hp);
+    if (php<=0.0) return it;
+    Double_t alpha= rr/php;
+    Add (x,  alpha, p);
+    Add (r, -alpha, hp);
+    Double_t rnew= r.Norm2Sqr();
+    if (rnew<=stop) return it;
+    p *= rnew/rr;
+    p += r;
+    rr= rnew;
+  }
+  return -1;
+}
+
+void
+RooUnfoldCGLS::GetCov()
+{
+  GetCovJacobian();
+}
+
+Bool_t
+RooUnfoldCGLS::GetJacobian()
+{
+  // x = H^-1 R^T W (y-fakes), with H = R^T W R + tau L^T L, so column j of dx/dy is the solution for b = W^1/2 e_j.
+  // For the response matrix errors, as in RooUnfoldInvert, P = H^-1 (one column per truth bin),
+  // s = W (y-fakes-Rx), and u = x.
+  if (!_A) return false;
+  Int_t nfail= 0;
+  TVectorD b(_nm), x(_nt);
+  _dxdy.ResizeTo(_nt,_nm);
+  for (Int_t j= 0; j<_nm; j++) {
+    b.Zero();
+    b[j]= _w12[j];
+    if (SolveLS (b, x) < 0) nfail++;
+    for (Int_t i= 0; i<_nt; i++) _dxdy(i,j)= x[i];
+  }
+  if (_dosys) {
+    _dxdAu.ResizeTo(_nt);
+    _dxdAu= _rec;
+    _dxdAP.ResizeTo(_nt,_nt);
+    TVectorD e(_nt);
+    for (Int_t k= 0; k<_nt; k++) {
+      e.Zero();
+      e[k]= 1.0;
+      if (SolveNormal (e, x) < 0) nfail++;
+      for (Int_t i= 0; i<_nt; i++) _dxdAP(i,k)= x[i];
+    }
+    _dxdAs.ResizeTo(_nm);
+    _dxdAs= Vmeasured();
+    _res->SubtractFakes (_dxdAs, _dxdAs.Sum());
+    for (Int_t i= 0; i<_nm; i++) _dxdAs[i] *= _w12[i];
+    TVectorD ax(_nm);
+    Mult (_rec, ax);
+    _dxdAs -= ax;
+    for (Int_t i= 0; i<_nm; i++) _dxdAs[i] *= _w12[i];
+  }
+  if (nfail) cerr << "Warning: RooUnfoldCGLS did not converge for " << nfail << " columns of the error propagation" << endl;
+  return true;
+}
+
+void
+RooUnfoldCGLS::GetSettings()
+{
+    _minparm=0;
+    _maxparm=1e-2;
+    _stepsizeparm=1e-4;
+    _defaultparm=1e-3;
+}
+
+TString
+RooUnfoldCGLS::CacheSettings() const
+{
+  return Form ("tau=%.17g regmethod=%d maxiter=%d tol=%.17g", _tau, _reg, _maxiter, _tol);
+}
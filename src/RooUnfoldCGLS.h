@@ -0,0 +1,192 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Unfolding class using Tikhonov regularisation, solved iteratively with
+//      CGLS (conjugate gradients for least squares) on a sparse response matrix.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDCGLS_H_
+#define ROOUNFOLDCGLS_H_
+
+#include "RooUnfold.h"
+#include "TMatrixDSparse.h"
+
+class RooUnfoldResponse;
+class TH1;
+
+class RooUnfoldCGLS : public RooUnfold {
+
+public:
+  enum RegMode {         // Regularisation condition, applied to the truth vector:
+    kRegModeNone,        //   none (least squares, minimum norm solution)
+    kRegModeSize,        //   size: x_i
+    kRegModeDerivative,  //   first derivative: x_i+1 - x_i
+    kRegModeCurvature    //   second derivative: x_i-1 - 2x_i + x_i+1
+  };
+
+  RooUnfoldCGLS(); // default constructor
+  RooUnfoldCGLS (const char*    name, const char*    title); // named constructor
+  RooUnfoldCGLS (const TString& name, const TString& title); // named constructor
+  RooUnfoldCGLS (const RooUnfoldCGLS& rhs); // copy constructor
+  virtual ~RooUnfoldCGLS(); // destructor
+  RooUnfoldCGLS& operator= (const RooUnfoldCGLS& rhs); // assignment operator
+  virtual RooUnfoldCGLS* Clone (const char* newname= 0) const;
+  RooUnfoldCGLS (const RooUnfoldResponse* res, const TH1* meas, Double_t tau= 1e-3, RegMode reg= kRegModeDerivative,
+                 const char* name= 0, const char* title= 0);
+
+  virtual void Reset();
+  const TMatrixDSparse* Impl();
+
+  virtual void     SetRegParm (Double_t tau);
+  virtual Double_t GetRegParm() const;
+  void     SetRegMethod     (RegMode reg);
+  RegMode  GetRegMethod()  const;
+  void     SetMaxIterations (Int_t maxiter);
+  Int_t    GetMaxIterations() const;
+  void     SetTolerance     (Double_t tol);
+  Double_t GetTolerance()  const;
+  Int_t    GetIterations() const;  // CGLS iterations used by the last unfolding
+
+protected:
+  virtual void Unfold();
+  virtual void GetCov();
+  virtual Bool_t GetJacobian();
+  virtual void GetSettings();
+  virtual TString CacheSettings() const;
+  void Assign   (const RooUnfoldCGLS& rhs); // implementation of assignment operator
+  void CopyData (const RooUnfoldCGLS& rhs);
+
+private:
+  void Init();
+  void Destroy();
+  Bool_t SetupResponse();
+  Int_t  NReg() const;
+  void   Mult     (const TVectorD& x, TVectorD& y) const;  // y = A x
+  void   MultT    (const TVectorD& y, TVectorD& x) const;  // x = A^T y
+  void   RegMult  (const TVectorD& x, TVectorD& y) const;  // y = L x
+  void   RegMultT (const TVectorD& y, TVectorD& x) const;  // x += L^T y
+  Int_t  SolveLS     (const TVectorD& b, TVectorD& x) const;  // min |Ax-b|^2 + tau |Lx|^2
+  Int_t  SolveNormal (const TVectorD& g, TVectorD& x) const;  // (A^T A + tau L^T L) x = g
+
+protected:
+  // instance variables
+  Double_t _tau;       // regularisation parameter
+  Int_t    _reg;       // RegMode
+  Int_t    _maxiter;   // maximum number of CGLS iterations
+  Double_t _tol;       // convergence tolerance, relative to |A^T b|
+  Int_t    _niter;     //! iterations used by last unfolding
+  TMatrixDSparse* _A;  //! weighted response matrix, W^1/2 R, in sparse (CSR) form
+  TVectorD _w12;       //! measurement weights, W^1/2 = 1/error
+
+public:
+  ClassDef (RooUnfoldCGLS, 1)  // Iterative sparse Tikhonov unfolding
+};
+
+// Inline method definitions
+
+inline
+RooUnfoldCGLS::RooUnfoldCGLS()
+  : RooUnfold(), _tau(1e-3), _reg(kRegModeDerivative), _maxiter(1000), _tol(1e-6)
+{
+  // Default constructor. Use Setup() to prepare for unfolding.
+  Init();
+}
+
+inline
+RooUnfoldCGLS::RooUnfoldCGLS (const char* name, const char* title)
+  : RooUnfold(name,title), _tau(1e-3), _reg(kRegModeDerivative), _maxiter(1000), _tol(1e-6)
+{
+  // Basic named constructor. Use Setup() to prepare for unfolding.
+  Init();
+}
+
+inline
+RooUnfoldCGLS::RooUnfoldCGLS (const TString& name, const TString& title)
+  : RooUnfold(name,title), _tau(1e-3), _reg(kRegModeDerivative), _maxiter(1000), _tol(1e-6)
+{
+  // Basic named constructor. Use Setup() to prepare for unfolding.
+  Init();
+}
+
+inline
+RooUnfoldCGLS& RooUnfoldCGLS::operator= (const RooUnfoldCGLS& rhs)
+{
+  // Assignment operator for copying RooUnfoldCGLS settings.
+  Assign(rhs);
+  return *this;
+}
+
+inline
+RooUnfoldCGLS::~RooUnfoldCGLS()
+{
+  Destroy();
+}
+
+inline
+void RooUnfoldCGLS::SetRegParm (Double_t tau)
+{
+  // Set regularisation parameter (tau)
+  _tau= tau;
+}
+
+inline
+Double_t RooUnfoldCGLS::GetRegParm() const
+{
+  // Return regularisation parameter (tau)
+  return _tau;
+}
+
+inline
+void RooUnfoldCGLS::SetRegMethod (RegMode reg)
+{
+  // Set regularisation condition
+  _reg= reg;
+}
+
+inline
+RooUnfoldCGLS::RegMode RooUnfoldCGLS::GetRegMethod() const
+{
+  // Return regularisation condition
+  return RegMode(_reg);
+}
+
+inline
+void RooUnfoldCGLS::SetMaxIterations (Int_t maxiter)
+{
+  // Set maximum number of CGLS iterations for each solution
+  _maxiter= maxiter;
+}
+
+inline
+Int_t RooUnfoldCGLS::GetMaxIterations() const
+{
+  // Return maximum number of CGLS iterations for each solution
+  return _maxiter;
+}
+
+inline
+void RooUnfoldCGLS::SetTolerance (Double_t tol)
+{
+  // Set convergence tolerance: stop when the normal equations' residual, |A^T(b-Ax) - tau L^T L x|,
+  // falls below tol*|A^T b|.
+  _tol= tol;
+}
+
+inline
+Double_t RooUnfoldCGLS::GetTolerance() const
+{
+  // Return convergence tolerance
+  return _tol;
+}
+
+inline
+Int_t RooUnfoldCGLS::GetIterations() const
+{
+  // Return the number of CGLS iterations used by the last unfolding
+  return _niter;
+}
+
+#endif /*ROOUNFOLDCGLS_H_*/
@@ -0,0 +1,234 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Persistent on-disk cache of unfolding results, keyed by a hash of
+//      the unfolding inputs.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>Stores the results of an unfolding (the unfolded vector, its errors, covariance and weight
+matrices, and the covariance matrix from toys) in a directory, so that an identical unfolding
+in the same or another process can be served without recomputing.</p>
+<p>Each result is kept in its own ROOT file, named after the key and the item. The key is an MD5 hash
+of everything the result depends on: the response matrix contents (including errors), the measured
+distribution and its errors or covariance matrix, the unfolding class, its settings (eg. number of
+iterations or regularisation parameter), and whether systematics and overflows are used.
+The covariance matrix from toys is also keyed by the number of toys.
+Files are written under a temporary name and renamed, so several jobs can share the same directory.</p>
+<p>To use, either call RooUnfold::SetCache() on an unfolding object, or
+RooUnfoldCache::SetDefault() for all unfolding objects created afterwards, eg.
+<pre>
+  RooUnfoldCache cache ("unfoldcache");
+  RooUnfoldCache::SetDefault (&cache);
+</pre>
+The cache is never cleared automatically: remove the directory to start afresh.</p>
+<p>The same directory also holds decompositions that depend only on the response (and for some algorithms the
+measurement covariance), not on the measured values: the SVD of the response matrix used by RooUnfoldInvert, and
+the inverted measurement covariance and the SVD of the regularised spline matrix used by RooUnfoldBasisSplines.
+These are keyed by RooUnfoldResponse::Checksum(), so, keeping the cache directory next to the response file,
+later jobs unfolding other measurements with the same response skip the factorisation at start-up.
+A changed response has a different checksum, so its decompositions are recomputed.
+RooUnfoldSvd's decomposition is made inside TSVDUnfold from the response rescaled by the measurement errors,
+so cannot be stored this way.</p>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldCache.h"
+#include "RooUnfoldCovariance.h"
+
+#include <iostream>
+#include <cstring>
+
+#include "TFile.h"
+#include "TSystem.h"
+#include "TMD5.h"
+#include "TH1.h"
+#include "TAxis.h"
+#include "TDecompSVD.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+ClassImp (RooUnfoldCache);
+
+RooUnfoldCache* RooUnfoldCache::_default= 0;
+
+RooUnfoldCache::RooUnfoldCache()
+  : TNamed(), _hits(0), _misses(0), _writes(0)
+{
+}
+
+RooUnfoldCache::RooUnfoldCache (const char* dir, const char* title)
+  : TNamed (dir, title ? title : "RooUnfold result cache"), _hits(0), _misses(0), _writes(0)
+{
+  // Use dir for the cache files, creating it if it does not exist.
+  if (gSystem->AccessPathName (dir) && gSystem->mkdir (dir, kTRUE) != 0)
+    cerr << "Warning: could not create RooUnfold cache directory " << dir << endl;
+}
+
+RooUnfoldCache::~RooUnfoldCache()
+{
+  if (_default == this) _default= 0;
+}
+
+TString RooUnfoldCache::FileName (const char* key, const char* item) const
+{
+  TString name= Directory();
+  name += "/";
+  name += key;
+  name += "_";
+  name += item;
+  name += ".root";
+  return name;
+}
+
+TObject* RooUnfoldCache::ReadObject (const char* key, const char* item) const
+{
+  TString name= FileName (key, item);
+  TObject* obj= 0;
+  if (!gSystem->AccessPathName (name)) {
+    TFile f (name, "READ");
+    if (!f.IsZombie()) obj= f.Get (item);
+    f.Close();
+  }
+  if (obj) _hits++;
+  else     _misses++;
+  return obj;
+}
+
+Bool_t RooUnfoldCache::Read (const char* key, const char* item, TVectorD& v) const
+{
+  // Read vector item for key. Returns false, leaving v unchanged, if it is not in the cache.
+  TVectorD* p= dynamic_cast<TVectorD*>(ReadObject (key, item));
+  if (!p) return false;
+  v.ResizeTo (*p);
+  v= *p;
+  delete p;
+  return true;
+}
+
+Bool_t RooUnfoldCache::Read (const char* key, const char* item, TMatrixD& m) const
+{
+  // Read matrix item for key. Returns false, leaving m unchanged, if it is not in the cache.
+  TMatrixD* p= dynamic_cast<TMatrixD*>(ReadObject (key, item));
+  if (!p) return false;
+  m.ResizeTo (*p);
+  m= *p;
+  delete p;
+  return true;
+}
+
+Bool_t RooUnfoldCache::Read (const char* key, const char* item, TDecompSVD& svd) const
+{
+  // Read a decomposition stored (after Decompose()) as item for key. Returns false, leaving svd unchanged, if it
+  // is not in the cache.
+  TDecompSVD* p= dynamic_cast<TDecompSVD*>(ReadObject (key, item));
+  if (!p) return false;
+  svd= *p;
+  delete p;
+  return true;
+}
+
+Bool_t RooUnfoldCache::Write (const char* key, const char* item, const TObject& obj) const
+{
+  // Store obj as item for key. The file is written under a temporary name and then renamed into
+  // place, so that concurrent readers never see a partial file.
+  TString name= FileName (key, item);
+  TString tmp= name;
+  tmp += Form (".%d.tmp", gSystem->GetPid());
+  {
+    TFile f (tmp, "RECREATE");
+    if (f.IsZombie()) {
+      cerr << "Warning: could not write RooUnfold cache file " << tmp << endl;
+      return false;
+    }
+    f.WriteTObject (&obj, item);
+    f.Close();
+  }
+  if (gSystem->Rename (tmp, name) != 0) {
+    cerr << "Warning: could not rename RooUnfold cache file " << tmp << " to " << name << endl;
+    gSystem->Unlink (tmp);
+    return false;
+  }
+  _writes++;
+  return true;
+}
+
+void RooUnfoldCache::Print (Option_t*) const
+{
+  cout << ClassName() << "::" << GetName() << " \"" << GetTitle() << "\": "
+       << _hits << " hits, " << _misses << " misses, " << _writes << " writes" << endl;
+}
+
+void RooUnfoldCache::Hash (TMD5& md5, const char* s)
+{
+  if (!s) s= "";
+  md5.Update ((const UChar_t*) s, strlen(s)+1);
+}
+
+void RooUnfoldCache::Hash (TMD5& md5, const TVectorD& v)
+{
+  Int_t n= v.GetNrows();
+  md5.Update ((const UChar_t*) &n, sizeof(n));
+  md5.Update ((const UChar_t*) v.GetMatrixArray(), n*sizeof(Double_t));
+}
+
+void RooUnfoldCache::Hash (TMD5& md5, const TMatrixD& m)
+{
+  Int_t n[2]= { m.GetNrows(), m.GetNcols() };
+  md5.Update ((const UChar_t*) n, sizeof(n));
+  md5.Update ((const UChar_t*) m.GetMatrixArray(), n[0]*n[1]*sizeof(Double_t));
+}
+
+void RooUnfoldCache::Hash (TMD5& md5, const TH1* h)
+{
+  // Hash the binning, contents and errors of a histogram (including under/overflows), but not its name.
+  // The bins are hashed in chunks, so a large response is not copied.
+  if (!h) {
+    Hash (md5, "(null)");
+    return;
+  }
+  Int_t nd= h->GetDimension();
+  Int_t nb= h->GetNbinsX()+2;
+  if (nd>=2) nb *= h->GetNbinsY()+2;
+  if (nd>=3) nb *= h->GetNbinsZ()+2;
+  const TAxis* axes[3]= { h->GetXaxis(), h->GetYaxis(), h->GetZaxis() };
+  Double_t head[10];
+  head[0]= nd;
+  for (Int_t a= 0; a<3; a++) {
+    head[1+3*a]= axes[a]->GetNbins();
+    head[2+3*a]= axes[a]->GetXmin();
+    head[3+3*a]= axes[a]->GetXmax();
+  }
+  md5.Update ((const UChar_t*) head, sizeof(head));
+  for (Int_t a= 0; a<3; a++) {
+    // variable bin edges (none for fixed binning)
+    const TArrayD* edges= axes[a]->GetXbins();
+    Int_t ne= edges ? edges->GetSize() : 0;
+    md5.Update ((const UChar_t*) &ne, sizeof(ne));
+    if (ne>0) md5.Update ((const UChar_t*) edges->GetArray(), ne*sizeof(Double_t));
+  }
+  const Int_t nchunk= 1024;
+  Double_t buf[nchunk];
+  for (Int_t err= 0; err<2; err++) {
+    for (Int_t i0= 0; i0<nb; i0 += nchunk) {
+      Int_t n= nb-i0 < nchunk ? nb-i0 : nchunk;
+      for (Int_t i= 0; i<n; i++) buf[i]= err ? h->GetBinError(i0+i) : h->GetBinContent(i0+i);
+      md5.Update ((const UChar_t*) buf, n*sizeof(Double_t));
+    }
+  }
+}
+
+void RooUnfoldCache::Hash (TMD5& md5, const RooUnfoldCovariance& cov)
+{
+  // Hash the stored form, so a diagonal or low-rank covariance is not expanded to an n x n matrix.
+  Hash (md5, Form ("covariance type=%d", cov.GetType()));
+  Hash (md5, cov.GetDiagonal());
+  if (cov.GetType()!=RooUnfoldCovariance::kDiagonal) Hash (md5, cov.GetFactors());
+}
@@ -0,0 +1,97 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Persistent on-disk cache of unfolding results, keyed by a hash of
+//      the unfolding inputs.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDCACHE_HH
+#define ROOUNFOLDCACHE_HH
+
+#include "TNamed.h"
+#include "TString.h"
+#include "TVectorD.h"
+#include "TMatrixD.h"
+
+class TH1;
+class TMD5;
+class TDecompSVD;
+class RooUnfoldCovariance;
+
+class RooUnfoldCache : public TNamed {
+
+public:
+
+  // Standard methods
+
+  RooUnfoldCache(); // default constructor
+  RooUnfoldCache (const char* dir, const char* title= 0); // cache in directory dir (created if necessary)
+  virtual ~RooUnfoldCache(); // destructor
+
+  // Accessors
+
+  const char* Directory() const;
+  TString FileName (const char* key, const char* item) const;
+  Bool_t Read  (const char* key, const char* item, TVectorD& v) const;
+  Bool_t Read  (const char* key, const char* item, TMatrixD& m) const;
+  Bool_t Read  (const char* key, const char* item, TDecompSVD& svd) const;
+  Bool_t Write (const char* key, const char* item, const TObject& obj) const;
+  Int_t  Hits()   const;
+  Int_t  Misses() const;
+  Int_t  Writes() const;
+  virtual void Print (Option_t* opt="") const;
+
+  static RooUnfoldCache* GetDefault();                 // cache used by new RooUnfold objects
+  static void            SetDefault (RooUnfoldCache* cache); // not owned
+
+  // Hashing of cache keys
+
+  static void Hash (TMD5& md5, const char* s);
+  static void Hash (TMD5& md5, const TVectorD& v);
+  static void Hash (TMD5& md5, const TMatrixD& m);
+  static void Hash (TMD5& md5, const TH1* h);
+  static void Hash (TMD5& md5, const RooUnfoldCovariance& cov);
+
+private:
+  TObject* ReadObject (const char* key, const char* item) const;
+
+  mutable Int_t _hits;    //! number of items found
+  mutable Int_t _misses;  //! number of items not found
+  mutable Int_t _writes;  //! number of items stored
+
+  static RooUnfoldCache* _default;
+
+public:
+  ClassDef (RooUnfoldCache, 1) // On-disk cache of unfolding results
+};
+
+// Inline method definitions
+
+inline
+const char* RooUnfoldCache::Directory() const
+{
+  // Directory holding the cache files.
+  return GetName();
+}
+
+inline Int_t RooUnfoldCache::Hits()   const { return _hits;   }
+inline Int_t RooUnfoldCache::Misses() const { return _misses; }
+inline Int_t RooUnfoldCache::Writes() const { return _writes; }
+
+inline
+RooUnfoldCache* RooUnfoldCache::GetDefault()
+{
+  return _default;
+}
+
+inline
+void RooUnfoldCache::SetDefault (RooUnfoldCache* cache)
+{
+  // Set the cache used by RooUnfold objects created from now on (0 to switch off).
+  _default= cache;
+}
+
+#endif
@@ -0,0 +1,161 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Checkpoint files for long toy and regularisation parameter scans,
+//      so that they can be resumed after the job is stopped.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>The toys of RooUnfold::GetErrMat() (kCovToy errors) and RooUnfoldErrors, and the regularisation parameter
+scan of RooUnfoldParms, can run for hours. With a checkpoint, these loops periodically write their state
+(the index of the next toy or scan point, the toy seed, and the running sums or the results so far) to a file.
+If the job is stopped (eg. pre-empted in a batch system) and rerun, the loop continues from the last
+checkpoint instead of starting again. The file is removed when the loop completes.</p>
+<p>To use, give the checkpoint to the unfolding object (which passes it to RooUnfoldErrors and RooUnfoldParms), eg.
+<pre>
+  RooUnfoldCheckpoint checkpoint ("/scratch/myjob", 500);   // files /scratch/myjob_*.root, every 500 toys
+  unfold.SetCheckpoint (&checkpoint);
+</pre>
+Each file is named after the loop and an MD5 hash of its inputs (the response, measured distribution, algorithm,
+settings, and number of toys), so a checkpoint is only picked up by the same calculation, and several
+calculations can use the same prefix. Files are written under a temporary name and renamed, so a job stopped while
+writing leaves the previous checkpoint intact.</p>
+<p>Toys use RooUnfoldPhilox streams (see RooUnfold::SetToySeed()), so a resumed loop gives the same result as an
+uninterrupted one. If no toy seed is set, one is taken from gRandom and saved in the checkpoint.</p>
+<p>RooUnfoldCheckpoint only reads, writes, and removes the files. All three loops are run by
+RooUnfoldForkPool::RunLoop(), which resumes from Read(), calls Write() between chunks of GetInterval() items,
+and Remove() at the end. A new loop should use RunLoop() too, rather than calling these directly.
+RooUnfold::GetErrMat() gives RunLoop() a reduction, so only the sums of the toy results are saved, and each
+checkpoint is the same size. RooUnfoldErrors and RooUnfoldParms need every result, so each of their checkpoints
+rewrites all the results so far: for long loops, use a larger interval.</p>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldCheckpoint.h"
+
+#include <iostream>
+
+#include "TFile.h"
+#include "TSystem.h"
+#include "TMD5.h"
+#include "TObjString.h"
+
+#include "RooUnfoldCache.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+ClassImp (RooUnfoldCheckpoint);
+
+RooUnfoldCheckpoint::RooUnfoldCheckpoint()
+  : TNamed(), _every(100), _resumes(0), _writes(0)
+{
+}
+
+RooUnfoldCheckpoint::RooUnfoldCheckpoint (const char* prefix, Int_t every, const char* title)
+  : TNamed (prefix, title ? title : "RooUnfold checkpoint"), _every(100), _resumes(0), _writes(0)
+{
+  // Write checkpoints to files prefix_*.root after every this many toys or scan points.
+  SetInterval (every);
+}
+
+RooUnfoldCheckpoint::~RooUnfoldCheckpoint()
+{
+}
+
+TString RooUnfoldCheckpoint::FileName (const char* item, const char* key) const
+{
+  TMD5 md5;
+  RooUnfoldCache::Hash (md5, key);
+  md5.Final();
+  TString name= Prefix();
+  name += "_";
+  name += item;
+  name += "_";
+  name += md5.AsString();
+  name += ".root";
+  return name;
+}
+
+Bool_t RooUnfoldCheckpoint::Read (const char* item, const char* key, Int_t& next, Long64_t& seed, TVectorD& acc) const
+{
+  // Read the checkpoint of loop item with inputs key. Returns false, leaving the arguments unchanged, if there is none.
+  TString name= FileName (item, key);
+  if (gSystem->AccessPathName (name)) return false;
+  TObjString* k= 0;
+  TVectorD *state= 0, *sums= 0;
+  {
+    TFile f (name, "READ");
+    if (!f.IsZombie()) {
+      k=     dynamic_cast<TObjString*>(f.Get ("key"));
+      state= dynamic_cast<TVectorD*>  (f.Get ("state"));
+      sums=  dynamic_cast<TVectorD*>  (f.Get ("acc"));
+    }
+    f.Close();
+  }
+  Bool_t ok= k && state && sums && k->GetString() == key && state->GetNrows() == 2;
+  if (ok) {
+    next= Int_t    ((*state)[0]);
+    seed= Long64_t ((*state)[1]);
+    acc.ResizeTo (*sums);
+    acc= *sums;
+    _resumes++;
+    cout << "Resuming " << item << " from checkpoint " << name << " at " << next << endl;
+  } else
+    cerr << "Warning: ignoring invalid RooUnfold checkpoint file " << name << endl;
+  delete k;
+  delete state;
+  delete sums;
+  return ok;
+}
+
+Bool_t RooUnfoldCheckpoint::Write (const char* item, const char* key, Int_t next, Long64_t seed, const TVectorD& acc) const
+{
+  // Store the state of loop item with inputs key: the next toy or scan point, the toy seed, and the accumulated results.
+  // The file is written under a temporary name and then renamed into place, so a job stopped during the write
+  // keeps the previous checkpoint.
+  TString name= FileName (item, key);
+  TString tmp= name;
+  tmp += Form (".%d.tmp", gSystem->GetPid());
+  {
+    TFile f (tmp, "RECREATE");
+    if (f.IsZombie()) {
+      cerr << "Warning: could not write RooUnfold checkpoint file " << tmp << endl;
+      return false;
+    }
+    TObjString k (key);
+    TVectorD state (2);
+    state[0]= next;
+    state[1]= seed;
+    f.WriteTObject (&k,     "key");
+    f.WriteTObject (&state, "state");
+    f.WriteTObject (&acc,   "acc");
+    f.Close();
+  }
+  if (gSystem->Rename (tmp, name) != 0) {
+    cerr << "Warning: could not rename RooUnfold checkpoint file " << tmp << " to " << name << endl;
+    gSystem->Unlink (tmp);
+    return false;
+  }
+  _writes++;
+  return true;
+}
+
+void RooUnfoldCheckpoint::Remove (const char* item, const char* key) const
+{
+  // Remove the checkpoint of a completed loop.
+  TString name= FileName (item, key);
+  if (!gSystem->AccessPathName (name)) gSystem->Unlink (name);
+}
+
+void RooUnfoldCheckpoint::Print (Option_t*) const
+{
+  cout << ClassName() << "::" << GetName() << " \"" << GetTitle() << "\": every " << _every << ", "
+       << _resumes << " resumes, " << _writes << " writes" << endl;
+}
@@ -0,0 +1,76 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Checkpoint files for long toy and regularisation parameter scans,
+//      so that they can be resumed after the job is stopped.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDCHECKPOINT_HH
+#define ROOUNFOLDCHECKPOINT_HH
+
+#include "TNamed.h"
+#include "TString.h"
+#include "TVectorD.h"
+
+class RooUnfoldCheckpoint : public TNamed {
+
+public:
+
+  // Standard methods
+
+  RooUnfoldCheckpoint(); // default constructor
+  RooUnfoldCheckpoint (const char* prefix, Int_t every= 100, const char* title= 0); // files named prefix_*.root
+  virtual ~RooUnfoldCheckpoint(); // destructor
+
+  // Accessors
+
+  const char* Prefix() const;
+  Int_t   GetInterval() const;
+  void    SetInterval (Int_t every);  // write a checkpoint after every this many toys or scan points
+  TString FileName (const char* item, const char* key) const;
+  Bool_t  Read   (const char* item, const char* key, Int_t& next, Long64_t& seed, TVectorD& acc) const;
+  Bool_t  Write  (const char* item, const char* key, Int_t  next, Long64_t  seed, const TVectorD& acc) const;
+  void    Remove (const char* item, const char* key) const;
+  Int_t   Resumes() const;
+  Int_t   Writes()  const;
+  virtual void Print (Option_t* opt="") const;
+
+private:
+  Int_t _every;             // number of toys or scan points between checkpoints
+  mutable Int_t _resumes;   //! number of loops resumed from a checkpoint
+  mutable Int_t _writes;    //! number of checkpoints written
+
+public:
+  ClassDef (RooUnfoldCheckpoint, 1) // Checkpoint files for toy and scan loops
+};
+
+// Inline method definitions
+
+inline
+const char* RooUnfoldCheckpoint::Prefix() const
+{
+  // Path and start of the name of the checkpoint files.
+  return GetName();
+}
+
+inline
+Int_t RooUnfoldCheckpoint::GetInterval() const
+{
+  return _every;
+}
+
+inline
+void RooUnfoldCheckpoint::SetInterval (Int_t every)
+{
+  // Write a checkpoint after every this many toys or scan points. Each checkpoint rewrites the whole state,
+  // so for fast unfoldings with many bins, use a larger interval.
+  _every= every>0 ? every : 1;
+}
+
+inline Int_t RooUnfoldCheckpoint::Resumes() const { return _resumes; }
+inline Int_t RooUnfoldCheckpoint::Writes()  const { return _writes;  }
+
+#endif
@@ -0,0 +1,395 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Covariance matrix that keeps diagonal or low-rank-plus-diagonal
+//      structure, with multiply, solve, and sampling.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>Holds a covariance matrix V of n bins in one of three forms:</p>
+<ul>
+<li>kDiagonal: uncorrelated errors, V = diag(d), stored as the n variances;</li>
+<li>kLowRank: uncorrelated errors plus k correlated sources (eg. systematics), V = diag(d) + F F<sup>T</sup>,
+    stored as d and the n x k matrix F;</li>
+<li>kDense: a general n x n matrix.</li>
+</ul>
+<p>The operations use the structure: for the diagonal form, Multiply(), Solve(), Chi2() and Sample() cost O(n)
+and Invert() O(n<sup>2</sup>), instead of O(n<sup>2</sup>) memory and an O(n<sup>3</sup>) decomposition.
+The low-rank form uses the Woodbury identity, with a k x k Cholesky decomposition,
+so Solve() costs O(nk+k<sup>3</sup>) and Invert() O(n<sup>2</sup>k). A dense matrix is Cholesky decomposed once,
+on first use. If a matrix is not positive definite (eg. a bin with zero error), Solve() and Invert() use the
+SVD pseudo-inverse, as RooUnfold::InvertMatrix() does.</p>
+<p>RooUnfold uses this for the measurement covariance: see RooUnfold::GetMeasuredCovariance() and
+RooUnfold::SetMeasuredCov(). For example, for measurement errors e with an overall normalisation uncertainty
+of 2%,
+<pre>
+  TVectorD var= e;  var.Sqr();
+  TMatrixD f (nm, 1);
+  for (Int_t i= 0; i&lt;nm; i++) f(i,0)= 0.02*meas[i];
+  unfold.SetMeasuredCov (RooUnfoldCovariance (var, f));
+</pre></p>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldCovariance.h"
+
+#include <iostream>
+#include <cmath>
+
+#include "TRandom.h"
+#include "TMatrixDSym.h"
+#include "TDecompChol.h"
+#include "TDecompSVD.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::sqrt;
+
+ClassImp (RooUnfoldCovariance);
+
+RooUnfoldCovariance::RooUnfoldCovariance()
+  : TObject(), _type(kDiagonal), _shared(0), _status(0), _chol(0), _root(0), _pinv(0)
+{
+}
+
+RooUnfoldCovariance::RooUnfoldCovariance (const TVectorD& variances)
+  : TObject(), _type(kDiagonal), _shared(0), _status(0), _chol(0), _root(0), _pinv(0)
+{
+  // Diagonal covariance matrix with the given variances.
+  SetVariances (variances);
+}
+
+RooUnfoldCovariance::RooUnfoldCovariance (const TMatrixD& cov)
+  : TObject(), _type(kDiagonal), _shared(0), _status(0), _chol(0), _root(0), _pinv(0)
+{
+  // Dense covariance matrix.
+  SetMatrix (cov);
+}
+
+RooUnfoldCovariance::RooUnfoldCovariance (const TVectorD& variances, const TMatrixD& factors)
+  : TObject(), _type(kDiagonal), _shared(0), _status(0), _chol(0), _root(0), _pinv(0)
+{
+  // Covariance matrix diag(variances) + factors * factors^T.
+  SetLowRank (variances, factors);
+}
+
+RooUnfoldCovariance::RooUnfoldCovariance (const RooUnfoldCovariance& rhs)
+  : TObject(rhs), _type(rhs._type), _diag(rhs._diag), _mat(rhs.Mat()), _shared(0), _status(0), _chol(0), _root(0), _pinv(0)
+{
+  // Copy constructor. A matrix shared with Use() is copied.
+}
+
+RooUnfoldCovariance::~RooUnfoldCovariance()
+{
+  ClearDecomposition();
+}
+
+RooUnfoldCovariance& RooUnfoldCovariance::operator= (const RooUnfoldCovariance& rhs)
+{
+  if (this == &rhs) return *this;
+  ClearDecomposition();
+  _type= rhs._type;
+  _diag.ResizeTo (rhs._diag);
+  _diag= rhs._diag;
+  _mat.ResizeTo (rhs.Mat());
+  _mat= rhs.Mat();
+  _shared= 0;
+  return *this;
+}
+
+void RooUnfoldCovariance::ClearDecomposition()
+{
+  delete _chol; _chol= 0;
+  delete _root; _root= 0;
+  delete _pinv; _pinv= 0;
+  _status= 0;
+}
+
+RooUnfoldCovariance& RooUnfoldCovariance::SetVariances (const TVectorD& variances)
+{
+  ClearDecomposition();
+  _type= kDiagonal;
+  _diag.ResizeTo (variances);
+  _diag= variances;
+  _mat.ResizeTo (0, 0);
+  _shared= 0;
+  return *this;
+}
+
+RooUnfoldCovariance& RooUnfoldCovariance::SetErrors (const TVectorD& errors)
+{
+  SetVariances (errors);
+  _diag.Sqr();
+  return *this;
+}
+
+RooUnfoldCovariance& RooUnfoldCovariance::SetMatrix (const TMatrixD& cov)
+{
+  ClearDecomposition();
+  _type= kDense;
+  _mat.ResizeTo (cov);
+  _mat= cov;
+  _shared= 0;
+  Int_t n= cov.GetNrows();
+  _diag.ResizeTo (n);
+  for (Int_t i= 0; i<n; i++) _diag[i]= cov(i,i);
+  return *this;
+}
+
+RooUnfoldCovariance& RooUnfoldCovariance::Use (const TMatrixD& cov)
+{
+  // Dense covariance matrix using cov in place, so cov must not be changed or deleted while this object
+  // is in use. A copy of this object has its own copy of the matrix, but the object itself cannot be written.
+  SetVariances (TVectorD (cov.GetNrows()));
+  _type= kDense;
+  _shared= &cov;
+  for (Int_t i= 0, n= cov.GetNrows(); i<n; i++) _diag[i]= cov(i,i);
+  return *this;
+}
+
+RooUnfoldCovariance& RooUnfoldCovariance::SetLowRank (const TVectorD& variances, const TMatrixD& factors)
+{
+  // Covariance matrix diag(variances) + factors * factors^T, where factors is an n x k matrix whose
+  // columns are the bin-by-bin shifts of k independent, correlated, error sources.
+  if (factors.GetNrows() != variances.GetNrows()) {
+    cerr << "Warning: RooUnfoldCovariance given " << factors.GetNrows() << " x " << factors.GetNcols()
+         << " factors for " << variances.GetNrows() << " bins: ignore them" << endl;
+    return SetVariances (variances);
+  }
+  SetVariances (variances);
+  _type= kLowRank;
+  _mat.ResizeTo (factors);
+  _mat= factors;
+  return *this;
+}
+
+RooUnfoldCovariance& RooUnfoldCovariance::SetSlice (const RooUnfoldCovariance& cov, const std::vector<Int_t>& bins)
+{
+  // Covariance of the subset of bins (indices into cov), keeping the structure of cov.
+  // The rows of the factors of a low-rank covariance are selected, so it stays low-rank.
+  Int_t n= bins.size();
+  TVectorD d(n);
+  for (Int_t i= 0; i<n; i++) d[i]= cov._diag[bins[i]];
+  if (cov._type==kDiagonal) return SetVariances (d);
+  const TMatrixD& m= cov.Mat();
+  if (cov._type==kLowRank) {
+    Int_t k= m.GetNcols();
+    TMatrixD f(n,k);
+    for (Int_t i= 0; i<n; i++)
+      for (Int_t l= 0; l<k; l++) f(i,l)= m(bins[i],l);
+    return SetLowRank (d, f);
+  }
+  TMatrixD c(n,n);
+  for (Int_t i= 0; i<n; i++)
+    for (Int_t j= 0; j<n; j++) c(i,j)= m(bins[i],bins[j]);
+  return SetMatrix (c);
+}
+
+Double_t RooUnfoldCovariance::operator() (Int_t i, Int_t j) const
+{
+  if (_type==kDense) return Mat()(i,j);
+  Double_t v= (i==j) ? _diag[i] : 0.0;
+  if (_type==kLowRank)
+    for (Int_t a= 0, k= Mat().GetNcols(); a<k; a++) v += Mat()(i,a)*Mat()(j,a);
+  return v;
+}
+
+TMatrixD& RooUnfoldCovariance::GetMatrix (TMatrixD& m) const
+{
+  Int_t n= GetN();
+  m.ResizeTo (n, n);
+  if (_type==kDense) {
+    m= Mat();
+    return m;
+  }
+  m.Zero();
+  if (_type==kLowRank) m.MultT (Mat(), Mat());
+  for (Int_t i= 0; i<n; i++) m(i,i) += _diag[i];
+  return m;
+}
+
+Bool_t RooUnfoldCovariance::Decompose() const
+{
+  // Cholesky decomposition of V (kDense) or of the k x k capacitance matrix 1 + F^T d^-1 F (kLowRank).
+  if (_status) return _status>0;
+  _status= -1;
+  if (_type==kDiagonal) return false;
+  // A zero or negative variance means V is not positive definite: use the pseudo-inverse without trying
+  // Cholesky, which would print an error. For kDense, _diag is the diagonal of V.
+  Int_t n= GetN();
+  for (Int_t i= 0; i<n; i++)
+    if (!(_diag[i] > 0.0)) return false;
+  if (_type==kDense) {
+    _chol= new TDecompChol (Mat());
+  } else {
+    Int_t k= Mat().GetNcols();
+    TMatrixD cap (k, k);
+    for (Int_t a= 0; a<k; a++)
+      for (Int_t b= 0; b<=a; b++) {
+        Double_t s= (a==b) ? 1.0 : 0.0;
+        for (Int_t i= 0; i<n; i++) s += Mat()(i,a)*Mat()(i,b)/_diag[i];
+        cap(a,b)= cap(b,a)= s;
+      }
+    _chol= new TDecompChol (cap);
+  }
+  if (_chol->Decompose()) _status= 1;
+  return _status>0;
+}
+
+const TMatrixD& RooUnfoldCovariance::PseudoInverse() const
+{
+  // SVD pseudo-inverse, for a dense or low-rank matrix that is not positive definite.
+  if (_pinv) return *_pinv;
+  TMatrixD m;
+  GetMatrix (m);
+  Int_t n= GetN();
+  TDecompSVD svd (m);
+  svd.Decompose();
+  const TMatrixD& U=   svd.GetU();
+  const TVectorD& sig= svd.GetSig();
+  _pinv= new TMatrixD (n, n);
+  for (Int_t k= 0; k<n; k++) {
+    if (sig[k] <= 0.0) continue;
+    for (Int_t i= 0; i<n; i++)
+      for (Int_t j= 0; j<n; j++)
+        (*_pinv)(i,j) += U(i,k)*U(j,k)/sig[k];
+  }
+  return *_pinv;
+}
+
+TVectorD& RooUnfoldCovariance::Multiply (TVectorD& v) const
+{
+  if (_type==kDense) {
+    v *= Mat();
+    return v;
+  }
+  Int_t n= GetN(), k= Mat().GetNcols();
+  TVectorD ftv;
+  if (_type==kLowRank) {
+    ftv.ResizeTo (k);
+    for (Int_t a= 0; a<k; a++)
+      for (Int_t i= 0; i<n; i++) ftv[a] += Mat()(i,a)*v[i];
+  }
+  for (Int_t i= 0; i<n; i++) v[i] *= _diag[i];
+  if (_type==kLowRank)
+    for (Int_t i= 0; i<n; i++)
+      for (Int_t a= 0; a<k; a++) v[i] += Mat()(i,a)*ftv[a];
+  return v;
+}
+
+Bool_t RooUnfoldCovariance::Solve (TVectorD& v) const
+{
+  // Replace v with V^-1 v. Bins with zero variance (kDiagonal) are set to zero, as for the pseudo-inverse.
+  Int_t n= GetN();
+  if (_type==kDiagonal) {
+    for (Int_t i= 0; i<n; i++) v[i]= _diag[i] > 0.0 ? v[i]/_diag[i] : 0.0;
+    return true;
+  }
+  if (!Decompose()) {
+    v *= PseudoInverse();
+    return true;
+  }
+  if (_type==kDense) return _chol->Solve (v);
+
+  // (d + F F^T)^-1 = d^-1 - d^-1 F (1 + F^T d^-1 F)^-1 F^T d^-1
+  Int_t k= Mat().GetNcols();
+  for (Int_t i= 0; i<n; i++) v[i] /= _diag[i];
+  TVectorD t (k);
+  for (Int_t a= 0; a<k; a++)
+    for (Int_t i= 0; i<n; i++) t[a] += Mat()(i,a)*v[i];
+  if (!_chol->Solve (t)) return false;
+  for (Int_t i= 0; i<n; i++) {
+    Double_t s= 0.0;
+    for (Int_t a= 0; a<k; a++) s += Mat()(i,a)*t[a];
+    v[i] -= s/_diag[i];
+  }
+  return true;
+}
+
+Bool_t RooUnfoldCovariance::Invert (TMatrixD& inv) const
+{
+  // Fill inv with V^-1 (or the pseudo-inverse, if V is not positive definite).
+  Int_t n= GetN();
+  inv.ResizeTo (n, n);
+  if (_type==kDiagonal) {
+    inv.Zero();
+    for (Int_t i= 0; i<n; i++) if (_diag[i] > 0.0) inv(i,i)= 1.0/_diag[i];
+    return true;
+  }
+  if (!Decompose()) {
+    inv= PseudoInverse();
+    return true;
+  }
+  Int_t k= Mat().GetNcols();
+  TMatrixDSym cinv (k);
+  _chol->Invert (cinv);
+  if (_type==kDense) {
+    inv= cinv;
+    return true;
+  }
+  // d^-1 - G C^-1 G^T, with G = d^-1 F
+  TMatrixD g (n, k);
+  for (Int_t i= 0; i<n; i++)
+    for (Int_t a= 0; a<k; a++) g(i,a)= Mat()(i,a)/_diag[i];
+  TMatrixD gc (g, TMatrixD::kMult, cinv);
+  inv.MultT (gc, g);
+  inv *= -1.0;
+  for (Int_t i= 0; i<n; i++) inv(i,i) += 1.0/_diag[i];
+  return true;
+}
+
+Double_t RooUnfoldCovariance::Chi2 (const TVectorD& delta) const
+{
+  TVectorD s= delta;
+  Solve (s);
+  Double_t chi2= 0.0;
+  for (Int_t i= 0, n= GetN(); i<n; i++) chi2 += delta[i]*s[i];
+  return chi2;
+}
+
+TVectorD& RooUnfoldCovariance::Sample (TVectorD& x, TRandom* rnd) const
+{
+  // Fill x with Gaussian random numbers with covariance V, taken from rnd, if specified, or gRandom.
+  if (!rnd) rnd= gRandom;
+  Int_t n= GetN();
+  x.ResizeTo (n);
+  if (_type==kDense) {
+    if (!_root) {
+      // L = U^T from the Cholesky decomposition V = U^T U, or U sqrt(S) from the SVD if not positive definite
+      if (Decompose()) {
+        _root= new TMatrixD (TMatrixD::kTransposed, _chol->GetU());
+      } else {
+        TDecompSVD svd (Mat());
+        svd.Decompose();
+        const TVectorD& sig= svd.GetSig();
+        _root= new TMatrixD (svd.GetU());
+        for (Int_t i= 0; i<n; i++)
+          for (Int_t k= 0; k<n; k++) (*_root)(i,k) *= sig[k] > 0.0 ? sqrt(sig[k]) : 0.0;
+      }
+    }
+    for (Int_t i= 0; i<n; i++) x[i]= rnd->Gaus(0.0,1.0);
+    x *= *_root;
+    return x;
+  }
+  for (Int_t i= 0; i<n; i++) x[i]= _diag[i] > 0.0 ? rnd->Gaus(0.0,sqrt(_diag[i])) : 0.0;
+  if (_type==kLowRank)
+    for (Int_t a= 0, k= Mat().GetNcols(); a<k; a++) {
+      Double_t g= rnd->Gaus(0.0,1.0);
+      for (Int_t i= 0; i<n; i++) x[i] += Mat()(i,a)*g;
+    }
+  return x;
+}
+
+void RooUnfoldCovariance::Print (Option_t*) const
+{
+  static const char* const names[]= { "diagonal", "dense", "low-rank plus diagonal" };
+  cout << ClassName() << ": " << names[_type] << " " << GetN() << " x " << GetN();
+  if (_type==kLowRank) cout << ", rank " << GetRank();
+  cout << endl;
+}
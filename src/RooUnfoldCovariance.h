@@ -0,0 +1,105 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Covariance matrix that keeps diagonal or low-rank-plus-diagonal
+//      structure, with multiply, solve, and sampling.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDCOVARIANCE_HH
+#define ROOUNFOLDCOVARIANCE_HH
+
+#include <vector>
+
+#include "TObject.h"
+#include "TVectorD.h"
+#include "TMatrixD.h"
+
+class TRandom;
+class TDecompChol;
+
+class RooUnfoldCovariance : public TObject {
+
+public:
+
+  enum Type {       // Storage of the covariance matrix V:
+    kDiagonal,      //   V = diag(d), for uncorrelated errors
+    kDense,         //   V as a full n x n matrix
+    kLowRank        //   V = diag(d) + F F^T, with F an n x k matrix of correlated error sources
+  };
+
+  // Standard methods
+
+  RooUnfoldCovariance(); // default constructor
+  explicit RooUnfoldCovariance (const TVectorD& variances);                   // diagonal
+  explicit RooUnfoldCovariance (const TMatrixD& cov);                         // dense
+  RooUnfoldCovariance (const TVectorD& variances, const TMatrixD& factors);   // low-rank plus diagonal
+  RooUnfoldCovariance (const RooUnfoldCovariance& rhs); // copy constructor
+  virtual ~RooUnfoldCovariance(); // destructor
+  RooUnfoldCovariance& operator= (const RooUnfoldCovariance& rhs); // assignment operator
+
+  // Set up
+
+  RooUnfoldCovariance& SetVariances (const TVectorD& variances);
+  RooUnfoldCovariance& SetErrors    (const TVectorD& errors);  // diagonal, with variances errors^2
+  RooUnfoldCovariance& SetMatrix    (const TMatrixD& cov);
+  RooUnfoldCovariance& SetLowRank   (const TVectorD& variances, const TMatrixD& factors);
+  RooUnfoldCovariance& Use          (const TMatrixD& cov);     // dense, sharing cov (not copied or written)
+  RooUnfoldCovariance& SetSlice     (const RooUnfoldCovariance& cov, const std::vector<Int_t>& bins);  // bins of cov only
+
+  // Accessors
+
+  Int_t    GetType() const;
+  Int_t    GetN()    const;
+  Int_t    GetRank() const;                    // columns of F (kLowRank), n (kDense), or 0 (kDiagonal)
+  const TVectorD& GetDiagonal() const;         // d (kDiagonal, kLowRank), or the diagonal of V (kDense)
+  const TMatrixD& GetFactors()  const;         // F (kLowRank), or V (kDense)
+  Double_t operator() (Int_t i, Int_t j) const;
+  TMatrixD& GetMatrix (TMatrixD& m) const;     // fill a dense n x n matrix
+
+  // Operations
+
+  TVectorD& Multiply (TVectorD& v) const;      // v = V v
+  Bool_t    Solve    (TVectorD& v) const;      // v = V^-1 v (pseudo-inverse if V is singular)
+  Bool_t    Invert   (TMatrixD& inv) const;    // inv = V^-1 (pseudo-inverse if V is singular)
+  Double_t  Chi2     (const TVectorD& delta) const;  // delta^T V^-1 delta
+  TVectorD& Sample   (TVectorD& x, TRandom* rnd= 0) const;  // random x with covariance V (and zero mean)
+  virtual void Print (Option_t* opt="") const;
+
+private:
+  const TMatrixD& Mat() const;
+  Bool_t Decompose() const;
+  const TMatrixD& PseudoInverse() const;
+  void   ClearDecomposition();
+
+  Int_t    _type;   // Type
+  TVectorD _diag;   // d, or the diagonal of V for kDense
+  TMatrixD _mat;    // V (kDense) or F (kLowRank)
+  const TMatrixD*      _shared; //! V given to Use(), instead of _mat
+  mutable Int_t        _status; //! 0: not decomposed, 1: Cholesky decomposition, -1: not positive definite
+  mutable TDecompChol* _chol;   //! Cholesky decomposition of V (kDense), or of 1 + F^T d^-1 F (kLowRank)
+  mutable TMatrixD*    _root;   //! L with V = L L^T (kDense), for Sample
+  mutable TMatrixD*    _pinv;   //! pseudo-inverse, if V is not positive definite
+
+public:
+  ClassDef (RooUnfoldCovariance, 1) // Diagonal, dense, or low-rank-plus-diagonal covariance matrix
+};
+
+// Inline method definitions
+
+inline Int_t           RooUnfoldCovariance::GetType()     const { return _type; }
+inline Int_t           RooUnfoldCovariance::GetN()        const { return _diag.GetNrows(); }
+inline const TVectorD& RooUnfoldCovariance::GetDiagonal() const { return _diag; }
+inline const TMatrixD& RooUnfoldCovariance::GetFactors()  const { return Mat();  }
+inline const TMatrixD& RooUnfoldCovariance::Mat()         const { return _shared ? *_shared : _mat; }
+
+inline
+Int_t RooUnfoldCovariance::GetRank() const
+{
+  if (_type==kDiagonal) return 0;
+  return Mat().GetNcols();
+}
+
+#endif
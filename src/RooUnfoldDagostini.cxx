@@ -175,6 +175,14 @@ RooUnfoldDagostini::GetCov()
   _haveCov= true;
 }
 
+Bool_t
+RooUnfoldDagostini::ThreadSafe (ErrorTreatment) const
+{
+  // BAYES keeps its inputs and results in the /BAYESC/ common block, so cannot run at the same time as
+  // another D'Agostini unfolding.
+  return false;
+}
+
 void
 RooUnfoldDagostini::GetSettings(){
   _minparm=1;
@@ -36,6 +36,7 @@ public:
   Int_t GetIterations() const;
   virtual void  SetRegParm (Double_t parm);
   virtual Double_t GetRegParm() const;
+  virtual Bool_t ThreadSafe (ErrorTreatment withError=kErrors) const;
 
   virtual void Reset();
 
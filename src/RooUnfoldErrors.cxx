@@ -27,6 +27,8 @@ maths needed to plot these graphs. The object requires the number of toys over w
  (0 for a simple calculation, 1 or 2 for a method based on the covariance matrix, depending on the method used for calculation of errors.). </p>
 <p>On some occasions the chi squared value can be very large. This is due to the covariance matrices being near singular and thus 
 difficult to invert reliably. A warning will be displayed if this is the case. To plot the chi squared distribution use the option Draw("chi2"), to filter out the larger values use Draw("chi2","abs(chi2 < max") where max is the largest value to be included.</p> 
+<p>If the unfolding object has a RooUnfoldCheckpoint (RooUnfold::SetCheckpoint()), the toys are saved periodically, and resumed if the job is restarted.
+With a RooUnfoldProgress (RooUnfold::SetProgress()), the toys report their progress, and can be stopped early: the plots then only include the toys done.</p>
 END_HTML */
 /////////////////////////////////////////////////////////////////
 
@@ -42,9 +44,13 @@ END_HTML */
 #include "TProfile.h"
 #include "TNtuple.h"
 #include "TAxis.h"
+#include "TRandom.h"
 
 #include "RooUnfoldResponse.h"
 #include "RooUnfold.h"
+#include "RooUnfoldPhilox.h"
+#include "RooUnfoldForkPool.h"
+#include "RooUnfoldCheckpoint.h"
 #include "RooUnfoldResponse.h"
 
 using std::cout;
@@ -166,23 +172,33 @@ RooUnfoldErrors::CreatePlotsWithChi2()
     TH1::AddDirectory (oldstat);
     
     int odd_ch=0;
-    for (int k=0; k<toys;k++){  
-        RooUnfold* toy= unfold->RunToy();
-        Double_t chi2=       toy->Chi2 (hTrue);
-        const TVectorD reco= toy->Vreco();
-        const TVectorD err=  toy->ErecoV();
+    // Toys may run in worker processes (see RooUnfoldForkPool), which need their own random numbers,
+    // or be resumed from a checkpoint (see RooUnfoldCheckpoint), which needs reproducible ones
+    RooUnfoldCheckpoint* checkpoint= unfold->GetCheckpoint();
+    ToyArgs args= { unfold, hTrue, ntx, unfold->GetToySeed() };
+    if (args.seed<0 && (checkpoint || RooUnfoldForkPool::GetNWorkers()>1)) args.seed= UInt_t(gRandom->Rndm()*4294967296.0);
+    std::vector<Double_t> results;
+    const Int_t nout= 2*ntx+1;
+    TString key;
+    if (checkpoint) key= unfold->CheckpointKey() + Form (" toys=%d truth=%d", toys, hTrue ? 1 : 0);
+    // Stops early if cancelled or out of time (see RooUnfoldProgress)
+    int done= RooUnfoldForkPool::RunLoop ("errors", toys, nout, &RooUnfoldErrors::ToyJob, &args, results,
+                                          unfold->GetProgress(), checkpoint, key, &args.seed);
+    for (int k=0; k<done;k++){  
+        Double_t        chi2= results[size_t(k)*nout];
+        const Double_t* reco= &results[size_t(k)*nout+1];
+        const Double_t* err=  reco+ntx;
         for (int i=0; i<ntx; i++) {    
             graph_vector[i]->Fill(reco[i]);
             h_err->Fill(h_err->GetBinCenter(i+1),err[i]);
         } 
         if (hTrue){
             hchi2->Fill(chi2);
-            if (fabs(chi2)>=maxchi2 && toy->verbose()>=1){
+            if (fabs(chi2)>=maxchi2 && unfold->verbose()>=1){
                 cerr<<"Large |chi^2| value: "<< chi2 << endl;
                 odd_ch++;
             }
         }
-        delete toy;
     }
     for (int i=0; i<ntx; i++){
       TH1D* graph= graph_vector[i];
@@ -200,3 +216,21 @@ RooUnfoldErrors::CreatePlotsWithChi2()
 
 }
 
+void
+RooUnfoldErrors::ToyJob (Int_t k, Double_t* out, void* arg)
+{
+    // chi2, unfolded result, and errors of toy k, for RooUnfoldForkPool.
+    const ToyArgs* args= static_cast<const ToyArgs*>(arg);
+    RooUnfoldPhilox* rnd= args->seed>=0 ? new RooUnfoldPhilox (UInt_t(args->seed), k) : 0;
+    RooUnfold* toy= args->unfold->RunToy (rnd);
+    out[0]= toy->Chi2 (args->hTrue);
+    const TVectorD& reco= toy->Vreco();
+    TVectorD err;
+    toy->ErecoV(err);
+    for (int i=0; i<args->ntx; i++) {
+        out[1+i]=           reco[i];
+        out[1+args->ntx+i]= err[i];
+    }
+    delete toy;
+    delete rnd;
+}
@@ -42,6 +42,8 @@ private:
   double xlo; // Minimum x-axis value 
   double xhi; // Maximum x-axis value
   int ntx; // Number of bins in true distribution
+  struct ToyArgs { RooUnfold* unfold; const TH1* hTrue; int ntx; Long64_t seed; };
+  static void ToyJob (Int_t k, Double_t* out, void* arg); // RooUnfoldForkPool job
   
 public:
 
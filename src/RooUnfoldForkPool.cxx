@@ -0,0 +1,197 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Multi-process worker pool for toy studies. Worker processes are
+//      forked, run disjoint ranges of toys, and write their results into
+//      shared memory, which the parent then merges.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>Runs the toys of RooUnfold::GetErrMat() (kCovToy errors), RooUnfoldErrors, and the regularisation
+parameter scan of RooUnfoldParms in several processes. Unlike threads, this also works for
+unfolding algorithms that are not reentrant, such as RooUnfoldDagostini (which uses Fortran common blocks)
+and RooUnfoldTUnfold.</p>
+<p>Each worker is a fork() of the calling process, so it starts with a copy of all the unfolding objects.
+It runs a contiguous range of the toys and writes each toy's results into an anonymous shared memory
+mapping. The parent waits for the workers, and combines the results in toy order, so the output does
+not depend on the number of workers. Any toys not completed by a worker (eg. if it crashed) are
+rerun in the parent.</p>
+<p>The pool is off by default. To use, eg. 8 processes,
+<pre>
+  RooUnfoldForkPool::SetNWorkers (8);   // or -1 for one per CPU
+</pre>
+With workers, toys use RooUnfoldPhilox streams (see RooUnfold::SetToySeed()). If no toy seed is set,
+one is taken from gRandom, so the toys differ from run to run as before.
+Do not combine with RooUnfold::UnfoldAsync(): only the calling thread survives the fork(). Jobs submitted
+to the thread pool inside a worker (eg. by RooUnfoldBlocks) are run synchronously.</p>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldForkPool.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "TSystem.h"
+#include "TVectorD.h"
+
+#include "RooUnfoldProgress.h"
+#include "RooUnfoldCheckpoint.h"
+#include "RooUnfoldTrace.h"
+#include "RooUnfoldAsync.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+Int_t RooUnfoldForkPool::_nworkers= 0;
+
+void RooUnfoldForkPool::SetNWorkers (Int_t nworkers)
+{
+  _nworkers= nworkers;
+}
+
+Int_t RooUnfoldForkPool::GetNWorkers()
+{
+  Int_t n= _nworkers;
+  if (n<0) {
+    SysInfo_t info;
+    n= (gSystem->GetSysInfo (&info) == 0 && info.fCpus > 0) ? info.fCpus : 1;
+  }
+#if defined(_WIN32)
+  n= 1;
+#endif
+  return n;
+}
+
+void RooUnfoldForkPool::Run (Int_t n, Int_t nout, Job_t job, void* arg, std::vector<Double_t>& results, Int_t offset)
+{
+  // Call job(offset+k,&results[k*nout],arg) for k=0..n-1, using GetNWorkers() processes.
+  results.assign (size_t(n)*nout, 0.0);
+  if (n<=0 || nout<=0) return;
+  std::vector<char> done (n, 0);
+  Int_t nw= GetNWorkers();
+  if (nw > n) nw= n;
+
+#if !defined(_WIN32)
+  if (nw > 1) {
+    // Results, followed by a flag for each item.
+    size_t nbytes= size_t(n)*nout*sizeof(Double_t) + n;
+    void* shm= mmap (0, nbytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (shm == MAP_FAILED) {
+      cerr << "Warning: RooUnfoldForkPool could not map " << nbytes << " bytes of shared memory: running in one process" << endl;
+    } else {
+      Double_t* out=  static_cast<Double_t*>(shm);
+      char*     flag= static_cast<char*>(shm) + size_t(n)*nout*sizeof(Double_t);
+      cout.flush(); cerr.flush(); fflush (0);   // don't duplicate buffered output in the children
+      std::vector<pid_t> pids;
+      for (Int_t w= 0; w<nw; w++) {
+        Int_t first= Long64_t(n)*w/nw, last= Long64_t(n)*(w+1)/nw;
+        pid_t pid= fork();
+        if (pid == 0) {
+          _nworkers= 0;   // no nested pools, eg. kCovToy errors inside a RooUnfoldParms scan
+          RooUnfoldThreadPool::AfterFork();   // the pool's threads were not copied, eg. for RooUnfoldBlocks toys
+          for (Int_t k= first; k<last; k++) {
+            job (offset+k, out+size_t(k)*nout, arg);
+            flag[k]= 1;
+          }
+          cout.flush(); cerr.flush(); fflush (0);
+          _exit (0);   // skip ROOT's exit handlers, which belong to the parent
+        }
+        if (pid < 0) cerr << "Warning: RooUnfoldForkPool could not fork worker " << w << endl;
+        else         pids.push_back (pid);
+      }
+      for (size_t w= 0; w<pids.size(); w++) {
+        int status= 0;
+        while (waitpid (pids[w], &status, 0) < 0 && errno == EINTR) {}
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+          cerr << "Warning: RooUnfoldForkPool worker " << pids[w] << " failed: its remaining toys will be rerun" << endl;
+      }
+      memcpy (&results[0], out, size_t(n)*nout*sizeof(Double_t));
+      memcpy (&done[0], flag, n);
+      munmap (shm, nbytes);
+    }
+  }
+#endif
+
+  // Anything not done by workers (or everything, if there are none)
+  for (Int_t k= 0; k<n; k++)
+    if (!done[k]) job (offset+k, &results[size_t(k)*nout], arg);
+}
+
+Int_t RooUnfoldForkPool::ChunkSize (Int_t n, const RooUnfoldProgress* progress, const RooUnfoldCheckpoint* checkpoint)
+{
+  // Number of items to run between progress updates and checkpoints: at least one per worker.
+  Int_t every= n;
+  if (checkpoint && checkpoint->GetInterval() < every) every= checkpoint->GetInterval();
+  if (progress   && progress  ->GetInterval() < every) every= progress  ->GetInterval();
+  Int_t nw= GetNWorkers();
+  if (every < nw) every= nw;
+  return every>0 ? every : 1;
+}
+
+Int_t RooUnfoldForkPool::RunLoop (const char* item, Int_t n, Int_t nout, Job_t job, void* arg, std::vector<Double_t>& results,
+                                  RooUnfoldProgress* progress, const RooUnfoldCheckpoint* checkpoint, const char* key, Long64_t* seed,
+                                  Reduce_t reduce, Int_t nacc)
+{
+  // As Run(), but in chunks, reporting progress and writing checkpoints in between (see RooUnfoldProgress and
+  // RooUnfoldCheckpoint). A checkpoint of this loop (named item, with inputs key) is resumed, replacing *seed,
+  // the toy seed that job takes from arg. Returns the number of items done, which is less than n if progress
+  // stopped the loop: their results are in results[0..done*nout-1].
+  // With reduce, each item's results are instead added, in item order, to the nacc running sums in results,
+  // which is all that is checkpointed. Otherwise each checkpoint rewrites the results of all the items so far.
+  results.assign (reduce ? size_t(nacc) : size_t(n)*nout, 0.0);
+  if (n<=0 || nout<=0) return 0;
+  Long64_t noseed= -1;
+  if (!seed) seed= &noseed;
+  Int_t next= 0;
+  if (checkpoint) {
+    TVectorD acc;
+    if (checkpoint->Read (item, key, next, *seed, acc)) {
+      if (next<0 || next>n || acc.GetNrows() != (reduce ? nacc : next*nout)) {
+        cerr << "Warning: RooUnfold checkpoint for " << item << " does not match: starting again" << endl;
+        next= 0;
+      } else if (acc.GetNrows()>0)
+        memcpy (&results[0], acc.GetMatrixArray(), acc.GetNrows()*sizeof(Double_t));
+    }
+  }
+  Int_t every= ChunkSize (n, progress, checkpoint);
+  std::vector<Double_t> chunk;
+  while (next<n && (!progress || progress->Update (item, next, n))) {
+    Int_t m= n-next < every ? n-next : every;
+    {
+      RooUnfoldTraceSpan span (item);
+      Run (m, nout, job, arg, chunk, next);
+    }
+    if (reduce) {
+      for (Int_t k= 0; k<m; k++) reduce (&chunk[size_t(k)*nout], &results[0], arg);
+    } else
+      memcpy (&results[size_t(next)*nout], &chunk[0], size_t(m)*nout*sizeof(Double_t));
+    next += m;
+    if (checkpoint && next<n) {
+      RooUnfoldTraceSpan span ("checkpoint");
+      checkpoint->Write (item, key, next, *seed, TVectorD (reduce ? nacc : next*nout, &results[0]));
+    }
+  }
+  if (next==n) {
+    if (progress)   progress->Update (item, n, n);
+    if (checkpoint) checkpoint->Remove (item, key);
+  } else {
+    RooUnfoldTrace::Instant ("stopped");
+    cerr << "Warning: " << item << " stopped after " << next << " of " << n << endl;
+  }
+  return next;
+}
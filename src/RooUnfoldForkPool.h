@@ -0,0 +1,42 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Multi-process worker pool for toy studies. Worker processes are
+//      forked, run disjoint ranges of toys, and write their results into
+//      shared memory, which the parent then merges.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDFORKPOOL_HH
+#define ROOUNFOLDFORKPOOL_HH
+
+#include <vector>
+
+#include "Rtypes.h"
+
+class RooUnfoldProgress;
+class RooUnfoldCheckpoint;
+
+class RooUnfoldForkPool {
+public:
+  typedef void (*Job_t)(Int_t k, Double_t* out, void* arg);  // fill out[0..nout-1] for item k
+  typedef void (*Reduce_t)(const Double_t* out, Double_t* acc, void* arg);  // add one item's out to acc
+
+  static void   SetNWorkers (Int_t nworkers);  // 0 or 1: run in this process (default), -1: one per CPU
+  static Int_t  GetNWorkers();                 // number of worker processes that will be used
+
+  static void   Run (Int_t n, Int_t nout, Job_t job, void* arg, std::vector<Double_t>& results,
+                      Int_t offset= 0);  // items offset..offset+n-1, in results[k*nout+i]
+  static Int_t  RunLoop (const char* item, Int_t n, Int_t nout, Job_t job, void* arg, std::vector<Double_t>& results,
+                         RooUnfoldProgress* progress= 0, const RooUnfoldCheckpoint* checkpoint= 0,
+                         const char* key= 0, Long64_t* seed= 0,
+                         Reduce_t reduce= 0, Int_t nacc= 0);  // Run() with progress and checkpoints: returns items done
+  static Int_t  ChunkSize (Int_t n, const RooUnfoldProgress* progress, const RooUnfoldCheckpoint* checkpoint);
+
+private:
+  static Int_t _nworkers;
+};
+
+#endif
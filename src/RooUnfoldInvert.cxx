@@ -16,6 +16,10 @@
 <p>The simplest method of unfolding works by simply inverting the response matrix.</p> 
 <p>This is not accurate for small matrices and produces inaccurate unfolded distributions.</p>
 <p>The inversion method is included largely to illustrate the necessity of a more effective method of unfolding</p>
+<p>If the response is changed in place, eg. by RooUnfoldResponse::Add() with a new batch of MC, call UpdateResponse()
+before unfolding again. If only a few truth bins changed, this updates the existing decomposition with a low-rank
+correction instead of a new SVD. The change need not be confined to a few bins: only its numerical rank matters,
+eg. a reweighting that changes every bin by a common shape is a rank-1 update.</p>
 END_HTML */
 
 /////////////////////////////////////////////////////////////
@@ -30,7 +34,11 @@ END_HTML */
 #include "TMatrixD.h"
 #include "TDecompSVD.h"
 
+#include <vector>
+#include <cmath>
+
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldCache.h"
 
 using std::cout;
 using std::cerr;
@@ -38,6 +46,10 @@ using std::endl;
 
 ClassImp (RooUnfoldInvert);
 
+static const Int_t    kMaxUpdates= 20;     // successive low-rank updates before a full decomposition
+static const Double_t kUpdateTol=  1e-8;   // largest relative residual accepted after an update
+static const Double_t kRankTol=    1e-12;  // relative size of the part of a response change that is neglected
+
 RooUnfoldInvert::RooUnfoldInvert (const RooUnfoldInvert& rhs)
   : RooUnfold (rhs)
 {
@@ -64,8 +76,7 @@ RooUnfoldInvert::Clone (const char* newname) const
 
 RooUnfoldInvert::~RooUnfoldInvert()
 {
-  delete _svd;
-  delete _resinv;
+  DropDecomposition();
 }
 
 void
@@ -73,51 +84,104 @@ RooUnfoldInvert::Init()
 {
   _svd= 0;
   _resinv= 0;
+  _bmat= _gp= _gq= 0;
+  _nupdates= 0;
   GetSettings();
 }
 
 void
 RooUnfoldInvert::Reset()
 {
-  delete _svd;
-  delete _resinv;
+  DropDecomposition();
   Init();
   RooUnfold::Reset();
 }
 
+void
+RooUnfoldInvert::DropDecomposition()
+{
+  delete _svd;    _svd=    0;
+  delete _resinv; _resinv= 0;
+  delete _bmat;   _bmat=   0;
+  delete _gp;     _gp=     0;
+  delete _gq;     _gq=     0;
+  _nupdates= 0;
+}
+
+void
+RooUnfoldInvert::ResponseMatrix (TMatrixD& b) const
+{
+  // The matrix that is decomposed: the response matrix, or its transpose if there are more truth than measured bins.
+  if (_nt>_nm) {
+    b.ResizeTo (_nt, _nm);
+    b.Transpose (_res->Mresponse());
+  } else {
+    b.ResizeTo (_nm, _nt);
+    b= _res->Mresponse();
+  }
+}
+
 TDecompSVD*
 RooUnfoldInvert::Impl()
 {
-  return _svd;
+  // SVD of the response matrix (or its transpose), or 0 after UpdateResponse().
+  return _gp ? 0 : _svd;
 }
 
 void
 RooUnfoldInvert::Unfold()
 {
-  if (_nt>_nm) {
-    TMatrixD resT (TMatrixD::kTransposed, _res->Mresponse());
-    _svd= new TDecompSVD (resT);
-    delete _resinv; _resinv= 0;
-  } else
-    _svd= new TDecompSVD (_res->Mresponse());
-  if (_svd->Condition()<0){
-    cerr <<"Warning: response matrix bad condition= "<<_svd->Condition()<<endl;
+  // The SVD only depends on the response, so is kept for the next measurement given to this object,
+  // or can be read from the cache, if another measurement was unfolded with the same response.
+  // After UpdateResponse(), the updated (B^T B)^-1 is used instead, until the response changes again
+  // (eg. SetResponse()), when it is decomposed afresh.
+  TMatrixD* bmat= new TMatrixD();
+  ResponseMatrix (*bmat);
+  if (_svd && _bmat && *bmat == *_bmat) {
+    delete bmat;
+    bmat= 0;
+  }
+  if (bmat) {
+    TString key;
+    if (_cache) key= DecompositionKey (_nt>_nm ? "transposed" : "");
+    DropDecomposition();
+    _bmat= bmat;
+    if (_cache) {
+      TDecompSVD* svd= new TDecompSVD();
+      if (_cache->Read (key, "svd", *svd)) _svd= svd;
+      else                                 delete svd;
+    }
+    if (!_svd) {
+      _svd= new TDecompSVD (*_bmat);
+      if (_cache && _svd->Decompose()) _cache->Write (key, "svd", *_svd);
+    }
+    if (_svd->Condition()<0){
+      cerr <<"Warning: response matrix bad condition= "<<_svd->Condition()<<endl;
+    }
   }
 
   _rec.ResizeTo(_nm);
   _rec= Vmeasured();
+  SubtractFakes (_rec, _verbose);
 
-  if (_res->FakeEntries()) {
-    TVectorD fakes= _res->Vfakes();
-    Double_t fac= _res->Vmeasured().Sum();
-    if (fac!=0.0) fac=  Vmeasured().Sum() / fac;
-    if (_verbose>=1) cout << "Subtract " << fac*fakes.Sum() << " fakes from measured distribution" << endl;
-    fakes *= fac;
-    _rec -= fakes;
-  }
-
-  Bool_t ok;
-  if (_nt>_nm) {
+  Bool_t ok= true;
+  if (_gp) {
+    // least squares x = (A^T A)^-1 A^T y, or minimum norm x = A^T (A A^T)^-1 y
+    const TMatrixD& b= *_bmat;
+    if (_nt>_nm) {
+      TVectorD gy (_nm);
+      ApplyG (_rec, gy);
+      _rec.ResizeTo(_nt);
+      _rec= b * gy;
+    } else {
+      TVectorD bty (_nt);
+      for (Int_t j= 0; j<_nt; j++)
+        for (Int_t i= 0; i<_nm; i++)
+          bty[j] += b(i,j) * _rec[i];
+      _rec.ResizeTo(_nt);
+      ApplyG (bty, _rec);
+    }
+  } else if (_nt>_nm) {
     ok= InvertResponse();
     if (ok) _rec *= *_resinv;
   } else
@@ -133,20 +197,72 @@ RooUnfoldInvert::Unfold()
   _haveCov=  false;
 }
 
+TVectorD&
+RooUnfoldInvert::SubtractFakes (TVectorD& v, Int_t verbose) const
+{
+  if (_res->FakeEntries()) {
+    TVectorD fakes= _res->Vfakes();
+    Double_t fac= _res->Vmeasured().Sum();
+    if (fac!=0.0) fac=  Vmeasured().Sum() / fac;
+    if (verbose>=1) cout << "Subtract " << fac*fakes.Sum() << " fakes from measured distribution" << endl;
+    fakes *= fac;
+    v -= fakes;
+  }
+  return v;
+}
+
 void
 RooUnfoldInvert::GetCov()
 {
-    if (!InvertResponse()) return;
-    _cov.ResizeTo(_nt,_nt);
-    ABAT (*_resinv, GetMeasuredCov(), _cov);
-    _haveCov= true;
+    GetCovJacobian();
+}
+
+Bool_t
+RooUnfoldInvert::GetJacobian()
+{
+    // x = A^+ (y-fakes), so dx/dy = A^+. Differentiating the pseudo-inverse gives
+    // dx/dA_jk = P(i,k)*s(j) - A^+(i,j)*x(k) with, for the least-squares solution (_nt<=_nm),
+    // P = (A^T A)^-1 = A^+ A^+^T and s = y-fakes-Ax, or for the minimum-norm solution (_nt>_nm),
+    // P = 1 - A^+ A and s = A^+^T x.
+    if (!InvertResponse()) return false;
+    _dxdy.ResizeTo(_nt,_nm);
+    _dxdy= *_resinv;
+    if (!_dosys) return true;
+    const TMatrixD& A= _res->Mresponse();
+    _dxdAu.ResizeTo(_nt);
+    _dxdAu= _rec;
+    _dxdAP.ResizeTo(_nt,_nt);
+    _dxdAs.ResizeTo(_nm);
+    if (_nt>_nm) {
+      _dxdAP.Mult (_dxdy, A);
+      _dxdAP *= -1.0;
+      for (Int_t i= 0; i<_nt; i++) _dxdAP(i,i) += 1.0;
+      _dxdAs.Zero();
+      for (Int_t j= 0; j<_nm; j++)
+        for (Int_t i= 0; i<_nt; i++)
+          _dxdAs[j] += _dxdy(i,j) * _rec[i];
+    } else {
+      _dxdAP.MultT (_dxdy, _dxdy);
+      _dxdAs= Vmeasured();
+      SubtractFakes (_dxdAs);
+      Add (_dxdAs, -1.0, A, _rec);
+    }
+    return true;
 }
 
 Bool_t
 RooUnfoldInvert::InvertResponse()
 {
-    if (!_svd)   return false;
     if (_resinv) return true;
+    if (_gp) {
+      // A^+ = (A^T A)^-1 A^T, or A^T (A A^T)^-1 for _nt>_nm, where _bmat is A^T
+      TMatrixD bt (TMatrixD::kTransposed, *_bmat);
+      _resinv= new TMatrixD (bt.GetNrows(), bt.GetNcols());
+      ApplyG (bt, *_resinv);
+      if (_nt>_nm) _resinv->T();
+      return true;
+    }
+    if (!_svd)   return false;
     if (_nt>_nm) _resinv= new TMatrixD(_nm,_nt);
     else         _resinv= new TMatrixD(_nt,_nm);
 #if ROOT_VERSION_CODE >= ROOT_VERSION(5,13,4)  /* TDecompSVD::Invert() didn't have ok status before 5.13/04. */
@@ -163,6 +279,184 @@ RooUnfoldInvert::InvertResponse()
     return true;
 }
 
+void
+RooUnfoldInvert::ApplyG (const TMatrixD& x, TMatrixD& y) const
+{
+  // y = G x for G = (B^T B)^-1, kept factored as V S^-2 V^T from the SVD B = U S V^T, less the
+  // corrections P Q^T from UpdateResponse(). Costs O(n^2) per column, rather than O(n^3) to form G.
+  const TVectorD& sig= _svd->GetSig();
+  const TMatrixD& v=   _svd->GetV();
+  TMatrixD vtx (v, TMatrixD::kTransposeMult, x);
+  for (Int_t l= 0; l<vtx.GetNrows(); l++) {
+    Double_t s2= 1.0 / (sig[l]*sig[l]);
+    for (Int_t c= 0; c<vtx.GetNcols(); c++) vtx(l,c) *= s2;
+  }
+  y.Mult (v, vtx);
+  if (_gp) {
+    TMatrixD qtx (*_gq, TMatrixD::kTransposeMult, x);
+    TMatrixD pqtx (*_gp, TMatrixD::kMult, qtx);
+    y -= pqtx;
+  }
+}
+
+void
+RooUnfoldInvert::ApplyG (const TVectorD& x, TVectorD& y) const
+{
+  // y = G x for a single vector.
+  Int_t n= x.GetNrows();
+  TMatrixD xm (n, 1), ym (n, 1);
+  for (Int_t i= 0; i<n; i++) xm(i,0)= x[i];
+  ApplyG (xm, ym);
+  y.ResizeTo (n);
+  for (Int_t i= 0; i<n; i++) y[i]= ym(i,0);
+}
+
+Int_t
+RooUnfoldInvert::LowRank (TMatrixD& d, Int_t maxrank, Double_t tol, TMatrixD& x)
+{
+  // Finds orthonormal columns X with D = X X^T D, to within tol in the Frobenius norm, by Gram-Schmidt
+  // with column pivoting (a truncated rank-revealing QR), which costs O(m n k) for rank k.
+  // Returns the rank k, or -1 if it is more than maxrank. D is deflated in place.
+  Int_t m= d.GetNrows(), n= d.GetNcols();
+  std::vector<TVectorD> q;
+  TVectorD norm2 (n);
+  for (Int_t k= 0;; k++) {
+    Double_t resid= 0.0;
+    Int_t jmax= 0;
+    for (Int_t j= 0; j<n; j++) {
+      Double_t s= 0.0;
+      for (Int_t i= 0; i<m; i++) s += d(i,j)*d(i,j);
+      norm2[j]= s;
+      resid += s;
+      if (s > norm2[jmax]) jmax= j;
+    }
+    if (resid <= tol*tol) {
+      x.ResizeTo (m, k);
+      for (Int_t c= 0; c<k; c++)
+        for (Int_t i= 0; i<m; i++) x(i,c)= q[c][i];
+      return k;
+    }
+    if (k >= maxrank) return -1;
+    TVectorD qk (m);
+    for (Int_t i= 0; i<m; i++) qk[i]= d(i,jmax);
+    for (Int_t c= 0; c<k; c++) qk -= (qk*q[c]) * q[c];   // re-orthogonalise against rounding errors
+    qk *= 1.0/sqrt(qk.Norm2Sqr());
+    q.push_back (qk);
+    for (Int_t j= 0; j<n; j++) {
+      Double_t y= 0.0;
+      for (Int_t i= 0; i<m; i++) y += qk[i]*d(i,j);
+      for (Int_t i= 0; i<m; i++) d(i,j) -= y*qk[i];
+    }
+  }
+}
+
+Bool_t
+RooUnfoldInvert::UpdateResponse (Int_t maxrank)
+{
+  // Call after the response has been changed in place, eg. by RooUnfoldResponse::Add() with a new batch of MC,
+  // to unfold again with the updated response. The results are cleared, so are recalculated when next requested.
+  // If the change to the response matrix A has numerical rank k<=maxrank (default: a quarter of the truth bins),
+  // then instead of a new SVD of A, which costs O(n^3), (A^T A)^-1 is corrected with the Woodbury identity in
+  // O(n^2 k). The result is checked with a probe vector: if the update is inaccurate, the change has too high
+  // a rank, or there have been many successive updates, the response is decomposed afresh at the next unfolding.
+  // Returns true if the decomposition was updated (or did not need to be).
+  _unfolded= _haveCov= _have_err_mat= _haveErrors= _haveWgt= _fail= _fromCache= false;
+  if (!_res || !_bmat || !_svd) {
+    DropDecomposition();
+    return false;
+  }
+  TMatrixD b;
+  ResponseMatrix (b);
+  const TMatrixD& b0= *_bmat;
+  Int_t m= b.GetNrows(), n= b.GetNcols();
+  if (m != b0.GetNrows() || n != b0.GetNcols()) {
+    cerr << "Warning: RooUnfoldInvert::UpdateResponse: response matrix size changed" << endl;
+    DropDecomposition();
+    return false;
+  }
+  if (maxrank<0) maxrank= n/4;
+  if (!_gp) {
+    if (!_svd->Decompose()) {
+      DropDecomposition();
+      return false;
+    }
+    const TVectorD& sig= _svd->GetSig();
+    if (!(sig[n-1] > 1e-12*sig[0])) {
+      DropDecomposition();
+      return false;
+    }
+  }
+
+  // Factor the change D = B'-B = X Y^T, with orthonormal X, from its numerical rank.
+  TMatrixD d (b, TMatrixD::kMinus, b0), x;
+  Int_t k= LowRank (d, (_nupdates<kMaxUpdates ? maxrank : 0), kRankTol*sqrt(b.E2Norm()), x);
+  if (k==0) return true;
+  if (k<0) {
+    if (_verbose>=1) cout << "RooUnfoldInvert: response change has rank above " << maxrank << " after " << _nupdates
+                          << " updates - decompose again" << endl;
+    DropDecomposition();
+    return false;
+  }
+
+  // B'^T B' = B^T B + U C U^T, with W = B^T X, Y = B'^T X - W, U = [Y W], and C = [[1, 1], [1, 0]]. Then by the
+  // Woodbury identity, (B'^T B')^-1 = G - G U (C^-1 + U^T G U)^-1 U^T G, with C^-1 = [[0, 1], [1, -1]].
+  TMatrixD w (b0, TMatrixD::kTransposeMult, x), y (b, TMatrixD::kTransposeMult, x);
+  y -= w;
+  TMatrixD u (n, 2*k);
+  u.SetSub (0, 0, y);
+  u.SetSub (0, k, w);
+  TMatrixD gu (n, 2*k);
+  ApplyG (u, gu);
+  TMatrixD cap (u, TMatrixD::kTransposeMult, gu);
+  for (Int_t c= 0; c<k; c++) {
+    cap(c,k+c)   += 1.0;
+    cap(k+c,c)   += 1.0;
+    cap(k+c,k+c) -= 1.0;
+  }
+  TMatrixD capinv;
+  if (InvertMatrix (cap, capinv, "response update", 0) != 1) {
+    DropDecomposition();
+    return false;
+  }
+  TMatrixD p (gu, TMatrixD::kMult, capinv);
+
+  // Check G' B'^T B' z = z for a probe vector z, with G' = G - P (GU)^T
+  TVectorD z (n);
+  for (Int_t j= 0; j<n; j++) z[j]= 1.0 + (j%7)/7.0;
+  TVectorD bz= b * z, btbz (n), r (n);
+  for (Int_t j= 0; j<n; j++)
+    for (Int_t i= 0; i<m; i++)
+      btbz[j] += b(i,j) * bz[i];
+  ApplyG (btbz, r);
+  TVectorD gutv (2*k);
+  for (Int_t c= 0; c<2*k; c++)
+    for (Int_t j= 0; j<n; j++)
+      gutv[c] += gu(j,c) * btbz[j];
+  r -= p * gutv;
+  r -= z;
+  if (!(r.Norm2Sqr() <= kUpdateTol*kUpdateTol*z.Norm2Sqr())) {
+    if (_verbose>=1) cout << "RooUnfoldInvert: inaccurate response update - decompose again" << endl;
+    DropDecomposition();
+    return false;
+  }
+
+  // Append the correction to P and Q, keeping the SVD of the original response
+  Int_t r0= _gp ? _gp->GetNcols() : 0;
+  if (!_gp) {
+    _gp= new TMatrixD (n, 2*k);
+    _gq= new TMatrixD (n, 2*k);
+  } else {
+    _gp->ResizeTo (n, r0+2*k);
+    _gq->ResizeTo (n, r0+2*k);
+  }
+  _gp->SetSub (0, r0, p);
+  _gq->SetSub (0, r0, gu);
+  delete _resinv; _resinv= 0;
+  *_bmat= b;
+  _nupdates++;
+  return true;
+}
+
 void
 RooUnfoldInvert::GetSettings(){
     _minparm=0;
@@ -36,20 +36,33 @@ public:
 
   virtual void Reset();
   TDecompSVD* Impl();
+  Bool_t UpdateResponse (Int_t maxrank= -1);  // Update the decomposition after the response was changed, eg. by more MC
+  Int_t  GetNUpdates() const;                 // Number of low-rank updates since the last full decomposition
 
 protected:
   virtual void Unfold();
   virtual void GetCov();
+  virtual Bool_t GetJacobian();
   virtual void GetSettings();
 
 private:
   void Init();
   Bool_t InvertResponse();
+  TVectorD& SubtractFakes (TVectorD& v, Int_t verbose= 0) const;
+  void ResponseMatrix (TMatrixD& b) const;
+  void DropDecomposition();
+  void ApplyG (const TMatrixD& x, TMatrixD& y) const;
+  void ApplyG (const TVectorD& x, TVectorD& y) const;
+  static Int_t LowRank (TMatrixD& d, Int_t maxrank, Double_t tol, TMatrixD& x);
 
 protected:
   // instance variables
   TDecompSVD* _svd;
   TMatrixD*   _resinv;
+  TMatrixD*   _bmat;      //! Decomposed response matrix (transposed if _nt>_nm), for UpdateResponse
+  TMatrixD*   _gp;        //! (B^T B)^-1 = V S^-2 V^T - P Q^T for _bmat=B after UpdateResponse, where _svd
+  TMatrixD*   _gq;        //! is of the response before the updates
+  Int_t       _nupdates;  //! Number of updates since the last full decomposition
 
 public:
   ClassDef (RooUnfoldInvert, 1)  // Unregularised unfolding
@@ -57,6 +70,12 @@ public:
 
 // Inline method definitions
 
+inline
+Int_t RooUnfoldInvert::GetNUpdates() const
+{
+  return _nupdates;
+}
+
 inline
 RooUnfoldInvert::RooUnfoldInvert()
   : RooUnfold()
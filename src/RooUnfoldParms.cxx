@@ -23,6 +23,9 @@
 <p>For each regularisaion parameter in the predefined range, the measured distribution is unfolded. For each unfolded distribution residuals are plotted and rms found for the 
 rms spread. The sum of the residuals over the whole distribution are calculated,divided by the number of bins and then rooted in order to 
 return an rms. The chi squared values are calculated using the chi2() method in RooUnfold.</p>
+<p>If the unfolding object has a RooUnfoldCheckpoint (RooUnfold::SetCheckpoint()), the points are saved periodically,
+and resumed if the job is restarted. With a RooUnfoldProgress (RooUnfold::SetProgress()), the scan reports its progress,
+and can be stopped early: the plots then only include the points done.</p>
 
  END_HTML */
 ////////////////////////////////////////////////////////////////
@@ -41,6 +44,8 @@ return an rms. The chi squared values are calculated using the chi2() method in
 #include "RooUnfold.h"
 #include "TRandom.h"
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldForkPool.h"
+#include "RooUnfoldCheckpoint.h"
 #include "TLatex.h"
 using std::cout;
 using std::cerr;
@@ -157,16 +162,38 @@ RooUnfoldParms::DoMath()
         Int_t _overflow=unfold->Overflow();
         Int_t nt = unfold->response()->GetNbinsTruth();
         if (_overflow) nt += 2;
-    
-        for (Double_t k=_minparm;k<=_maxparm;k+=_stepsizeparm)
+        const TH1* htbins= unfold->response()->Htruth();
+
+        // Unfold at each point, possibly in worker processes (see RooUnfoldForkPool)
+        vector<Double_t> parms;
+        for (Double_t k=_minparm;k<=_maxparm;k+=_stepsizeparm) parms.push_back(k);
+        // Each point is unfolded into the same histogram, rather than a new one per point
+        Bool_t oldstat= TH1::AddDirectoryStatus();
+        TH1::AddDirectory (kFALSE);
+        TH1* hReco= (TH1*) htbins->Clone ("unfold_reco");
+        TH1::AddDirectory (oldstat);
+        ParmArgs args= { unfold, doerror, hTrue, (parms.empty() ? 0 : &parms[0]), nt, _overflow, hReco };
+        vector<Double_t> results;
+        const Int_t nout= 2*nt+1;
+        // Resume from, and save, the points done so far (see RooUnfoldCheckpoint),
+        // and stop early if cancelled or out of time (see RooUnfoldProgress)
+        RooUnfoldCheckpoint* checkpoint= unfold->GetCheckpoint();
+        TString key;
+        if (checkpoint) key= unfold->CheckpointKey() + Form (" doerror=%d truth=%d parms=%.17g:%.17g:%.17g",
+                                                             doerror, hTrue ? 1 : 0, _minparm, _maxparm, _stepsizeparm);
+        size_t done= RooUnfoldForkPool::RunLoop ("parms", parms.size(), nout, &RooUnfoldParms::ParmJob, &args, results,
+                                                 unfold->GetProgress(), checkpoint, key);
+        delete hReco;
+
+        for (size_t p=0; p<done; p++)
         {   
-            RooUnfold* unf = unfold->Clone("unfold_toy");
-            unf->SetRegParm(k);
+            Double_t k= parms[p];
+            const Double_t* reco= &results[p*nout+1];
+            const Double_t* err=  reco+nt;
             Double_t sq_err_tot=0;
-            TH1* hReco=unf->Hreco(doerror); 
             for (Int_t i= 0; i < nt; i++)
             {
-              sq_err_tot += RooUnfoldResponse::GetBinError (hReco, i, _overflow);
+              sq_err_tot += err[i];
             }
             herr->Fill(k,sq_err_tot/nt);
             if (hTrue)
@@ -174,10 +201,10 @@ RooUnfoldParms::DoMath()
                 Double_t rsqt=0;    
                 Double_t res_tot=0;
                 for (int i=0;i<nt;i++){
-                    Int_t j= RooUnfoldResponse::GetBin (hReco, i, _overflow);
-                    if (hReco->GetBinContent(j)!=0.0 || (hReco->GetBinError(j)>0.0)) 
+                    Int_t j= RooUnfoldResponse::GetBin (htbins, i, _overflow);
+                    if (reco[i]!=0.0 || (err[i]>0.0)) 
                     {
-                        Double_t res=hReco->GetBinContent(j) - hTrue->GetBinContent(j);
+                        Double_t res=reco[i] - hTrue->GetBinContent(j);
                         //cout <<"res="<<res<<endl;
                         Double_t rsq=res*res;
                         rsqt+=rsq;
@@ -186,14 +213,13 @@ RooUnfoldParms::DoMath()
                         hres->Fill(k,res);
                     }
                 }
-                double chi2=unf->Chi2(hTrue,doerror);
+                double chi2=results[p*nout];
                 if (chi2<=1e10){
                     hch2->Fill(k,chi2);
                 }
                 
             }
             gvl++;
-            delete unf;
         }
         Double_t bn=_minparm;
         for (int i=0; i<hres->GetNbinsX(); i++){
@@ -208,6 +234,23 @@ RooUnfoldParms::DoMath()
     _done_math=true;
 }
 
+void
+RooUnfoldParms::ParmJob (Int_t p, Double_t* out, void* arg)
+{
+    // chi2 (if there is a truth distribution), unfolded result, and errors
+    // at regularisation parameter point p, for RooUnfoldForkPool.
+    const ParmArgs* args= static_cast<const ParmArgs*>(arg);
+    RooUnfold* unf = args->unfold->Clone("unfold_toy");
+    unf->SetRegParm(args->parms[p]);
+    TH1* hReco=unf->Hreco(args->hReco,args->doerror);
+    for (Int_t i= 0; i < args->nt; i++) {
+        out[1+i]=          RooUnfoldResponse::GetBinContent (hReco, i, args->overflow);
+        out[1+args->nt+i]= RooUnfoldResponse::GetBinError   (hReco, i, args->overflow);
+    }
+    out[0]= args->hTrue ? unf->Chi2(args->hTrue,args->doerror) : 0.0;
+    delete unf;
+}
+
 void
 RooUnfoldParms::SetMinParm(double min)
 {
@@ -45,6 +45,8 @@ class RooUnfoldParms : public TNamed {
     Double_t _maxparm; //Maximum parameter
     Double_t _minparm; //Minimum parameter
     Double_t _stepsizeparm; //Step size
+    struct ParmArgs { const RooUnfold* unfold; RooUnfold::ErrorTreatment doerror; const TH1* hTrue; const Double_t* parms; Int_t nt; Int_t overflow; TH1* hReco; };
+    static void ParmJob (Int_t p, Double_t* out, void* arg); // RooUnfoldForkPool job
 public:
     ClassDef (RooUnfoldParms, 0)  // Optimisation of unfolding regularisation parameter
 };
@@ -0,0 +1,104 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Counter-based random number generator (Philox4x32-10) with
+//      independent streams, used for reproducible toys.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>A TRandom implementing the Philox4x32-10 counter-based generator of Salmon et al.,
+"Parallel random numbers: as easy as 1, 2, 3" (SC11). Each output block is a keyed bijection of a
+128-bit counter, so there is no state to carry from one number to the next.
+The key is the seed and the upper half of the counter is the stream number, so that, for example,
+toy number <i>k</i> generated with <tt>SetStream(k)</tt> always sees the same random numbers, however
+many toys are run, in whatever order, and on whatever thread.</p>
+<p>RooUnfold::SetToySeed() uses this generator, with one stream per toy, for the toys used by
+RooUnfold::GetErrMat() (kCovToy errors) and RooUnfoldErrors.
+It can also be passed to RooUnfold::RunToy() and RooUnfoldResponse::RunToy().</p>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldPhilox.h"
+
+ClassImp (RooUnfoldPhilox);
+
+RooUnfoldPhilox::RooUnfoldPhilox (UInt_t seed, ULong64_t stream)
+  : TRandom(seed), _stream(stream), _counter(0), _used(4)
+{
+  SetName  ("RooUnfoldPhilox");
+  SetTitle ("Random number generator: Philox4x32-10");
+  SetSeed (seed);
+}
+
+RooUnfoldPhilox::~RooUnfoldPhilox()
+{
+}
+
+void RooUnfoldPhilox::SetSeed (UInt_t seed)
+{
+  // Set the key. Unlike other TRandoms, 0 is an ordinary seed. Restarts the current stream.
+  fSeed= seed;
+  _counter= 0;
+  _used= 4;
+}
+
+void RooUnfoldPhilox::SetStream (ULong64_t stream)
+{
+  _stream= stream;
+  _counter= 0;
+  _used= 4;
+}
+
+void RooUnfoldPhilox::Philox4x32 (const UInt_t ctr[4], const UInt_t key[2], UInt_t out[4])
+{
+  // Philox4x32 with 10 rounds.
+  const ULong64_t m0= 0xD2511F53, m1= 0xCD9E8D57;
+  const UInt_t    w0= 0x9E3779B9, w1= 0xBB67AE85;
+  UInt_t c0= ctr[0], c1= ctr[1], c2= ctr[2], c3= ctr[3];
+  UInt_t k0= key[0], k1= key[1];
+  for (Int_t r= 0; r<10; r++) {
+    if (r>0) {
+      k0 += w0;
+      k1 += w1;
+    }
+    ULong64_t p0= m0*c0, p1= m1*c2;
+    UInt_t hi0= UInt_t(p0>>32), lo0= UInt_t(p0);
+    UInt_t hi1= UInt_t(p1>>32), lo1= UInt_t(p1);
+    c0= hi1 ^ c1 ^ k0;
+    c1= lo1;
+    c2= hi0 ^ c3 ^ k1;
+    c3= lo0;
+  }
+  out[0]= c0; out[1]= c1; out[2]= c2; out[3]= c3;
+}
+
+void RooUnfoldPhilox::NextBlock()
+{
+  UInt_t ctr[4]= { UInt_t(_counter), UInt_t(_counter>>32), UInt_t(_stream), UInt_t(_stream>>32) };
+  UInt_t key[2]= { fSeed, 0 };
+  Philox4x32 (ctr, key, _block);
+  _counter++;
+  _used= 0;
+}
+
+Double_t RooUnfoldPhilox::Rndm (Int_t)
+{
+  // Uniform random number in the open interval (0,1), with 32-bit resolution like TRandom3.
+  if (_used>=4) NextBlock();
+  return (Double_t(_block[_used++]) + 0.5) * 2.3283064365386963e-10;  // 2^-32
+}
+
+void RooUnfoldPhilox::RndmArray (Int_t n, Double_t* array)
+{
+  for (Int_t i= 0; i<n; i++) array[i]= Rndm();
+}
+
+void RooUnfoldPhilox::RndmArray (Int_t n, Float_t* array)
+{
+  for (Int_t i= 0; i<n; i++) array[i]= Float_t(Rndm());
+}
@@ -0,0 +1,60 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Counter-based random number generator (Philox4x32-10) with
+//      independent streams, used for reproducible toys.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDPHILOX_HH
+#define ROOUNFOLDPHILOX_HH
+
+#include "TRandom.h"
+
+class RooUnfoldPhilox : public TRandom {
+
+public:
+
+  RooUnfoldPhilox (UInt_t seed= 0, ULong64_t stream= 0); // constructor
+  virtual ~RooUnfoldPhilox(); // destructor
+
+  void      SetStream (ULong64_t stream);   // Select stream (eg. toy number) and restart it
+  ULong64_t GetStream() const;
+  ULong64_t GetCounter() const;             // Number of blocks of 4 words generated in this stream
+
+  virtual void     SetSeed (UInt_t seed= 0); // Set key and restart stream
+  virtual Double_t Rndm (Int_t i= 0);
+  virtual void     RndmArray (Int_t n, Float_t*  array);
+  virtual void     RndmArray (Int_t n, Double_t* array);
+
+  static void Philox4x32 (const UInt_t ctr[4], const UInt_t key[2], UInt_t out[4]);
+
+private:
+  void NextBlock();
+
+  ULong64_t _stream;   // stream number, the upper half of the counter
+  ULong64_t _counter;  // block number within the stream
+  UInt_t    _block[4]; // current output block
+  Int_t     _used;     // words of _block already returned
+
+public:
+  ClassDef (RooUnfoldPhilox, 1) // Philox4x32-10 counter-based random number generator
+};
+
+// Inline method definitions
+
+inline
+ULong64_t RooUnfoldPhilox::GetStream() const
+{
+  return _stream;
+}
+
+inline
+ULong64_t RooUnfoldPhilox::GetCounter() const
+{
+  return _counter;
+}
+
+#endif
@@ -0,0 +1,133 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Progress reporting, cancellation, and wall-clock budget for long
+//      toy and scan loops.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>Observes and controls the long loops: the toys of RooUnfold::GetErrMat() (kCovToy errors) and RooUnfoldErrors,
+and the regularisation parameter scan of RooUnfoldParms. Each loop calls Update() after every GetInterval() toys
+or scan points. Override Update() to receive the progress, or use SetVerbose(1) to print it.</p>
+<p>A loop stops at its next update if Update() returns false, which the default implementation does after
+Cancel() (which may be called from another thread) or when the wall-clock budget set with SetBudget() is used up.
+Toy loops then return the estimate from the toys done so far: RooUnfold::NToysRun() gives the number used.
+The covariance matrix from fewer toys than requested is not stored in a RooUnfoldCache, but a
+RooUnfoldCheckpoint is kept, so the loop can be completed later.
+A stopped RooUnfoldParms scan only includes the points done.</p>
+<p>The L-curve scan of RooUnfoldTUnfold and the response toys of RooUnfoldSvd run inside TUnfold and TSVDUnfold,
+so can only be skipped if already stopped when they start.</p>
+<pre>
+  RooUnfoldProgress progress;
+  progress.SetBudget (3600);       // stop toys after an hour
+  unfold.SetProgress (&amp;progress);
+  TVectorD err= unfold.ErecoV (RooUnfold::kCovToy);
+  cout &lt;&lt; "used " &lt;&lt; unfold.NToysRun() &lt;&lt; " of " &lt;&lt; unfold.NToys() &lt;&lt; " toys" &lt;&lt; endl;
+</pre>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldProgress.h"
+
+#include <iostream>
+
+#include "TStopwatch.h"
+#include "TMutex.h"
+
+using std::cout;
+using std::endl;
+
+ClassImp (RooUnfoldProgress);
+
+RooUnfoldProgress::RooUnfoldProgress (const char* name, const char* title)
+  : TNamed (name, title ? title : "RooUnfold progress"),
+    _budget(0.0), _every(1), _verbose(0), _cancel(kFALSE), _done(0), _total(0), _sw(new TStopwatch()),
+    _lock(new TMutex())
+{
+  _sw->Start();
+}
+
+RooUnfoldProgress::~RooUnfoldProgress()
+{
+  delete _sw;
+  delete _lock;
+}
+
+void RooUnfoldProgress::SetBudget (Double_t seconds)
+{
+  // Stop loops when this many seconds have passed from now. 0 for no limit.
+  _lock->Lock();
+  _budget= seconds;
+  _sw->Start();
+  _lock->UnLock();
+}
+
+void RooUnfoldProgress::Cancel()
+{
+  // Stop the current loop at its next update. Loops over toys keep the toys done so far.
+  _lock->Lock();
+  _cancel= kTRUE;
+  _lock->UnLock();
+}
+
+Bool_t RooUnfoldProgress::Cancelled() const
+{
+  _lock->Lock();
+  Bool_t cancel= _cancel;
+  _lock->UnLock();
+  return cancel;
+}
+
+void RooUnfoldProgress::Reset()
+{
+  _lock->Lock();
+  _cancel= kFALSE;
+  _task= "";
+  _done= _total= 0;
+  _sw->Start();
+  _lock->UnLock();
+}
+
+Double_t RooUnfoldProgress::Elapsed() const
+{
+  _lock->Lock();
+  Double_t t= _sw->RealTime();
+  _sw->Continue();
+  _lock->UnLock();
+  return t;
+}
+
+Bool_t RooUnfoldProgress::Expired() const
+{
+  _lock->Lock();
+  Double_t budget= _budget;
+  _lock->UnLock();
+  return budget>0.0 && Elapsed() >= budget;
+}
+
+Bool_t RooUnfoldProgress::Update (const char* task, Int_t done, Int_t total)
+{
+  // Called by the loops with the number of items done so far. Returns false if the loop should stop.
+  _lock->Lock();
+  _task=  task;
+  _done=  done;
+  _total= total;
+  _lock->UnLock();
+  if (_verbose>=1) cout << task << ": " << done << " of " << total << " done after " << Elapsed() << " s" << endl;
+  return !Stopped();
+}
+
+void RooUnfoldProgress::Print (Option_t*) const
+{
+  cout << ClassName() << "::" << GetName() << " \"" << GetTitle() << "\": ";
+  if (_total>0) cout << _task << " " << _done << " of " << _total << ", ";
+  cout << Elapsed() << " s";
+  if (_budget>0.0) cout << " of " << _budget << " s budget";
+  if (Cancelled()) cout << ", cancelled";
+  cout << endl;
+}
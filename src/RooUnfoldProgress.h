@@ -0,0 +1,97 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Progress reporting, cancellation, and wall-clock budget for long
+//      toy and scan loops.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDPROGRESS_HH
+#define ROOUNFOLDPROGRESS_HH
+
+#include "TNamed.h"
+
+class TStopwatch;
+class TMutex;
+
+class RooUnfoldProgress : public TNamed {
+
+public:
+
+  // Standard methods
+
+  RooUnfoldProgress (const char* name= "progress", const char* title= 0); // constructor
+  virtual ~RooUnfoldProgress(); // destructor
+
+  // Control
+
+  void     SetBudget (Double_t seconds);  // stop loops this long after now (0: no limit)
+  Double_t GetBudget() const;
+  void     SetInterval (Int_t every);     // report after every this many toys or scan points
+  Int_t    GetInterval() const;
+  void     SetVerbose (Int_t level);      // 1: print each update
+  void     Cancel();                      // stop loops at the next update, eg. from another thread
+  void     Reset();                       // clear cancellation and restart the budget
+
+  // Status
+
+  Bool_t   Cancelled() const;
+  Bool_t   Expired() const;               // wall-clock budget used up
+  Bool_t   Stopped() const;               // cancelled or expired
+  Double_t Elapsed() const;               // seconds since construction, SetBudget(), or Reset()
+  const char* Task() const;               // last task reported
+  Int_t    Done()  const;                 // items done in the last task reported
+  Int_t    Total() const;                 // items requested in the last task reported
+
+  virtual Bool_t Update (const char* task, Int_t done, Int_t total);  // returns false to stop
+  virtual void   Print (Option_t* opt="") const;
+
+private:
+  RooUnfoldProgress (const RooUnfoldProgress&);             // not copyable
+  RooUnfoldProgress& operator= (const RooUnfoldProgress&);
+
+  Double_t        _budget;     // wall-clock budget (s)
+  Int_t           _every;      // items between updates
+  Int_t           _verbose;    // print level
+  Bool_t          _cancel;     // set by Cancel(), maybe from another thread
+  TString         _task;       // last task
+  Int_t           _done;       // last items done
+  Int_t           _total;      // last items requested
+  TStopwatch*     _sw;         //! wall clock
+  TMutex*         _lock;       //! guards _cancel, the last task, and _sw, which other threads may use
+
+public:
+  ClassDef (RooUnfoldProgress, 0) // Progress, cancellation and time budget for toy and scan loops
+};
+
+// Inline method definitions
+
+inline Double_t    RooUnfoldProgress::GetBudget()   const { return _budget; }
+inline Int_t       RooUnfoldProgress::GetInterval() const { return _every;  }
+inline const char* RooUnfoldProgress::Task()        const { return _task;   }
+inline Int_t       RooUnfoldProgress::Done()        const { return _done;   }
+inline Int_t       RooUnfoldProgress::Total()       const { return _total;  }
+
+inline
+void RooUnfoldProgress::SetInterval (Int_t every)
+{
+  // Report progress, and check for cancellation or the end of the budget, after every this many toys or scan points.
+  // With RooUnfoldForkPool workers, at least one item per worker is run between updates.
+  _every= every>0 ? every : 1;
+}
+
+inline
+void RooUnfoldProgress::SetVerbose (Int_t level)
+{
+  _verbose= level;
+}
+
+inline
+Bool_t RooUnfoldProgress::Stopped() const
+{
+  return Cancelled() || Expired();
+}
+
+#endif
@@ -17,6 +17,12 @@
  Conversely can also convert these vectors and matrices into TH1Ds and TH2Ds. </p>
 <p> Can also take a variety of parameters as inputs. This includes maximum and minimum values, distributions and vectors/matrices of values. </p>
 <p> This class does the numerical modifications needed to allow unfolding techniques to work in the unfolding routines used in RooUnfold. </p>
+<p> Multi-dimensional distributions are flattened into vectors with x varying fastest, so a migration that is local in y or z
+ lands far from the diagonal of the response matrix. SetBinOrder() can instead order the vector indices by Reverse Cuthill-McKee
+ (which minimises the bandwidth of the filled response matrix, so call it after filling) or along a Morton space-filling curve.
+ The response histogram and all vectors and matrices (here and in RooUnfold, eg. Vreco() and Ereco()) then use that order,
+ while the measured, truth, and unfolded histograms keep their natural binning. Use GetPermTruth() etc. to convert.
+ 1D distributions always keep their natural order.</p>
 END_HTML */
 
 /////////////////////////////////////////////////////////////
@@ -26,6 +32,8 @@ END_HTML */
 #include <iostream>
 #include <assert.h>
 #include <cmath>
+#include <algorithm>
+#include <utility>
 
 #include "TClass.h"
 #include "TNamed.h"
@@ -37,7 +45,11 @@ END_HTML */
 #include "TF3.h"
 #include "TVectorD.h"
 #include "TMatrixD.h"
+#include "TMatrixDSparse.h"
 #include "TRandom.h"
+#include "TMD5.h"
+
+#include "RooUnfoldCache.h"
 
 #if ROOT_VERSION_CODE >= ROOT_VERSION(5,18,0)
 #define HAVE_RooUnfoldFoldingFunction
@@ -68,6 +80,7 @@ public:
     else if (_ndim==2) bin= RooUnfoldResponse::FindBin (mes, x[0], x[1]);
     else               bin= RooUnfoldResponse::FindBin (mes, x[0], x[1], x[2]);
     if (bin<0 || bin>=_res->GetNbinsMeasured()) return 0.0;
+    bin= _res->VectorIndexMeasured (bin);
     for (Int_t i=0, n=_func->GetNpar(); i<n; i++) {
       if (p[i] == _func->GetParameter(i)) continue;
       _func->SetParameters(p);
@@ -89,7 +102,7 @@ private:
     }
     _fvals.Zero();
     for (Int_t i=0, n=_res->GetNbinsTruth(); i<n; i++) {
-      Int_t j= RooUnfoldResponse::GetBin(tru, i);
+      Int_t j= RooUnfoldResponse::GetBin(tru, i, kFALSE, _res->GetPermTruth());
       Int_t jx, jy, jz;
       if (_ndim>=2) tru->GetBinXYZ (j, jx, jy, jz);
       Double_t fv;
@@ -171,6 +184,7 @@ RooUnfoldResponse::RooUnfoldResponse (const TH1* measured, const TH1* truth, con
   // in "truth" for unmeasured events (inefficiency).
   // "measured" and/or "truth" can be specified as 0 (1D case only) or an empty histograms (no entries) as a shortcut
   // to indicate, respectively, no fakes and/or no inefficiency.
+  RooUnfoldTimer timer (_timing, RooUnfoldTiming::kSetup);
   Init();
   Setup (measured, truth, response);
 }
@@ -212,7 +226,25 @@ RooUnfoldResponse::Add (const RooUnfoldResponse& rhs)
   _mes->Add (rhs._mes);
   _fak->Add (rhs._fak);
   _tru->Add (rhs._tru);
-  _res->Add (rhs._res);
+  if (_mperm == rhs._mperm && _tperm == rhs._tperm) {
+    _res->Add (rhs._res);
+    return;
+  }
+  // Different bin orders: add each bin at its position in our order
+  Bool_t s= _res->GetSumw2N() || rhs._res->GetSumw2N();
+  if (s && !_res->GetSumw2N()) _res->Sumw2();
+  for (Int_t j= 0; j<_nt+2; j++) {
+    Int_t jt= j;
+    if (j>=1 && j<=_nt) jt= 1 + VectorIndexTruth    (rhs._tperm.empty() ? j-1 : rhs._tperm[j-1]);
+    for (Int_t i= 0; i<_nm+2; i++) {
+      Int_t it= i;
+      if (i>=1 && i<=_nm) it= 1 + VectorIndexMeasured (rhs._mperm.empty() ? i-1 : rhs._mperm[i-1]);
+      Int_t bin= _res->GetBin (it, jt), rbin= rhs._res->GetBin (i, j);
+      _res->SetBinContent (bin, _res->GetBinContent (bin) + rhs._res->GetBinContent (rbin));
+      if (s) _res->SetBinError (bin, sqrt (pow (_res->GetBinError (bin), 2) + pow (rhs._res->GetBinError (rbin), 2)));
+    }
+  }
+  _res->SetEntries (_res->GetEntries() + rhs._res->GetEntries());
 }
 
 RooUnfoldResponse&
@@ -243,6 +275,11 @@ RooUnfoldResponse::Setup()
   _mRes= _eRes= 0;
   _nm= _nt= _mdim= _tdim= 0;
   _cached= false;
+  _order= kBinOrderNatural;
+  _mperm.clear();
+  _tperm.clear();
+  _minv.clear();
+  _tinv.clear();
   return *this;
 }
 
@@ -251,13 +288,28 @@ RooUnfoldResponse::Setup (const RooUnfoldResponse& rhs)
 {
   // Copy data from another RooUnfoldResponse
   _overflow= rhs._overflow;
-  return Setup (rhs.Hmeasured(), rhs.Htruth(), rhs.Hresponse());
+  Setup (rhs.Hmeasured(), rhs.Htruth(), rhs.Hresponse());
+  if (rhs._order != kBinOrderNatural) {
+    // The projections made by Setup assume the natural order, so take them from rhs.
+    Bool_t oldstat= TH1::AddDirectoryStatus();
+    TH1::AddDirectory (kFALSE);
+    delete _mes; _mes= (TH1*) rhs._mes->Clone();
+    delete _fak; _fak= (TH1*) rhs._fak->Clone();
+    delete _tru; _tru= (TH1*) rhs._tru->Clone();
+    TH1::AddDirectory (oldstat);
+    _order= rhs._order;
+    _mperm= rhs._mperm;
+    _tperm= rhs._tperm;
+    InvertPerm();
+  }
+  return *this;
 }
 
 RooUnfoldResponse&
 RooUnfoldResponse::Setup (Int_t nm, Double_t mlo, Double_t mhi, Int_t nt, Double_t tlo, Double_t thi)
 {
   // set up simple 1D case
+  RooUnfoldTimer timer (_timing, RooUnfoldTiming::kSetup);
   Reset();
   Bool_t oldstat= TH1::AddDirectoryStatus();
   TH1::AddDirectory (kFALSE);
@@ -288,6 +340,7 @@ RooUnfoldResponse&
 RooUnfoldResponse::Setup (const TH1* measured, const TH1* truth)
 {
   // set up - measured and truth only used for shape
+  RooUnfoldTimer timer (_timing, RooUnfoldTiming::kSetup);
   Reset();
   Bool_t oldstat= TH1::AddDirectoryStatus();
   TH1::AddDirectory (kFALSE);
@@ -455,10 +508,12 @@ RooUnfoldResponse::Fill (Double_t xr, Double_t yr, Double_t xt, Double_t yt, Dou
   assert (_mes != 0 && _tru != 0);
   assert (_mdim==2 && _tdim==2);
   if (_cached) ClearCache();
-  ((TH2*)_mes)->Fill (xr, yr, w);
-  ((TH2*)_tru)->Fill (xt, yt, w);
-  return _res->Fill (_res->GetXaxis()->GetBinCenter (FindBin (_mes, xr, yr)+1),
-                     _res->GetYaxis()->GetBinCenter (FindBin (_tru, xt, yt)+1), w);
+  Int_t mbin, tbin;
+  Int_t i= FindBins (_mes, xr, yr, 0.0, mbin);
+  Int_t j= FindBins (_tru, xt, yt, 0.0, tbin);
+  FillBin (_mes, mbin, w);
+  FillBin (_tru, tbin, w);
+  return FillBin (_res, _res->GetBin (VectorIndexMeasured(i)+1, VectorIndexTruth(j)+1), w);
 }
 
 Int_t
@@ -468,10 +523,30 @@ RooUnfoldResponse::Fill (Double_t xr, Double_t yr, Double_t zr, Double_t xt, Dou
   assert (_mes != 0 && _tru != 0);
   assert (_mdim==3 && _tdim==3);
   if (_cached) ClearCache();
-  ((TH3*)_mes)->Fill (xr, yr, zr, w);
-  ((TH3*)_tru)->Fill (xt, yt, zt, w);
-  return _res->Fill (_res->GetXaxis()->GetBinCenter (FindBin (_mes, xr, yr, zr)+1),
-                     _res->GetYaxis()->GetBinCenter (FindBin (_tru, xt, yt, zt)+1), w);
+  Int_t mbin, tbin;
+  Int_t i= FindBins (_mes, xr, yr, zr, mbin);
+  Int_t j= FindBins (_tru, xt, yt, zt, tbin);
+  FillBin (_mes, mbin, w);
+  FillBin (_tru, tbin, w);
+  return FillBin (_res, _res->GetBin (VectorIndexMeasured(i)+1, VectorIndexTruth(j)+1), w);
+}
+
+void
+RooUnfoldResponse::FillN (Int_t n, const Double_t* xr, const Double_t* xt, const Double_t* w)
+{
+  // Fill 1D Response Matrix with n events, with weights w (or 1 if w=0).
+  // Uses TH1::FillN, so there is no per-event call overhead from PyROOT.
+  // 2D and 3D responses are not supported: use Fill() for each event.
+  assert (_mes != 0 && _tru != 0);
+  if (_mdim!=1 || _tdim!=1) {
+    cerr << "Warning: RooUnfoldResponse::FillN only supports 1D responses, not "
+         << _mdim << "D measured, " << _tdim << "D truth: use Fill() for each event" << endl;
+    return;
+  }
+  if (_cached) ClearCache();
+  _mes->FillN (n, xr, w);
+  _tru->FillN (n, xt, w);
+  _res->FillN (n, xr, xt, w);
 }
 
 Int_t
@@ -508,6 +583,56 @@ RooUnfoldResponse::FindBin(const TH1* h, Double_t x, Double_t y, Double_t z)
   return binx + nx*(biny + ny*binz);
 }
 
+Int_t
+RooUnfoldResponse::FindBins (const TH1* h, Double_t x, Double_t y, Double_t z, Int_t& bin)
+{
+  // Returns the vector index (as FindBin, including -1 or nx*ny*nz for under/overflows) of the bin containing
+  // (x,y) or (x,y,z), and sets bin to its global bin number in h. Searches each axis once.
+  Int_t ndim= h->GetDimension();
+  Int_t nx=   h->GetNbinsX(), ny= h->GetNbinsY(), nz= h->GetNbinsZ();
+  Int_t binx= h->GetXaxis()->FindBin(x);
+  Int_t biny= h->GetYaxis()->FindBin(y);
+  Int_t binz= ndim>=3 ? h->GetZaxis()->FindBin(z) : 0;
+  bin= binx + (nx+2)*(biny + (ny+2)*binz);
+  Int_t n= nx*ny*nz;
+  if (binx <  1)  return -1;
+  if (binx >  nx) return n;
+  if (biny <  1)  return -1;
+  if (biny >  ny) return n;
+  if (ndim>=3) {
+    if (binz <  1)  return -1;
+    if (binz >  nz) return n;
+  }
+  return (binx-1) + nx*((biny-1) + ny*(ndim>=3 ? binz-1 : 0));
+}
+
+Int_t
+RooUnfoldResponse::FillBin (TH1* h, Int_t bin, Double_t w)
+{
+  // Adds w to global bin number bin of h, like TH1::Fill but without the search of each axis.
+  // The sums for the mean and RMS are cleared, so ROOT recalculates them from the bin contents when needed.
+  if (h->GetBuffer()) {
+    // TH1::Fill adds to the buffer instead: do the same, at the bin centre
+    Int_t bx, by, bz;
+    h->GetBinXYZ (bin, bx, by, bz);
+    Double_t x= h->GetXaxis()->GetBinCenter(bx), y= h->GetYaxis()->GetBinCenter(by), z= h->GetZaxis()->GetBinCenter(bz);
+    switch (h->GetDimension()) {
+      case 1:  h->Fill (x, w);                          break;
+      case 2:  static_cast<TH2*>(h)->Fill (x, y, w);    break;
+      default: static_cast<TH3*>(h)->Fill (x, y, z, w); break;
+    }
+    return bin;
+  }
+  // As TH1::Fill, keep the sum of weights squared once a weight other than 1 is used
+  if (!h->GetSumw2N() && w != 1.0 && !h->TestBit (TH1::kIsNotW)) h->Sumw2();
+  if (h->GetSumw2N()) h->GetSumw2()->fArray[bin] += w*w;
+  h->AddBinContent (bin, w);
+  h->SetEntries (h->GetEntries()+1);
+  Double_t stats[13]= {0.0};
+  h->PutStats (stats);
+  return bin;
+}
+
 Int_t
 RooUnfoldResponse::GetBinDim (const TH1* h, Int_t i)
 {
@@ -535,6 +660,21 @@ RooUnfoldResponse::Miss1D (Double_t xt, Double_t w)
   return _tru->Fill (xt, w);
 }
 
+void
+RooUnfoldResponse::MissN (Int_t n, const Double_t* xt, const Double_t* w)
+{
+  // Fill n missed events into 1D Response Matrix, with weights w (or 1 if w=0).
+  // 2D and 3D truth distributions are not supported: use Miss() for each event.
+  assert (_tru != 0);
+  if (_tdim!=1) {
+    cerr << "Warning: RooUnfoldResponse::MissN only supports 1D responses, not "
+         << _tdim << "D truth: use Miss() for each event" << endl;
+    return;
+  }
+  if (_cached) ClearCache();
+  _tru->FillN (n, xt, w);
+}
+
 Int_t
 RooUnfoldResponse::Miss2D (Double_t xt, Double_t yt, Double_t w)
 {
@@ -542,7 +682,9 @@ RooUnfoldResponse::Miss2D (Double_t xt, Double_t yt, Double_t w)
   assert (_tru != 0);
   assert (_tdim==2);
   if (_cached) ClearCache();
-  return ((TH2*)_tru)->Fill (xt, yt, w);
+  Int_t bin;
+  FindBins (_tru, xt, yt, 0.0, bin);
+  return FillBin (_tru, bin, w);
 }
 
 Int_t
@@ -552,7 +694,9 @@ RooUnfoldResponse::Miss (Double_t xt, Double_t yt, Double_t zt, Double_t w)
   assert (_tru != 0);
   assert (_tdim==3);
   if (_cached) ClearCache();
-  return ((TH3*)_tru)->Fill (xt, yt, zt, w);
+  Int_t bin;
+  FindBins (_tru, xt, yt, zt, bin);
+  return FillBin (_tru, bin, w);
 }
 
 Int_t
@@ -566,6 +710,22 @@ RooUnfoldResponse::Fake1D (Double_t xr, Double_t w)
   return _fak->Fill (xr, w);
 }
 
+void
+RooUnfoldResponse::FakeN (Int_t n, const Double_t* xr, const Double_t* w)
+{
+  // Fill n fake events into 1D Response Matrix, with weights w (or 1 if w=0).
+  // 2D and 3D measured distributions are not supported: use Fake() for each event.
+  assert (_fak != 0 && _mes != 0);
+  if (_mdim!=1) {
+    cerr << "Warning: RooUnfoldResponse::FakeN only supports 1D responses, not "
+         << _mdim << "D measured: use Fake() for each event" << endl;
+    return;
+  }
+  if (_cached) ClearCache();
+  _mes->FillN (n, xr, w);
+  _fak->FillN (n, xr, w);
+}
+
 Int_t
 RooUnfoldResponse::Fake2D (Double_t xr, Double_t yr, Double_t w)
 {
@@ -573,8 +733,10 @@ RooUnfoldResponse::Fake2D (Double_t xr, Double_t yr, Double_t w)
   assert (_mes != 0);
   assert (_mdim==2);
   if (_cached) ClearCache();
-         ((TH2*)_fak)->Fill (xr, yr, w);
-  return ((TH2*)_mes)->Fill (xr, yr, w);
+  Int_t bin;   // _mes and _fak have the same binning
+  FindBins (_mes, xr, yr, 0.0, bin);
+         FillBin (_fak, bin, w);
+  return FillBin (_mes, bin, w);
 }
 
 Int_t
@@ -584,17 +746,19 @@ RooUnfoldResponse::Fake (Double_t xr, Double_t yr, Double_t zr, Double_t w)
   assert (_mes != 0);
   assert (_mdim==3);
   if (_cached) ClearCache();
-         ((TH3*)_mes)->Fill (xr, yr, zr, w);
-  return ((TH3*)_fak)->Fill (xr, yr, zr, w);
+  Int_t bin;   // _mes and _fak have the same binning
+  FindBins (_mes, xr, yr, zr, bin);
+         FillBin (_mes, bin, w);
+  return FillBin (_fak, bin, w);
 }
 
 TH1D*
-RooUnfoldResponse::H2H1D(const TH1* h, Int_t nb)
+RooUnfoldResponse::H2H1D(const TH1* h, Int_t nb, const Int_t* perm)
 {
-  if (dynamic_cast<const TH1D*>(h)) return dynamic_cast<TH1D*>(h->Clone());
+  if (!perm && dynamic_cast<const TH1D*>(h)) return dynamic_cast<TH1D*>(h->Clone());
   TH1D* h1d= new TH1D(h->GetName(), h->GetTitle(), nb, 0.0, 1.0);
   for (Int_t i= 0; i < nb; i++) {
-    Int_t j= GetBin (h, i);  // don't bother with under/overflow bins (not supported for >1D)
+    Int_t j= GetBin (h, i, kFALSE, perm);  // don't bother with under/overflow bins (not supported for >1D)
     h1d->SetBinContent (i+1, h->GetBinContent (j));
     h1d->SetBinError   (i+1, h->GetBinError   (j));
   }
@@ -645,47 +809,48 @@ RooUnfoldResponse::HresponseNoOverflow() const
 }
 
 TVectorD*
-RooUnfoldResponse::H2V  (const TH1* h, Int_t nb, Bool_t overflow)
+RooUnfoldResponse::H2V  (const TH1* h, Int_t nb, Bool_t overflow, const Int_t* perm)
 {
   // Returns TVectorD of the bin contents of the input histogram
   if (overflow) nb += 2;
   TVectorD* v= new TVectorD (nb);
   if (!h) return v;
   for (Int_t i= 0; i < nb; i++) {
-    (*v)(i)= GetBinContent (h, i, overflow);
+    (*v)(i)= GetBinContent (h, i, overflow, perm);
   }
   return v;
 }
 
 void
-RooUnfoldResponse::V2H (const TVectorD& v, TH1* h, Int_t nb, Bool_t overflow)
+RooUnfoldResponse::V2H (const TVectorD& v, TH1* h, Int_t nb, Bool_t overflow, const Int_t* perm)
 {
   // Sets the bin content of the histogram as that element of the input vector
   h->Reset();  // in particular, ensure under/overflows are reset
   if (overflow) nb += 2;
   for (Int_t i= 0; i < nb; i++) {
-    Int_t j= GetBin (h, i, overflow);
+    Int_t j= GetBin (h, i, overflow, perm);
     h->SetBinContent (j, v(i));
   }
 }
 
 TVectorD*
-RooUnfoldResponse::H2VE (const TH1* h, Int_t nb, Bool_t overflow)
+RooUnfoldResponse::H2VE (const TH1* h, Int_t nb, Bool_t overflow, const Int_t* perm)
 {
   // Returns TVectorD of bin errors for input histogram
   if (overflow) nb += 2;
   TVectorD* v= new TVectorD (nb);
   if (!h) return v;
   for (Int_t i= 0; i < nb; i++) {
-    (*v)(i)= GetBinError (h, i, overflow);
+    (*v)(i)= GetBinError (h, i, overflow, perm);
   }
   return v;
 }
 
 TMatrixD*
-RooUnfoldResponse::H2M  (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow)
+RooUnfoldResponse::H2M  (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow, const Int_t* perm)
 {
-  // Returns Matrix of values of bins in a 2D input histogram
+  // Returns Matrix of values of bins in a 2D input histogram.
+  // perm gives the natural index in norm of each column.
   Int_t first= overflow ? 0 : 1;
   if (overflow) {
     nx += 2;
@@ -697,7 +862,7 @@ RooUnfoldResponse::H2M  (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool
     Double_t fac;
     if (!norm) fac= 1.0;
     else {
-      fac= GetBinContent (norm, j, overflow);
+      fac= GetBinContent (norm, j, overflow, perm);
       if (fac != 0.0) fac= 1.0/fac;
     }
     for (Int_t i= 0; i < nx; i++) {
@@ -708,7 +873,7 @@ RooUnfoldResponse::H2M  (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool
 }
 
 TMatrixD*
-RooUnfoldResponse::H2ME (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow)
+RooUnfoldResponse::H2ME (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow, const Int_t* perm)
 {
   // Returns matrix of bin errors for a 2D histogram.
   Int_t first= overflow ? 0 : 1;
@@ -722,7 +887,7 @@ RooUnfoldResponse::H2ME (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool
     Double_t fac;
     if (!norm) fac= 1.0;
     else {
-      fac= GetBinContent (norm, j, overflow);
+      fac= GetBinContent (norm, j, overflow, perm);
       if (fac != 0.0) fac= 1.0/fac;
     }
     for (Int_t i= 0; i < nx; i++) {
@@ -733,6 +898,83 @@ RooUnfoldResponse::H2ME (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool
   return m;
 }
 
+TMatrixDSparse*
+RooUnfoldResponse::MresponseSparse (const TVectorD* rowscale) const
+{
+  // Returns a new sparse (compressed row) response matrix, (row,column)=(measured,truth), with row i multiplied
+  // by (*rowscale)[i] if rowscale is given, or 0 if the response is empty. It is filled directly from the
+  // response histogram, skipping empty bins, so neither the dense Mresponse() nor its transpose is made.
+  Int_t first= _overflow ? 0 : 1, nm= _nm, nt= _nt;
+  if (_overflow) {
+    nm += 2;
+    nt += 2;
+  }
+  std::vector<Int_t>    row, col;
+  std::vector<Double_t> data;
+  for (Int_t j= 0; j<nt; j++) {
+    Double_t fac= GetBinContent (_tru, j, _overflow, GetPermTruth());
+    if (fac==0.0) continue;
+    fac= 1.0/fac;
+    for (Int_t i= 0; i<nm; i++) {
+      Double_t r= _res->GetBinContent (i+first, j+first);
+      if (r==0.0) continue;
+      if (rowscale) r *= (*rowscale)[i];
+      row .push_back (i);
+      col .push_back (j);
+      data.push_back (r * fac);
+    }
+  }
+  if (data.empty()) return 0;
+  TMatrixDSparse* m= new TMatrixDSparse (nm, nt);
+  m->SetMatrixArray (data.size(), &row[0], &col[0], &data[0]);
+  return m;
+}
+
+TVectorD&
+RooUnfoldResponse::SubtractFakes (TVectorD& v, Double_t nmeas, Int_t verbose) const
+{
+  // Subtracts the fakes from v, a measured distribution with nmeas entries in total.
+  // The fakes are scaled from the training sample to nmeas.
+  if (FakeEntries()) {
+    TVectorD fakes= Vfakes();
+    Double_t fac= Vmeasured().Sum();
+    if (fac!=0.0) fac= nmeas / fac;
+    if (verbose>=1) cout << "Subtract " << fac*fakes.Sum() << " fakes from measured distribution" << endl;
+    fakes *= fac;
+    v -= fakes;
+  }
+  return v;
+}
+
+void
+RooUnfoldResponse::SparseMult (const TMatrixDSparse& a, const TVectorD& x, TVectorD& y)
+{
+  // y = a x
+  const Int_t*    irow= a.GetRowIndexArray();
+  const Int_t*    icol= a.GetColIndexArray();
+  const Double_t* d=    a.GetMatrixArray();
+  for (Int_t i= 0; i<a.GetNrows(); i++) {
+    Double_t sum= 0.0;
+    for (Int_t k= irow[i]; k<irow[i+1]; k++) sum += d[k] * x[icol[k]];
+    y[i]= sum;
+  }
+}
+
+void
+RooUnfoldResponse::SparseMultT (const TMatrixDSparse& a, const TVectorD& y, TVectorD& x)
+{
+  // x = a^T y, without forming the transpose
+  const Int_t*    irow= a.GetRowIndexArray();
+  const Int_t*    icol= a.GetColIndexArray();
+  const Double_t* d=    a.GetMatrixArray();
+  x.Zero();
+  for (Int_t i= 0; i<a.GetNrows(); i++) {
+    Double_t yi= y[i];
+    if (yi==0.0) continue;
+    for (Int_t k= irow[i]; k<irow[i+1]; k++) x[icol[k]] += d[k] * yi;
+  }
+}
+
 void RooUnfoldResponse::PrintMatrix(const TMatrixD& m, const char* name, const char* format, Int_t cols_per_sheet)
 {
    // Print the matrix as a table of elements.
@@ -790,10 +1032,30 @@ void RooUnfoldResponse::PrintMatrix(const TMatrixD& m, const char* name, const c
    printf("\n");
 }
 
+TString
+RooUnfoldResponse::Checksum() const
+{
+  // MD5 hash of the response matrix, truth, measured, and fakes histograms (contents and errors), and the
+  // overflow and bin order settings. Decompositions of the response stored in a RooUnfoldCache are keyed by
+  // this, so are only reused while the response is unchanged.
+  TMD5 md5;
+  RooUnfoldCache::Hash (md5, Form ("nm=%d nt=%d overflow=%d order=%d", _nm, _nt, _overflow, _order));
+  RooUnfoldCache::Hash (md5, Hresponse());
+  RooUnfoldCache::Hash (md5, Htruth());
+  RooUnfoldCache::Hash (md5, Hmeasured());
+  RooUnfoldCache::Hash (md5, Hfakes());
+  md5.Final();
+  return md5.AsString();
+}
+
 void
 RooUnfoldResponse::Print (Option_t* /* option */) const
 {
   PrintMatrix (Mresponse(), Form("%s response matrix",GetTitle()));
+  if (!_timing.IsEmpty()) {
+    cout << GetTitle() << " timing:" << endl;
+    _timing.Print();
+  }
 }
 
 
@@ -814,7 +1076,7 @@ RooUnfoldResponse::ApplyToTruth (const TH1* truth, const char* name) const
       cerr << "Warning: RooUnfoldResponse::ApplyToTruth truth histogram is a different size ("
            << (truth->GetNbinsX() * truth->GetNbinsY() * truth->GetNbinsZ()) << " bins) or shape from response matrix truth ("
            << ( _tru->GetNbinsX() *  _tru->GetNbinsY() *  _tru->GetNbinsZ()) << " bins)" << endl;
-    resultvect= H2V (truth, GetNbinsTruth(), _overflow);
+    resultvect= H2V (truth, GetNbinsTruth(), _overflow, GetPermTruth());
     if (!resultvect) return 0;
   } else {
     resultvect= new TVectorD (Vtruth());
@@ -825,7 +1087,7 @@ RooUnfoldResponse::ApplyToTruth (const TH1* truth, const char* name) const
   // Turn results vector into properly binned histogram
   TH1* result= (TH1*) Hmeasured()->Clone (name);
   result->SetTitle (name);
-  V2H (*resultvect, result, GetNbinsMeasured(), _overflow);
+  V2H (*resultvect, result, GetNbinsMeasured(), _overflow, GetPermMeasured());
   delete resultvect;
   return result;
 }
@@ -879,9 +1141,12 @@ TF1* RooUnfoldResponse::MakeFoldingFunction (TF1* func, Double_t eps, Bool_t ver
 }
 
 
-RooUnfoldResponse* RooUnfoldResponse::RunToy() const
+RooUnfoldResponse* RooUnfoldResponse::RunToy (TRandom* rnd) const
 {
   // Returns new RooUnfoldResponse object with smeared response matrix elements for use as a toy.
+  // Random numbers are taken from rnd, if specified, or gRandom.
+  if (!rnd) rnd= gRandom;
+  RooUnfoldTimer timer (_timing, RooUnfoldTiming::kToys);
   TString name= GetName();
   name += "_toy";
   RooUnfoldResponse* res= new RooUnfoldResponse (*this);
@@ -893,7 +1158,7 @@ RooUnfoldResponse* RooUnfoldResponse::RunToy() const
       Int_t bin= hres->GetBin (i,j);
       Double_t e= hres->GetBinError (bin);
       if (e>0.0) {
-        Double_t v= hres->GetBinContent(bin) + gRandom->Gaus(0.0,e);
+        Double_t v= hres->GetBinContent(bin) + rnd->Gaus(0.0,e);
         if (v<0.0) v= 0.0;
         hres->SetBinContent (bin, v);
       }
@@ -902,6 +1167,277 @@ RooUnfoldResponse* RooUnfoldResponse::RunToy() const
   return res;
 }
 
+Int_t RooUnfoldResponse::FindBlocks (std::vector<Int_t>& mblock, std::vector<Int_t>& tblock) const
+{
+  // Find the connected components of the migration graph, where measured bin i and truth bin j are
+  // linked if response(i,j) is non-zero. Each component is an independent unfolding problem.
+  // On return, mblock and tblock give the block number (0..nblocks-1) of each measured and truth bin
+  // (vector index, including under/overflows if used), numbered in order of their first truth bin.
+  // Bins that are not linked to any bin of the other kind (pure fakes or no reconstructed events)
+  // are given block -1. Returns the number of blocks.
+  Int_t first= _overflow ? 0 : 1, nm= _nm, nt= _nt;
+  if (_overflow) {
+    nm += 2;
+    nt += 2;
+  }
+  // Union-find over measured bins 0..nm-1 and truth bins nm..nm+nt-1
+  std::vector<Int_t> parent (nm+nt);
+  for (Int_t k= 0; k<nm+nt; k++) parent[k]= k;
+  std::vector<Bool_t> linked (nm+nt, kFALSE);
+  for (Int_t j= 0; j<nt; j++) {
+    for (Int_t i= 0; i<nm; i++) {
+      if (_res->GetBinContent (i+first, j+first) == 0.0) continue;
+      linked[i]= linked[nm+j]= kTRUE;
+      Int_t a= i, b= nm+j;
+      while (parent[a]!=a) a= parent[a]= parent[parent[a]];
+      while (parent[b]!=b) b= parent[b]= parent[parent[b]];
+      if (a!=b) parent[a < b ? b : a]= (a < b ? a : b);
+    }
+  }
+  std::vector<Int_t> block (nm+nt, -1);
+  Int_t nblocks= 0;
+  for (Int_t k= nm; k<nm+nt; k++) {
+    if (!linked[k]) continue;
+    Int_t r= k;
+    while (parent[r]!=r) r= parent[r];
+    if (block[r]<0) block[r]= nblocks++;
+    block[k]= block[r];
+  }
+  for (Int_t k= 0; k<nm; k++) {
+    if (!linked[k]) continue;
+    Int_t r= k;
+    while (parent[r]!=r) r= parent[r];
+    block[k]= block[r];
+  }
+  mblock.assign (block.begin(),    block.begin()+nm);
+  tblock.assign (block.begin()+nm, block.end());
+  return nblocks;
+}
+
+RooUnfoldResponse* RooUnfoldResponse::BlockResponse (const std::vector<Int_t>& mbins, const std::vector<Int_t>& tbins,
+                                                     const char* name) const
+{
+  // Returns a new 1D response containing only the measured and truth bins with the given vector indices
+  // (eg. one block from FindBlocks()), including their fakes, misses, and errors.
+  Int_t first= _overflow ? 0 : 1;
+  Int_t nm= mbins.size(), nt= tbins.size();
+  Bool_t oldstat= TH1::AddDirectoryStatus();
+  TH1::AddDirectory (kFALSE);
+  TH1D hmes ("measured", "Measured", nm, 0.0, Double_t(nm));
+  TH1D htru ("truth",    "Truth",    nt, 0.0, Double_t(nt));
+  TH2D hres ("response", "Response", nm, 0.0, Double_t(nm), nt, 0.0, Double_t(nt));
+  TH1::AddDirectory (oldstat);
+  hmes.Sumw2();
+  htru.Sumw2();
+  hres.Sumw2();
+  for (Int_t i= 0; i<nm; i++) {
+    hmes.SetBinContent (i+1, GetBinContent (_mes, mbins[i], _overflow, GetPermMeasured()));
+    hmes.SetBinError   (i+1, GetBinError   (_mes, mbins[i], _overflow, GetPermMeasured()));
+  }
+  for (Int_t j= 0; j<nt; j++) {
+    htru.SetBinContent (j+1, GetBinContent (_tru, tbins[j], _overflow, GetPermTruth()));
+    htru.SetBinError   (j+1, GetBinError   (_tru, tbins[j], _overflow, GetPermTruth()));
+    for (Int_t i= 0; i<nm; i++) {
+      hres.SetBinContent (i+1, j+1, _res->GetBinContent (mbins[i]+first, tbins[j]+first));
+      hres.SetBinError   (i+1, j+1, _res->GetBinError   (mbins[i]+first, tbins[j]+first));
+    }
+  }
+  TString n= name ? TString(name) : TString(GetName()) + "_block";
+  return new RooUnfoldResponse (&hmes, &htru, &hres, n, GetTitle());
+}
+
+void
+RooUnfoldResponse::SetBinOrder (Int_t order)
+{
+  // Reorder the vector indices of multi-dimensional measured and truth distributions, to bring migrations that
+  // are local in y or z close to the diagonal of the response matrix. kBinOrderRCM uses the non-zero elements
+  // of the response, so should be called after filling (later fills are placed correctly, but the order is
+  // not updated). The response histogram is rearranged in place; the other histograms are unchanged.
+  if (!_res) {
+    cerr << "Warning: RooUnfoldResponse::SetBinOrder called before the response was set up" << endl;
+    return;
+  }
+  std::vector<Int_t> mperm, tperm;
+  if        (order == kBinOrderRCM) {
+    RCMOrder (mperm, tperm);
+    if (mperm.empty()) {
+      cerr << "Warning: RooUnfoldResponse::SetBinOrder(kBinOrderRCM) needs a filled response" << endl;
+      return;
+    }
+    // RCMOrder gives the current vector indices: convert to natural
+    if (!_mperm.empty()) for (Int_t i= 0; i<_nm; i++) mperm[i]= _mperm[mperm[i]];
+    if (!_tperm.empty()) for (Int_t j= 0; j<_nt; j++) tperm[j]= _tperm[tperm[j]];
+  } else if (order == kBinOrderMorton) {
+    MortonOrder (_mes, _nm, mperm);
+    MortonOrder (_tru, _nt, tperm);
+  } else if (order != kBinOrderNatural) {
+    cerr << "Warning: RooUnfoldResponse::SetBinOrder unknown order " << order << endl;
+    return;
+  }
+  if (_mdim < 2) mperm.clear();
+  if (_tdim < 2) tperm.clear();
+  Permute (mperm, tperm);
+  _order= order;
+}
+
+void
+RooUnfoldResponse::MortonOrder (const TH1* h, Int_t n, std::vector<Int_t>& perm)
+{
+  // Natural index of each bin of h, sorted along the Morton (Z-order) curve, which interleaves the bits of the
+  // x, y, and z bin numbers.
+  perm.clear();
+  Int_t ndim= h->GetDimension();
+  if (ndim < 2) return;
+  Int_t nx= h->GetNbinsX(), ny= h->GetNbinsY();
+  std::vector< std::pair<ULong64_t,Int_t> > key (n);
+  for (Int_t k= 0; k<n; k++) {
+    Int_t xyz[3]= { k%nx, (k/nx)%ny, k/(nx*ny) };
+    ULong64_t m= 0;
+    for (Int_t b= 0; b<21; b++)
+      for (Int_t d= 0; d<ndim; d++)
+        m |= ULong64_t((xyz[d]>>b)&1) << (ndim*b+d);
+    key[k]= std::make_pair (m, k);
+  }
+  std::sort (key.begin(), key.end());
+  perm.resize (n);
+  for (Int_t k= 0; k<n; k++) perm[k]= key[k].second;
+}
+
+void
+RooUnfoldResponse::RCMOrder (std::vector<Int_t>& mperm, std::vector<Int_t>& tperm) const
+{
+  // Reverse Cuthill-McKee order of the current measured and truth vector indices, from the graph of non-zero
+  // response elements. If the measured and truth binnings are the same, both get the same order (from the
+  // symmetrised response); otherwise measured and truth bins are ordered together as one bipartite graph.
+  // Returns empty orders if the response is empty.
+  mperm.clear();
+  tperm.clear();
+  Bool_t same= (_mdim == _tdim && _mes->GetNbinsX() == _tru->GetNbinsX() &&
+                _mes->GetNbinsY() == _tru->GetNbinsY() && _mes->GetNbinsZ() == _tru->GetNbinsZ());
+  Int_t n= same ? _nm : _nm+_nt, toff= same ? 0 : _nm, nnz= 0;
+  std::vector< std::vector<Int_t> > adj (n);
+  for (Int_t j= 0; j<_nt; j++) {
+    for (Int_t i= 0; i<_nm; i++) {
+      if (_res->GetBinContent (i+1, j+1) == 0.0) continue;
+      nnz++;
+      Int_t b= toff+j;
+      if (b == i) continue;
+      adj[i].push_back (b);
+      adj[b].push_back (i);
+    }
+  }
+  if (nnz == 0) return;
+  std::vector< std::pair<Int_t,Int_t> > bydeg (n);
+  for (Int_t k= 0; k<n; k++) {
+    std::sort (adj[k].begin(), adj[k].end());
+    adj[k].erase (std::unique (adj[k].begin(), adj[k].end()), adj[k].end());
+    bydeg[k]= std::make_pair (Int_t(adj[k].size()), k);
+  }
+  std::sort (bydeg.begin(), bydeg.end());
+
+  std::vector<Int_t> order, dist (n, -1), queue;
+  std::vector< std::pair<Int_t,Int_t> > next;
+  std::vector<Bool_t> done (n, kFALSE);
+  order.reserve (n);
+  for (Int_t c= 0; Int_t(order.size()) < n; ) {
+    // Start each connected component from a pseudo-peripheral node: from its lowest-degree node, move to the
+    // lowest-degree node of the last breadth-first level for as long as that increases the eccentricity.
+    while (done[bydeg[c].second]) c++;
+    Int_t start= bydeg[c].second;
+    for (Int_t ecc= -1;;) {
+      queue.assign (1, start);
+      dist[start]= 0;
+      for (size_t h= 0; h<queue.size(); h++) {
+        for (size_t a= 0; a<adj[queue[h]].size(); a++) {
+          Int_t v= adj[queue[h]][a];
+          if (dist[v] < 0) {
+            dist[v]= dist[queue[h]]+1;
+            queue.push_back (v);
+          }
+        }
+      }
+      Int_t e= dist[queue.back()], best= queue.back();
+      for (size_t h= 0; h<queue.size(); h++) {
+        if (dist[queue[h]] == e && adj[queue[h]].size() < adj[best].size()) best= queue[h];
+        dist[queue[h]]= -1;
+      }
+      if (e <= ecc) break;
+      ecc= e;
+      start= best;
+    }
+    // Cuthill-McKee: breadth-first, visiting each node's neighbours in order of increasing degree
+    size_t head= order.size();
+    order.push_back (start);
+    done[start]= kTRUE;
+    for (; head<order.size(); head++) {
+      const std::vector<Int_t>& nb= adj[order[head]];
+      next.clear();
+      for (size_t a= 0; a<nb.size(); a++) {
+        if (done[nb[a]]) continue;
+        done[nb[a]]= kTRUE;
+        next.push_back (std::make_pair (Int_t(adj[nb[a]].size()), nb[a]));
+      }
+      std::sort (next.begin(), next.end());
+      for (size_t a= 0; a<next.size(); a++) order.push_back (next[a].second);
+    }
+  }
+  std::reverse (order.begin(), order.end());
+  if (same) {
+    mperm= order;
+    tperm= order;
+    return;
+  }
+  mperm.reserve (_nm);
+  tperm.reserve (_nt);
+  for (Int_t k= 0; k<n; k++) {
+    if (order[k] < _nm) mperm.push_back (order[k]);
+    else                tperm.push_back (order[k]-_nm);
+  }
+}
+
+void
+RooUnfoldResponse::Permute (const std::vector<Int_t>& mperm, const std::vector<Int_t>& tperm)
+{
+  // Move the response histogram bins from the current order to the order given by mperm and tperm
+  // (vector index -> natural index, or empty for the natural order). Under/overflows stay where they are.
+  std::vector<Int_t> minv (_nm), tinv (_nt);
+  for (Int_t i= 0; i<_nm; i++) minv[mperm.empty() ? i : mperm[i]]= i;
+  for (Int_t j= 0; j<_nt; j++) tinv[tperm.empty() ? j : tperm[j]]= j;
+  Bool_t oldstat= TH1::AddDirectoryStatus();
+  TH1::AddDirectory (kFALSE);
+  TH2* res= (TH2*) _res->Clone();
+  TH1::AddDirectory (oldstat);
+  Bool_t s= _res->GetSumw2N();
+  for (Int_t j= 0; j<_nt+2; j++) {
+    Int_t jn= j;
+    if (j>=1 && j<=_nt) jn= 1 + tinv[_tperm.empty() ? j-1 : _tperm[j-1]];
+    for (Int_t i= 0; i<_nm+2; i++) {
+      Int_t in= i;
+      if (i>=1 && i<=_nm) in= 1 + minv[_mperm.empty() ? i-1 : _mperm[i-1]];
+      Int_t bin= res->GetBin (in, jn), obin= _res->GetBin (i, j);
+             res->SetBinContent (bin, _res->GetBinContent (obin));
+      if (s) res->SetBinError   (bin, _res->GetBinError   (obin));
+    }
+  }
+  res->SetEntries (_res->GetEntries());
+  delete _res;
+  _res= res;
+  _mperm= mperm;
+  _tperm= tperm;
+  InvertPerm();
+  ClearCache();
+}
+
+void
+RooUnfoldResponse::InvertPerm()
+{
+  // Set up the natural index -> vector index lookups
+  _minv.assign (_mperm.size(), 0);
+  _tinv.assign (_tperm.size(), 0);
+  for (size_t i= 0; i<_mperm.size(); i++) _minv[_mperm[i]]= i;
+  for (size_t j= 0; j<_tperm.size(); j++) _tinv[_tperm[j]]= j;
+}
+
 void
 RooUnfoldResponse::SetNameTitleDefault (const char* defname, const char* deftitle)
 {
@@ -951,6 +1487,7 @@ RooUnfoldResponse::Streamer (TBuffer &R__b)
     TH1::AddDirectory (kFALSE);
     RooUnfoldResponse::Class()->ReadBuffer  (R__b, this);
     TH1::AddDirectory (oldstat);
+    InvertPerm();
   } else {
     RooUnfoldResponse::Class()->WriteBuffer (R__b, this);
   }
@@ -12,23 +12,35 @@
 #ifndef ROOUNFOLDRESPONSE_HH
 #define ROOUNFOLDRESPONSE_HH
 
+#include <vector>
+
 #include "TNamed.h"
 #include "TMatrixD.h"
 #include "TH1.h"
+#include "RooUnfoldTiming.h"
 #if ROOT_VERSION_CODE >= ROOT_VERSION(5,0,0)
 #include "TVectorDfwd.h"
+#include "TMatrixDSparsefwd.h"
 #else
 class TVectorD;
+class TMatrixDSparse;
 #endif
 class TF1;
 class TH2;
 class TH2D;
 class TAxis;
+class TRandom;
 
 class RooUnfoldResponse : public TNamed {
 
 public:
 
+  enum BinOrder {        // Order of vector indices for multi-dimensional distributions:
+    kBinOrderNatural,    //   x fastest, then y, then z
+    kBinOrderRCM,        //   Reverse Cuthill-McKee, minimising the bandwidth of the filled response
+    kBinOrderMorton      //   Morton (Z-order) space-filling curve
+  };
+
   // Standard methods
 
   RooUnfoldResponse(); // default constructor
@@ -70,6 +82,12 @@ public:
           Int_t Fake (Double_t xr, Double_t yr, Double_t w);  // Fill fake event into 2D (with weight) or 3D Response Matrix
   virtual Int_t Fake (Double_t xr, Double_t yr, Double_t zr, Double_t w);  // Fill fake event into 3D Response Matrix
 
+  // Fill 1D Response Matrix from arrays of n events (eg. NumPy arrays from PyROOT). w=0 for unit weights.
+  // Only for 1D measured and truth distributions: for 2D or 3D, call Fill(), Miss() or Fake() for each event.
+  virtual void FillN (Int_t n, const Double_t* xr, const Double_t* xt, const Double_t* w= 0);
+  virtual void MissN (Int_t n, const Double_t* xt, const Double_t* w= 0);
+  virtual void FakeN (Int_t n, const Double_t* xr, const Double_t* w= 0);
+
   virtual void Add (const RooUnfoldResponse& rhs);
 
   // Accessors
@@ -96,32 +114,50 @@ public:
   const TVectorD& Etruth()            const;   // Truth distribution errors as a TVectorD
   const TMatrixD& Mresponse()         const;   // Response matrix as a TMatrixD: (row,column)=(measured,truth)
   const TMatrixD& Eresponse()         const;   // Response matrix errors as a TMatrixD: (row,column)=(measured,truth)
+  TMatrixDSparse* MresponseSparse (const TVectorD* rowscale= 0) const;  // New sparse response matrix, rows optionally scaled, without Mresponse()
+  TVectorD&       SubtractFakes (TVectorD& v, Double_t nmeas, Int_t verbose= 0) const;  // v -= fakes, scaled to nmeas measured entries
 
   Double_t operator() (Int_t r, Int_t t) const;// Response matrix element (measured,truth)
 
   void   UseOverflow (Bool_t set= kTRUE);      // Specify to use overflow bins
   Bool_t UseOverflowStatus() const;            // Get UseOverflow setting
   Double_t FakeEntries() const;                // Return number of bins with fakes
+  void   SetBinOrder (Int_t order);            // Reorder multi-dimensional vector indices (see BinOrder)
+  Int_t  GetBinOrder() const;                  // Get SetBinOrder setting
+  const Int_t* GetPermMeasured() const;        // Measured vector index -> natural index, or 0 if natural order
+  const Int_t* GetPermTruth()    const;        // Truth    vector index -> natural index, or 0 if natural order
+  Int_t  VectorIndexMeasured (Int_t i) const;  // Natural measured index -> vector index
+  Int_t  VectorIndexTruth    (Int_t j) const;  // Natural truth    index -> vector index
+  TString Checksum() const;                    // MD5 hash of the response, eg. to validate stored decompositions
   virtual void Print (Option_t* option="") const;
 
-  static TH1D*     H2H1D(const TH1*  h, Int_t nb);
-  static TVectorD* H2V  (const TH1*  h, Int_t nb, Bool_t overflow= kFALSE);
-  static TVectorD* H2VE (const TH1*  h, Int_t nb, Bool_t overflow= kFALSE);
-  static TMatrixD* H2M  (const TH2*  h, Int_t nx, Int_t ny, const TH1* norm= 0, Bool_t overflow= kFALSE);
-  static TMatrixD* H2ME (const TH2*  h, Int_t nx, Int_t ny, const TH1* norm= 0, Bool_t overflow= kFALSE);
-  static void      V2H  (const TVectorD& v, TH1* h, Int_t nb, Bool_t overflow= kFALSE);
+  // perm gives the natural index of each vector index (eg. GetPermTruth()), or 0 for natural order
+  static TH1D*     H2H1D(const TH1*  h, Int_t nb, const Int_t* perm= 0);
+  static TVectorD* H2V  (const TH1*  h, Int_t nb, Bool_t overflow= kFALSE, const Int_t* perm= 0);
+  static TVectorD* H2VE (const TH1*  h, Int_t nb, Bool_t overflow= kFALSE, const Int_t* perm= 0);
+  static TMatrixD* H2M  (const TH2*  h, Int_t nx, Int_t ny, const TH1* norm= 0, Bool_t overflow= kFALSE, const Int_t* perm= 0);
+  static TMatrixD* H2ME (const TH2*  h, Int_t nx, Int_t ny, const TH1* norm= 0, Bool_t overflow= kFALSE, const Int_t* perm= 0);
+  static void SparseMult  (const TMatrixDSparse& a, const TVectorD& x, TVectorD& y);  // y = a x
+  static void SparseMultT (const TMatrixDSparse& a, const TVectorD& y, TVectorD& x);  // x = a^T y, without forming the transpose
+  static void      V2H  (const TVectorD& v, TH1* h, Int_t nb, Bool_t overflow= kFALSE, const Int_t* perm= 0);
   static Int_t   FindBin(const TH1*  h, Double_t x);  // return vector index for bin containing (x)
   static Int_t   FindBin(const TH1*  h, Double_t x, Double_t y);  // return vector index for bin containing (x,y)
   static Int_t   FindBin(const TH1*  h, Double_t x, Double_t y, Double_t z);  // return vector index for bin containing (x,y,z)
-  static Int_t   GetBin (const TH1*  h, Int_t i, Bool_t overflow= kFALSE);  // vector index (0..nx*ny-1) -> multi-dimensional histogram global bin number (0..(nx+2)*(ny+2)-1) skipping under/overflow bins
-  static Double_t GetBinContent (const TH1* h, Int_t i, Bool_t overflow= kFALSE); // Bin content by vector index
-  static Double_t GetBinError   (const TH1* h, Int_t i, Bool_t overflow= kFALSE); // Bin error   by vector index
+  static Int_t   GetBin (const TH1*  h, Int_t i, Bool_t overflow= kFALSE, const Int_t* perm= 0);  // vector index (0..nx*ny-1) -> multi-dimensional histogram global bin number (0..(nx+2)*(ny+2)-1) skipping under/overflow bins
+  static Double_t GetBinContent (const TH1* h, Int_t i, Bool_t overflow= kFALSE, const Int_t* perm= 0); // Bin content by vector index
+  static Double_t GetBinError   (const TH1* h, Int_t i, Bool_t overflow= kFALSE, const Int_t* perm= 0); // Bin error   by vector index
   static void PrintMatrix (const TMatrixD& m, const char* name="matrix", const char* format=0, Int_t cols_per_sheet=10);
 
   TH1* ApplyToTruth (const TH1* truth= 0, const char* name= "AppliedResponse") const; // If argument is 0, applies itself to its own truth
   TF1* MakeFoldingFunction (TF1* func, Double_t eps=1e-12, Bool_t verbose=false) const;
 
-  RooUnfoldResponse* RunToy() const;
+  RooUnfoldResponse* RunToy (TRandom* rnd= 0) const;  // rnd=0 uses gRandom
+
+  Int_t FindBlocks (std::vector<Int_t>& mblock, std::vector<Int_t>& tblock) const;  // independent sub-problems: block number of each measured and truth bin
+  RooUnfoldResponse* BlockResponse (const std::vector<Int_t>& mbins, const std::vector<Int_t>& tbins,
+                                    const char* name= 0) const;  // new 1D response for the given measured and truth vector indices
+
+  RooUnfoldTiming& Timing() const;  // Per-phase timing (see RooUnfoldTiming::Enable)
 
 private:
 
@@ -135,6 +171,12 @@ private:
   virtual Int_t Fake2D (Double_t xr, Double_t yr, Double_t w= 1.0);  // Fill fake event into 2D Response Matrix (with weight)
 
   static Int_t GetBinDim (const TH1* h, Int_t i);
+  static Int_t FindBins (const TH1* h, Double_t x, Double_t y, Double_t z, Int_t& bin);  // vector index and global bin
+  static Int_t FillBin (TH1* h, Int_t bin, Double_t w);  // fill global bin directly
+  static void MortonOrder (const TH1* h, Int_t n, std::vector<Int_t>& perm);
+  void RCMOrder (std::vector<Int_t>& mperm, std::vector<Int_t>& tperm) const;
+  void Permute (const std::vector<Int_t>& mperm, const std::vector<Int_t>& tperm);
+  void InvertPerm();
   static void ReplaceAxis(TAxis* axis, const TAxis* source);
 
   // instance variables
@@ -148,6 +190,11 @@ private:
   TH1*  _tru;      // Truth    histogram
   TH2*  _res;      // Response histogram
   Int_t _overflow; // Use histogram under/overflows if 1
+  Int_t _order;    // Bin order (BinOrder) of multi-dimensional vector indices
+  std::vector<Int_t> _mperm;  // Measured vector index -> natural index (empty if natural order)
+  std::vector<Int_t> _tperm;  // Truth    vector index -> natural index (empty if natural order)
+  std::vector<Int_t> _minv;   //! Natural measured index -> vector index
+  std::vector<Int_t> _tinv;   //! Natural truth    index -> vector index
 
   mutable TVectorD* _vMes;   //! Cached measured vector
   mutable TVectorD* _eMes;   //! Cached measured error
@@ -157,10 +204,11 @@ private:
   mutable TMatrixD* _mRes;   //! Cached response matrix
   mutable TMatrixD* _eRes;   //! Cached response error
   mutable Bool_t    _cached; //! We are using cached vectors/matrices
+  mutable RooUnfoldTiming _timing; //! Per-phase timing
 
 public:
 
-  ClassDef (RooUnfoldResponse, 1) // Respose Matrix
+  ClassDef (RooUnfoldResponse, 2) // Respose Matrix
 };
 
 // Inline method definitions
@@ -294,7 +342,10 @@ inline
 const TVectorD& RooUnfoldResponse::Vmeasured() const
 {
   // Measured distribution as a TVectorD
-  if (!_vMes) _cached= (_vMes= H2V  (_mes, _nm, _overflow));
+  if (!_vMes) {
+    RooUnfoldTimer t (_timing, RooUnfoldTiming::kConversion, Long64_t(_nm)*sizeof(Double_t));
+    _cached= (_vMes= H2V  (_mes, _nm, _overflow, GetPermMeasured()));
+  }
   return *_vMes;
 }
 
@@ -302,7 +353,10 @@ inline
 const TVectorD& RooUnfoldResponse::Vfakes() const
 {
   // Fakes distribution as a TVectorD
-  if (!_vFak) _cached= (_vFak= H2V  (_fak, _nm, _overflow));
+  if (!_vFak) {
+    RooUnfoldTimer t (_timing, RooUnfoldTiming::kConversion, Long64_t(_nm)*sizeof(Double_t));
+    _cached= (_vFak= H2V  (_fak, _nm, _overflow, GetPermMeasured()));
+  }
   return *_vFak;
 }
 
@@ -310,7 +364,10 @@ inline
 const TVectorD& RooUnfoldResponse::Emeasured() const
 {
   // Measured distribution errors as a TVectorD
-  if (!_eMes) _cached= (_eMes= H2VE (_mes, _nm, _overflow));
+  if (!_eMes) {
+    RooUnfoldTimer t (_timing, RooUnfoldTiming::kConversion, Long64_t(_nm)*sizeof(Double_t));
+    _cached= (_eMes= H2VE (_mes, _nm, _overflow, GetPermMeasured()));
+  }
   return *_eMes;
 }
 
@@ -318,7 +375,10 @@ inline
 const TVectorD& RooUnfoldResponse::Vtruth() const
 {
   // Truth distribution as a TVectorD
-  if (!_vTru) _cached= (_vTru= H2V  (_tru, _nt, _overflow)); 
+  if (!_vTru) {
+    RooUnfoldTimer t (_timing, RooUnfoldTiming::kConversion, Long64_t(_nt)*sizeof(Double_t));
+    _cached= (_vTru= H2V  (_tru, _nt, _overflow, GetPermTruth()));
+  }
   return *_vTru;
 }
 
@@ -326,7 +386,10 @@ inline
 const TVectorD& RooUnfoldResponse::Etruth() const
 {
   // Truth distribution errors as a TVectorD
-  if (!_eTru) _cached= (_eTru= H2VE (_tru, _nt, _overflow)); 
+  if (!_eTru) {
+    RooUnfoldTimer t (_timing, RooUnfoldTiming::kConversion, Long64_t(_nt)*sizeof(Double_t));
+    _cached= (_eTru= H2VE (_tru, _nt, _overflow, GetPermTruth()));
+  }
   return *_eTru;
 }
 
@@ -334,7 +397,10 @@ inline
 const TMatrixD& RooUnfoldResponse::Mresponse() const
 {
   // Response matrix as a TMatrixD: (row,column)=(measured,truth)
-  if (!_mRes) _cached= (_mRes= H2M  (_res, _nm, _nt, _tru, _overflow)); 
+  if (!_mRes) {
+    RooUnfoldTimer t (_timing, RooUnfoldTiming::kConversion, Long64_t(_nm)*_nt*sizeof(Double_t));
+    _cached= (_mRes= H2M  (_res, _nm, _nt, _tru, _overflow, GetPermTruth()));
+  }
   return *_mRes;
 }
 
@@ -342,11 +408,21 @@ inline
 const TMatrixD& RooUnfoldResponse::Eresponse() const
 {
   // Response matrix errors as a TMatrixD: (row,column)=(measured,truth)
-  if (!_eRes) _cached= (_eRes= H2ME (_res, _nm, _nt, _tru, _overflow)); 
+  if (!_eRes) {
+    RooUnfoldTimer t (_timing, RooUnfoldTiming::kConversion, Long64_t(_nm)*_nt*sizeof(Double_t));
+    _cached= (_eRes= H2ME (_res, _nm, _nt, _tru, _overflow, GetPermTruth()));
+  }
   return *_eRes;
 }
 
 
+inline
+RooUnfoldTiming& RooUnfoldResponse::Timing() const
+{
+  // Per-phase timing and memory use of this object. Only filled after RooUnfoldTiming::Enable().
+  return _timing;
+}
+
 inline
 Double_t RooUnfoldResponse::operator() (Int_t r, Int_t t) const
 {
@@ -355,25 +431,26 @@ Double_t RooUnfoldResponse::operator() (Int_t r, Int_t t) const
 }
 
 inline
-Int_t    RooUnfoldResponse::GetBin (const TH1* h, Int_t i, Bool_t overflow)
+Int_t    RooUnfoldResponse::GetBin (const TH1* h, Int_t i, Bool_t overflow, const Int_t* perm)
 {
   // vector index (0..nx*ny-1) -> multi-dimensional histogram
   // global bin number (0..(nx+2)*(ny+2)-1) skipping under/overflow bins
+  if (perm) i= perm[i];
   return (h->GetDimension()<2) ? i+(overflow ? 0 : 1) : GetBinDim(h,i);
 }
 
 inline
-Double_t RooUnfoldResponse::GetBinContent (const TH1* h, Int_t i, Bool_t overflow)
+Double_t RooUnfoldResponse::GetBinContent (const TH1* h, Int_t i, Bool_t overflow, const Int_t* perm)
 {
   // Bin content by vector index
-  return h->GetBinContent (GetBin (h, i, overflow));
+  return h->GetBinContent (GetBin (h, i, overflow, perm));
 }
 
 inline
-Double_t RooUnfoldResponse::GetBinError   (const TH1* h, Int_t i, Bool_t overflow)
+Double_t RooUnfoldResponse::GetBinError   (const TH1* h, Int_t i, Bool_t overflow, const Int_t* perm)
 {
   // Bin error   by vector index
-  return h->GetBinError   (GetBin (h, i, overflow));
+  return h->GetBinError   (GetBin (h, i, overflow, perm));
 }
 
 
@@ -435,6 +512,41 @@ Bool_t RooUnfoldResponse::UseOverflowStatus() const
   return _overflow;
 }
 
+inline
+Int_t RooUnfoldResponse::GetBinOrder() const
+{
+  // Get SetBinOrder setting
+  return _order;
+}
+
+inline
+const Int_t* RooUnfoldResponse::GetPermMeasured() const
+{
+  // Natural index (x fastest) of each measured vector index, or 0 if the vector index is in natural order
+  return _mperm.empty() ? 0 : &_mperm[0];
+}
+
+inline
+const Int_t* RooUnfoldResponse::GetPermTruth() const
+{
+  // Natural index (x fastest) of each truth vector index, or 0 if the vector index is in natural order
+  return _tperm.empty() ? 0 : &_tperm[0];
+}
+
+inline
+Int_t RooUnfoldResponse::VectorIndexMeasured (Int_t i) const
+{
+  // Vector index of natural measured index i (eg. from FindBin). Out-of-range indices are returned unchanged.
+  return (_minv.empty() || i<0 || i>=_nm) ? i : _minv[i];
+}
+
+inline
+Int_t RooUnfoldResponse::VectorIndexTruth (Int_t j) const
+{
+  // Vector index of natural truth index j (eg. from FindBin). Out-of-range indices are returned unchanged.
+  return (_tinv.empty() || j<0 || j>=_nt) ? j : _tinv[j];
+}
+
 inline
 Double_t RooUnfoldResponse::FakeEntries() const
 {
@@ -38,6 +38,8 @@ END_HTML */
 #endif
 
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldCovariance.h"
+#include "RooUnfoldProgress.h"
 
 using std::cout;
 using std::cerr;
@@ -146,9 +148,11 @@ RooUnfoldSvd::Unfold()
 
   Bool_t oldstat= TH1::AddDirectoryStatus();
   TH1::AddDirectory (kFALSE);
-  _meas1d=  HistNoOverflow (_meas,             _overflow);
-  _train1d= HistNoOverflow (_res->Hmeasured(), _overflow);
-  _truth1d= HistNoOverflow (_res->Htruth(),    _overflow);
+  // In the vector index order, which may differ from the natural bin order (RooUnfoldResponse::SetBinOrder),
+  // to match the response histogram.
+  _meas1d=  HistNoOverflow (Hmeasured(),       _overflow, _res->GetPermMeasured());
+  _train1d= HistNoOverflow (_res->Hmeasured(), _overflow, _res->GetPermMeasured());
+  _truth1d= HistNoOverflow (_res->Htruth(),    _overflow, _res->GetPermTruth());
   _reshist= _res->HresponseNoOverflow();
   Resize (_meas1d,  _nb);
   Resize (_train1d, _nb);
@@ -166,10 +170,15 @@ RooUnfoldSvd::Unfold()
   }
 
   _meascov= new TH2D ("meascov", "meascov", _nb, 0.0, 1.0, _nb, 0.0, 1.0);
-  const TMatrixD& cov= GetMeasuredCov();
-  for (Int_t i= 0; i<_nm; i++)
-    for (Int_t j= 0; j<_nm; j++)
-      _meascov->SetBinContent (i+1, j+1, cov(i,j));
+  const RooUnfoldCovariance& cov= GetMeasuredCovariance();
+  if (cov.GetType()==RooUnfoldCovariance::kDiagonal) {
+    for (Int_t i= 0; i<_nm; i++)
+      _meascov->SetBinContent (i+1, i+1, cov.GetDiagonal()[i]);
+  } else {
+    for (Int_t i= 0; i<_nm; i++)
+      for (Int_t j= 0; j<_nm; j++)
+        _meascov->SetBinContent (i+1, j+1, cov(i,j));
+  }
 
   if (_verbose>=1) cout << "SVD init " << _reshist->GetNbinsX() << " x " << _reshist->GetNbinsY()
                         << " bins, kreg=" << _kreg << endl;
@@ -200,6 +209,8 @@ void
 RooUnfoldSvd::GetCov()
 {
   if (!_svd) return;
+  // Analytic propagation replaces GetAdetCovMatrix's toys for the response errors
+  if (GetCovJacobian()) return;
   Bool_t oldstat= TH1::AddDirectoryStatus();
   TH1::AddDirectory (kFALSE);
 
@@ -207,7 +218,17 @@ RooUnfoldSvd::GetCov()
   //Get the covariance matrix for statistical uncertainties on the measured distribution
   if (_dosys!=2) unfoldedCov= _svd->GetXtau();
   //Get the covariance matrix for statistical uncertainties on the response matrix
-  if (_dosys) adetCov= _svd->GetAdetCovMatrix (_NToys);
+  if (_dosys) {
+    // TSVDUnfold's toys cannot be interrupted, so can only be skipped (see RooUnfoldProgress)
+    if (_progress && !_progress->Update ("TSVDUnfold response toys", 0, _NToys)) {
+      cerr << "Warning: RooUnfoldSvd stopped before response toys" << endl;
+      delete unfoldedCov;
+      TH1::AddDirectory (oldstat);
+      return;
+    }
+    adetCov= _svd->GetAdetCovMatrix (_NToys, _toySeed>=0 ? Int_t(_toySeed) : 1);
+    if (_progress) _progress->Update ("TSVDUnfold response toys", _NToys, _NToys);
+  }
 
   _cov.ResizeTo (_nt, _nt);
   for (Int_t i= 0; i<_nt; i++) {
@@ -225,6 +246,77 @@ RooUnfoldSvd::GetCov()
   _haveCov= true;
 }
 
+Bool_t
+RooUnfoldSvd::GetJacobian()
+{
+  // TSVDUnfold's damped SVD solution is the Tikhonov solution for weights w=x/xini,
+  //   w = G At^T W b,  G = (At^T W At + tau C^T C)^-1,
+  // where At is the response histogram, W the inverse measured covariance, C TSVDUnfold's
+  // second-derivative matrix, and tau the square of the kreg'th singular value. With the
+  // normalised response A = At/xini, this is a least-squares solution for x, which gives
+  // dx/db = xini G At^T W, and the response derivatives with P = xini G xini and s = W(b-At w).
+  // TSVDUnfold's cutoff for tiny singular values (<1e-12 of the largest) is not reproduced.
+  if (!_svd || _kreg < 1) return false;
+  const TH1D* sv= _svd->GetSV();
+  if (!sv) return false;
+  Double_t tau= sv->GetBinContent (_kreg);
+  tau *= tau;
+
+  TMatrixD At (_nb, _nb);
+  TVectorD xini(_nb), b(_nb);
+  for (Int_t i= 0; i<_nb; i++) {
+    xini[i]= _truth1d->GetBinContent (i+1);
+    b[i]=    _meas1d ->GetBinContent (i+1);
+    for (Int_t j= 0; j<_nb; j++)
+      At(i,j)= _reshist->GetBinContent (i+1, j+1);
+  }
+
+  // (Pseudo-)inverse of the measured covariance, as used by TSVDUnfold to rescale the inputs.
+  // Bins beyond _nm have zero covariance, so are zero in the pseudo-inverse.
+  TMatrixD W (_nb, _nb), covinv;
+  GetMeasuredCovariance().Invert (covinv);
+  for (Int_t i= 0; i<_nm; i++)
+    for (Int_t j= 0; j<_nm; j++)
+      W(i,j)= covinv(i,j);
+
+  // TSVDUnfold's curvature matrix (second derivative, with a small diagonal offset)
+  const Double_t eps= 0.00001;
+  TMatrixD C (_nb, _nb);
+  for (Int_t i= 0; i<_nb; i++) {
+    if (_nb == 1) { C(i,i)= 1.0 + eps; continue; }
+    if (i > 0)     C(i,i-1)= 1.0;
+    if (i < _nb-1) C(i,i+1)= 1.0;
+    C(i,i)= (i == 0 || i == _nb-1 ? -1.0 : -2.0) + eps;
+  }
+
+  TMatrixD WAt (W, TMatrixD::kMult, At);
+  TMatrixD G   (At, TMatrixD::kTransposeMult, WAt);
+  TMatrixD CTC (C, TMatrixD::kTransposeMult, C);
+  CTC *= tau;
+  G += CTC;
+  if (!InvertMatrix (G, G, "regularised SVD matrix", 0)) return false;
+  TMatrixD M (G, TMatrixD::kMultTranspose, WAt);   // dw/db
+
+  _dxdy.ResizeTo (_nt, _nm);
+  for (Int_t i= 0; i<_nt; i++)
+    for (Int_t j= 0; j<_nm; j++)
+      _dxdy(i,j)= xini[i] * M(i,j);
+  if (!_dosys) return true;
+
+  TVectorD r= b;
+  Add (r, -1.0, At, M*b);
+  TVectorD s= W*r;
+  _dxdAP.ResizeTo (_nt, _nt);
+  for (Int_t i= 0; i<_nt; i++)
+    for (Int_t k= 0; k<_nt; k++)
+      _dxdAP(i,k)= xini[i] * G(i,k) * xini[k];
+  _dxdAs.ResizeTo (_nm);
+  for (Int_t j= 0; j<_nm; j++) _dxdAs[j]= s[j];
+  _dxdAu.ResizeTo (_nt);
+  _dxdAu= _rec;
+  return true;
+}
+
 void RooUnfoldSvd::GetWgt()
 {
   // Get weight matrix
@@ -251,11 +343,23 @@ void RooUnfoldSvd::GetWgt()
 
 void RooUnfoldSvd::GetSettings(){
     _minparm=0;
-    _maxparm= _meas ? _meas->GetNbinsX() : 0;
+    _maxparm= _res ? _res->Hmeasured()->GetNbinsX() : 0;
     _stepsizeparm=1;
     _defaultparm=_maxparm/2;
 }
 
+Bool_t RooUnfoldSvd::ThreadSafe (ErrorTreatment) const
+{
+  // TSVDUnfold works with histograms, so cannot run at the same time as other unfoldings.
+  return false;
+}
+
+TString RooUnfoldSvd::CacheSettings() const
+{
+  // The number of toys is used if the errors cannot be propagated analytically.
+  return Form ("kreg=%d ntoys=%d", _kreg, _NToys);
+}
+
 void RooUnfoldSvd::Streamer (TBuffer &R__b)
 {
   // Stream an object of class RooUnfoldSvd.
@@ -49,6 +49,7 @@ public:
   Int_t GetKterm() const;
   virtual void  SetRegParm (Double_t parm);
   virtual Double_t GetRegParm() const;
+  virtual Bool_t ThreadSafe (ErrorTreatment withError=kErrors) const;
   virtual void Reset();
   TSVDUnfold* Impl();
 
@@ -60,7 +61,9 @@ protected:
   virtual void Unfold();
   virtual void GetCov();
   virtual void GetWgt();
+  virtual Bool_t GetJacobian();
   virtual void GetSettings();
+  virtual TString CacheSettings() const;
 
 private:
   void Init();
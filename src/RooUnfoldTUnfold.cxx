@@ -37,6 +37,7 @@ END_HTML */
 #include "TSpline.h"
 
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldProgress.h"
 
 using std::cout;
 using std::cerr;
@@ -166,7 +167,7 @@ RooUnfoldTUnfold::Unfold()
 
   Bool_t oldstat= TH1::AddDirectoryStatus();
   TH1::AddDirectory (kFALSE);
-  TH1D* meas= HistNoOverflow (_meas, _overflow);
+  TH1D* meas= HistNoOverflow (Hmeasured(), _overflow, _res->GetPermMeasured());
   TH2D* Hres=_res->HresponseNoOverflow();
   TH1::AddDirectory (oldstat);
 
@@ -190,7 +191,8 @@ RooUnfoldTUnfold::Unfold()
       meas->SetBinContent (i, meas->GetBinContent(i)-(fac*fakes[i-1]));
   }
 
-  Int_t ndim= _meas->GetDimension();
+  const TH1* rmeas= _res->Hmeasured();
+  Int_t ndim= rmeas->GetDimension();
   TUnfold::ERegMode reg= _reg_method;
   if (ndim == 2 || ndim == 3) reg= TUnfold::kRegModeNone;  // set explicitly
 
@@ -200,18 +202,18 @@ RooUnfoldTUnfold::Unfold()
     _unf= new TUnfold(Hres,TUnfold::kHistMapOutputVert,reg);
 
   if        (ndim == 2) {
-    Int_t nx= _meas->GetNbinsX(), ny= _meas->GetNbinsY();
-    _unf->RegularizeBins2D (0, 1, nx, nx, ny, _reg_method);
+    Int_t nx= rmeas->GetNbinsX(), ny= rmeas->GetNbinsY();
+    RegularizeBins2D (0, 1, nx, nx, ny);
   } else if (ndim == 3) {
-    Int_t nx= _meas->GetNbinsX(), ny= _meas->GetNbinsY(), nz= _meas->GetNbinsZ(), nxy= nx*ny;
+    Int_t nx= rmeas->GetNbinsX(), ny= rmeas->GetNbinsY(), nz= rmeas->GetNbinsZ(), nxy= nx*ny;
     for (Int_t i= 0; i<nx; i++) {
-      _unf->RegularizeBins2D (    i, nx, ny, nxy, nz, _reg_method);
+      RegularizeBins2D (    i, nx, ny, nxy, nz);
     }
     for (Int_t i= 0; i<ny; i++) {
-      _unf->RegularizeBins2D ( nx*i,  1, nx, nxy, nz, _reg_method);
+      RegularizeBins2D ( nx*i,  1, nx, nxy, nz);
     }
     for (Int_t i= 0; i<nz; i++) {
-      _unf->RegularizeBins2D (nxy*i,  1, nx,  nx, ny, _reg_method);
+      RegularizeBins2D (nxy*i,  1, nx,  nx, ny);
     }
   }
 
@@ -234,7 +236,15 @@ RooUnfoldTUnfold::Unfold()
     delete _lCurve;  _lCurve  = 0;
     delete _logTauX; _logTauX = 0;
     delete _logTauY; _logTauY = 0;
+    // TUnfold's scan cannot be interrupted, so can only be skipped (see RooUnfoldProgress)
+    if (_progress && !_progress->Update ("TUnfold L-curve scan", 0, nScan)) {
+      cerr << "Warning: RooUnfoldTUnfold stopped before L-curve scan" << endl;
+      delete meas;
+      delete Hres;
+      return;
+    }
     _unf->ScanLcurve(nScan,tauMin,tauMax,&_lCurve,&_logTauX,&_logTauY);
+    if (_progress) _progress->Update ("TUnfold L-curve scan", nScan, nScan);
     _tau=_unf->GetTau();  // save value, even if we don't use it unless tau_set
     cout <<"Lcurve scan chose tau= "<<_tau<<endl;
   }
@@ -248,8 +258,8 @@ RooUnfoldTUnfold::Unfold()
   }
 
   if (_verbose>=2) {
-    TH1* train1d= HistNoOverflow (_res->Hmeasured(), _overflow);
-    TH1* truth1d= HistNoOverflow (_res->Htruth(),    _overflow);
+    TH1* train1d= HistNoOverflow (_res->Hmeasured(), _overflow, _res->GetPermMeasured());
+    TH1* truth1d= HistNoOverflow (_res->Htruth(),    _overflow, _res->GetPermTruth());
     PrintTable (cout, truth1d, train1d, 0, meas, reco, _nm, _nt, kTRUE);
     delete truth1d;
     delete train1d;
@@ -262,6 +272,30 @@ RooUnfoldTUnfold::Unfold()
   _haveCov=  false;
 }
 
+void
+RooUnfoldTUnfold::RegularizeBins2D (Int_t start, Int_t step1, Int_t nbin1, Int_t step2, Int_t nbin2)
+{
+  // As TUnfold::RegularizeBins2D, with bins numbered in the natural (x fastest) order of the truth distribution.
+  // If the response uses another bin order (RooUnfoldResponse::SetBinOrder), each condition is mapped to it.
+  if (!_res->GetPermTruth()) {
+    _unf->RegularizeBins2D (start, step1, nbin1, step2, nbin2, _reg_method);
+    return;
+  }
+  for (Int_t d= 0; d<2; d++) {
+    Int_t step= d ? step2 : step1, nbin= d ? nbin2 : nbin1;
+    Int_t sout= d ? step1 : step2, nout= d ? nbin1 : nbin2;
+    for (Int_t o= 0; o<nout; o++) {
+      for (Int_t i= 0; i<nbin; i++) {
+        Int_t b[3];
+        for (Int_t k= 0; k<3; k++) b[k]= 1 + _res->VectorIndexTruth (start + sout*o + step*(i+k) - 1);
+        if      (_reg_method==TUnfold::kRegModeSize)                   _unf->RegularizeSize       (b[0]);
+        else if (_reg_method==TUnfold::kRegModeDerivative && i+1<nbin) _unf->RegularizeDerivative (b[0], b[1]);
+        else if (_reg_method==TUnfold::kRegModeCurvature  && i+2<nbin) _unf->RegularizeCurvature  (b[0], b[1], b[2]);
+      }
+    }
+  }
+}
+
 void
 RooUnfoldTUnfold::GetCov()
 {
@@ -324,3 +358,16 @@ RooUnfoldTUnfold::GetSettings()
     _stepsizeparm=1e-2;
     _defaultparm=2;
 }
+
+Bool_t
+RooUnfoldTUnfold::ThreadSafe (ErrorTreatment) const
+{
+  // TUnfold works with histograms, so cannot run at the same time as other unfoldings.
+  return false;
+}
+
+TString
+RooUnfoldTUnfold::CacheSettings() const
+{
+  return Form ("regmethod=%d tauset=%d tau=%.17g", Int_t(_reg_method), Int_t(tau_set), _tau);
+}
@@ -48,6 +48,7 @@ public:
   const TSpline* GetLogTauX() const;
   const TSpline* GetLogTauY() const;
   virtual Double_t GetRegParm() const;
+  virtual Bool_t ThreadSafe (ErrorTreatment withError=kErrors) const;
   void SetRegMethod (TUnfold::ERegMode regmethod);
   TUnfold::ERegMode GetRegMethod() const;
 
@@ -57,8 +58,10 @@ protected:
   virtual void Unfold();
   virtual void GetCov();
   virtual void GetSettings();
+  virtual TString CacheSettings() const;
   void Assign   (const RooUnfoldTUnfold& rhs); // implementation of assignment operator
   void CopyData (const RooUnfoldTUnfold& rhs);
+  void RegularizeBins2D (Int_t start, Int_t step1, Int_t nbin1, Int_t step2, Int_t nbin2);
 
 private:
   TUnfold::ERegMode _reg_method; //Regularisation method
@@ -0,0 +1,388 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Fast regularisation parameter selection: projects the Tikhonov
+//      unfolding problem onto a small Golub-Kahan (Lanczos) bidiagonal basis,
+//      then scans the L-curve, GCV, and discrepancy principle criteria.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>Chooses the regularisation parameter without repeating the unfolding for each trial value.
+The Tikhonov problem, minimising</p>
+<pre>
+  (y-Rx)<sup>T</sup> W (y-Rx) + tau |Lx|<sup>2</sup>
+</pre>
+<p>(W the inverse measurement variances, L the size, derivative, or curvature condition), is projected once onto
+k steps of Golub-Kahan bidiagonalisation of W<sup>1/2</sup>R, starting from W<sup>1/2</sup>y. This needs k products
+with the response matrix and its transpose, which use the non-zero elements of the response only. Thereafter each tau only needs a k x k solution, so hundreds of
+values can be scanned in less time than one unfolding. For each tau the scan records</p>
+<ul>
+<li>the chi2 and regularisation term |Lx|, giving the L-curve, whose corner (maximum curvature) is the kLCurve choice,
+<li>the generalised cross-validation function, chi2/(nm-dof)<sup>2</sup>, whose minimum is the kGCV choice, and
+<li>the discrepancy principle, chi2 = nm (SetDiscrepancyScale() changes the target): kDiscrepancy
+chooses the largest tau satisfying this.
+</ul>
+<p>Apply() hands the chosen value to the unfolding:</p>
+<ul>
+<li>RooUnfoldCGLS: the same tau and regularisation condition.
+<li>RooUnfoldTUnfold: TUnfold uses tau<sup>2</sup>|Lx|<sup>2</sup>, so sqrt(tau), with the same condition.
+<li>RooUnfoldBasisSplines: tau, with curvature regularisation. BasisSplines regularises the spline coefficients,
+so this is only equivalent when the splines follow the truth binning.
+<li>RooUnfoldSvd: the number of terms, kreg, is taken as the effective number of parameters (dof) at the chosen tau,
+which is the sum of the Tikhonov filter factors.
+</ul>
+<p>By default the regularisation condition is taken from the unfolding (derivative for TUnfold and CGLS, curvature otherwise).
+Example:</p>
+<pre>
+  RooUnfoldTauScan scan (&amp;unfold);
+  scan.Scan();
+  scan.Apply (&amp;unfold, RooUnfoldTauScan::kGCV);
+</pre>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldTauScan.h"
+
+#include <iostream>
+#include <cmath>
+
+#include "TGraph.h"
+#include "TMatrixDSparse.h"
+
+#include "RooUnfold.h"
+#include "RooUnfoldResponse.h"
+#include "RooUnfoldSvd.h"
+#include "RooUnfoldBasisSplines.h"
+#include "RooUnfoldCGLS.h"
+#ifndef NOTUNFOLD
+#include "RooUnfoldTUnfold.h"
+#endif
+#include "core/RooUnfoldCore.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+ClassImp (RooUnfoldTauScan);
+
+RooUnfoldTauScan::RooUnfoldTauScan (const RooUnfold* unfold, Int_t regmode, Int_t nkrylov)
+  : _unfold(unfold), _reg(regmode), _nkrylov(nkrylov)
+{
+  Init();
+  if (_reg<0) {
+    _reg= RooUnfoldCGLS::kRegModeCurvature;
+    if (const RooUnfoldCGLS* u= dynamic_cast<const RooUnfoldCGLS*>(_unfold)) _reg= u->GetRegMethod();
+#ifndef NOTUNFOLD
+    if (const RooUnfoldTUnfold* u= dynamic_cast<const RooUnfoldTUnfold*>(_unfold)) _reg= u->GetRegMethod();
+#endif
+  }
+  if (_reg==RooUnfoldCGLS::kRegModeNone) _reg= RooUnfoldCGLS::kRegModeSize;
+}
+
+RooUnfoldTauScan::~RooUnfoldTauScan()
+{
+  delete _lCurve;
+}
+
+void
+RooUnfoldTauScan::Init()
+{
+  _k= _nm= _nt= 0;
+  _scale= 1.0;
+  _beta1= 0.0;
+  _lCurve= 0;
+}
+
+Int_t
+RooUnfoldTauScan::NReg() const
+{
+  switch (_reg) {
+    case RooUnfoldCGLS::kRegModeDerivative: return _nt>1 ? _nt-1 : 0;
+    case RooUnfoldCGLS::kRegModeCurvature:  return _nt>2 ? _nt-2 : 0;
+    default:                                return _nt;
+  }
+}
+
+void
+RooUnfoldTauScan::RegMult (const TVectorD& x, TVectorD& y) const
+{
+  // Neighbouring truth bins in the natural order, as RooUnfoldCGLS
+  const RooUnfoldResponse* res= _unfold->response();
+  Int_t nr= NReg();
+  for (Int_t i= 0; i<nr; i++) {
+    Int_t a= res->VectorIndexTruth(i), b= res->VectorIndexTruth(i+1), c= res->VectorIndexTruth(i+2);
+    switch (_reg) {
+      case RooUnfoldCGLS::kRegModeDerivative: y[i]= x[b] - x[a];                  break;
+      case RooUnfoldCGLS::kRegModeCurvature:  y[i]= x[a] - 2.0*x[b] + x[c];       break;
+      default:                                y[i]= x[a];                         break;
+    }
+  }
+}
+
+Bool_t
+RooUnfoldTauScan::Bidiagonalise()
+{
+  // Golub-Kahan bidiagonalisation, W^1/2 R V = U B, with U and V reorthogonalised at each step.
+  // Only B and the projected regularisation matrix, (LV)^T (LV), are kept.
+  _k= 0;
+  if (!_unfold || !_unfold->response()) {
+    cerr << "Warning: RooUnfoldTauScan has no unfolding object" << endl;
+    return false;
+  }
+  const RooUnfoldResponse* res= _unfold->response();
+  Int_t overflow= res->UseOverflowStatus() ? 1 : 0;
+  _nm= res->GetNbinsMeasured() + 2*overflow;
+  _nt= res->GetNbinsTruth()    + 2*overflow;
+  Int_t kmax= _nkrylov>0 ? _nkrylov : (_nt<100 ? _nt : 100);
+  if (kmax>_nt) kmax= _nt;
+
+  TVectorD w= _unfold->Emeasured();
+  for (Int_t i= 0; i<_nm; i++) w[i]= (w[i]>0.0) ? 1.0/w[i] : 1.0;
+
+  // W^1/2 R as a sparse matrix, filled from the response histogram as in RooUnfoldCGLS,
+  // so that neither a dense copy nor its transpose is made.
+  TMatrixDSparse* A= res->MresponseSparse (&w);
+  if (!A) {
+    cerr << "Warning: RooUnfoldTauScan response matrix is empty" << endl;
+    return false;
+  }
+
+  TVectorD b= _unfold->Vmeasured();
+  res->SubtractFakes (b, b.Sum());
+  for (Int_t i= 0; i<_nm; i++) b[i] *= w[i];
+
+  std::vector<TVectorD> U, V;
+  std::vector<Double_t> alpha, beta;
+  TVectorD u(b), v(_nt);
+  _beta1= sqrt(u.Norm2Sqr());
+  if (_beta1==0.0) {
+    cerr << "Warning: RooUnfoldTauScan measured distribution is empty" << endl;
+    delete A;
+    return false;
+  }
+  u *= 1.0/_beta1;
+  U.push_back (u);
+  beta.push_back (_beta1);
+  RooUnfoldResponse::SparseMultT (*A, u, v);
+  Double_t a= sqrt(v.Norm2Sqr());
+  if (a==0.0) {
+    cerr << "Warning: RooUnfoldTauScan response matrix is empty" << endl;
+    delete A;
+    return false;
+  }
+  Double_t tiny= 1e-12*a;
+  v *= 1.0/a;
+  V.push_back (v);
+  alpha.push_back (a);
+  for (;;) {
+    TVectorD un(_nm);
+    RooUnfoldResponse::SparseMult  (*A, v, un);
+    Add (un, -alpha.back(), u);
+    for (size_t l= 0; l<U.size(); l++) Add (un, -Dot(un,U[l]), U[l]);
+    Double_t bn= sqrt(un.Norm2Sqr());
+    beta.push_back (bn);
+    if (bn<=tiny || Int_t(alpha.size())>=kmax) break;
+    un *= 1.0/bn;
+    u= un;
+    U.push_back (u);
+    TVectorD vn(_nt);
+    RooUnfoldResponse::SparseMultT (*A, u, vn);
+    Add (vn, -bn, v);
+    for (size_t l= 0; l<V.size(); l++) Add (vn, -Dot(vn,V[l]), V[l]);
+    Double_t an= sqrt(vn.Norm2Sqr());
+    if (an<=tiny) break;
+    vn *= 1.0/an;
+    v= vn;
+    V.push_back (v);
+    alpha.push_back (an);
+  }
+  delete A;
+  _k= alpha.size();
+
+  Int_t k= _k;
+  _B.assign (size_t(k+1)*k, 0.0);
+  for (Int_t i= 0; i<k; i++) {
+    _B[size_t(i)*k+i]=   alpha[i];
+    _B[size_t(i+1)*k+i]= beta[i+1];
+  }
+  _BtB.assign (size_t(k)*k, 0.0);
+  for (Int_t i= 0; i<k; i++)
+    for (Int_t j= 0; j<k; j++) {
+      Double_t s= 0.0;
+      for (Int_t l= 0; l<=k; l++) s += _B[size_t(l)*k+i] * _B[size_t(l)*k+j];
+      _BtB[size_t(i)*k+j]= s;
+    }
+  Int_t nr= NReg();
+  std::vector<TVectorD> LV (k, TVectorD(nr));
+  for (Int_t j= 0; j<k; j++) RegMult (V[j], LV[j]);
+  _M.assign (size_t(k)*k, 0.0);
+  for (Int_t i= 0; i<k; i++)
+    for (Int_t j= 0; j<k; j++) _M[size_t(i)*k+j]= Dot (LV[i], LV[j]);
+
+  if (_unfold->verbose()>=1)
+    cout << "RooUnfoldTauScan projected " << _nm << "x" << _nt << " response onto " << k << " Golub-Kahan vectors" << endl;
+  return true;
+}
+
+Int_t
+RooUnfoldTauScan::Scan (Int_t ntau, Double_t taumin, Double_t taumax)
+{
+  // Scan ntau values of tau, logarithmically spaced between taumin and taumax. By default, the range
+  // is from 10^2 down to 10^-10 times trace(B^T B)/trace(M), which spans the effective number of
+  // parameters from about zero to k. Returns the number of tau values scanned.
+  if (_k==0 && !Bidiagonalise()) return 0;
+  Int_t k= _k;
+  if (taumax<=0.0 || taumin<=0.0) {
+    Double_t tb= 0.0, tm= 0.0;
+    for (Int_t i= 0; i<k; i++) {
+      tb += _BtB[size_t(i)*k+i];
+      tm += _M  [size_t(i)*k+i];
+    }
+    Double_t scale= (tm>0.0) ? tb/tm : tb;
+    if (taumax<=0.0) taumax= 1e2*scale;
+    if (taumin<=0.0) taumin= 1e-10*scale;
+  }
+  if (ntau<2) ntau= 2;
+  _tau .ResizeTo(ntau);
+  _chi2.ResizeTo(ntau);
+  _eta .ResizeTo(ntau);
+  _gcv .ResizeTo(ntau);
+  _dof .ResizeTo(ntau);
+  _curv.ResizeTo(ntau);
+  delete _lCurve; _lCurve= 0;
+
+  std::vector<Double_t> H (size_t(k)*k), y(k), col(k);
+  Double_t lmin= log(taumin), dl= (log(taumax)-lmin)/(ntau-1);
+  for (Int_t t= 0; t<ntau; t++) {
+    Double_t tau= exp (lmin + t*dl);
+    _tau[t]= tau;
+    for (size_t i= 0; i<H.size(); i++) H[i]= _BtB[i] + tau*_M[i];
+    if (!RooUnfoldCore::Cholesky (k, &H[0])) {
+      cerr << "Warning: RooUnfoldTauScan projected system is singular for tau=" << tau << endl;
+      _chi2[t]= _eta[t]= _gcv[t]= _dof[t]= -1.0;
+      continue;
+    }
+    // y = (B^T B + tau M)^-1 B^T beta1 e1, with B^T e1 = alpha1 e1
+    for (Int_t i= 0; i<k; i++) y[i]= 0.0;
+    y[0]= _beta1 * _B[0];
+    RooUnfoldCore::CholeskySolve (k, &H[0], &y[0]);
+    Double_t chi2= 0.0;
+    for (Int_t l= 0; l<=k; l++) {
+      Double_t r= (l==0) ? -_beta1 : 0.0;
+      for (Int_t i= (l>0 ? l-1 : 0); i<k && i<=l; i++) r += _B[size_t(l)*k+i] * y[i];
+      chi2 += r*r;
+    }
+    Double_t eta= 0.0, dof= 0.0;
+    for (Int_t i= 0; i<k; i++)
+      for (Int_t j= 0; j<k; j++) eta += y[i] * _M[size_t(i)*k+j] * y[j];
+    for (Int_t j= 0; j<k; j++) {
+      for (Int_t i= 0; i<k; i++) col[i]= _BtB[size_t(i)*k+j];
+      RooUnfoldCore::CholeskySolve (k, &H[0], &col[0]);
+      dof += col[j];
+    }
+    _chi2[t]= chi2;
+    _eta [t]= sqrt(eta>0.0 ? eta : 0.0);
+    _dof [t]= dof;
+    _gcv [t]= (_nm>dof) ? chi2/((_nm-dof)*(_nm-dof)) : -1.0;
+  }
+
+  // L-curve curvature in (log chi2^1/2, log |Lx|), differentiating with respect to log tau
+  _curv.Zero();
+  for (Int_t t= 1; t<ntau-1; t++) {
+    if (_chi2[t-1]<=0.0 || _chi2[t]<=0.0 || _chi2[t+1]<=0.0 ||
+        _eta [t-1]<=0.0 || _eta [t]<=0.0 || _eta [t+1]<=0.0) continue;
+    Double_t r0= 0.5*log(_chi2[t-1]), r1= 0.5*log(_chi2[t]), r2= 0.5*log(_chi2[t+1]);
+    Double_t e0= log(_eta[t-1]),      e1= log(_eta[t]),      e2= log(_eta[t+1]);
+    Double_t dr= (r2-r0)/(2*dl), ddr= (r2-2*r1+r0)/(dl*dl);
+    Double_t de= (e2-e0)/(2*dl), dde= (e2-2*e1+e0)/(dl*dl);
+    Double_t d= pow (dr*dr + de*de, 1.5);
+    if (d>0.0) _curv[t]= (dr*dde - ddr*de) / d;
+  }
+  return ntau;
+}
+
+Int_t
+RooUnfoldTauScan::BestIndex (Criterion crit) const
+{
+  // Index in GetTau() of the value chosen by crit, or -1 if there is no scan.
+  Int_t ntau= _tau.GetNrows(), best= -1;
+  for (Int_t t= 0; t<ntau; t++) {
+    if (_chi2[t]<0.0) continue;
+    switch (crit) {
+      case kLCurve:
+        if (t>0 && t<ntau-1 && (best<0 || _curv[t]>_curv[best])) best= t;
+        break;
+      case kGCV:
+        if (_gcv[t]>=0.0 && (best<0 || _gcv[t]<_gcv[best])) best= t;
+        break;
+      case kDiscrepancy:
+        if (_chi2[t] <= _scale*_nm) best= t;
+        break;
+    }
+  }
+  if (best<0 && ntau>0 && crit==kDiscrepancy) {
+    cerr << "Warning: RooUnfoldTauScan chi2 is above " << _scale*_nm << " for all tau: using the smallest" << endl;
+    best= 0;
+  }
+  return best;
+}
+
+Double_t
+RooUnfoldTauScan::BestTau (Criterion crit) const
+{
+  Int_t t= BestIndex (crit);
+  return t>=0 ? _tau[t] : -1.0;
+}
+
+Bool_t
+RooUnfoldTauScan::Apply (RooUnfold* unfold, Criterion crit) const
+{
+  // Set the regularisation parameter of unfold to the value chosen by crit, converted for its algorithm.
+  Int_t t= BestIndex (crit);
+  if (t<0) {
+    cerr << "Warning: RooUnfoldTauScan::Apply called before Scan" << endl;
+    return false;
+  }
+  Double_t tau= _tau[t], parm;
+  if (RooUnfoldCGLS* u= dynamic_cast<RooUnfoldCGLS*>(unfold)) {
+    u->SetRegMethod (RooUnfoldCGLS::RegMode(_reg));
+    parm= tau;
+#ifndef NOTUNFOLD
+  } else if (RooUnfoldTUnfold* u= dynamic_cast<RooUnfoldTUnfold*>(unfold)) {
+    u->SetRegMethod (TUnfold::ERegMode(_reg));
+    parm= sqrt(tau);
+#endif
+  } else if (dynamic_cast<RooUnfoldBasisSplines*>(unfold)) {
+    parm= tau;
+  } else if (dynamic_cast<RooUnfoldSvd*>(unfold)) {
+    parm= _dof[t]<1.0 ? 1.0 : _dof[t];
+  } else {
+    cerr << "Warning: RooUnfoldTauScan cannot set the regularisation parameter of " << unfold->ClassName() << endl;
+    return false;
+  }
+  if (unfold->verbose()>=1)
+    cout << "RooUnfoldTauScan chose tau=" << tau << " (chi2=" << _chi2[t] << ", dof=" << _dof[t]
+         << "): " << unfold->ClassName() << " regularisation parameter " << parm << endl;
+  unfold->SetRegParm (parm);
+  return true;
+}
+
+TGraph*
+RooUnfoldTauScan::GetLCurve()
+{
+  // L-curve from the last Scan(): log10|Lx| vs log10 chi2.
+  if (!_lCurve) {
+    Int_t ntau= _tau.GetNrows();
+    _lCurve= new TGraph();
+    for (Int_t t= 0, n= 0; t<ntau; t++) {
+      if (_chi2[t]<=0.0 || _eta[t]<=0.0) continue;
+      _lCurve->SetPoint (n++, log10(_chi2[t]), log10(_eta[t]));
+    }
+  }
+  return _lCurve;
+}
@@ -0,0 +1,115 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Fast regularisation parameter selection: projects the Tikhonov
+//      unfolding problem onto a small Golub-Kahan (Lanczos) bidiagonal basis,
+//      then scans the L-curve, GCV, and discrepancy principle criteria.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDTAUSCAN_H_
+#define ROOUNFOLDTAUSCAN_H_
+
+#include <vector>
+
+#include "TNamed.h"
+#include "TVectorD.h"
+
+class RooUnfold;
+class TGraph;
+
+class RooUnfoldTauScan : public TNamed {
+public:
+  enum Criterion {       // Selection criterion:
+    kLCurve,             //   maximum curvature of the L-curve
+    kGCV,                //   minimum of the generalised cross-validation function
+    kDiscrepancy         //   largest tau with chi2 <= SetDiscrepancyScale() * number of measured bins
+  };
+
+  RooUnfoldTauScan (const RooUnfold* unfold= 0, Int_t regmode= -1, Int_t nkrylov= 0);
+  virtual ~RooUnfoldTauScan();
+
+  void     SetNKrylov (Int_t nkrylov);          // number of bidiagonalisation steps (default: number of truth bins, up to 100)
+  Int_t    GetNKrylov() const;                  // number of steps actually done (after Bidiagonalise)
+  void     SetDiscrepancyScale (Double_t scale);  // kDiscrepancy target chi2 per measured bin (default 1)
+  Int_t    GetRegMode() const;                  // regularisation condition, as RooUnfoldCGLS::RegMode
+
+  Bool_t   Bidiagonalise();
+  Int_t    Scan (Int_t ntau= 200, Double_t taumin= 0.0, Double_t taumax= 0.0);  // default range from the projected matrix
+  Int_t    BestIndex (Criterion crit= kLCurve) const;
+  Double_t BestTau   (Criterion crit= kLCurve) const;
+  Bool_t   Apply (RooUnfold* unfold, Criterion crit= kLCurve) const;
+
+  const TVectorD& GetTau()         const;  // scanned tau values
+  const TVectorD& GetChi2()        const;  // |W^1/2 (y-Rx)|^2
+  const TVectorD& GetRegNorm()     const;  // |Lx|
+  const TVectorD& GetGCV()         const;
+  const TVectorD& GetDOF()         const;  // effective number of parameters, trace of the influence matrix
+  const TVectorD& GetCurvature()   const;  // L-curve curvature
+  TGraph* GetLCurve();                     // log10|Lx| vs log10 chi2, owned by RooUnfoldTauScan
+
+private:
+  void   Init();
+  void   RegMult (const TVectorD& x, TVectorD& y) const;
+  Int_t  NReg() const;
+
+  const RooUnfold* _unfold;   // unfolding to scan (not owned)
+  Int_t    _reg;              // regularisation condition
+  Int_t    _nkrylov;          // requested bidiagonalisation steps
+  Int_t    _k;                // bidiagonalisation steps done
+  Int_t    _nm;               // number of measured bins
+  Int_t    _nt;               // number of truth bins
+  Double_t _scale;            // discrepancy principle target
+  Double_t _beta1;            // |W^1/2 y|
+  std::vector<Double_t> _B;   // (k+1) x k lower bidiagonal matrix, row-major
+  std::vector<Double_t> _BtB; // k x k, B^T B
+  std::vector<Double_t> _M;   // k x k, (LV)^T (LV)
+  TVectorD _tau, _chi2, _eta, _gcv, _dof, _curv;
+  TGraph*  _lCurve;
+
+public:
+  ClassDef (RooUnfoldTauScan, 0)  // Regularisation parameter selection by Golub-Kahan projection
+};
+
+// Inline method definitions
+
+inline
+void RooUnfoldTauScan::SetNKrylov (Int_t nkrylov)
+{
+  // Set number of Golub-Kahan bidiagonalisation steps. If the chosen tau changes when this is increased,
+  // the projection is not yet converged.
+  _nkrylov= nkrylov;
+  _k= 0;
+}
+
+inline
+Int_t RooUnfoldTauScan::GetNKrylov() const
+{
+  // Number of bidiagonalisation steps done (may be fewer than requested, if the Krylov space is exhausted)
+  return _k;
+}
+
+inline
+void RooUnfoldTauScan::SetDiscrepancyScale (Double_t scale)
+{
+  // Target chi2 per measured bin for the kDiscrepancy criterion
+  _scale= scale;
+}
+
+inline
+Int_t RooUnfoldTauScan::GetRegMode() const
+{
+  // Regularisation condition, as RooUnfoldCGLS::RegMode (the same numbering as TUnfold::ERegMode)
+  return _reg;
+}
+
+inline const TVectorD& RooUnfoldTauScan::GetTau()       const { return _tau;  }
+inline const TVectorD& RooUnfoldTauScan::GetChi2()      const { return _chi2; }
+inline const TVectorD& RooUnfoldTauScan::GetRegNorm()   const { return _eta;  }
+inline const TVectorD& RooUnfoldTauScan::GetGCV()       const { return _gcv;  }
+inline const TVectorD& RooUnfoldTauScan::GetDOF()       const { return _dof;  }
+inline const TVectorD& RooUnfoldTauScan::GetCurvature() const { return _curv; }
+
+#endif /*ROOUNFOLDTAUSCAN_H_*/
@@ -0,0 +1,160 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Per-phase timing and memory instrumentation for RooUnfold and
+//      RooUnfoldResponse objects. Disabled by default.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>Records, for each unfolding object, the number of calls, wall-clock and CPU time spent in
+setup, unfolding, covariance calculation, toys, and histogram conversions, together with the
+bytes allocated by conversions and the peak process resident memory (the high-water mark, so far,
+of the whole process, which includes earlier phases) at the end of each phase.</p>
+<p>Instrumentation is off by default and then costs only a flag test per phase.
+Switch it on with RooUnfoldTiming::Enable(), then use RooUnfold::Timing() or
+RooUnfoldResponse::Timing() to retrieve the data, or Print() to list it.
+To see when each phase ran in each process and thread, use RooUnfoldTrace.</p>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldTiming.h"
+
+#include <iostream>
+#include <iomanip>
+#include <ctime>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+#include "TSystem.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+using std::setprecision;
+
+ClassImp (RooUnfoldTiming);
+
+Bool_t RooUnfoldTiming::_enabled= kFALSE;
+
+RooUnfoldTiming::RooUnfoldTiming()
+  : TObject()
+{
+  Reset();
+}
+
+RooUnfoldTiming::~RooUnfoldTiming()
+{
+}
+
+void RooUnfoldTiming::Reset()
+{
+  for (Int_t i= 0; i < kNPhases; i++) {
+    _calls[i]= 0;
+    _real [i]= _cpu[i]= 0.0;
+    _bytes[i]= 0;
+    _mem  [i]= 0;
+  }
+}
+
+void RooUnfoldTiming::Add (Int_t phase, Double_t real, Double_t cpu, Long64_t bytes, Long_t memory)
+{
+  if (phase < 0 || phase >= kNPhases) return;
+  _calls[phase]++;
+  _real [phase] += real;
+  _cpu  [phase] += cpu;
+  _bytes[phase] += bytes;
+  if (memory > _mem[phase]) _mem[phase]= memory;
+}
+
+RooUnfoldTiming& RooUnfoldTiming::operator+= (const RooUnfoldTiming& rhs)
+{
+  // Accumulate another object's timings, eg. from toys.
+  for (Int_t i= 0; i < kNPhases; i++) {
+    _calls[i] += rhs._calls[i];
+    _real [i] += rhs._real [i];
+    _cpu  [i] += rhs._cpu  [i];
+    _bytes[i] += rhs._bytes[i];
+    if (rhs._mem[i] > _mem[i]) _mem[i]= rhs._mem[i];
+  }
+  return *this;
+}
+
+Double_t RooUnfoldTiming::TotalRealTime() const
+{
+  Double_t t= 0.0;
+  for (Int_t i= 0; i < kNPhases; i++) t += _real[i];
+  return t;
+}
+
+Bool_t RooUnfoldTiming::IsEmpty() const
+{
+  for (Int_t i= 0; i < kNPhases; i++)
+    if (_calls[i]) return false;
+  return true;
+}
+
+const char* RooUnfoldTiming::PhaseName (Int_t phase)
+{
+  static const char* const names[kNPhases]= { "setup", "unfold", "covariance", "toys", "conversion" };
+  if (phase < 0 || phase >= kNPhases) return "unknown";
+  return names[phase];
+}
+
+void RooUnfoldTiming::Print (Option_t* /*opt*/) const
+{
+  cout << setw(12) << "phase" << setw(8) << "calls" << setw(11) << "real (s)" << setw(11) << "cpu (s)"
+       << setw(12) << "alloc (kB)" << setw(14) << "peak RSS (kB)" << endl;
+  for (Int_t i= 0; i < kNPhases; i++) {
+    if (!_calls[i]) continue;
+    cout << setw(12) << PhaseName(i) << setw(8) << _calls[i] << std::fixed << setprecision(4)
+         << setw(11) << _real[i] << setw(11) << _cpu[i] << setprecision(1)
+         << setw(12) << _bytes[i]/1024.0 << setw(14) << _mem[i] << endl;
+  }
+  cout.unsetf (std::ios::fixed);
+  cout << setprecision(6);
+}
+
+static Long_t PeakResident()
+{
+  // High-water mark of the process resident memory (kB). Windows only has the current resident memory.
+#if !defined(_WIN32)
+  struct rusage ru;
+  if (getrusage (RUSAGE_SELF, &ru) == 0) {
+#if defined(__APPLE__)
+    return Long_t (ru.ru_maxrss / 1024);   // bytes on macOS
+#else
+    return Long_t (ru.ru_maxrss);
+#endif
+  }
+#endif
+  ProcInfo_t info;
+  if (gSystem && gSystem->GetProcInfo (&info) == 0) return info.fMemResident;
+  return 0;
+}
+
+void RooUnfoldTimer::Start (RooUnfoldTiming& timing, Int_t phase, Long64_t bytes)
+{
+  // Only takes timestamps, so is cheap enough for every conversion.
+  _timing= &timing;
+  _phase=  phase;
+  _bytes=  bytes;
+  Double_t now= RooUnfoldTrace::Now();
+  _start= RooUnfoldTiming::Traced (phase) ? now : -1.0;
+  _real=  RooUnfoldTiming::Enabled()      ? now : -1.0;
+  _cpu=   _real >= 0.0 ? Double_t (std::clock()) : 0.0;
+}
+
+void RooUnfoldTimer::Stop()
+{
+  if (_start >= 0.0) RooUnfoldTrace::Complete (RooUnfoldTiming::PhaseName (_phase), _start);
+  if (_real < 0.0) return;
+  Double_t cpu=  (Double_t (std::clock()) - _cpu) / CLOCKS_PER_SEC;
+  Double_t real= 1e-6 * (RooUnfoldTrace::Now() - _real);
+  _timing->Add (_phase, real, cpu, _bytes, PeakResident());
+}
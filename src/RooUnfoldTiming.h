@@ -0,0 +1,114 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Per-phase timing and memory instrumentation for RooUnfold and
+//      RooUnfoldResponse objects. Disabled by default.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDTIMING_HH
+#define ROOUNFOLDTIMING_HH
+
+#include "TObject.h"
+
+#include "RooUnfoldTrace.h"
+
+class RooUnfoldTiming : public TObject {
+
+public:
+
+  enum Phase {           // Instrumented phases:
+    kSetup,              //   response/unfolding object setup
+    kUnfold,             //   Unfold()
+    kCovariance,         //   GetCov(), GetErrors(), GetWgt()
+    kToys,               //   toy generation and unfolding (GetErrMat(), RunToy())
+    kConversion,         //   histogram <-> vector/matrix conversions (H2V, H2M, V2H, Hreco)
+    kNPhases
+  };
+
+  RooUnfoldTiming(); // default constructor
+  virtual ~RooUnfoldTiming(); // destructor
+
+  void Reset();
+  void Add (Int_t phase, Double_t real, Double_t cpu, Long64_t bytes= 0, Long_t memory= 0);
+  RooUnfoldTiming& operator+= (const RooUnfoldTiming& rhs);
+
+  Int_t    Calls      (Int_t phase) const;  // Number of times phase was entered
+  Double_t RealTime   (Int_t phase) const;  // Accumulated wall-clock time (s)
+  Double_t CpuTime    (Int_t phase) const;  // Accumulated CPU time (s)
+  Long64_t Bytes      (Int_t phase) const;  // Bytes allocated for vectors/matrices by conversions
+  Long_t   PeakMemory (Int_t phase) const;  // High-water mark of process resident memory (kB) at the end of phase
+  Double_t TotalRealTime() const;
+  Bool_t   IsEmpty() const;
+
+  virtual void Print (Option_t* opt="") const;
+
+  static const char* PhaseName (Int_t phase);
+  static void   Enable (Bool_t on= kTRUE);  // Switch instrumentation on/off for all objects
+  static Bool_t Enabled();
+  static Bool_t Traced (Int_t phase);       // phase written to the RooUnfoldTrace file
+
+private:
+  Int_t    _calls[kNPhases];
+  Double_t _real [kNPhases];
+  Double_t _cpu  [kNPhases];
+  Long64_t _bytes[kNPhases];
+  Long_t   _mem  [kNPhases];
+
+  static Bool_t _enabled;
+
+public:
+  ClassDef (RooUnfoldTiming, 1) // Per-phase timing of unfolding objects
+};
+
+
+class RooUnfoldTimer {
+  // Scoped timer: adds the time until it goes out of scope to one phase of a RooUnfoldTiming,
+  // and writes it to the trace file, if open. Does nothing (beyond testing flags) unless
+  // RooUnfoldTiming::Enable() or RooUnfoldTrace::Open() has been called.
+public:
+  RooUnfoldTimer (RooUnfoldTiming& timing, Int_t phase, Long64_t bytes= 0)
+    : _timing(0) { if (RooUnfoldTiming::Enabled() || RooUnfoldTiming::Traced(phase)) Start (timing, phase, bytes); }
+  ~RooUnfoldTimer() { if (_timing) Stop(); }
+private:
+  RooUnfoldTimer (const RooUnfoldTimer&);             // not copyable
+  RooUnfoldTimer& operator= (const RooUnfoldTimer&);
+  void Start (RooUnfoldTiming& timing, Int_t phase, Long64_t bytes);
+  void Stop();
+  RooUnfoldTiming* _timing;
+  Int_t            _phase;
+  Long64_t         _bytes;
+  Double_t         _start;    // trace start time, or -1 if not traced
+  Double_t         _real;     // wall-clock start (RooUnfoldTrace::Now()), or -1 if timing is not enabled
+  Double_t         _cpu;      // CPU clock at start
+};
+
+// Inline method definitions
+
+inline
+Bool_t RooUnfoldTiming::Enabled()
+{
+  return _enabled;
+}
+
+inline
+void RooUnfoldTiming::Enable (Bool_t on)
+{
+  _enabled= on;
+}
+
+inline
+Bool_t RooUnfoldTiming::Traced (Int_t phase)
+{
+  return RooUnfoldTrace::IsOpen() && (phase != kConversion || RooUnfoldTrace::Conversions());
+}
+
+inline Int_t    RooUnfoldTiming::Calls      (Int_t phase) const { return _calls[phase]; }
+inline Double_t RooUnfoldTiming::RealTime   (Int_t phase) const { return _real [phase]; }
+inline Double_t RooUnfoldTiming::CpuTime    (Int_t phase) const { return _cpu  [phase]; }
+inline Long64_t RooUnfoldTiming::Bytes      (Int_t phase) const { return _bytes[phase]; }
+inline Long_t   RooUnfoldTiming::PeakMemory (Int_t phase) const { return _mem  [phase]; }
+
+#endif
@@ -0,0 +1,210 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Timeline of unfolding phases per process and thread, written as
+//      Chrome trace-event JSON. Disabled by default.
+//
+//==============================================================================
+
+//____________________________________________________________
+/* BEGIN_HTML
+<p>Writes a timeline of the instrumented phases of RooUnfoldTiming (response setup, Unfold(), covariance
+calculation and toys), and of each RooUnfold::RunToy(), to a file in the Chrome trace-event JSON format.
+This can be loaded in chrome://tracing or https://ui.perfetto.dev to see, for each process and thread,
+when each phase ran, eg. to find load imbalance or serial sections in parallel toy or scan jobs.</p>
+<pre>
+  RooUnfoldTrace::Open ("unfold_trace.json");
+  ... unfold, run toys, scan ...
+  RooUnfoldTrace::Close();
+</pre>
+<p>Each event is appended to the file with a single write() when its phase ends, so events from several threads,
+and from RooUnfoldForkPool workers (which inherit the open file), are interleaved safely and appear under
+their own thread and process IDs. Close() waits for any events still being written by other threads before
+writing the closing bracket. If the job is stopped before Close(), the file lacks the closing bracket,
+which the trace viewers accept. Histogram conversions are many short events, so are only traced if requested
+with the second argument of Open().</p>
+<p>Tracing does not require RooUnfoldTiming::Enable(). When no trace file is open, each phase costs only a flag test.
+Not available on Windows.</p>
+END_HTML */
+
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldTrace.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <vector>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#else
+#include <pthread.h>
+#endif
+#else
+#include <sys/timeb.h>
+#endif
+
+#include "TString.h"
+
+using std::cerr;
+using std::endl;
+
+Int_t  RooUnfoldTrace::_fd= -1;
+Int_t  RooUnfoldTrace::_writers= 0;
+Bool_t RooUnfoldTrace::_conversions= kFALSE;
+
+#if !defined(_WIN32)
+static Long_t TraceThreadId()
+{
+#if defined(__linux__)
+  return Long_t (syscall (SYS_gettid));
+#else
+  return Long_t (pthread_self());
+#endif
+}
+
+static void TraceWrite (Int_t fd, const char* fmt, ...)
+{
+  // Format into a buffer on the stack (not ROOT's Form(), whose buffer is shared by all threads), then
+  // make one write() per event, so appends from several threads and processes do not interleave.
+  char buf[1024];
+  std::vector<char> big;
+  char* s= buf;
+  va_list ap;
+  va_start (ap, fmt);
+  Int_t len= vsnprintf (buf, sizeof(buf), fmt, ap);
+  va_end (ap);
+  if (len < 0) return;
+  if (size_t(len) >= sizeof(buf)) {
+    big.resize (len+1);
+    s= &big[0];
+    va_start (ap, fmt);
+    vsnprintf (s, len+1, fmt, ap);
+    va_end (ap);
+  }
+  ssize_t n= write (fd, s, len);
+  if (n != ssize_t(len)) cerr << "Warning: RooUnfoldTrace write failed" << endl;
+}
+
+static TString TraceEscape (const char* s)
+{
+  TString e;
+  for (; s && *s; s++) {
+    if      (*s == '"' || *s == '\\') { e += '\\'; e += *s; }
+    else if (*s >= ' ')                 e += *s;
+  }
+  return e;
+}
+#endif
+
+Bool_t RooUnfoldTrace::Open (const char* filename, Bool_t conversions)
+{
+  // Start writing trace events to filename, replacing any existing file.
+  // If conversions, also trace histogram/vector conversions.
+  Close();
+#if defined(_WIN32)
+  cerr << "Warning: RooUnfoldTrace is not available on Windows" << endl;
+  return false;
+#else
+  Int_t fd= open (filename, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, 0644);
+  if (fd < 0) {
+    cerr << "Warning: could not open RooUnfold trace file " << filename << endl;
+    return false;
+  }
+  // Begin with a metadata event, so every later event can be preceded by a comma.
+  TraceWrite (fd, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":\"RooUnfold\"}}",
+              Int_t(getpid()), TraceThreadId());
+  _conversions= conversions;
+  __sync_lock_test_and_set (&_fd, fd);
+  return true;
+#endif
+}
+
+void RooUnfoldTrace::Close()
+{
+#if !defined(_WIN32)
+  // Swap in -1 atomically, so only one caller closes the file, and others see it closed.
+  Int_t fd= __sync_lock_test_and_set (&_fd, -1);
+  if (fd < 0) return;
+  // Wait for events that other threads are still writing to fd, so the footer comes last, and the
+  // descriptor is not closed (and its number reused for another file) while they use it.
+  __sync_synchronize();
+  while (__sync_fetch_and_add (&_writers, 0) > 0) usleep (10);
+  TraceWrite (fd, "\n]\n");
+  close (fd);
+#endif
+}
+
+#if !defined(_WIN32)
+Int_t RooUnfoldTrace::Acquire()
+{
+  // Count this event as a writer before reading _fd, so Close() cannot close the file until Release().
+  __sync_fetch_and_add (&_writers, 1);
+  Int_t fd= __sync_fetch_and_add (&_fd, 0);
+  if (fd < 0) __sync_fetch_and_sub (&_writers, 1);
+  return fd;
+}
+
+void RooUnfoldTrace::Release()
+{
+  __sync_fetch_and_sub (&_writers, 1);
+}
+#endif
+
+Bool_t RooUnfoldTrace::IsOpen()
+{
+#if defined(_WIN32)
+  return kFALSE;
+#else
+  return __sync_fetch_and_add (&_fd, 0) >= 0;   // atomic read: the file may be opened or closed by another thread
+#endif
+}
+
+Double_t RooUnfoldTrace::Now()
+{
+  // Wall-clock time in microseconds, which is shared by all processes on the machine.
+  // Also used by RooUnfoldTimer.
+#if defined(_WIN32)
+  struct _timeb tb;
+  _ftime (&tb);
+  return 1e6*Double_t(tb.time) + 1e3*Double_t(tb.millitm);
+#else
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return 1e6*Double_t(tv.tv_sec) + Double_t(tv.tv_usec);
+#endif
+}
+
+void RooUnfoldTrace::Complete (const char* name, Double_t start, const char* cat)
+{
+  // Record an event that started at start (from Now()) and ends now, in the calling process and thread.
+#if !defined(_WIN32)
+  Int_t fd= Acquire();
+  if (fd < 0) return;
+  Double_t now= Now();
+  TraceWrite (fd, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,\"pid\":%d,\"tid\":%ld}",
+              TraceEscape(name).Data(), TraceEscape(cat).Data(), start, now-start,
+              Int_t(getpid()), TraceThreadId());
+  Release();
+#endif
+}
+
+void RooUnfoldTrace::Instant (const char* name, const char* cat)
+{
+  // Record a point in time, eg. a checkpoint or a cancelled loop.
+#if !defined(_WIN32)
+  Int_t fd= Acquire();
+  if (fd < 0) return;
+  TraceWrite (fd, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.0f,\"pid\":%d,\"tid\":%ld}",
+              TraceEscape(name).Data(), TraceEscape(cat).Data(), Now(),
+              Int_t(getpid()), TraceThreadId());
+  Release();
+#endif
+}
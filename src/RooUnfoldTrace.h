@@ -0,0 +1,52 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Timeline of unfolding phases per process and thread, written as
+//      Chrome trace-event JSON. Disabled by default.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDTRACE_HH
+#define ROOUNFOLDTRACE_HH
+
+#include "Rtypes.h"
+
+class RooUnfoldTrace {
+public:
+  static Bool_t   Open (const char* filename, Bool_t conversions= kFALSE);  // start writing events to filename
+  static void     Close();                     // finish the file
+  static Bool_t   IsOpen();
+  static Bool_t   Conversions();               // also trace histogram conversions (many short events)
+  static Double_t Now();                       // wall clock (microseconds)
+  static void     Complete (const char* name, Double_t start, const char* cat= "RooUnfold");  // event from start to Now()
+  static void     Instant  (const char* name, const char* cat= "RooUnfold");
+
+private:
+  static Int_t  Acquire();    // _fd for one event, or -1. Release() after writing
+  static void   Release();
+  static Int_t  _fd;          // trace file descriptor, or -1. Only read and written atomically
+  static Int_t  _writers;     // number of events being written to _fd, which Close() waits for
+  static Bool_t _conversions;
+};
+
+
+class RooUnfoldTraceSpan {
+  // Scoped trace event: records the time until it goes out of scope, if a trace file is open.
+public:
+  RooUnfoldTraceSpan (const char* name)
+    : _name(name), _start(-1.0) { if (RooUnfoldTrace::IsOpen()) _start= RooUnfoldTrace::Now(); }
+  ~RooUnfoldTraceSpan() { if (_start >= 0.0) RooUnfoldTrace::Complete (_name, _start); }
+private:
+  RooUnfoldTraceSpan (const RooUnfoldTraceSpan&);             // not copyable
+  RooUnfoldTraceSpan& operator= (const RooUnfoldTraceSpan&);
+  const char* _name;
+  Double_t    _start;
+};
+
+// Inline method definitions
+
+inline Bool_t RooUnfoldTrace::Conversions() { return _conversions; }
+
+#endif
@@ -9,10 +9,23 @@
 #pragma link C++ class RooUnfoldSvd-;
 #pragma link C++ class RooUnfoldBinByBin+;
 #pragma link C++ class RooUnfoldResponse-;
+#pragma link C++ class RooUnfoldCovariance+;
 #pragma link C++ class RooUnfoldErrors+;
 #pragma link C++ class RooUnfoldParms+;
+#pragma link C++ class RooUnfoldTauScan+;
 #pragma link C++ class RooUnfoldInvert+;
 #pragma link C++ class RooUnfoldBasisSplines+;
+#pragma link C++ class RooUnfoldCGLS+;
+#pragma link C++ class RooUnfoldBlocks+;
+#pragma link C++ class RooUnfoldTiming+;
+#pragma link C++ class RooUnfoldTrace;
+#pragma link C++ class RooUnfoldCache+;
+#pragma link C++ class RooUnfoldCheckpoint+;
+#pragma link C++ class RooUnfoldProgress+;
+#pragma link C++ class RooUnfoldFuture;
+#pragma link C++ class RooUnfoldThreadPool;
+#pragma link C++ class RooUnfoldPhilox+;
+#pragma link C++ class RooUnfoldForkPool;
 #ifndef NOTUNFOLD
 #pragma link C++ class RooUnfoldTUnfold+;
 #endif
@@ -0,0 +1,359 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Header-only numerical core of the unfolding algorithms, with no
+//      dependence on ROOT, for embedding in online and trigger systems.
+//
+//==============================================================================
+
+// All routines are templates on the scalar type (float, double, long double)
+// and work on plain contiguous buffers. Matrices are stored row-major, so
+// element (i,j) of an n-row, m-column matrix is a[i*m+j] - the same layout as
+// TMatrixD::GetMatrixArray(), so RooUnfold passes its matrices without copying.
+// Only the C++98 standard library is used. Output buffers are supplied by the
+// caller and must not overlap the inputs, unless stated otherwise.
+//
+// The RooUnfold classes (RooUnfold::ABAT, RooUnfoldBayes, RooUnfoldBinByBin)
+// are adapters over these kernels, so both give identical results.
+
+#ifndef ROOUNFOLDCORE_HH
+#define ROOUNFOLDCORE_HH
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace RooUnfoldCore {
+
+//==============================================================================
+// Covariance propagation
+//==============================================================================
+
+template <class T>
+void ABAT (int na, int nb, const T* a, const T* b, T* c)
+{
+  // c (na x na) = a (na x nb) * b (nb x nb) * a^T.
+  std::vector<T> d (std::size_t(na)*nb);   // d = a * b
+  for (int i= 0; i<na; i++) {
+    T* di= &d[std::size_t(i)*nb];
+    const T* ai= a + std::size_t(i)*nb;
+    for (int k= 0; k<nb; k++) {
+      T aik= ai[k];
+      if (aik==T(0)) continue;
+      const T* bk= b + std::size_t(k)*nb;
+      for (int l= 0; l<nb; l++) di[l] += aik*bk[l];
+    }
+  }
+  for (int i= 0; i<na; i++) {
+    const T* di= &d[std::size_t(i)*nb];
+    for (int j= 0; j<na; j++) {
+      const T* aj= a + std::size_t(j)*nb;
+      T s= 0;
+      for (int l= 0; l<nb; l++) s += di[l]*aj[l];
+      c[std::size_t(i)*na+j]= s;
+    }
+  }
+}
+
+template <class T>
+void ABATDiag (int na, int nb, const T* a, const T* b, T* c)
+{
+  // c (na x na) = a (na x nb) * diag(b) * a^T. The result is symmetric, so only half is computed.
+  for (int i= 0; i<na; i++) {
+    const T* ai= a + std::size_t(i)*nb;
+    for (int j= 0; j<=i; j++) {
+      const T* aj= a + std::size_t(j)*nb;
+      T s= 0;
+      for (int l= 0; l<nb; l++) s += ai[l]*b[l]*aj[l];
+      c[std::size_t(i)*na+j]= c[std::size_t(j)*na+i]= s;
+    }
+  }
+}
+
+//==============================================================================
+// Bin-by-bin correction factors
+//==============================================================================
+
+template <class T>
+void BinByBin (int n, const T* truth, const T* train, const T* fakes, const T* meas, T fakescale,
+               T* factors, T* reco)
+{
+  // factors[i] = truth[i] / (train[i]-fakes[i]), and reco[i] = factors[i] * (meas[i] - fakescale*fakes[i]).
+  // fakes may be 0. Bins with no training entries get a factor of 0.
+  for (int i= 0; i<n; i++) {
+    T f= fakes ? fakes[i] : T(0);
+    T t= train[i]-f;
+    T c= t==T(0) ? T(0) : truth[i]/t;
+    factors[i]= c;
+    reco[i]= c * (meas[i]-fakescale*f);
+  }
+}
+
+template <class T>
+void BinByBinCov (int n, const T* factors, const T* covmeas, T* cov)
+{
+  // cov(i,j) = factors[i] * factors[j] * covmeas(i,j), for n x n matrices.
+  for (int i= 0; i<n; i++)
+    for (int j= 0; j<n; j++)
+      cov[std::size_t(i)*n+j]= factors[i]*factors[j]*covmeas[std::size_t(i)*n+j];
+}
+
+//==============================================================================
+// Iterative Bayes
+//==============================================================================
+
+template <class T>
+void BayesEfficiencies (int ne, int nc, const T* Nji, const T* nCi, T* PEjCi, T* PEjCiEff, T* eff)
+{
+  // From the response counts Nji (ne x nc) and truth counts nCi, fill the probabilities
+  // P(Ej|Ci) (ne x nc), the same normalised by efficiency, and the efficiencies eff[i].
+  for (int i= 0; i<nc; i++) {
+    if (nCi[i] <= T(0)) {
+      eff[i]= 0;
+      for (int j= 0; j<ne; j++) PEjCi[std::size_t(j)*nc+i]= PEjCiEff[std::size_t(j)*nc+i]= 0;
+      continue;
+    }
+    T e= 0;
+    for (int j= 0; j<ne; j++) {
+      T r= Nji[std::size_t(j)*nc+i] / nCi[i];
+      PEjCi[std::size_t(j)*nc+i]= r;
+      e += r;
+    }
+    eff[i]= e;
+    T einv= e > T(0) ? T(1)/e : T(0);
+    for (int j= 0; j<ne; j++) PEjCiEff[std::size_t(j)*nc+i]= PEjCi[std::size_t(j)*nc+i]*einv;
+  }
+}
+
+template <class T>
+T BayesStep (int ne, int nc, const T* PEjCi, const T* PEjCiEff, const T* P0C, const T* nEstj,
+             T* UjInv, T* Mij, T* nbarCi)
+{
+  // One iteration: from the prior P0C (nc) and measurement nEstj (ne), fill the unfolding
+  // matrix Mij (nc x ne) and the unfolded distribution nbarCi (nc), and return its sum.
+  // UjInv (ne) receives the inverse of the folded prior.
+  for (int j= 0; j<ne; j++) {
+    const T* pj= PEjCi + std::size_t(j)*nc;
+    T u= 0;
+    for (int i= 0; i<nc; i++) u += pj[i]*P0C[i];
+    UjInv[j]= u > T(0) ? T(1)/u : T(0);
+  }
+  T nbartrue= 0;
+  for (int i= 0; i<nc; i++) {
+    T* mi= Mij + std::size_t(i)*ne;
+    T nbar= 0;
+    for (int j= 0; j<ne; j++) {
+      T m= UjInv[j] * PEjCiEff[std::size_t(j)*nc+i] * P0C[i];
+      mi[j]= m;
+      nbar += m*nEstj[j];
+    }
+    nbarCi[i]= nbar;
+    nbartrue += nbar;
+  }
+  return nbartrue;
+}
+
+template <class T>
+T Bayes (int ne, int nc, const T* Nji, const T* nCi, const T* nEstj, int niter, T* nbarCi,
+         const T* prior= 0)
+{
+  // Complete iterative Bayes unfolding without smoothing or errors, starting from the truth
+  // prior nCi, or prior (nc, need not be normalised) if given. Returns the total number of
+  // unfolded events. Nji is ne x nc.
+  std::vector<T> PEjCi (std::size_t(ne)*nc), PEjCiEff (std::size_t(ne)*nc), Mij (std::size_t(nc)*ne);
+  std::vector<T> eff (nc), P0C (nc), UjInv (ne);
+  BayesEfficiencies (ne, nc, Nji, nCi, &PEjCi[0], &PEjCiEff[0], &eff[0]);
+  if (!prior) prior= nCi;
+  T n0= 0;
+  for (int i= 0; i<nc; i++) n0 += prior[i];
+  for (int i= 0; i<nc; i++) P0C[i]= n0!=T(0) ? prior[i]/n0 : T(0);
+  T nbartrue= 0;
+  for (int k= 0; k<niter; k++) {
+    if (k>0) for (int i= 0; i<nc; i++) P0C[i]= nbartrue!=T(0) ? nbarCi[i]/nbartrue : T(0);
+    nbartrue= BayesStep (ne, nc, &PEjCi[0], &PEjCiEff[0], &P0C[0], nEstj, &UjInv[0], &Mij[0], nbarCi);
+  }
+  return nbartrue;
+}
+
+//==============================================================================
+// Linear solves
+//==============================================================================
+
+template <class T>
+bool Cholesky (int n, T* a)
+{
+  // Replace the lower triangle of symmetric positive-definite a (n x n) with L, where a = L L^T.
+  // The upper triangle is zeroed. Returns false if a is not positive definite.
+  for (int j= 0; j<n; j++) {
+    T* aj= a + std::size_t(j)*n;
+    T d= aj[j];
+    for (int k= 0; k<j; k++) d -= aj[k]*aj[k];
+    if (!(d > T(0))) return false;
+    d= std::sqrt(d);
+    aj[j]= d;
+    for (int i= j+1; i<n; i++) {
+      T* ai= a + std::size_t(i)*n;
+      T s= ai[j];
+      for (int k= 0; k<j; k++) s -= ai[k]*aj[k];
+      ai[j]= s/d;
+    }
+    for (int k= j+1; k<n; k++) aj[k]= 0;
+  }
+  return true;
+}
+
+template <class T>
+void CholeskySolve (int n, const T* l, T* b)
+{
+  // Solve L L^T x = b in place, with L from Cholesky().
+  for (int i= 0; i<n; i++) {
+    const T* li= l + std::size_t(i)*n;
+    T s= b[i];
+    for (int k= 0; k<i; k++) s -= li[k]*b[k];
+    b[i]= s/li[i];
+  }
+  for (int i= n-1; i>=0; i--) {
+    T s= b[i];
+    for (int k= i+1; k<n; k++) s -= l[std::size_t(k)*n+i]*b[k];
+    b[i]= s/l[std::size_t(i)*n+i];
+  }
+}
+
+template <class T>
+bool Tikhonov (int nm, int nt, const T* A, const T* W, const T* y, int nl, const T* L, T tau,
+               T* x, T* G= 0)
+{
+  // Minimise (y-Ax)^T W (y-Ax) + tau |Lx|^2 for x (nt), with A nm x nt, W nm x nm (0 for the
+  // identity), and L nl x nt (0 for the identity, when nl is ignored). If G is given, it is filled
+  // with the nt x nm matrix dx/dy = (A^T W A + tau L^T L)^-1 A^T W, so that cov(x) = G cov(y) G^T.
+  // Returns false if the normal equations are singular.
+  std::vector<T> AW (std::size_t(nt)*nm);   // A^T W
+  for (int k= 0; k<nt; k++)
+    for (int j= 0; j<nm; j++) {
+      if (!W) { AW[std::size_t(k)*nm+j]= A[std::size_t(j)*nt+k]; continue; }
+      T s= 0;
+      for (int i= 0; i<nm; i++) s += A[std::size_t(i)*nt+k]*W[std::size_t(i)*nm+j];
+      AW[std::size_t(k)*nm+j]= s;
+    }
+  std::vector<T> H (std::size_t(nt)*nt);
+  for (int k= 0; k<nt; k++)
+    for (int l= 0; l<nt; l++) {
+      T s= 0;
+      for (int j= 0; j<nm; j++) s += AW[std::size_t(k)*nm+j]*A[std::size_t(j)*nt+l];
+      H[std::size_t(k)*nt+l]= s;
+    }
+  if (!L) {
+    for (int k= 0; k<nt; k++) H[std::size_t(k)*nt+k] += tau;
+  } else {
+    for (int r= 0; r<nl; r++) {
+      const T* lr= L + std::size_t(r)*nt;
+      for (int k= 0; k<nt; k++) {
+        if (lr[k]==T(0)) continue;
+        for (int l= 0; l<nt; l++) H[std::size_t(k)*nt+l] += tau*lr[k]*lr[l];
+      }
+    }
+  }
+  if (!Cholesky (nt, &H[0])) return false;
+  for (int k= 0; k<nt; k++) {
+    T s= 0;
+    for (int j= 0; j<nm; j++) s += AW[std::size_t(k)*nm+j]*y[j];
+    x[k]= s;
+  }
+  CholeskySolve (nt, &H[0], x);
+  if (G) {
+    std::vector<T> col (nt);
+    for (int j= 0; j<nm; j++) {
+      for (int k= 0; k<nt; k++) col[k]= AW[std::size_t(k)*nm+j];
+      CholeskySolve (nt, &H[0], &col[0]);
+      for (int k= 0; k<nt; k++) G[std::size_t(k)*nm+j]= col[k];
+    }
+  }
+  return true;
+}
+
+template <class T>
+int SVD (int m, int n, T* a, T* s, T* v, int maxsweeps= 60)
+{
+  // One-sided Jacobi singular value decomposition of a (m x n, m >= n). On return a holds U (m x n),
+  // s the singular values (unsorted), and v (n x n) the right singular vectors, so that the input
+  // a = U diag(s) V^T. Returns the number of sweeps, or -1 if it did not converge.
+  for (int i= 0; i<n; i++)
+    for (int j= 0; j<n; j++) v[std::size_t(i)*n+j]= i==j ? T(1) : T(0);
+  const T eps= std::numeric_limits<T>::epsilon();
+  int sweep= 0;
+  for (;;) {
+    if (sweep >= maxsweeps) return -1;
+    sweep++;
+    bool rotated= false;
+    for (int p= 0; p<n-1; p++) {
+      for (int q= p+1; q<n; q++) {
+        T alpha= 0, beta= 0, gamma= 0;
+        for (int i= 0; i<m; i++) {
+          T ap= a[std::size_t(i)*n+p], aq= a[std::size_t(i)*n+q];
+          alpha += ap*ap;
+          beta  += aq*aq;
+          gamma += ap*aq;
+        }
+        if (gamma==T(0) || std::fabs(gamma) <= eps*std::sqrt(alpha*beta)) continue;
+        rotated= true;
+        T zeta= (beta-alpha)/(2*gamma);
+        T t= (zeta >= T(0) ? T(1) : T(-1)) / (std::fabs(zeta) + std::sqrt(1+zeta*zeta));
+        T c= 1/std::sqrt(1+t*t), sn= c*t;
+        for (int i= 0; i<m; i++) {
+          T ap= a[std::size_t(i)*n+p], aq= a[std::size_t(i)*n+q];
+          a[std::size_t(i)*n+p]= c*ap - sn*aq;
+          a[std::size_t(i)*n+q]= sn*ap + c*aq;
+        }
+        for (int i= 0; i<n; i++) {
+          T vp= v[std::size_t(i)*n+p], vq= v[std::size_t(i)*n+q];
+          v[std::size_t(i)*n+p]= c*vp - sn*vq;
+          v[std::size_t(i)*n+q]= sn*vp + c*vq;
+        }
+      }
+    }
+    if (!rotated) break;
+  }
+  for (int j= 0; j<n; j++) {
+    T norm= 0;
+    for (int i= 0; i<m; i++) norm += a[std::size_t(i)*n+j]*a[std::size_t(i)*n+j];
+    norm= std::sqrt(norm);
+    s[j]= norm;
+    if (norm > T(0)) for (int i= 0; i<m; i++) a[std::size_t(i)*n+j] /= norm;
+  }
+  return sweep;
+}
+
+template <class T>
+bool SVDSolve (int m, int n, const T* A, const T* y, T tau, T* x, T rcond= 0)
+{
+  // Damped least-squares solution x (n) of A x = y with A m x n (m >= n): x = V diag(s/(s^2+tau)) U^T y.
+  // tau=0 gives the pseudo-inverse, dropping singular values below rcond*max(s) (default n*epsilon).
+  std::vector<T> u (A, A+std::size_t(m)*n), s (n), v (std::size_t(n)*n);
+  if (SVD (m, n, &u[0], &s[0], &v[0]) < 0) return false;
+  T smax= 0;
+  for (int k= 0; k<n; k++) if (s[k] > smax) smax= s[k];
+  if (rcond <= T(0)) rcond= n*std::numeric_limits<T>::epsilon();
+  std::vector<T> w (n);
+  for (int k= 0; k<n; k++) {
+    T f;
+    if (tau > T(0))                   f= s[k]/(s[k]*s[k]+tau);
+    else if (s[k] > rcond*smax)       f= T(1)/s[k];
+    else                              f= 0;
+    T uy= 0;
+    for (int i= 0; i<m; i++) uy += u[std::size_t(i)*n+k]*y[i];
+    w[k]= f*uy;
+  }
+  for (int i= 0; i<n; i++) {
+    T sum= 0;
+    for (int k= 0; k<n; k++) sum += v[std::size_t(i)*n+k]*w[k];
+    x[i]= sum;
+  }
+  return true;
+}
+
+} // namespace RooUnfoldCore
+
+#endif
@@ -8,8 +8,12 @@
 #include <string>
 #include <vector>
 #include <complex>
+#include <fstream>
+#include <sstream>
 #include "TH1.h"
+#include "TH2.h"
 #include "TRandom.h"
+#include "TSystem.h"
 
 // BOOST test stuff:
 #define BOOST_TEST_DYN_LINK
@@ -19,6 +23,29 @@
 
 #include "RooUnfoldResponse.h"
 #include "RooUnfold.h"
+#include "RooUnfoldInvert.h"
+#include "RooUnfoldBayes.h"
+#include "RooUnfoldBinByBin.h"
+#include "RooUnfoldSvd.h"
+#include "RooUnfoldBasisSplines.h"
+#include "RooUnfoldCGLS.h"
+#include "RooUnfoldTauScan.h"
+#include "RooUnfoldBlocks.h"
+#include "TDecompSVD.h"
+#include "RooUnfoldCache.h"
+#include "RooUnfoldCheckpoint.h"
+#include "RooUnfoldProgress.h"
+#include "RooUnfoldPhilox.h"
+#include "RooUnfoldTrace.h"
+#include "RooUnfoldTiming.h"
+#include "RooUnfoldCovariance.h"
+#include "RooUnfoldAsync.h"
+#include "RooUnfoldForkPool.h"
+#include "RooUnfoldParms.h"
+#include "TProfile.h"
+#ifdef HAVE_DAGOSTINI
+#include "RooUnfoldDagostini.h"
+#endif
 
 // Namespaces:
 using std::string;
@@ -37,6 +64,98 @@ Double_t smear (Double_t xt)
   return xt+xsmear;
 }
 
+TMatrixD FiniteDifferenceCov (const RooUnfold& unfold)
+{
+  // Propagate the measured covariance, V, with the Jacobian J from central differences of the
+  // result in each measured bin, keeping V fixed: J V J^T.
+  TVectorD meas= unfold.Vmeasured();
+  TMatrixD cov= unfold.GetMeasuredCov();
+  Int_t nm= meas.GetNrows(), nt= unfold.response()->GetNbinsTruth();
+  TMatrixD jac( nt, nm );
+  for (Int_t j= 0; j<nm; j++) {
+    Double_t h= cov(j,j) > 0.0 ? sqrt( cov(j,j) ) : 1.0;
+    TVectorD x[2];
+    for (Int_t k= 0; k<2; k++) {
+      TVectorD shifted= meas;
+      shifted[j] += k ? -h : h;
+      RooUnfold* u= unfold.Clone( "fd" );
+      u->SetCache( 0 );
+      u->SetVerbose( 0 );
+      u->SetMeasured( shifted, cov );
+      x[k].ResizeTo( nt );
+      x[k]= u->Vreco();
+      delete u;
+    }
+    for (Int_t i= 0; i<nt; i++) jac(i,j)= (x[0][i]-x[1][i]) / (2.0*h);
+  }
+  TMatrixD jv( jac, TMatrixD::kMult, cov );
+  return TMatrixD( jv, TMatrixD::kMultTranspose, jac );
+}
+
+TMatrixD FiniteDifferenceResponseCov (const RooUnfold& unfold)
+{
+  // Propagate independent errors, E, on the response matrix elements with central differences of the
+  // result in each element, A(j,k), keeping the measurement fixed: sum_jk J_jk J_jk^T E(j,k)^2.
+  // The response must have no fakes, so that changing A does not change the fakes subtracted.
+  const RooUnfoldResponse* res= unfold.response();
+  TMatrixD eres= res->Eresponse();
+  TVectorD meas= unfold.Vmeasured();
+  TMatrixD cov= unfold.GetMeasuredCov();
+  Int_t nm= res->GetNbinsMeasured(), nt= res->GetNbinsTruth();
+  TMatrixD fd( nt, nt );
+  for (Int_t j= 0; j<nm; j++) {
+    for (Int_t k= 0; k<nt; k++) {
+      if (eres(j,k) == 0.0) continue;
+      Double_t h= 1e-3*eres(j,k), t= res->Htruth()->GetBinContent( k+1 );
+      TVectorD x[2];
+      for (Int_t s= 0; s<2; s++) {
+        TH2* hres= (TH2*) res->Hresponse()->Clone( "fdres" );
+        hres->SetBinContent( j+1, k+1, hres->GetBinContent( j+1, k+1 ) + (s ? -h : h)*t );
+        RooUnfoldResponse shifted;
+        shifted.Setup( 0, res->Htruth(), hres );
+        delete hres;
+        RooUnfold* u= unfold.Clone( "fd" );
+        u->SetCache( 0 );
+        u->SetVerbose( 0 );
+        u->SetResponse( &shifted );
+        u->SetMeasured( meas, cov );
+        x[s].ResizeTo( nt );
+        x[s]= u->Vreco();
+        delete u;
+      }
+      Double_t e2= eres(j,k)*eres(j,k);
+      for (Int_t i= 0; i<nt; i++)
+        for (Int_t l= 0; l<nt; l++)
+          fd(i,l) += (x[0][i]-x[1][i]) * (x[0][l]-x[1][l]) / (4.0*h*h) * e2;
+    }
+  }
+  return fd;
+}
+
+void CheckJacobianCov (RooUnfold& unfold, Double_t tolerance, Bool_t response= false)
+{
+  // response=true checks the response matrix error term alone (IncludeSystematics(2))
+  if (response) unfold.IncludeSystematics( 2 );
+  TMatrixD cov= unfold.Ereco( RooUnfold::kCovariance );
+  TMatrixD fd= response ? FiniteDifferenceResponseCov( unfold ) : FiniteDifferenceCov( unfold );
+  Double_t vmax= 0.0;
+  for (Int_t i= 0; i<fd.GetNrows(); i++) if (fd(i,i)>vmax) vmax= fd(i,i);
+  for (Int_t i= 0; i<fd.GetNrows(); i++) {
+    if (fd(i,i) < 1e-6*vmax) continue;
+    BOOST_CHECK_CLOSE( cov(i,i), fd(i,i), tolerance );
+    if (i>0 && fd(i-1,i-1) >= 1e-6*vmax)
+      BOOST_CHECK_SMALL( cov(i,i-1)-fd(i,i-1), 0.01*tolerance*sqrt( fd(i,i)*fd(i-1,i-1) ) );
+  }
+}
+
+void CheckSameCov (const TMatrixD& cov, const TMatrixD& dense, Double_t tolerance)
+{
+  // Elements agree relative to the dense errors, so zero off-diagonal elements can be compared
+  BOOST_REQUIRE_EQUAL( cov.GetNrows(), dense.GetNrows() );
+  for (Int_t i= 0; i<dense.GetNrows(); i++)
+    for (Int_t j= 0; j<dense.GetNcols(); j++)
+      BOOST_CHECK_SMALL( cov(i,j)-dense(i,j), tolerance*sqrt( fabs( dense(i,i)*dense(j,j) ) ) );
+}
 
 // Test fixture for all tests:
 class RooUnfoldTestFixture {
@@ -148,6 +267,873 @@ BOOST_AUTO_TEST_CASE(RunToy){
   BOOST_MESSAGE("RunToy test");
 }
 
+BOOST_AUTO_TEST_CASE(FillExistingBuffers){
+  BOOST_MESSAGE("Fill existing histograms and vectors test");
+  TH1* hreco= unfold->Hreco( RooUnfold::kCovariance );
+  TH1* hfill= (TH1*) hreco->Clone( "hfill" );
+  hfill->Reset();
+  BOOST_CHECK_EQUAL( unfold->Hreco( hfill, RooUnfold::kCovariance ), hfill );
+  for( Int_t i= 1; i <= hreco->GetNbinsX(); i++ ) {
+    BOOST_CHECK_EQUAL( hfill->GetBinContent( i ), hreco->GetBinContent( i ) );
+    BOOST_CHECK_EQUAL( hfill->GetBinError( i ),   hreco->GetBinError( i ) );
+  }
+
+  TH1* hmeas= unfold->HrecoMeasured();
+  TH1* hmfill= (TH1*) hmeas->Clone( "hmfill" );
+  hmfill->Reset();
+  BOOST_CHECK_EQUAL( unfold->HrecoMeasured( hmfill ), hmfill );
+  TVectorD yreco( 3 );   // resized to the measured bins
+  BOOST_CHECK_EQUAL( &unfold->VrecoMeasured( yreco ), &yreco );
+  BOOST_CHECK_EQUAL( yreco.GetNrows(), hmeas->GetNbinsX() );
+  for( Int_t i= 1; i <= hmeas->GetNbinsX(); i++ ) {
+    BOOST_CHECK_EQUAL( hmfill->GetBinContent( i ), hmeas->GetBinContent( i ) );
+    BOOST_CHECK_CLOSE( yreco[i-1], hmeas->GetBinContent( i ), 1e-10 );
+  }
+
+  TVectorD ereco;
+  BOOST_CHECK_EQUAL( &unfold->ErecoV( ereco, RooUnfold::kCovariance ), &ereco );
+  const TVectorD& ecopy= unfold->ErecoV( RooUnfold::kCovariance );
+  BOOST_CHECK_EQUAL( ereco.GetNrows(), ecopy.GetNrows() );
+  for( Int_t i= 0; i < ereco.GetNrows(); i++ ) BOOST_CHECK_EQUAL( ereco[i], ecopy[i] );
+  delete hreco;  delete hfill;
+  delete hmeas;  delete hmfill;
+}
+
+BOOST_AUTO_TEST_CASE(JacobianCovariance){
+  BOOST_MESSAGE("Analytic Jacobian covariance agrees with finite differences");
+  RooUnfoldInvert inv( response, unfold->Hmeasured() );
+  inv.SetCache( 0 );
+  CheckJacobianCov( inv, 1e-4 );
+
+  RooUnfoldSvd svd( response, unfold->Hmeasured(), 10 );
+  svd.SetCache( 0 );
+  svd.SetVerbose( 0 );
+  CheckJacobianCov( svd, 1.0 );
+
+  // With negligible regularisation, the control-point covariance is the propagated measurement covariance
+  RooUnfoldBasisSplines bs( response, unfold->Hmeasured(), 1, 1e-8 );
+  bs.SetCache( 0 );
+  bs.SetVerbose( 0 );
+  CheckJacobianCov( bs, 1.0 );
+
+  // Response matrix errors, with the response rebuilt without fakes so that only A changes
+  RooUnfoldResponse nofakes;
+  nofakes.Setup( 0, response->Htruth(), response->Hresponse() );
+  RooUnfoldInvert invsys( &nofakes, unfold->Hmeasured() );
+  invsys.SetCache( 0 );
+  CheckJacobianCov( invsys, 1.0, kTRUE );
+
+  // More truth than measured bins: the minimum-norm solution
+  RooUnfoldResponse wide( 10, -10.0, 10.0, 20, -10.0, 10.0 );
+  for (Int_t i= 0; i<100000; i++) {
+    Double_t xt= gRandom->BreitWigner( 0.3, 2.5 ), x= smear( xt );
+    if (x!=cutdummy) wide.Fill( x, xt );
+    else             wide.Miss( xt );
+  }
+  TH1D* hwide= new TH1D( "measwide", "Test Measured", 10, -10.0, 10.0 );
+  for (Int_t i= 0; i<10000; i++) {
+    Double_t x= smear( gRandom->Gaus( 0.0, 2.0 ) );
+    if (x!=cutdummy) hwide->Fill( x );
+  }
+  RooUnfoldInvert invwide( &wide, hwide );
+  invwide.SetCache( 0 );
+  CheckJacobianCov( invwide, 1e-4 );
+  RooUnfoldInvert invwidesys( &wide, hwide );
+  invwidesys.SetCache( 0 );
+  CheckJacobianCov( invwidesys, 1.0, kTRUE );
+  delete hwide;
+}
+
+BOOST_AUTO_TEST_CASE(PhaseTiming){
+  BOOST_MESSAGE("Per-phase timing test");
+  RooUnfoldInvert untimed( response, unfold->Hmeasured() );
+  untimed.SetCache( 0 );
+  untimed.Vreco();
+  BOOST_CHECK( untimed.Timing().IsEmpty() );
+
+  RooUnfoldTiming::Enable();
+  RooUnfoldInvert timed( response, unfold->Hmeasured() );
+  timed.SetCache( 0 );
+  timed.Ereco( RooUnfold::kCovariance );
+  RooUnfoldTiming::Enable( kFALSE );
+  const RooUnfoldTiming& t= timed.Timing();
+  BOOST_CHECK_EQUAL( t.Calls( RooUnfoldTiming::kUnfold ), 1 );
+  BOOST_CHECK_EQUAL( t.Calls( RooUnfoldTiming::kCovariance ), 1 );
+  BOOST_CHECK( t.RealTime( RooUnfoldTiming::kUnfold ) >= 0.0 );
+  BOOST_CHECK( t.CpuTime( RooUnfoldTiming::kUnfold ) >= 0.0 );
+  BOOST_CHECK( t.PeakMemory( RooUnfoldTiming::kUnfold ) > 0 );
+  BOOST_CHECK( t.PeakMemory( RooUnfoldTiming::kCovariance ) >= t.PeakMemory( RooUnfoldTiming::kUnfold ) );
+  BOOST_CHECK( t.TotalRealTime() >= t.RealTime( RooUnfoldTiming::kUnfold ) );
+}
+
+BOOST_AUTO_TEST_CASE(AsyncUnfolding){
+  BOOST_MESSAGE("Asynchronous unfoldings agree with serial ones");
+  RooUnfoldThreadPool::SetNThreads( 4 );
+  vector<RooUnfold*> serial, async;
+  for( Int_t k= 0; k < 4; k++ ) {
+    TVectorD meas= unfold->Vmeasured();
+    meas *= 1.0 + 0.25*k;
+    for( Int_t alg= 0; alg < 3; alg++ ) {
+      RooUnfold* u[2];
+      for( Int_t copy= 0; copy < 2; copy++ ) {
+        if      (alg==0) u[copy]= new RooUnfoldInvert( response, unfold->Hmeasured() );
+        else if (alg==1) u[copy]= new RooUnfoldBayes( response, unfold->Hmeasured(), 4 );
+#ifdef HAVE_DAGOSTINI
+        else             u[copy]= new RooUnfoldDagostini( response, unfold->Hmeasured(), 4 );  // shares Fortran state
+#else
+        else             u[copy]= new RooUnfoldBayes( response, unfold->Hmeasured(), 2+k );
+#endif
+        u[copy]->SetCache( 0 );
+        u[copy]->SetVerbose( 0 );
+        u[copy]->SetMeasured( meas, unfold->Emeasured() );
+      }
+      serial.push_back( u[0] );
+      async.push_back( u[1] );
+    }
+  }
+  for( size_t k= 0; k < serial.size(); k++ ) serial[k]->Ereco( RooUnfold::kCovariance );
+  vector<RooUnfoldFuture*> jobs;
+  for( size_t k= 0; k < async.size(); k++ ) jobs.push_back( async[k]->UnfoldAsync( RooUnfold::kCovariance ) );
+  for( size_t k= 0; k < jobs.size(); k++ ) {
+    BOOST_CHECK( jobs[k]->Wait() );
+    delete jobs[k];
+    const TVectorD& reco= serial[k]->Vreco();
+    const TMatrixD& cov=  serial[k]->Ereco( RooUnfold::kCovariance );
+    const TMatrixD& acov= async[k]->Ereco( RooUnfold::kCovariance );
+    for( Int_t i= 0; i < reco.GetNrows(); i++ ) {
+      BOOST_CHECK_EQUAL( async[k]->Vreco()[i], reco[i] );
+      BOOST_CHECK_EQUAL( acov(i,i), cov(i,i) );
+    }
+    delete serial[k];
+    delete async[k];
+  }
+}
+
+BOOST_AUTO_TEST_CASE(ForkPool){
+  BOOST_MESSAGE("Worker processes give the same results as running serially");
+  RooUnfoldBayes bayes( response, unfold->Hmeasured(), 3 );
+  bayes.SetVerbose( 0 );
+  bayes.SetCache( 0 );
+  bayes.SetNToys( 20 );
+  bayes.SetToySeed( 42 );
+
+  RooUnfoldForkPool::SetNWorkers( 0 );
+  TVectorD errserial= bayes.ErecoV( RooUnfold::kCovToy );
+  RooUnfoldParms serial( &bayes, RooUnfold::kErrors, response->Htruth() );
+  serial.SetMinParm( 1 );
+  serial.SetMaxParm( 4 );
+  serial.SetStepSizeParm( 1 );
+  TProfile* chi2serial= serial.GetChi2();
+  TProfile* rmsserial=  serial.GetRMSError();
+
+  RooUnfoldForkPool::SetNWorkers( 3 );
+  RooUnfold* copy= bayes.Clone();
+  TVectorD errpool= copy->ErecoV( RooUnfold::kCovToy );
+  RooUnfoldParms pool( &bayes, RooUnfold::kErrors, response->Htruth() );
+  pool.SetMinParm( 1 );
+  pool.SetMaxParm( 4 );
+  pool.SetStepSizeParm( 1 );
+  TProfile* chi2pool= pool.GetChi2();
+  TProfile* rmspool=  pool.GetRMSError();
+  RooUnfoldForkPool::SetNWorkers( 0 );
+
+  for( Int_t i= 0; i < errserial.GetNrows(); i++ ) {
+    BOOST_CHECK_CLOSE( errpool[i], errserial[i], 1e-8 );
+  }
+  BOOST_CHECK_EQUAL( chi2pool->GetNbinsX(), chi2serial->GetNbinsX() );
+  for( Int_t i= 1; i <= chi2serial->GetNbinsX(); i++ ) {
+    BOOST_CHECK_CLOSE( chi2pool->GetBinContent(i), chi2serial->GetBinContent(i), 1e-8 );
+    BOOST_CHECK_CLOSE( rmspool->GetBinContent(i),  rmsserial->GetBinContent(i),  1e-8 );
+  }
+  delete copy;
+}
+
+BOOST_AUTO_TEST_CASE(CGLSWithoutRegularisation){
+  BOOST_MESSAGE("Unregularised CGLS agrees with matrix inversion");
+  // Square, diagonally dominant response: the least squares solution is the exact inverse
+  RooUnfoldResponse res( 10, 0.0, 10.0, 10, 0.0, 10.0 );
+  for( Int_t i= 0; i < 10; i++ ) {
+    res.Fill( i+0.5, i+0.5, 800.0 );
+    if( i > 0 ) res.Fill( i-0.5, i+0.5, 100.0 );
+    if( i < 9 ) res.Fill( i+1.5, i+0.5, 100.0 );
+  }
+  TH1D meas( "cglsmeas", "CGLS measured", 10, 0.0, 10.0 );
+  for( Int_t i= 1; i <= 10; i++ ) meas.SetBinContent( i, 1000.0 + 50.0*i - 4.0*i*i );
+  RooUnfoldInvert invert( &res, &meas );
+  invert.SetCache( 0 );
+  RooUnfoldCGLS cgls( &res, &meas, 0.0, RooUnfoldCGLS::kRegModeNone );
+  cgls.SetCache( 0 );
+  cgls.SetTolerance( 1e-12 );
+  const TVectorD& xinv=  invert.Vreco();
+  const TVectorD& xcgls= cgls.Vreco();
+  BOOST_CHECK( cgls.GetIterations() < cgls.GetMaxIterations() );   // converged
+  for( Int_t i= 0; i < xinv.GetNrows(); i++ ) {
+    BOOST_CHECK_CLOSE( xcgls[i], xinv[i], 1e-6 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE(CGLSTikhonov){
+  BOOST_MESSAGE("Regularised CGLS and its covariance agree with the dense normal equations");
+  RooUnfoldResponse res( 10, 0.0, 10.0, 10, 0.0, 10.0 );
+  for( Int_t i= 0; i < 10; i++ ) {
+    res.Fill( i+0.5, i+0.5, 800.0 );
+    if( i > 0 ) res.Fill( i-0.5, i+0.5, 100.0 );
+    if( i < 9 ) res.Fill( i+1.5, i+0.5, 100.0 );
+  }
+  TH1D meas( "cglsregmeas", "CGLS measured", 10, 0.0, 10.0 );
+  for( Int_t i= 1; i <= 10; i++ ) {
+    Double_t y= 1000.0 + 50.0*i - 4.0*i*i + 60.0*(i%2);
+    meas.SetBinContent( i, y );
+    meas.SetBinError( i, sqrt( y ) );
+  }
+  const Double_t tau= 1e-3;
+  RooUnfoldCGLS cgls( &res, &meas, tau, RooUnfoldCGLS::kRegModeDerivative );
+  cgls.SetCache( 0 );
+  cgls.SetTolerance( 1e-12 );
+  TVectorD x= cgls.Vreco();
+  TMatrixD cov= cgls.Ereco( RooUnfold::kCovariance );
+
+  // x = H^-1 R^T W y and V_x = H^-1 R^T W R H^-1, with H = R^T W R + tau L^T L
+  const TMatrixD& r= res.Mresponse();
+  TVectorD y= cgls.Vmeasured(), e= cgls.Emeasured();
+  Int_t nm= r.GetNrows(), nt= r.GetNcols();
+  TMatrixD wr( r );
+  TVectorD wy( y );
+  for( Int_t i= 0; i < nm; i++ ) {
+    wy[i] /= e[i]*e[i];
+    for( Int_t j= 0; j < nt; j++ ) wr(i,j) /= e[i]*e[i];
+  }
+  TMatrixD rtwr( r, TMatrixD::kTransposeMult, wr ), h( rtwr );
+  for( Int_t j= 0; j+1 < nt; j++ ) {
+    h(j,j)     += tau;
+    h(j+1,j+1) += tau;
+    h(j,j+1)   -= tau;
+    h(j+1,j)   -= tau;
+  }
+  TMatrixD hinv( TMatrixD::kInverted, h );
+  TVectorD rtwy( nt );
+  for( Int_t j= 0; j < nt; j++ )
+    for( Int_t i= 0; i < nm; i++ ) rtwy[j] += r(i,j)*wy[i];
+  TVectorD xdense= hinv * rtwy;
+  TMatrixD t( hinv, TMatrixD::kMult, rtwr ), covdense( t, TMatrixD::kMult, hinv );
+
+  for( Int_t i= 0; i < nt; i++ ) {
+    BOOST_CHECK_CLOSE( x[i], xdense[i], 1e-6 );
+    for( Int_t j= 0; j < nt; j++ )
+      BOOST_CHECK_SMALL( cov(i,j) - covdense(i,j), 1e-8*sqrt( covdense(i,i)*covdense(j,j) ) );
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TauScanProjection){
+  BOOST_MESSAGE("Golub-Kahan tau scan agrees with a dense SVD");
+  // Gaussian smearing of 20 truth bins into 30 measured bins
+  RooUnfoldResponse res( 30, 0.0, 20.0, 20, 0.0, 20.0 );
+  for( Int_t j= 0; j < 20; j++ ) {
+    for( Int_t i= 0; i < 30; i++ ) {
+      Double_t xm= (i+0.5)*20.0/30.0, d= xm - (j+0.5);
+      res.Fill( xm, j+0.5, 1000.0*exp( -0.5*d*d/(1.5*1.5) ) + 1.0 );
+    }
+  }
+  TH1D meas( "scanmeas", "Tau scan measured", 30, 0.0, 20.0 );
+  for( Int_t i= 1; i <= 30; i++ ) {
+    Double_t x= meas.GetBinCenter( i ), y= 1000.0*exp( -0.5*(x-9.0)*(x-9.0)/16.0 ) + 20.0;
+    meas.SetBinContent( i, y );
+    meas.SetBinError( i, sqrt( y ) );
+  }
+  RooUnfoldCGLS cgls( &res, &meas, 1.0, RooUnfoldCGLS::kRegModeSize );
+  cgls.SetVerbose( 0 );
+  RooUnfoldTauScan scan( &cgls, RooUnfoldCGLS::kRegModeSize, 20 );
+  BOOST_CHECK_EQUAL( scan.Scan( 7, 1e-4, 1e2 ), 7 );
+  BOOST_CHECK_EQUAL( scan.GetNKrylov(), 20 );
+
+  // With as many steps as truth bins the projection is exact. With L = 1, the Tikhonov solution for
+  // the weighted response A = U S V^T is x = sum_i s_i/(s_i^2+tau) (u_i.b) v_i.
+  const TVectorD& err= cgls.Emeasured();
+  TMatrixD a= res.Mresponse();
+  TVectorD b= cgls.Vmeasured();
+  for( Int_t i= 0; i < a.GetNrows(); i++ ) {
+    for( Int_t j= 0; j < a.GetNcols(); j++ ) a(i,j) /= err[i];
+    b[i] /= err[i];
+  }
+  TDecompSVD svd( a );
+  BOOST_REQUIRE( svd.Decompose() );
+  const TMatrixD& u= svd.GetU();
+  const TMatrixD& v= svd.GetV();
+  const TVectorD& sig= svd.GetSig();
+  for( Int_t t= 0; t < scan.GetTau().GetNrows(); t++ ) {
+    Double_t tau= scan.GetTau()[t], dof= 0.0;
+    TVectorD x( a.GetNcols() );
+    for( Int_t k= 0; k < sig.GetNrows(); k++ ) {
+      Double_t ub= 0.0;
+      for( Int_t i= 0; i < a.GetNrows(); i++ ) ub += u(i,k) * b[i];
+      Double_t f= sig[k]*sig[k] / (sig[k]*sig[k] + tau);
+      dof += f;
+      for( Int_t j= 0; j < a.GetNcols(); j++ ) x[j] += f * ub / sig[k] * v(j,k);
+    }
+    TVectorD r= b;
+    r -= a * x;
+    BOOST_CHECK_CLOSE( scan.GetChi2()[t],    r.Norm2Sqr(),       1e-4 );
+    BOOST_CHECK_CLOSE( scan.GetRegNorm()[t], sqrt( x.Norm2Sqr() ), 1e-4 );
+    BOOST_CHECK_CLOSE( scan.GetDOF()[t],     dof,                1e-4 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BayesMultiLevel){
+  BOOST_MESSAGE("Multilevel Bayes converges to the single-level result, in fewer iterations");
+  RooUnfoldResponse res( 16, 0.0, 16.0, 16, 0.0, 16.0 );
+  for( Int_t i= 0; i < 16; i++ ) {
+    res.Fill( i+0.5, i+0.5, 700.0 );
+    if( i > 0 )  res.Fill( i-0.5, i+0.5, 150.0 );
+    if( i < 15 ) res.Fill( i+1.5, i+0.5, 150.0 );
+  }
+  TH1D meas( "mlmeas", "Multilevel measured", 16, 0.0, 16.0 );
+  for( Int_t i= 1; i <= 16; i++ ) meas.SetBinContent( i, 500.0 + 300.0*exp( -0.5*(i-6.0)*(i-6.0)/4.0 ) );
+  RooUnfoldBayes single( &res, &meas, 500 );
+  single.SetVerbose( 0 );
+  single.SetCache( 0 );
+  RooUnfoldBayes multi( &res, &meas, 500 );
+  multi.SetVerbose( 0 );
+  multi.SetCache( 0 );
+  multi.SetMultiLevel( 2, 4 );
+  BOOST_CHECK_EQUAL( multi.GetMultiLevel(), 2 );
+  const TVectorD& xs= single.Vreco();
+  const TVectorD& xm= multi.Vreco();
+  BOOST_REQUIRE_EQUAL( xm.GetNrows(), xs.GetNrows() );
+  for( Int_t i= 0; i < xs.GetNrows(); i++ ) {
+    BOOST_CHECK_CLOSE( xm[i], xs[i], 1e-3 );
+  }
+
+  // After only a few fine iterations, the multilevel prior is closer to the converged result than the MC truth
+  RooUnfoldBayes fewsingle( &res, &meas, 2 );
+  fewsingle.SetVerbose( 0 );
+  fewsingle.SetCache( 0 );
+  RooUnfoldBayes fewmulti( &res, &meas, 2 );
+  fewmulti.SetVerbose( 0 );
+  fewmulti.SetCache( 0 );
+  fewmulti.SetMultiLevel( 2, 4 );
+  const TVectorD& fs= fewsingle.Vreco();
+  const TVectorD& fm= fewmulti.Vreco();
+  Double_t dsingle= 0.0, dmulti= 0.0;
+  for( Int_t i= 0; i < xs.GetNrows(); i++ ) {
+    dsingle += (fs[i]-xs[i])*(fs[i]-xs[i]);
+    dmulti  += (fm[i]-xs[i])*(fm[i]-xs[i]);
+  }
+  BOOST_CHECK( dmulti < dsingle );
+}
+
+BOOST_AUTO_TEST_CASE(BlockUnfolding){
+  BOOST_MESSAGE("Unfolding in independent blocks agrees with unfolding the whole response");
+  // Two blocks, bins 0-4 and 5-9, with no migrations between them
+  RooUnfoldResponse res( 10, 0.0, 10.0, 10, 0.0, 10.0 );
+  for( Int_t i= 0; i < 10; i++ ) {
+    res.Fill( i+0.5, i+0.5, 800.0 );
+    if( i != 0 && i != 5 ) res.Fill( i-0.5, i+0.5, 100.0 );
+    if( i != 4 && i != 9 ) res.Fill( i+1.5, i+0.5, 100.0 );
+  }
+  TH1D meas( "blockmeas", "Block measured", 10, 0.0, 10.0 );
+  for( Int_t i= 1; i <= 10; i++ ) {
+    meas.SetBinContent( i, 1000.0 + 30.0*i );
+    meas.SetBinError( i, sqrt( 1000.0 + 30.0*i ) );
+  }
+  // Block-diagonal measurement covariance, with correlations within each block
+  TMatrixD cov( 10, 10 );
+  for( Int_t i= 0; i < 10; i++ )
+    for( Int_t j= 0; j < 10; j++ )
+      if( i/5 == j/5 ) cov(i,j)= (i==j ? 1.0 : 0.3) * meas.GetBinError( i+1 ) * meas.GetBinError( j+1 );
+
+  for( Int_t withcov= 0; withcov < 2; withcov++ ) {
+    RooUnfoldInvert whole( &res, &meas );
+    whole.SetVerbose( 0 );
+    whole.SetCache( 0 );
+    if( withcov ) whole.SetMeasuredCov( cov );
+    RooUnfoldBlocks blocked( &whole );
+    blocked.SetVerbose( 0 );
+    blocked.SetCache( 0 );
+    if( withcov ) blocked.SetMeasuredCov( cov );
+
+    const TVectorD& x=  whole.Vreco();
+    const TVectorD& xb= blocked.Vreco();
+    BOOST_CHECK_EQUAL( blocked.NBlocks(), 2 );
+    const TMatrixD& v=  whole.Ereco( RooUnfold::kCovariance );
+    const TMatrixD& vb= blocked.Ereco( RooUnfold::kCovariance );
+    TVectorD e=  whole.ErecoV( RooUnfold::kErrors );
+    TVectorD eb= blocked.ErecoV( RooUnfold::kErrors );
+    for( Int_t i= 0; i < x.GetNrows(); i++ ) {
+      BOOST_CHECK_CLOSE( xb[i], x[i], 1e-8 );
+      BOOST_CHECK_CLOSE( eb[i], e[i], 1e-6 );
+      for( Int_t j= 0; j < x.GetNrows(); j++ ) {
+        if( i/5 == j/5 ) BOOST_CHECK_CLOSE( vb(i,j), v(i,j), 1e-6 );
+        else             BOOST_CHECK_SMALL( v(i,j), 1e-8*sqrt( v(i,i)*v(j,j) ) );
+      }
+    }
+  }
+
+  // On the thread pool, with blocks that are not thread-safe (toy errors): these run in the worker's thread
+  RooUnfoldInvert proto( &res, &meas );
+  proto.SetVerbose( 0 );
+  proto.SetCache( 0 );
+  proto.SetNToys( 20 );
+  RooUnfoldBlocks pooled( &proto );
+  pooled.SetVerbose( 0 );
+  pooled.SetCache( 0 );
+  RooUnfoldFuture* job= pooled.UnfoldAsync( RooUnfold::kCovToy );
+  BOOST_CHECK( job->Wait() );
+  delete job;
+  BOOST_CHECK_EQUAL( pooled.NBlocks(), 2 );
+}
+
+BOOST_AUTO_TEST_CASE(SvdBinOrder){
+  BOOST_MESSAGE("RooUnfoldSvd gives the same result with reordered bins");
+  // 4x4 bins, with migrations to the neighbouring bin in x and in y
+  TH2D mtpl( "svdordermtpl", "Measured", 4, 0.0, 4.0, 4, 0.0, 4.0 );
+  TH2D ttpl( "svdorderttpl", "Truth",    4, 0.0, 4.0, 4, 0.0, 4.0 );
+  RooUnfoldResponse natural( &mtpl, &ttpl );
+  RooUnfoldResponse morton(  &mtpl, &ttpl );
+  for( Int_t ix= 0; ix < 4; ix++ ) {
+    for( Int_t iy= 0; iy < 4; iy++ ) {
+      Double_t x= ix+0.5, y= iy+0.5, w= 100.0 + 10.0*ix + 20.0*iy;
+      for( Int_t k= 0; k < 2; k++ ) {
+        RooUnfoldResponse& res= k ? morton : natural;
+        res.Fill( x, y, x, y, 6.0*w );
+        if( ix < 3 ) res.Fill( x+1.0, y, x, y, w );
+        if( iy < 3 ) res.Fill( x, y+1.0, x, y, w );
+      }
+    }
+  }
+  morton.SetBinOrder( RooUnfoldResponse::kBinOrderMorton );
+  BOOST_REQUIRE( morton.GetPermTruth() != 0 );
+
+  TH1* meas= (TH1*) natural.Hmeasured()->Clone( "svdordermeas" );
+  meas->Scale( 1.3 );
+  RooUnfoldSvd svdnatural( &natural, meas, 8 );
+  svdnatural.SetVerbose( 0 );
+  svdnatural.SetCache( 0 );
+  RooUnfoldSvd svdmorton(  &morton,  meas, 8 );
+  svdmorton.SetVerbose( 0 );
+  svdmorton.SetCache( 0 );
+  TH1* hnatural= svdnatural.Hreco( RooUnfold::kNoError );
+  TH1* hmorton=  svdmorton .Hreco( RooUnfold::kNoError );
+  for( Int_t ix= 1; ix <= 4; ix++ ) {
+    for( Int_t iy= 1; iy <= 4; iy++ ) {
+      BOOST_CHECK_CLOSE( hmorton->GetBinContent( ix, iy ), hnatural->GetBinContent( ix, iy ), 1e-4 );
+    }
+  }
+  delete hnatural;
+  delete hmorton;
+  delete meas;
+}
+
+BOOST_AUTO_TEST_CASE(ResultCache){
+  BOOST_MESSAGE("Result cache test");
+  TString dir= Form( "%s/roounfoldcache%d", gSystem->TempDirectory(), gSystem->GetPid() );
+  RooUnfoldCache cache( dir );
+
+  RooUnfold first( response, unfold->Hmeasured() );
+  first.SetCache( &cache );
+  TVectorD reco= first.Vreco();
+  TMatrixD cov=  first.Ereco( RooUnfold::kCovariance );
+  BOOST_CHECK_EQUAL( cache.Writes(), 2 );
+
+  // Identical inputs in a new object are served from the cache
+  RooUnfold second( response, unfold->Hmeasured() );
+  second.SetCache( &cache );
+  TVectorD recocached= second.Vreco();
+  TMatrixD covcached=  second.Ereco( RooUnfold::kCovariance );
+  BOOST_CHECK_EQUAL( cache.Hits(), 2 );
+  BOOST_CHECK_EQUAL( cache.Writes(), 2 );
+  for( Int_t i= 0; i < reco.GetNrows(); i++ ) {
+    BOOST_CHECK_EQUAL( reco[i], recocached[i] );
+    BOOST_CHECK_EQUAL( cov(i,i), covcached(i,i) );
+  }
+
+  // A result without errors is stored once
+  TVectorD meas= unfold->Vmeasured();
+  meas *= 2.0;
+  RooUnfold third( response, unfold->Hmeasured() );
+  third.SetMeasured( meas, unfold->Emeasured() );
+  third.SetCache( &cache );
+  Int_t writes= cache.Writes();
+  delete third.Hreco( RooUnfold::kNoError );
+  BOOST_CHECK_EQUAL( cache.Writes(), writes+1 );
+  gSystem->Exec( Form( "rm -rf %s", dir.Data() ) );
+}
+
+BOOST_AUTO_TEST_CASE(ResponseDecomposition){
+  BOOST_MESSAGE("Response decomposition cache test");
+  TString dir= Form( "%s/roounfoldsvd%d", gSystem->TempDirectory(), gSystem->GetPid() );
+  RooUnfoldCache cache( dir );
+  BOOST_CHECK_EQUAL( response->Checksum(), response->Checksum() );
+
+  RooUnfoldInvert first( response, unfold->Hmeasured() );
+  first.SetCache( &cache );
+  first.Vreco();
+  Int_t hits= cache.Hits();
+
+  // Another measurement with the same response reuses the stored SVD
+  TVectorD meas= unfold->Vmeasured(), err= unfold->Emeasured();
+  meas *= 2.0;
+  RooUnfoldInvert second( response, unfold->Hmeasured() );
+  second.SetMeasured( meas, err );
+  second.SetCache( &cache );
+  TVectorD reco= second.Vreco();
+  BOOST_CHECK_EQUAL( cache.Hits(), hits+1 );
+
+  RooUnfoldInvert uncached( response, unfold->Hmeasured() );
+  uncached.SetMeasured( meas, err );
+  uncached.SetCache( 0 );
+  TVectorD recouncached= uncached.Vreco();
+  for( Int_t i= 0; i < reco.GetNrows(); i++ ) {
+    BOOST_CHECK_CLOSE( reco[i], recouncached[i], 1e-6 );
+  }
+  gSystem->Exec( Form( "rm -rf %s", dir.Data() ) );
+}
+
+BOOST_AUTO_TEST_CASE(ResponseUpdate){
+  BOOST_MESSAGE("Low-rank response update test");
+  RooUnfoldResponse res( *response );
+  RooUnfoldInvert updated( &res, unfold->Hmeasured() );
+  updated.SetCache( 0 );
+  updated.Vreco();
+
+  // More MC in one truth bin only changes one column of the response matrix
+  for( Int_t i= 0; i < 100; i++ ) res.Fill( 0.1*i - 7.5, 0.25 );
+  BOOST_CHECK( updated.UpdateResponse() );
+  BOOST_CHECK_EQUAL( updated.GetNUpdates(), 1 );
+  TVectorD reco= updated.Vreco();
+
+  RooUnfoldInvert fresh( &res, unfold->Hmeasured() );
+  fresh.SetCache( 0 );
+  TVectorD recofresh= fresh.Vreco();
+  for( Int_t i= 0; i < reco.GetNrows(); i++ ) {
+    BOOST_CHECK_CLOSE( reco[i], recofresh[i], 1e-4 );
+  }
+
+  // A new response replaces the updated decomposition
+  updated.SetResponse( response );
+  updated.SetMeasured( unfold->Hmeasured() );
+  TVectorD recoorig= updated.Vreco();
+  BOOST_CHECK_EQUAL( updated.GetNUpdates(), 0 );
+  RooUnfoldInvert orig( response, unfold->Hmeasured() );
+  orig.SetCache( 0 );
+  TVectorD recoorigfresh= orig.Vreco();
+  for( Int_t i= 0; i < recoorig.GetNrows(); i++ ) {
+    BOOST_CHECK_CLOSE( recoorig[i], recoorigfresh[i], 1e-9 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE(ResponseUpdateSpread){
+  BOOST_MESSAGE("Low-rank response update spread over all bins");
+  RooUnfoldResponse res( *response );
+  RooUnfoldInvert updated( &res, unfold->Hmeasured() );
+  updated.SetCache( 0 );
+  updated.Vreco();
+
+  // A rank-2 change to every element of the response matrix
+  TH2* hres= (TH2*) res.Hresponse()->Clone();
+  TH1* hmes= (TH1*) res.Hmeasured()->Clone();
+  TH1* htru= (TH1*) res.Htruth()->Clone();
+  for( Int_t i= 0; i < res.GetNbinsMeasured(); i++ ) {
+    for( Int_t j= 0; j < res.GetNbinsTruth(); j++ ) {
+      Double_t d= 0.002*(1.0 + (i%3))*(1.0 + 0.1*j) + 0.001*(1.0 + (i%5))*(2.0 - 0.05*j);
+      hres->SetBinContent( i+1, j+1, hres->GetBinContent( i+1, j+1 ) + d*htru->GetBinContent( j+1 ) );
+    }
+  }
+  res.Setup( hmes, htru, hres );
+  delete hres;
+  delete hmes;
+  delete htru;
+  BOOST_CHECK( updated.UpdateResponse() );
+  BOOST_CHECK_EQUAL( updated.GetNUpdates(), 1 );
+  TVectorD reco= updated.Vreco();
+  TVectorD err= updated.ErecoV( RooUnfold::kCovariance );
+
+  RooUnfoldInvert fresh( &res, unfold->Hmeasured() );
+  fresh.SetCache( 0 );
+  TVectorD recofresh= fresh.Vreco();
+  TVectorD errfresh= fresh.ErecoV( RooUnfold::kCovariance );
+  for( Int_t i= 0; i < reco.GetNrows(); i++ ) {
+    BOOST_CHECK_CLOSE( reco[i], recofresh[i], 1e-4 );
+    BOOST_CHECK_CLOSE( err[i], errfresh[i], 1e-4 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE(NewMeasurement){
+  BOOST_MESSAGE("Unfolding object reused for a new measurement");
+  RooUnfoldInvert reused( response, unfold->Hmeasured() );
+  reused.SetCache( 0 );
+  reused.Vreco();
+  TVectorD meas= reused.Vmeasured();
+  for( Int_t i= 0; i < meas.GetNrows(); i++ ) meas[i] *= 1.0 + 0.01*(i%7);
+  TVectorD err= meas;
+  err.Sqrt();
+  reused.SetMeasured( meas, err );
+  TVectorD reco= reused.Vreco();
+
+  RooUnfoldInvert fresh( response, 0 );
+  fresh.SetCache( 0 );
+  fresh.SetMeasured( meas, err );
+  TVectorD recofresh= fresh.Vreco();
+  for( Int_t i= 0; i < reco.GetNrows(); i++ ) {
+    BOOST_CHECK_CLOSE( reco[i], recofresh[i], 1e-8 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE(ResultReferences){
+  BOOST_MESSAGE("Result accessors return internal matrices");
+  const TMatrixD& cov= unfold->ErecoRef( RooUnfold::kCovariance );
+  BOOST_CHECK_EQUAL( &cov, &unfold->ErecoRef( RooUnfold::kCovariance ) );
+  const TVectorD& err= unfold->ErecoVRef( RooUnfold::kCovariance );
+  BOOST_CHECK_CLOSE( err[2]*err[2], cov(2,2), 1e-10 );
+  TMatrixD copy= unfold->Ereco( RooUnfold::kCovariance );
+  BOOST_CHECK( copy == cov );
+}
+
+BOOST_AUTO_TEST_CASE(StructuredCovariance){
+  BOOST_MESSAGE("Diagonal and low-rank measurement covariance test");
+  const TVectorD& err= unfold->Emeasured();
+  const RooUnfoldCovariance& diag= unfold->GetMeasuredCovariance();
+  BOOST_CHECK_EQUAL( diag.GetType(), Int_t(RooUnfoldCovariance::kDiagonal) );
+  BOOST_CHECK_CLOSE( diag(3,3), err[3]*err[3], 1e-10 );
+
+  // Low-rank solve (Woodbury identity) agrees with the inverse of the dense matrix
+  Int_t n= err.GetNrows();
+  TVectorD var= err;
+  var.Sqr();
+  TMatrixD f( n, 1 );
+  for (Int_t i= 0; i<n; i++) f(i,0)= 0.02*unfold->Vmeasured()[i];
+  RooUnfoldCovariance lowrank( var, f );
+  TMatrixD dense, inv;
+  RooUnfoldCovariance( lowrank.GetMatrix( dense ) ).Invert( inv );
+  TVectorD delta= unfold->Vmeasured(), solved= delta;
+  lowrank.Solve( solved );
+  delta *= inv;
+  BOOST_CHECK_CLOSE( solved[3], delta[3], 1e-6 );
+
+  RooUnfold correlated( response, unfold->Hmeasured() );
+  correlated.SetMeasuredCov( lowrank );
+  BOOST_CHECK_EQUAL( correlated.GetMeasuredCovariance().GetType(), Int_t(RooUnfoldCovariance::kLowRank) );
+  BOOST_CHECK_CLOSE( correlated.GetMeasuredCov()(2,3), f(2,0)*f(3,0), 1e-10 );
+  BOOST_CHECK_CLOSE( correlated.Emeasured()[3]*correlated.Emeasured()[3], var[3]+f(3,0)*f(3,0), 1e-10 );
+
+  // A dense matrix with an empty bin goes straight to the pseudo-inverse, which ignores that bin
+  TMatrixD withzero( 3, 3 );
+  withzero(0,0)= 1.0;
+  withzero(2,2)= 4.0;
+  withzero(0,2)= withzero(2,0)= 1.0;
+  TVectorD d3( 3 );
+  d3[0]= 1.0; d3[1]= 5.0; d3[2]= 2.0;
+  BOOST_CHECK_CLOSE( RooUnfoldCovariance( withzero ).Chi2( d3 ), 4.0/3.0, 1e-9 );
+}
+
+BOOST_AUTO_TEST_CASE(StructuredCovarianceDense){
+  BOOST_MESSAGE("Structured measurement covariance against its dense equivalent");
+  Int_t n= unfold->Vmeasured().GetNrows();
+  TVectorD var= unfold->Emeasured();
+  var.Sqr();
+  var += 1.0;   // no empty bins, so the dense matrix can be inverted
+  TMatrixD f( n, 2 );
+  for (Int_t i= 0; i<n; i++) {
+    f(i,0)= 0.05*unfold->Vmeasured()[i];
+    f(i,1)= (i%2 ? 0.5 : -0.5)*sqrt( var[i] );
+  }
+  RooUnfoldCovariance diag( var ), lowrank( var, f );
+  TMatrixD diagdense, lowrankdense;
+  diag.GetMatrix( diagdense );
+  lowrank.GetMatrix( lowrankdense );
+  const RooUnfoldCovariance* structured[2]= { &diag, &lowrank };
+  const TMatrixD*            dense[2]=      { &diagdense, &lowrankdense };
+  Int_t i0= 0;
+  for (Int_t i= 1; i<n-1; i++) if (var[i] > var[i0]) i0= i;
+
+  for (Int_t s= 0; s<2; s++) {
+    // ABAT with the structure, in the propagation to the unfolded covariance
+    RooUnfoldInvert inv( response, unfold->Hmeasured() ), invdense( response, unfold->Hmeasured() );
+    inv.SetCache( 0 );
+    invdense.SetCache( 0 );
+    inv.SetMeasuredCov( *structured[s] );
+    invdense.SetMeasuredCov( *dense[s] );
+    BOOST_CHECK_EQUAL( inv.GetMeasuredCovariance().GetType(),      structured[s]->GetType() );
+    BOOST_CHECK_EQUAL( invdense.GetMeasuredCovariance().GetType(), Int_t(RooUnfoldCovariance::kDense) );
+    CheckSameCov( inv.Ereco( RooUnfold::kCovariance ), invdense.Ereco( RooUnfold::kCovariance ), 1e-8 );
+
+    // Chi2measured through RooUnfoldCovariance::Chi2, against the inverse of the dense matrix
+    TVectorD delta;
+    invdense.VrecoMeasured( delta );
+    delta -= invdense.Vmeasured();
+    TMatrixD w( TMatrixD::kInverted, *dense[s] );
+    TVectorD wdelta= delta;
+    wdelta *= w;
+    Double_t chi2= 0.0;
+    for (Int_t i= 0; i<n; i++) chi2 += delta[i]*wdelta[i];
+    BOOST_CHECK_CLOSE( inv.Chi2measured(),      chi2, 1e-6 );
+    BOOST_CHECK_CLOSE( invdense.Chi2measured(), chi2, 1e-6 );
+
+    // Bin-by-bin covariance from the diagonal or low-rank form
+    RooUnfoldBinByBin bbb( response, unfold->Hmeasured() ), bbbdense( response, unfold->Hmeasured() );
+    bbb.SetCache( 0 );
+    bbbdense.SetCache( 0 );
+    bbb.SetMeasuredCov( *structured[s] );
+    bbbdense.SetMeasuredCov( *dense[s] );
+    CheckSameCov( bbb.Ereco( RooUnfold::kCovariance ), bbbdense.Ereco( RooUnfold::kCovariance ), 1e-10 );
+
+    // Toys sample the structured form directly, with the spread of the dense matrix
+    RooUnfoldPhilox rnd( 4321+s );
+    const Int_t ntoys= 2000;
+    const TVectorD& meas= bbb.Vmeasured();
+    Double_t s00= 0.0, s11= 0.0, s01= 0.0;
+    for (Int_t k= 0; k<ntoys; k++) {
+      RooUnfold* toy= bbb.RunToy( &rnd );
+      Double_t d0= toy->Vmeasured()[i0]-meas[i0], d1= toy->Vmeasured()[i0+1]-meas[i0+1];
+      s00 += d0*d0;
+      s11 += d1*d1;
+      s01 += d0*d1;
+      delete toy;
+    }
+    const TMatrixD& v= *dense[s];
+    BOOST_CHECK_CLOSE( s00/ntoys, v(i0,i0),     15.0 );
+    BOOST_CHECK_CLOSE( s11/ntoys, v(i0+1,i0+1), 15.0 );
+    BOOST_CHECK_SMALL( s01/sqrt( s00*s11 ) - v(i0,i0+1)/sqrt( v(i0,i0)*v(i0+1,i0+1) ), 0.1 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE(MeasuredVectors){
+  BOOST_MESSAGE("Measured vectors test");
+  RooUnfold fromvec( response, unfold->Hmeasured() );
+  TVectorD meas= unfold->Vmeasured(), err= unfold->Emeasured();
+  meas *= 2.0;
+  fromvec.SetMeasured( meas, err );
+  BOOST_CHECK_EQUAL( fromvec.Vmeasured()[3], meas[3] );
+  BOOST_CHECK_EQUAL( fromvec.Emeasured()[3], err[3] );
+
+  // The histogram is only made on request, from the vectors
+  const TH1* h= fromvec.Hmeasured();
+  BOOST_CHECK( h != unfold->Hmeasured() );
+  BOOST_CHECK_EQUAL( h->GetBinContent( 4 ), meas[3] );
+  BOOST_CHECK_EQUAL( h->GetBinError( 4 ),   err[3] );
+}
+
+BOOST_AUTO_TEST_CASE(ToyCheckpoint){
+  BOOST_MESSAGE("Toy checkpoint test");
+  TString prefix= Form( "%s/roounfoldcheckpoint%d", gSystem->TempDirectory(), gSystem->GetPid() );
+  RooUnfoldCheckpoint checkpoint( prefix, 3 );
+
+  RooUnfold plain( response, unfold->Hmeasured() );
+  plain.SetNToys( 10 );
+  plain.SetToySeed( 42 );
+  TVectorD err1= plain.ErecoV( RooUnfold::kCovToy );
+
+  // Checkpoints after toys 3, 6, and 9 do not change the result, and are removed at the end
+  RooUnfold saved( response, unfold->Hmeasured() );
+  saved.SetNToys( 10 );
+  saved.SetToySeed( 42 );
+  saved.SetCheckpoint( &checkpoint );
+  TString key= saved.CheckpointKey() + " ntoys=10";
+  TVectorD err2= saved.ErecoV( RooUnfold::kCovToy );
+  BOOST_CHECK_EQUAL( checkpoint.Writes(), 3 );
+  BOOST_CHECK( gSystem->AccessPathName( checkpoint.FileName( "toys", key ) ) );
+  for( Int_t i= 0; i < err1.GetNrows(); i++ ) BOOST_CHECK_CLOSE( err1[i], err2[i], 1e-9 );
+
+  // Resumes from a checkpoint with the state after no toys
+  Int_t nt= err1.GetNrows();
+  checkpoint.Write( "toys", key, 0, 42, TVectorD( nt*(nt+1) ) );
+  RooUnfold resumed( response, unfold->Hmeasured() );
+  resumed.SetNToys( 10 );
+  resumed.SetCheckpoint( &checkpoint );
+  TVectorD err3= resumed.ErecoV( RooUnfold::kCovToy );
+  BOOST_CHECK_EQUAL( checkpoint.Resumes(), 1 );
+  for( Int_t i= 0; i < err1.GetNrows(); i++ ) BOOST_CHECK_CLOSE( err1[i], err3[i], 1e-9 );
+
+  // The key covers the measurement and its errors, even for an algorithm that is not cached (Bayes with a prior)
+  RooUnfoldBayes prior( response, unfold->Hmeasured() );
+  TVectorD flat( nt );
+  flat += 1.0;
+  prior.SetPrior( flat );
+  TString key0= prior.CheckpointKey();
+  TVectorD meas= prior.Vmeasured(), merr= prior.Emeasured();
+  meas[0] += 1.0;
+  prior.SetMeasured( meas, merr );
+  TString key1= prior.CheckpointKey();
+  BOOST_CHECK( key1 != key0 );
+  merr[0] *= 2.0;
+  prior.SetMeasured( meas, merr );
+  BOOST_CHECK( prior.CheckpointKey() != key1 );
+}
+
+// Cancels the loop once n items are done
+class StopAfter : public RooUnfoldProgress {
+public:
+  StopAfter( Int_t n ) : _n( n ) {}
+  virtual Bool_t Update( const char* task, Int_t done, Int_t total ) {
+    if( done >= _n ) Cancel();
+    return RooUnfoldProgress::Update( task, done, total );
+  }
+private:
+  Int_t _n;
+};
+
+BOOST_AUTO_TEST_CASE(ToyProgress){
+  BOOST_MESSAGE("Toy progress test");
+  StopAfter progress( 5 );
+  RooUnfold stopped( response, unfold->Hmeasured() );
+  stopped.SetNToys( 10 );
+  stopped.SetToySeed( 42 );
+  stopped.SetProgress( &progress );
+  TVectorD err= stopped.ErecoV( RooUnfold::kCovToy );
+  BOOST_CHECK( progress.Cancelled() );
+  BOOST_CHECK_EQUAL( progress.Done(), 5 );
+  BOOST_CHECK_EQUAL( stopped.NToysRun(), 5 );
+  BOOST_CHECK( err.Sum() > 0.0 );
+}
+
+BOOST_AUTO_TEST_CASE(TraceFile){
+  BOOST_MESSAGE("Trace file test");
+  TString name= Form( "%s/roounfoldtrace%d.json", gSystem->TempDirectory(), gSystem->GetPid() );
+  BOOST_CHECK( RooUnfoldTrace::Open( name ) );
+  RooUnfold* toy= unfold->RunToy();
+  toy->Vreco();
+  delete toy;
+  RooUnfoldTrace::Close();
+  BOOST_CHECK( !RooUnfoldTrace::IsOpen() );
+
+  std::ifstream in( name.Data() );
+  std::stringstream json;
+  json << in.rdbuf();
+  string trace= json.str();
+  BOOST_CHECK_EQUAL( trace[0], '[' );
+  BOOST_CHECK( trace.find( "\"name\":\"RunToy\"" ) != string::npos );
+  BOOST_CHECK( trace.find( "\"name\":\"unfold\"" ) != string::npos );
+  BOOST_CHECK_EQUAL( trace.rfind( "]" ), trace.size()-2 );
+  gSystem->Unlink( name );
+}
+
+BOOST_AUTO_TEST_CASE(ReproducibleToys){
+  BOOST_MESSAGE("Reproducible toys test");
+  // Philox4x32-10 known-answer test
+  UInt_t ctr[4]= { 0, 0, 0, 0 }, key[2]= { 0, 0 }, out[4];
+  RooUnfoldPhilox::Philox4x32( ctr, key, out );
+  BOOST_CHECK_EQUAL( out[0], 0x6627e8d5U );
+  BOOST_CHECK_EQUAL( out[3], 0x9b00dbd8U );
+
+  // Toy stream does not depend on what was generated before
+  RooUnfoldPhilox rnd( 1234 );
+  rnd.SetStream( 7 );
+  Double_t first= rnd.Gaus();
+  rnd.SetStream( 3 );
+  rnd.Rndm();
+  rnd.SetStream( 7 );
+  BOOST_CHECK_EQUAL( rnd.Gaus(), first );
+
+  // kCovToy errors are the same whatever gRandom has done
+  unfold->SetNToys( 10 );
+  unfold->SetToySeed( 42 );
+  TVectorD err1= unfold->ErecoV( RooUnfold::kCovToy );
+  RooUnfold* copy= unfold->Clone();
+  gRandom->Rndm();
+  TVectorD err2= copy->ErecoV( RooUnfold::kCovToy );
+  for( Int_t i= 0; i < err1.GetNrows(); i++ ) BOOST_CHECK_EQUAL( err1[i], err2[i] );
+  delete copy;
+}
+
 BOOST_AUTO_TEST_CASE(GetStepSizeParm){
   BOOST_MESSAGE("GetStepSizeParm test");
 
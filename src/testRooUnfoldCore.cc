@@ -0,0 +1,100 @@
+// Unit tests for the ROOT-free numerical core, core/RooUnfoldCore.h.
+// Nothing here uses ROOT.
+
+#include "core/RooUnfoldCore.h"
+
+#include <vector>
+
+// BOOST test stuff:
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE RooUnfoldCoreTests
+#include <boost/test/unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+using std::vector;
+
+// Test fixture for all tests: an over-determined 6x4 system with a known solution.
+class RooUnfoldCoreFixture {
+public:
+  RooUnfoldCoreFixture() : m(6), n(4), A(m*n), x(n), y(m) {
+    BOOST_MESSAGE( "Create RooUnfoldCoreFixture" );
+    const double a[]= { 0.9, 0.1, 0.0, 0.0,
+                        0.2, 0.7, 0.1, 0.0,
+                        0.0, 0.2, 0.8, 0.1,
+                        0.0, 0.0, 0.1, 0.9,
+                        0.3, 0.1, 0.0, 0.2,
+                        0.1, 0.0, 0.4, 0.1 };
+    const double xt[]= { 1.0, 2.0, -1.0, 0.5 };
+    A.assign( a, a+m*n );
+    x.assign( xt, xt+n );
+    for (int i= 0; i<m; i++) {
+      y[i]= 0.0;
+      for (int k= 0; k<n; k++) y[i] += A[i*n+k]*x[k];
+    }
+  }
+  virtual ~RooUnfoldCoreFixture() {
+    BOOST_MESSAGE( "Tear down RooUnfoldCoreFixture" );
+  }
+  int m, n;
+  vector<double> A, x, y;
+};
+
+BOOST_FIXTURE_TEST_SUITE( RooUnfoldCoreSuite, RooUnfoldCoreFixture )
+
+BOOST_AUTO_TEST_CASE( SolvesAgree ) {
+  vector<double> xs(n), xk(n), G(n*m);
+  BOOST_REQUIRE( RooUnfoldCore::SVDSolve( m, n, &A[0], &y[0], 0.0, &xs[0] ) );
+  BOOST_REQUIRE( RooUnfoldCore::Tikhonov( m, n, &A[0], (const double*)0, &y[0], 0, (const double*)0, 0.0, &xk[0], &G[0] ) );
+  for (int k= 0; k<n; k++) {
+    BOOST_CHECK_CLOSE( xs[k], x[k], 1e-8 );
+    BOOST_CHECK_CLOSE( xk[k], x[k], 1e-8 );
+    // G is the left inverse of A
+    for (int l= 0; l<n; l++) {
+      double gA= 0.0;
+      for (int j= 0; j<m; j++) gA += G[k*m+j]*A[j*n+l];
+      BOOST_CHECK_SMALL( gA-(k==l ? 1.0 : 0.0), 1e-10 );
+    }
+  }
+  // float instantiation
+  vector<float> Af( A.begin(), A.end() ), yf( y.begin(), y.end() ), xf(n);
+  BOOST_REQUIRE( RooUnfoldCore::SVDSolve( m, n, &Af[0], &yf[0], 0.0f, &xf[0] ) );
+  for (int k= 0; k<n; k++) BOOST_CHECK_CLOSE( double(xf[k]), x[k], 1e-2 );
+}
+
+BOOST_AUTO_TEST_CASE( ABATDiagonal ) {
+  const double b[]= { 1.0, 2.0, 3.0, 4.0 };
+  vector<double> B(n*n, 0.0), c1(m*m), c2(m*m);
+  for (int k= 0; k<n; k++) B[k*n+k]= b[k];
+  RooUnfoldCore::ABAT    ( m, n, &A[0], &B[0], &c1[0] );
+  RooUnfoldCore::ABATDiag( m, n, &A[0], b,     &c2[0] );
+  for (int i= 0; i<m*m; i++) BOOST_CHECK_CLOSE( c1[i], c2[i], 1e-12 );
+}
+
+BOOST_AUTO_TEST_CASE( BayesConverges ) {
+  // With a square, invertible response, many iterations approach the inverse.
+  const double Nji[]= { 8.0, 1.0, 0.0,
+                        1.0, 8.0, 1.0,
+                        0.0, 1.0, 8.0 };
+  const double nCi[]= { 10.0, 10.0, 10.0 }, nEstj[]= { 9.0, 10.0, 9.0 };
+  double nbar[3];
+  double total= RooUnfoldCore::Bayes( 3, 3, Nji, nCi, nEstj, 50, nbar );
+  BOOST_CHECK_CLOSE( total, 30.0, 1e-6 );
+  for (int i= 0; i<3; i++) BOOST_CHECK_CLOSE( nbar[i], 10.0, 1e-4 );
+}
+
+BOOST_AUTO_TEST_CASE( BayesPrior ) {
+  // Only the shape of the prior matters, and it defaults to the MC truth.
+  const double Nji[]= { 4.0, 1.0, 0.0,
+                        1.0, 8.0, 2.0,
+                        0.0, 1.0, 16.0 };
+  const double nCi[]= { 5.0, 10.0, 20.0 }, nEstj[]= { 6.0, 9.0, 14.0 };
+  const double prior[]= { 10.0, 20.0, 40.0 }, flat[]= { 1.0, 1.0, 1.0 };
+  double nbar1[3], nbar2[3], nbar3[3];
+  RooUnfoldCore::Bayes( 3, 3, Nji, nCi, nEstj, 1, nbar1 );
+  RooUnfoldCore::Bayes( 3, 3, Nji, nCi, nEstj, 1, nbar2, prior );
+  RooUnfoldCore::Bayes( 3, 3, Nji, nCi, nEstj, 1, nbar3, flat );
+  for (int i= 0; i<3; i++) BOOST_CHECK_CLOSE( nbar1[i], nbar2[i], 1e-12 );
+  BOOST_CHECK( std::fabs( nbar1[0]-nbar3[0] ) > 1e-3 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -119,6 +119,18 @@ public:
     BOOST_CHECK_CLOSE(expectedBinContent,binContent,0.0001);
   }
 
+  /**
+   * Tests that two histograms have the same bin contents, errors, and number of entries.
+   */
+  static void testSameHistograms(const TH1& expected, const TH1& histogram){
+    BOOST_CHECK_EQUAL(expected.GetNcells(), histogram.GetNcells());
+    BOOST_CHECK_EQUAL(expected.GetEntries(), histogram.GetEntries());
+    for(int bin=0; bin<expected.GetNcells() && bin<histogram.GetNcells(); bin++){
+      BOOST_CHECK_CLOSE(expected.GetBinContent(bin), histogram.GetBinContent(bin), 1e-10);
+      BOOST_CHECK_CLOSE(expected.GetBinError(bin),   histogram.GetBinError(bin),   1e-10);
+    }
+  }
+
 
   RooUnfoldResponse response;
   RooUnfoldResponse responseSameBinsMeasuredTruth;
@@ -353,6 +365,35 @@ BOOST_AUTO_TEST_CASE(testFill1D){
   BOOST_CHECK_CLOSE( 1, resultDefaultWeight, 0.0001 );
 }
 
+BOOST_AUTO_TEST_CASE(testFillNArrays){
+  //filling from arrays gives the same histograms as filling each event
+  const int n = 50;
+  double xMeasured[n], xTruth[n], weight[n];
+  TRandom random(222);
+  for(int i=0; i<n; i++){
+    xTruth[i]    = random.Uniform(-5.,105.);
+    xMeasured[i] = xTruth[i] + random.Gaus(0.,5.);
+    weight[i]    = random.Uniform(0.5,2.);
+  }
+  RooUnfoldResponse fromArrays(10,0.,100.), fromEvents(10,0.,100.);
+  fromArrays.FillN(n/2, xMeasured, xTruth, weight);
+  fromArrays.MissN(n/4, xTruth+n/2, weight+n/2);
+  fromArrays.FakeN(n/4, xMeasured+3*n/4, weight+3*n/4);
+  for(int i=0; i<n/2; i++)       fromEvents.Fill(xMeasured[i], xTruth[i], weight[i]);
+  for(int i=n/2; i<3*n/4; i++)   fromEvents.Miss(xTruth[i], weight[i]);
+  for(int i=3*n/4; i<n; i++)     fromEvents.Fake(xMeasured[i], weight[i]);
+  RooUnfoldResponseFixture::testSameHistograms(*fromEvents.Hmeasured(), *fromArrays.Hmeasured());
+  RooUnfoldResponseFixture::testSameHistograms(*fromEvents.Htruth(),    *fromArrays.Htruth());
+  RooUnfoldResponseFixture::testSameHistograms(*fromEvents.Hfakes(),    *fromArrays.Hfakes());
+  RooUnfoldResponseFixture::testSameHistograms(*fromEvents.Hresponse(), *fromArrays.Hresponse());
+
+  //unit weights
+  RooUnfoldResponse unitArrays(10,0.,100.), unitEvents(10,0.,100.);
+  unitArrays.FillN(n, xMeasured, xTruth);
+  for(int i=0; i<n; i++) unitEvents.Fill(xMeasured[i], xTruth[i]);
+  RooUnfoldResponseFixture::testSameHistograms(*unitEvents.Hresponse(), *unitArrays.Hresponse());
+}
+
 BOOST_AUTO_TEST_CASE(testFill2D){
   //initialising of histograms needed for constructor
   int measuredBinX = 10;
@@ -412,6 +453,34 @@ BOOST_AUTO_TEST_CASE(testFill2D){
 
 }
 
+//2D and 3D fills add to the bins directly: they must give the same histograms as TH1::Fill
+BOOST_AUTO_TEST_CASE(testFillBinMatchesFill){
+  TH2D measuredTemplate("measuredFillBin","measured",5,0.,10.,4,0.,8.);
+  TH2D truthTemplate   ("truthFillBin",   "truth",   5,0.,10.,4,0.,8.);
+  for(int buffered=0; buffered<2; buffered++){
+    RooUnfoldResponse response2D(&measuredTemplate,&truthTemplate);
+    TH2D* expectedMeasured = (TH2D*) measuredTemplate.Clone("expectedMeasured");
+    TH2D* expectedTruth    = (TH2D*) truthTemplate.Clone("expectedTruth");
+    if(buffered){
+      response2D.Hmeasured()->SetBuffer(1000);
+      expectedMeasured->SetBuffer(1000);
+    }
+    //unit weights first, so the sum of weights squared is only needed from the first weight other than 1
+    for(int i=0; i<40; i++){
+      double xm= 0.37*i - 2.0, ym= 0.23*i - 0.5, xt= 0.29*i - 1.0, yt= 0.19*i;
+      double w= i<15 ? 1.0 : 0.5 + 0.1*(i%7);
+      response2D.Fill(xm,ym,xt,yt,w);
+      expectedMeasured->Fill(xm,ym,w);
+      expectedTruth->Fill(xt,yt,w);
+    }
+    BOOST_CHECK(response2D.Htruth()->GetSumw2N() > 0);
+    RooUnfoldResponseFixture::testSameHistograms(*expectedMeasured, *response2D.Hmeasured());
+    RooUnfoldResponseFixture::testSameHistograms(*expectedTruth,    *response2D.Htruth());
+    delete expectedMeasured;
+    delete expectedTruth;
+  }
+}
+
 //Test of UseOverflowStatus
 BOOST_AUTO_TEST_CASE(testUseOverflowStatus){
   //  RooUnfoldResponse testObject;